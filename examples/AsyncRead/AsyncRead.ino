@@ -0,0 +1,79 @@
+/* Copyright (C) 2018  Samuel Trassare (https://github.com/tiogaplanet)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* Example used in following API documentation:
+    readDistanceTravelledAsync()
+    readVolumeAsync()
+    readSoftwareVersionAsync()
+    handle()
+*/
+#include <mip_esp8266.h>
+
+MiP     mip;
+
+unsigned long lastRequestTime = 0;
+unsigned long lastBlinkTime = 0;
+bool          ledOn = false;
+
+void onDistance(int8_t result, const float& cm, void* pContext) {
+  if (result != MIP_ERROR_NONE) {
+    Serial1.println(F("Odometer read failed."));
+    return;
+  }
+  Serial1.print(F("MiP has travelled "));
+    Serial1.print(cm);
+    Serial1.println(F(" cm."));
+}
+
+void setup() {
+  bool connectResult = mip.begin();
+  if (!connectResult) {
+    Serial1.println(F("Failed connecting to MiP!"));
+    return;
+  }
+
+  Serial1.println(F("AsyncRead.ino - Read from MiP without blocking the rest of the sketch."));
+
+  // Issue both requests back to back and then wait for the answers.
+  MiPFuture<MiPSoftwareVersion> software = mip.readSoftwareVersionAsync();
+  MiPFuture<uint8_t>            volume = mip.readVolumeAsync();
+
+  MiPSoftwareVersion softwareVersion = software.get();
+  Serial1.print(F("software version: "));
+  Serial1.print(softwareVersion.year);
+    Serial1.print('-');
+    Serial1.print(softwareVersion.month);
+    Serial1.print('-');
+    Serial1.println(softwareVersion.day);
+  Serial1.print(F("volume: "));
+    Serial1.println(volume.get());
+}
+
+void loop() {
+  // Runs the onDistance() continuation once the odometer response arrives.
+  mip.handle();
+
+  // Ask for the odometer reading once a second.
+  if (millis() - lastRequestTime >= 1000) {
+    mip.readDistanceTravelledAsync().then(onDistance);
+    lastRequestTime = millis();
+  }
+
+  // Keep the chest LED blinking while waiting on the responses.
+  if (millis() - lastBlinkTime >= 250) {
+    ledOn = !ledOn;
+    mip.unverifiedWriteChestLED(0, ledOn ? 255 : 0, 0);
+    lastBlinkTime = millis();
+  }
+}
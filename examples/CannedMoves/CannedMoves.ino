@@ -0,0 +1,70 @@
+/* Copyright (C) 2018  Samuel Trassare (https://github.com/tiogaplanet)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* Example used in following API documentation:
+    sendFrame()
+    sendFrame_P()
+*/
+#include <mip_esp8266.h>
+#include <mip_frames.h>
+
+MiP     mip;
+
+// The frames for this little dance are encoded by the compiler and stored in flash. Changing one of the parameters
+// below to something out of range, such as a speed of 40, fails the build rather than the robot.
+static const auto PROGMEM chestRed    = mipChestLEDFrame<255, 0, 0>();
+static const auto PROGMEM chestBlue   = mipChestLEDFrame<0, 0, 255>();
+static const auto PROGMEM forward     = mipDriveForwardFrame<15, 700>();
+static const auto PROGMEM backward    = mipDriveBackwardFrame<15, 700>();
+static const auto PROGMEM spinLeft    = mipTurnLeftFrame<360, 24>();
+static const auto PROGMEM spinRight   = mipTurnRightFrame<360, 24>();
+static const auto PROGMEM eyesBlink   = mipHeadLEDsFrame<MIP_HEAD_LED_BLINK_FAST, MIP_HEAD_LED_BLINK_FAST,
+                                                         MIP_HEAD_LED_BLINK_FAST, MIP_HEAD_LED_BLINK_FAST>();
+static const auto PROGMEM eyesOn      = mipHeadLEDsFrame<MIP_HEAD_LED_ON, MIP_HEAD_LED_ON,
+                                                         MIP_HEAD_LED_ON, MIP_HEAD_LED_ON>();
+static const auto PROGMEM cheer       = mipPlaySoundFrame<MIP_SOUND_ACTION_BURPING, MIP_VOLUME_4>();
+
+void setup() {
+  bool connectResult = mip.begin();
+  if (!connectResult) {
+    Serial1.println(F("Failed connecting to MiP!"));
+    return;
+  }
+
+  Serial1.println(F("CannedMoves.ino - Dance using request frames built at compile time."));
+
+  mip.sendFrame_P(eyesBlink);
+  mip.sendFrame_P(chestRed);
+  mip.sendFrame_P(forward);
+  delay(1000);
+  mip.sendFrame_P(spinLeft);
+  delay(2000);
+  mip.sendFrame_P(chestBlue);
+  mip.sendFrame_P(backward);
+  delay(1000);
+  mip.sendFrame_P(spinRight);
+  delay(2000);
+  mip.sendFrame_P(cheer);
+  mip.sendFrame_P(eyesOn);
+
+  // Frames can also be built on the fly in RAM.
+  mip.sendFrame(mipStopFrame());
+
+  Serial1.println();
+  Serial1.println(F("Sample done."));
+}
+
+void loop() {
+}
+
@@ -0,0 +1,90 @@
+/* Copyright (C) 2018  Samuel Trassare (https://github.com/tiogaplanet)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* Example used in following API documentation:
+    MiPScheduler
+    MiPTask
+
+   Runs three scripts at once: one animates the eyes, one tantrums whenever MiP sees a gesture and one reports the
+   odometer. Each script is written top to bottom with co_await instead of delay().
+
+   Coroutines must be enabled in the compiler. In the Arduino IDE add the following line to a platform.local.txt file
+   next to the esp8266 platform.txt:
+     compiler.cpp.extra_flags=-fcoroutines
+*/
+#include <mip_esp8266.h>
+#include <mip_coroutine.h>
+
+#if !defined(__cpp_impl_coroutine)
+#error "This sketch must be built with -fcoroutines."
+#endif
+
+MiP          mip;
+MiPScheduler scheduler(mip);
+
+MiPTask blinkEyes() {
+  while (true) {
+    mip.unverifiedWriteHeadLEDs(MIP_HEAD_LED_ON, MIP_HEAD_LED_OFF, MIP_HEAD_LED_OFF, MIP_HEAD_LED_ON);
+    co_await scheduler.sleepFor(300);
+    mip.unverifiedWriteHeadLEDs(MIP_HEAD_LED_OFF, MIP_HEAD_LED_ON, MIP_HEAD_LED_ON, MIP_HEAD_LED_OFF);
+    co_await scheduler.sleepFor(300);
+  }
+}
+
+MiPTask tantrumOnGesture() {
+  while (true) {
+    MiPGesture gesture = co_await scheduler.nextGesture();
+    Serial1.print(F("Gesture: "));
+      Serial1.println(gesture);
+
+    mip.unverifiedWriteChestLED(0xFF, 0x00, 0x00);
+    mip.playSound(MIP_SOUND_MOOD_ANGRY);
+    for (uint8_t i = 0; i < 3; i++) {
+      (i & 1) ? mip.turnLeft(180, 24) : mip.turnRight(180, 24);
+      co_await scheduler.sleepFor(1500);
+    }
+    mip.playSound(MIP_SOUND_ACTION_OUT_OF_BREATH);
+    mip.unverifiedWriteChestLED(0x00, 0xFF, 0x00);
+  }
+}
+
+MiPTask reportDistance() {
+  while (true) {
+    float cm = co_await mip.readDistanceTravelledAsync();
+    Serial1.print(F("MiP has travelled "));
+      Serial1.print(cm);
+      Serial1.println(F(" cm."));
+    co_await scheduler.sleepFor(5000);
+  }
+}
+
+void setup() {
+  bool connectResult = mip.begin();
+  if (!connectResult) {
+    Serial1.println(F("Failed connecting to MiP!"));
+    return;
+  }
+
+  Serial1.println(F("CoroutineScripts.ino - Run several MiP scripts at once without delay()."));
+
+  mip.enableGestureMode();
+
+  scheduler.start(blinkEyes());
+  scheduler.start(tantrumOnGesture());
+  scheduler.start(reportDistance());
+}
+
+void loop() {
+  scheduler.handle();
+}
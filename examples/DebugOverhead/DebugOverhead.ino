@@ -0,0 +1,73 @@
+/* Copyright (C) 2018  Samuel Trassare (https://github.com/tiogaplanet)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* Example used in following API documentation:
+    MIP_DEBUG_MIN_LEVEL
+    isLevelActive()
+    debugf_P()
+*/
+// Remove verbose and profiler messages from the build entirely. Build this sketch again with this set to 0 and
+// compare the flash and RAM usage reported by the IDE to see how much the compiled out messages were costing.
+#define MIP_DEBUG_MIN_LEVEL 2
+
+#include <mip_esp8266.h>
+#include <mip_debug.h>
+
+MiP         mip;
+MiPDebug    debug;
+
+// Number of calls timed by each benchmark.
+const uint32_t iterations = 10000;
+
+void setup() {
+  bool connectResult = mip.begin();
+  if (!connectResult) {
+    Serial1.println(F("Failed connecting to MiP!"));
+    return;
+  }
+
+  Serial1.println(F("DebugOverhead.ino - Measure the cost of debug messages which aren't shown."));
+
+  // No telnet client is connected and serial output isn't enabled so none of these messages are shown.
+  uint32_t start = ESP.getCycleCount();
+  for (uint32_t i = 0 ; i < iterations ; i++) {
+    // How the mDebug*() macros used to expand.
+    if (debug.isActive(MiPDebug::DEBUG)) debug.printf("Loop %u\n", i);
+  }
+  uint32_t callCycles = ESP.getCycleCount() - start;
+
+  start = ESP.getCycleCount();
+  for (uint32_t i = 0 ; i < iterations ; i++) {
+    // Filtered at run time by the inlined level check.
+    mDebugD("Loop %u\n", i);
+  }
+  uint32_t inlineCycles = ESP.getCycleCount() - start;
+
+  start = ESP.getCycleCount();
+  for (uint32_t i = 0 ; i < iterations ; i++) {
+    // Below MIP_DEBUG_MIN_LEVEL so this is compiled out.
+    mDebugV("Loop %u\n", i);
+  }
+  uint32_t compiledOutCycles = ESP.getCycleCount() - start;
+
+  Serial1.print(F("Cycles per hidden message: isActive() call = "));
+    Serial1.print(callCycles / iterations);
+    Serial1.print(F("  inline check = "));
+    Serial1.print(inlineCycles / iterations);
+    Serial1.print(F("  compiled out = "));
+    Serial1.println(compiledOutCycles / iterations);
+}
+
+void loop() {
+}
@@ -0,0 +1,119 @@
+/* Copyright (C) 2018  Samuel Trassare (https://github.com/tiogaplanet)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* Example used in following API documentation:
+    readBatteryMillivolts()
+    readDistanceTravelledTicks()
+    readDistanceTravelledMillimetres()
+    mipFormatFixed()
+*/
+#include <mip_esp8266.h>
+#include <mip_protocol.h>
+#include <mip_format.h>
+
+MiP     mip;
+
+// Number of conversions timed by each benchmark.
+const uint32_t iterations = 10000;
+
+// volatile so that the compiler can't optimize the conversions away.
+volatile uint8_t  batteryLevel = 0x60;
+volatile uint32_t odometerTicks = 123456;
+volatile float    floatResult;
+volatile uint32_t integerResult;
+volatile uint16_t batteryMillivolts = 7123;
+char              text[16];
+
+void setup() {
+  bool connectResult = mip.begin();
+  if (!connectResult) {
+    Serial1.println(F("Failed connecting to MiP!"));
+    return;
+  }
+
+  Serial1.println(F("FixedPointTelemetry.ino - Compare floating point and integer telemetry conversions."));
+
+  uint32_t start = ESP.getCycleCount();
+  for (uint32_t i = 0 ; i < iterations ; i++) {
+    // The battery conversion used by earlier versions of the library.
+    floatResult = (float)(((batteryLevel - 0x4D) / (float)(0x7C - 0x4D)) * (6.4f - 4.0f)) + 4.0f;
+  }
+  uint32_t floatCycles = ESP.getCycleCount() - start;
+
+  start = ESP.getCycleCount();
+  for (uint32_t i = 0 ; i < iterations ; i++) {
+    integerResult = mipDecodeBatteryMillivolts(batteryLevel);
+  }
+  uint32_t integerCycles = ESP.getCycleCount() - start;
+
+  Serial1.print(F("Battery conversion (cycles each): float = "));
+    Serial1.print(floatCycles / iterations);
+    Serial1.print(F("  lookup table = "));
+    Serial1.println(integerCycles / iterations);
+
+  start = ESP.getCycleCount();
+  for (uint32_t i = 0 ; i < iterations ; i++) {
+    // The odometer conversion used by earlier versions of the library.
+    floatResult = (float)((double)odometerTicks / 48.5);
+  }
+  floatCycles = ESP.getCycleCount() - start;
+
+  start = ESP.getCycleCount();
+  for (uint32_t i = 0 ; i < iterations ; i++) {
+    integerResult = mipDecodeOdometerMillimetres(odometerTicks);
+  }
+  integerCycles = ESP.getCycleCount() - start;
+
+  Serial1.print(F("Odometer conversion (cycles each): double = "));
+    Serial1.print(floatCycles / iterations);
+    Serial1.print(F("  integer = "));
+    Serial1.println(integerCycles / iterations);
+
+  start = ESP.getCycleCount();
+  for (uint32_t i = 0 ; i < iterations ; i++) {
+    // Print(float, 3) formats volts this way.
+    dtostrf(batteryMillivolts / 1000.0f, 0, 3, text);
+  }
+  floatCycles = ESP.getCycleCount() - start;
+
+  start = ESP.getCycleCount();
+  for (uint32_t i = 0 ; i < iterations ; i++) {
+    mipFormatFixed(text, sizeof(text), batteryMillivolts, 3);
+  }
+  integerCycles = ESP.getCycleCount() - start;
+
+  Serial1.print(F("Formatting volts (cycles each): dtostrf = "));
+    Serial1.print(floatCycles / iterations);
+    Serial1.print(F("  mipFormatFixed = "));
+    Serial1.println(integerCycles / iterations);
+}
+
+void loop() {
+  // Show millivolts as volts and millimetres as centimetres without any float math.
+  char volts[MIP_FORMAT_NUMBER_SIZE];
+  char centimetres[MIP_FORMAT_NUMBER_SIZE];
+  mipFormatFixed(volts, sizeof(volts), mip.readBatteryMillivolts(), 3);
+  mipFormatFixed(centimetres, sizeof(centimetres), mip.readDistanceTravelledMillimetres(), 1);
+
+  Serial1.print(F("Battery: "));
+    Serial1.print(volts);
+    Serial1.print(F("V  Distance: "));
+    Serial1.print(centimetres);
+    Serial1.print(F("cm ("));
+    Serial1.print(mip.readDistanceTravelledTicks());
+    Serial1.println(F(" ticks)"));
+
+  delay(1000);
+}
+
@@ -0,0 +1,77 @@
+/* Copyright (C) 2018  Samuel Trassare (https://github.com/tiogaplanet)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* Example used in following API documentation:
+    MiPFlashLog::begin()
+    MiPFlashLog::readStats()
+    MiPDebug::setFlashLog()
+*/
+#include <mip_esp8266.h>
+#include <mip_debug.h>
+#include <mip_flash_log.h>
+#include "FS.h"
+
+const char* ssid = "..............";          // Enter the SSID for your wifi network.
+const char* password = "..............";      // Enter your wifi password.
+
+const char* hostname = "MiP-0x01";            // Set any hostname you desire.
+
+MiP         mip;
+MiPDebug    debug;                            // For debugging over telnet.
+MiPFlashLog flashLog;                         // Keeps the debug output in flash across resets.
+
+// Time between status messages, in milliseconds.
+const uint32_t statusInterval = 5000;
+
+uint32_t lastStatusTime;
+
+void setup() {
+  bool connectResult = mip.begin(ssid, password, hostname);
+  if (!connectResult) {
+    Serial1.println(F("Failed connecting to MiP!"));
+    return;
+  }
+
+  Serial1.println(F("FlashLog.ino - Keep telnet debug output in flash so that it can be read after a reset."));
+
+  // The file system must be mounted before the flash log is started.
+  if (!SPIFFS.begin() || !flashLog.begin(SPIFFS)) {
+    Serial1.println(F("Failed starting the flash log."));
+  }
+
+  debug.begin(hostname);
+  debug.setResetCmdEnabled(true);             // The log is flushed to flash before the reset command restarts.
+  debug.registerMiPCommands(mip);
+  debug.setFlashLog(flashLog, MiPDebug::INFO); // Log INFO and above, even with no telnet client connected.
+
+  MiPFlashLogStats stats;
+  flashLog.readStats(stats);
+  Serial1.print(F("Flash log holds "));
+  Serial1.print(stats.storedBytes);
+  Serial1.println(F(" bytes from earlier runs. Type \"flog\" in telnet to see them."));
+
+  lastStatusTime = millis();
+}
+
+void loop() {
+  mip.handle();
+
+  if (millis() - lastStatusTime >= statusInterval) {
+    mDebugI("Battery: %u mV\n", mip.readBatteryMillivolts());
+    mDebugD("This debug message only goes to telnet clients which show it.\n");
+    lastStatusTime = millis();
+  }
+
+  debug.handle();                             // Also writes the flash log out a page at a time.
+}
@@ -0,0 +1,71 @@
+/* Copyright (C) 2018  Samuel Trassare (https://github.com/tiogaplanet)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* Example used in following API documentation:
+    readFlightRecords()
+    dumpFlightRecorder()
+    keepFlightRecorderInRtc()
+    restoreFlightRecorderFromRtc()
+*/
+// Press the reset button on the D1 mini while this sketch is running. After the reset it prints the last requests and
+// responses which went between the D1 mini and MiP before the reset, recovered from RTC memory.
+#include <mip_esp8266.h>
+
+MiP     mip;
+
+uint32_t lastDumpTime = 0;
+
+void setup() {
+  bool connectResult = mip.begin();
+  if (!connectResult) {
+    Serial1.println(F("Failed connecting to MiP!"));
+    return;
+  }
+
+  Serial1.println(F("FlightRecorder.ino - Keep a record of recent traffic to and from MiP."));
+
+  // This must be done before keepFlightRecorderInRtc() starts overwriting the old records.
+  if (mip.restoreFlightRecorderFromRtc()) {
+    Serial1.println(F("Traffic before the last reset:"));
+    mip.dumpFlightRecorder(Serial1);
+    mip.clearFlightRecorder();
+  }
+  mip.keepFlightRecorderInRtc(true);
+}
+
+void loop() {
+  // Generate some traffic.
+  mip.readWeight();
+  mip.readVolume();
+  delay(500);
+
+  if (millis() - lastDumpTime >= 10000) {
+    lastDumpTime = millis();
+
+    // Walk through the records ourselves to look for timeouts.
+    MiPFlightRecord records[MIP_FLIGHT_RECORDER_LENGTH];
+    uint8_t         count = mip.readFlightRecords(records, MIP_FLIGHT_RECORDER_LENGTH);
+    uint8_t         timeouts = 0;
+    for (uint8_t i = 0 ; i < count ; i++) {
+      if (records[i].event == MIP_FLIGHT_TIMEOUT) {
+        timeouts++;
+      }
+    }
+    Serial1.print(F("Timeouts in flight recorder: "));
+      Serial1.println(timeouts);
+
+    mip.dumpFlightRecorder(Serial1);
+  }
+}
+
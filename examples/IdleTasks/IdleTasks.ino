@@ -0,0 +1,103 @@
+/* Copyright (C) 2018  Samuel Trassare (https://github.com/tiogaplanet)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* Example used in following API documentation:
+    addIdleTask()
+    removeIdleTask()
+*/
+// Measures how much UDP traffic the ESP8266 can take in while it is kept busy polling MiP. Flood it from another
+// computer with something like:
+//   cat /dev/urandom | nc -u MiP-0x01.local 4210
+// Every 5 seconds the sketch prints the received throughput and switches between servicing UDP only from loop()
+// and also servicing it from an idle task while the library waits on MiP. Each report splits the bytes by whether
+// loop() or the idle task read them and gives the rate at which snapshots were read. Comparing the runs shows how
+// much of the traffic only gets taken in by the idle task and what, if anything, it costs the MiP polling rate.
+#include <mip_esp8266.h>
+#include <WiFiUdp.h>
+
+const char* ssid = "..............";          // Enter the SSID for your wifi network.
+const char* password = "..............";      // Enter your wifi password.
+
+const char* hostname = "MiP-0x01";            // Set any hostname you desire.
+
+const uint16_t udpPort = 4210;
+
+MiP      mip;
+WiFiUDP  udp;
+uint32_t loopBytesReceived = 0;
+uint32_t idleBytesReceived = 0;
+uint32_t snapshotCount = 0;
+uint32_t lastReportTime = 0;
+bool     idleTaskEnabled = false;
+
+// pContext points at the counter to add the received bytes to.
+void serviceUdp(void* pContext) {
+  uint32_t* pBytesReceived = (uint32_t*)pContext;
+  uint8_t   buffer[256];
+
+  int packetSize = udp.parsePacket();
+  while (packetSize > 0) {
+    *pBytesReceived += udp.read(buffer, sizeof(buffer));
+    packetSize = udp.parsePacket();
+  }
+}
+
+void setup() {
+  bool connectResult = mip.begin(ssid, password, hostname);
+  if (!connectResult) {
+    Serial1.println(F("Failed connecting to MiP!"));
+    return;
+  }
+
+  Serial1.println(F("IdleTasks.ino - Keep the network serviced while waiting on MiP."));
+
+  udp.begin(udpPort);
+  lastReportTime = millis();
+}
+
+void loop() {
+  ArduinoOTA.handle();
+  serviceUdp(&loopBytesReceived);
+
+  // A heavy polling workload which keeps the library waiting on MiP most of the time.
+  MiPSnapshot snapshot;
+  mip.readSnapshot(snapshot);
+  snapshotCount++;
+
+  if (millis() - lastReportTime >= 5000) {
+    uint32_t elapsed = millis() - lastReportTime;
+
+    Serial1.print(idleTaskEnabled ? F("With idle task: ") : F("Without idle task: "));
+      Serial1.print((loopBytesReceived + idleBytesReceived) * 1000 / elapsed);
+      Serial1.print(F(" bytes/second (loop "));
+      Serial1.print(loopBytesReceived);
+      Serial1.print(F(", idle task "));
+      Serial1.print(idleBytesReceived);
+      Serial1.print(F("), "));
+      Serial1.print(snapshotCount * 1000 / elapsed);
+      Serial1.println(F(" snapshots/second"));
+
+    idleTaskEnabled = !idleTaskEnabled;
+    if (idleTaskEnabled) {
+      mip.addIdleTask(serviceUdp, &idleBytesReceived);
+    } else {
+      mip.removeIdleTask(serviceUdp, &idleBytesReceived);
+    }
+    loopBytesReceived = 0;
+    idleBytesReceived = 0;
+    snapshotCount = 0;
+    lastReportTime = millis();
+  }
+}
+
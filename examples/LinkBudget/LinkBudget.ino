@@ -0,0 +1,85 @@
+/* Copyright (C) 2018  Samuel Trassare (https://github.com/tiogaplanet)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* Example used in following API documentation:
+    readLinkUtilization()
+    readLinkStats()
+    isLinkOverBudget()
+    setLinkThrottleThreshold()
+    estimateCommandWireTime()
+*/
+#include <mip_esp8266.h>
+#include <mip_protocol.h>
+
+MiP     mip;
+
+uint32_t lastPrintTime = 0;
+uint8_t  hue = 0;
+
+void setup() {
+  bool connectResult = mip.begin();
+  if (!connectResult) {
+    Serial1.println(F("Failed connecting to MiP!"));
+    return;
+  }
+
+  Serial1.println(F("LinkBudget.ino - Measure how busy the serial link to MiP is."));
+
+  // Older MiPs talk at 115200 baud while newer ones only manage 9600 so the same animation costs 12 times as much.
+  Serial1.print(F("Status request: "));
+    Serial1.print(mip.estimateCommandWireTime(MIP_CMD_GET_STATUS, 115200));
+    Serial1.print(F("us at 115200 baud, "));
+    Serial1.print(mip.estimateCommandWireTime(MIP_CMD_GET_STATUS, 9600));
+    Serial1.println(F("us at 9600 baud"));
+  Serial1.print(F("Chest LED update on this MiP: "));
+    Serial1.print(mip.estimateCommandWireTime(MIP_CMD_SET_CHEST_LED));
+    Serial1.println(F("us"));
+
+  // Start shedding low priority traffic, such as continuousDrive(), once the link is half used.
+  mip.setLinkThrottleThreshold(50);
+}
+
+void loop() {
+  // Spin slowly on the spot.
+  mip.continuousDrive(0, 8);
+  if (mip.lastCallResult() == MIP_ERROR_THROTTLED) {
+    Serial1.println(F("Drive command dropped."));
+  }
+
+  // Only step the chest LED animation along when there is room for it on the link.
+  if (!mip.isLinkOverBudget()) {
+    mip.unverifiedWriteChestLED(hue, 255 - hue, 128);
+    hue++;
+  }
+
+  if (millis() - lastPrintTime >= 1000) {
+    MiPLinkStats stats;
+
+    lastPrintTime = millis();
+    mip.readLinkStats(stats);
+    Serial1.print(F("Link utilization: "));
+      Serial1.print(mip.readLinkUtilization());
+      Serial1.print(F("%  (tx "));
+      Serial1.print(stats.txUtilization);
+      Serial1.print(F("%, rx "));
+      Serial1.print(stats.rxUtilization);
+      Serial1.print(F("%)  Bytes sent: "));
+      Serial1.print(stats.bytesSent);
+      Serial1.print(F("  Bytes received: "));
+      Serial1.print(stats.bytesReceived);
+      Serial1.print(F("  Throttled: "));
+      Serial1.println(stats.throttledRequests);
+  }
+}
+
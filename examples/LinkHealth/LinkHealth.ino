@@ -0,0 +1,68 @@
+/* Copyright (C) 2018  Samuel Trassare (https://github.com/tiogaplanet)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* Example used in following API documentation:
+    setLinkHealthThreshold()
+    isLinkDown()
+*/
+// Try unplugging the D1 mini from MiP's UART, or turning MiP off and on again, while this sketch is running. The
+// library notices that MiP has stopped answering, reconnects once it is back and turns the chest LED purple again.
+#include <mip_esp8266.h>
+
+MiP     mip;
+
+bool    wasLinkDown = false;
+
+void setup() {
+  bool connectResult = mip.begin();
+  if (!connectResult) {
+    // The library will keep trying to connect in the background.
+    Serial1.println(F("Failed connecting to MiP! Will keep trying..."));
+  }
+
+  Serial1.println(F("LinkHealth.ino - Recover from a lost connection to MiP."));
+
+  // Reconnect once 4 of the last 32 requests to MiP have failed.
+  mip.setLinkHealthThreshold(4);
+  mip.unverifiedWriteChestLED(255, 0, 255);
+}
+
+void loop() {
+  // Reconnect attempts are made from handle() as well as before each request.
+  mip.handle();
+
+  // Keep talking to MiP so that problems are noticed.
+  uint8_t volume = mip.readVolume();
+
+  bool isLinkDown = mip.isLinkDown();
+  if (isLinkDown != wasLinkDown) {
+    MiPLinkStats stats;
+
+    mip.readLinkStats(stats);
+    Serial1.print(isLinkDown ? F("Lost MiP.") : F("Reconnected to MiP."));
+      Serial1.print(F("  Timeouts: "));
+      Serial1.print(stats.timeouts);
+      Serial1.print(F("  Bad responses: "));
+      Serial1.print(stats.badResponses);
+      Serial1.print(F("  Reconnects: "));
+      Serial1.println(stats.reconnects);
+    wasLinkDown = isLinkDown;
+  } else if (!isLinkDown) {
+    Serial1.print(F("Volume: "));
+      Serial1.println(volume);
+  }
+
+  delay(1000);
+}
+
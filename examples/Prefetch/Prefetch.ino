@@ -0,0 +1,79 @@
+/* Copyright (C) 2018  Samuel Trassare (https://github.com/tiogaplanet)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* Example used in following API documentation:
+    enablePrefetch()
+    disablePrefetch()
+    prefetchAge()
+    readPrefetchedDistanceTicks()
+    readPrefetchedWeight()
+    readPrefetchedVolume()
+*/
+#include <mip_esp8266.h>
+
+MiP     mip;
+
+uint32_t lastPrintTime = 0;
+
+void setup() {
+  bool connectResult = mip.begin();
+  if (!connectResult) {
+    Serial1.println(F("Failed connecting to MiP!"));
+    return;
+  }
+
+  Serial1.println(F("Prefetch.ino - Poll telemetry in the background so that reading it never blocks."));
+
+  // Odometer every 250ms. Report an error if the value is more than a second old.
+  mip.enablePrefetch(MIP_PREFETCH_DISTANCE, 250, 1000, MIP_STALE_ERROR);
+  // Weight every 500ms. MiP also sends weight updates on its own which keep this value fresh.
+  mip.enablePrefetch(MIP_PREFETCH_WEIGHT, 500);
+  // Volume rarely changes so only poll it every 5 seconds but never use a value older than 10 seconds.
+  mip.enablePrefetch(MIP_PREFETCH_VOLUME, 5000, 10000, MIP_STALE_REFRESH);
+}
+
+void loop() {
+  // Prefetch requests are issued and their responses collected from handle().
+  mip.handle();
+
+  if (millis() - lastPrintTime < 1000) {
+    return;
+  }
+  lastPrintTime = millis();
+
+  uint32_t ticks = mip.readPrefetchedDistanceTicks();
+  if (mip.didLastCallFail()) {
+    mip.printLastCallResult();
+  }
+  Serial1.print(F("Distance: "));
+    Serial1.print(ticks);
+    Serial1.print(F(" ticks ("));
+    Serial1.print(mip.prefetchAge(MIP_PREFETCH_DISTANCE));
+    Serial1.println(F("ms old)"));
+
+  int8_t weight = mip.readPrefetchedWeight();
+  Serial1.print(F("Weight: "));
+    Serial1.print(weight);
+    Serial1.print(F(" ("));
+    Serial1.print(mip.prefetchAge(MIP_PREFETCH_WEIGHT));
+    Serial1.println(F("ms old)"));
+
+  uint8_t volume = mip.readPrefetchedVolume();
+  Serial1.print(F("Volume: "));
+    Serial1.print(volume);
+    Serial1.print(F(" ("));
+    Serial1.print(mip.prefetchAge(MIP_PREFETCH_VOLUME));
+    Serial1.println(F("ms old)"));
+}
+
@@ -0,0 +1,62 @@
+/* Copyright (C) 2018  Samuel Trassare (https://github.com/tiogaplanet)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* Example used in following API documentation:
+    MIP_PROFILE_SCOPE()
+    mipProfileDump()
+    mipProfileReset()
+    mipLoopDump()
+    mipLoopReset()
+*/
+#include <mip_esp8266.h>
+
+MiP         mip;
+
+// Time between reports, in milliseconds.
+const uint32_t reportInterval = 5000;
+
+uint32_t lastReportTime;
+
+void setup() {
+  bool connectResult = mip.begin();
+  if (!connectResult) {
+    Serial1.println(F("Failed connecting to MiP!"));
+    return;
+  }
+
+  Serial1.println(F("ScopeProfiler.ino - Show where the library and the sketch spend their time and any loop stalls."));
+
+  lastReportTime = millis();
+}
+
+void loop() {
+  // The sketch can profile its own code next to the library's scopes.
+  {
+    MIP_PROFILE_SCOPE("sketch.leds");
+
+    mip.writeChestLED(0, millis() & 0xFF, 0);
+    mip.writeHeadLEDs(MIP_HEAD_LED_ON, MIP_HEAD_LED_OFF, MIP_HEAD_LED_ON, MIP_HEAD_LED_OFF);
+  }
+
+  mip.handle();
+
+  if (millis() - lastReportTime >= reportInterval) {
+    // Each report covers the time since the last one.
+    mipProfileDump(Serial1);
+    mipProfileReset();
+    mipLoopDump(Serial1);
+    mipLoopReset();
+    lastReportTime = millis();
+  }
+}
@@ -0,0 +1,72 @@
+/* Copyright (C) 2018  Samuel Trassare (https://github.com/tiogaplanet)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* Example used in following API documentation:
+    readSnapshot()
+*/
+#include <mip_esp8266.h>
+
+MiP     mip;
+
+void setup() {
+  bool connectResult = mip.begin();
+  if (!connectResult) {
+    Serial1.println(F("Failed connecting to MiP!"));
+    return;
+  }
+
+  Serial1.println(F("Snapshot.ino - Read all of MiP's state in one call."));
+}
+
+void loop() {
+  MiPSnapshot snapshot;
+
+  mip.readSnapshot(snapshot);
+  if (mip.didLastCallFail()) {
+    mip.printLastCallResult();
+  }
+
+  Serial1.print(F("Battery: "));
+    Serial1.print(snapshot.status.batteryVoltage());
+    Serial1.println(F("V"));
+  Serial1.print(F("Position: "));
+    Serial1.println(snapshot.status.position);
+  Serial1.print(F("Weight: "));
+    Serial1.println(snapshot.weight);
+  Serial1.print(F("Distance: "));
+    Serial1.print(snapshot.distance());
+    Serial1.println(F(" cm"));
+  Serial1.print(F("Volume: "));
+    Serial1.println(snapshot.volume);
+  Serial1.print(F("Chest LED: "));
+    Serial1.print(snapshot.chestLED.red);
+    Serial1.print(',');
+    Serial1.print(snapshot.chestLED.green);
+    Serial1.print(',');
+    Serial1.println(snapshot.chestLED.blue);
+  Serial1.print(F("Clap events: "));
+    Serial1.println(snapshot.clapSettings.enabled == MIP_CLAP_ENABLED ? F("enabled") : F("disabled"));
+  Serial1.print(F("Game mode: "));
+    Serial1.println(snapshot.gameMode);
+  Serial1.print(F("Gesture/radar mode: "));
+    Serial1.println(snapshot.gestureRadarMode);
+  Serial1.print(F("IR remote control: "));
+    Serial1.println(snapshot.irRemoteControlEnabled ? F("enabled") : F("disabled"));
+  Serial1.print(F("Snapshot took "));
+    Serial1.print(snapshot.readTime);
+    Serial1.println(F(" ms"));
+  Serial1.println();
+
+  delay(5000);
+}
@@ -30,6 +30,17 @@ const int period = 30000;                     // Give the user time to open a te
 
 bool runOnce = true;
 
+// Handler for the "chest" telnet command added in setup().
+void chestCommand(MiPDebugArgs& args, void* pContext) {
+  if (args.count() != 3) {
+    args.output.println("* Usage: chest red green blue");
+    return;
+  }
+
+  mip.writeChestLED(args.toInt(0), args.toInt(1), args.toInt(2));
+  args.output.println(mip.didLastCallFail() ? "* Chest LED failed" : "* Chest LED set");
+}
+
 void setup() {
   connectResult = mip.begin(ssid, password, hostname);
 
@@ -41,6 +52,8 @@ void setup() {
   debug.begin(hostname);
 
   debug.setResetCmdEnabled(true);             // Enable the reset command.
+  debug.registerMiPCommands(mip);             // Add the stats, snapshot, queues and sound commands.
+  debug.registerCommand(PSTR("chest"), PSTR("red green blue -> set the chest LED color"), chestCommand);
 
   Serial1.println(F("TelnetDebug.ino - Explore the different telnet debug levels."));
   Serial1.println();
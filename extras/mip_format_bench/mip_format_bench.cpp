@@ -0,0 +1,217 @@
+/* Copyright (C) 2018  Samuel Trassare (https://github.com/tiogaplanet)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* Host side benchmark for the integer number formatting in src/mip_format.h. It first checks that every function
+   gives the same text as snprintf() over a spread of values, then times each of them against snprintf() and
+   against the pow() and String based padding which MiPDebug::formatNumber() used to do.
+
+   Build and run it on the PC with any C++11 compiler:
+       g++ -O2 -I../../src -o mip_format_bench mip_format_bench.cpp ../../src/mip_format.cpp
+       ./mip_format_bench
+
+   The PC has a floating point unit, so the gap is far wider on the ESP8266 where float math is done in software.
+   The FixedPointTelemetry example times the same comparison on the robot.
+*/
+#include <chrono>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "mip_format.h"
+
+
+// Number of calls timed for each function.
+static const uint32_t ITERATIONS = 2000000;
+
+// Written by every timed call so that the compiler can't optimize them away.
+static volatile size_t g_sink;
+
+static std::vector<int32_t> g_values;
+
+
+
+// The padding done by the old MiPDebug::formatNumber(), with std::string standing in for Arduino's String.
+static std::string powFormatNumber(uint32_t value, uint8_t size, char insert)
+{
+    std::string ret = "";
+
+    for (uint8_t i = 1; i <= size; i++) {
+        uint32_t max = pow(10, i);
+        if (value < max)
+        {
+            for (uint8_t j = (size - i); j > 0; j--) {
+                ret += insert;
+            }
+            break;
+        }
+    }
+    ret += std::to_string(value);
+
+    return ret;
+}
+
+static bool check(const char* pName, int32_t value, const char* pExpected, const char* pActual, size_t length)
+{
+    if (strcmp(pExpected, pActual) == 0 && length == strlen(pExpected))
+    {
+        return true;
+    }
+    printf("FAILED %s(%" PRId32 "): expected \"%s\", got \"%s\" (length %zu)\n", pName, value, pExpected, pActual,
+           length);
+    return false;
+}
+
+static bool checkAll()
+{
+    bool isPassing = true;
+
+    for (int32_t value : g_values)
+    {
+        char   expected[64];
+        char   actual[64];
+        size_t length;
+
+        snprintf(expected, sizeof(expected), "%" PRIu32, (uint32_t)value);
+        length = mipFormatUnsigned(actual, sizeof(actual), value);
+        isPassing &= check("mipFormatUnsigned", value, expected, actual, length);
+
+        snprintf(expected, sizeof(expected), "%04" PRIu32, (uint32_t)value);
+        length = mipFormatUnsigned(actual, sizeof(actual), value, 4, '0');
+        isPassing &= check("mipFormatUnsigned 4 '0'", value, expected, actual, length);
+
+        snprintf(expected, sizeof(expected), "%10" PRId32, value);
+        length = mipFormatSigned(actual, sizeof(actual), value, 10);
+        isPassing &= check("mipFormatSigned 10", value, expected, actual, length);
+
+        snprintf(expected, sizeof(expected), "%06" PRId32, value);
+        length = mipFormatSigned(actual, sizeof(actual), value, 6, '0');
+        isPassing &= check("mipFormatSigned 6 '0'", value, expected, actual, length);
+
+        snprintf(expected, sizeof(expected), "%02" PRIX32, (uint32_t)value);
+        length = mipFormatHex(actual, sizeof(actual), value, 2);
+        isPassing &= check("mipFormatHex 2", value, expected, actual, length);
+
+        snprintf(expected, sizeof(expected), "%" PRIx32, (uint32_t)value);
+        length = mipFormatHex(actual, sizeof(actual), value, 0, false);
+        isPassing &= check("mipFormatHex lower", value, expected, actual, length);
+
+        for (uint8_t decimals = 1 ; decimals <= MIP_FORMAT_MAX_DECIMALS ; decimals++)
+        {
+            // Worked out with integers since a double can't hold every value / 10^decimals exactly.
+            int64_t  scale = 1;
+            for (uint8_t i = 0 ; i < decimals ; i++)
+            {
+                scale *= 10;
+            }
+            uint64_t magnitude = value < 0 ? -(int64_t)value : value;
+            snprintf(expected, sizeof(expected), "%s%" PRIu64 ".%0*" PRIu64, value < 0 ? "-" : "", magnitude / scale,
+                     decimals, magnitude % scale);
+            length = mipFormatFixed(actual, sizeof(actual), value, decimals);
+            isPassing &= check("mipFormatFixed", value, expected, actual, length);
+        }
+    }
+
+    // Numbers which don't fit leave the buffer empty.
+    char   small[4];
+    size_t length = mipFormatUnsigned(small, sizeof(small), 1234);
+    isPassing &= check("mipFormatUnsigned small buffer", 1234, "", small, length);
+    length = mipFormatSigned(small, sizeof(small), -12, 4);
+    isPassing &= check("mipFormatSigned small buffer", -12, "", small, length);
+    length = mipFormatSigned(small, sizeof(small), -12);
+    isPassing &= check("mipFormatSigned exact fit", -12, "-12", small, length);
+
+    return isPassing;
+}
+
+template<typename FUNCTION>
+static double timeCalls(FUNCTION function)
+{
+    auto     start = std::chrono::steady_clock::now();
+    uint32_t index = 0;
+
+    for (uint32_t i = 0 ; i < ITERATIONS ; i++)
+    {
+        g_sink = function(g_values[index]);
+        index = index + 1 < g_values.size() ? index + 1 : 0;
+    }
+
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / ITERATIONS;
+}
+
+static void report(const char* pTest, const char* pName, double nanoseconds, double baseline)
+{
+    printf("%-22s %-34s %8.1f ns %8.2fx\n", pTest, pName, nanoseconds, baseline / nanoseconds);
+}
+
+
+
+int main()
+{
+    // Edge cases, then values spread over the whole 32-bit range, then the small values which are logged most.
+    const int32_t edges[] = { 0, 1, -1, 9, 10, 99, 100, 999, 1000, 9999, 10000, 65535, 7123, -7123, 2147483647,
+                              -2147483647 - 1 };
+    g_values.assign(edges, edges + sizeof(edges) / sizeof(edges[0]));
+    uint32_t random = 12345;
+    for (int i = 0 ; i < 1000 ; i++)
+    {
+        random = random * 1103515245 + 12345;
+        g_values.push_back(random);
+        g_values.push_back(random % 100000);
+    }
+
+    if (!checkAll())
+    {
+        return 1;
+    }
+    printf("All formatting checks passed\n\n");
+
+    char   buffer[64];
+    double baseline;
+
+    baseline = timeCalls([](int32_t value) { return powFormatNumber(value, 4, '0').length(); });
+    report("zero padded decimal", "formatNumber() with pow()", baseline, baseline);
+    report("", "snprintf(\"%04u\")", timeCalls([&](int32_t value)
+    {
+        return (size_t)snprintf(buffer, sizeof(buffer), "%04" PRIu32, (uint32_t)value);
+    }), baseline);
+    report("", "mipFormatUnsigned(4, '0')", timeCalls([&](int32_t value)
+    {
+        return mipFormatUnsigned(buffer, sizeof(buffer), value, 4, '0');
+    }), baseline);
+
+    baseline = timeCalls([&](int32_t value)
+    {
+        return (size_t)snprintf(buffer, sizeof(buffer), "%.3f", (int16_t)value / 1000.0f);
+    });
+    report("millivolts as volts", "snprintf(\"%.3f\")", baseline, baseline);
+    report("", "mipFormatFixed(3)", timeCalls([&](int32_t value)
+    {
+        return mipFormatFixed(buffer, sizeof(buffer), (int16_t)value, 3);
+    }), baseline);
+
+    baseline = timeCalls([&](int32_t value)
+    {
+        return (size_t)snprintf(buffer, sizeof(buffer), "%02X", (uint8_t)value);
+    });
+    report("byte as hex", "snprintf(\"%02X\")", baseline, baseline);
+    report("", "mipFormatHex(2)", timeCalls([&](int32_t value)
+    {
+        return mipFormatHex(buffer, sizeof(buffer), (uint8_t)value, 2);
+    }), baseline);
+
+    return 0;
+}
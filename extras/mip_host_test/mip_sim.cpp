@@ -0,0 +1,370 @@
+/* Copyright (C) 2018  Samuel Trassare (https://github.com/tiogaplanet)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* Host side stand-in for the ESP8266 and MiP used by the host tests.
+*/
+#include "mip_sim.h"
+#include <ArduinoOTA.h>
+#include <ESP8266WiFi.h>
+#include <ESP8266mDNS.h>
+#include <deque>
+#include <map>
+
+
+HardwareSerial   Serial;
+HardwareSerial   Serial1;
+EspClass         ESP;
+ESP8266WiFiClass WiFi;
+MDNSResponder    MDNS;
+ArduinoOTAClass  ArduinoOTA;
+
+// The simulator's state is created on first use so that it is ready for global objects constructed before it.
+class MiPSimState
+{
+public:
+    MiPSimState()
+    {
+        micros = 0;
+        isScripted = false;
+        memset(rtcMemory, 0, sizeof(rtcMemory));
+    }
+
+    uint64_t                       micros;
+    std::deque<uint8_t>            received;        // Hex text sent by MiP, waiting to be read from Serial.
+    MiPSimBytes                    requestBytes;    // Bytes of the request being written to Serial.
+    std::deque<MiPSimBytes>        requests;
+    std::map<uint8_t, MiPSimBytes> answers;
+    bool                           isScripted;
+    std::string                    log;
+    uint32_t                       rtcMemory[128];
+};
+
+static MiPSimState& sim()
+{
+    static MiPSimState* pState = new MiPSimState;
+
+    return *pState;
+}
+
+
+
+// The library writes a request a byte at a time and then goes on to do something else, such as read the clock, so
+// the request is complete as soon as anything other than Serial.write() is called.
+static void endRequest()
+{
+    if (sim().requestBytes.empty())
+    {
+        return;
+    }
+
+    MiPSimBytes request;
+    request.swap(sim().requestBytes);
+    if (sim().isScripted)
+    {
+        sim().requests.push_back(request);
+        return;
+    }
+
+    std::map<uint8_t, MiPSimBytes>::const_iterator answer = sim().answers.find(request[0]);
+    if (answer != sim().answers.end())
+    {
+        mipSimRespond(answer->second);
+    }
+}
+
+static void resetAnswers()
+{
+    sim().answers.clear();
+    // Battery level and position, so that begin() connects.
+    sim().answers[0x79] = MiPSimBytes { 0x79, 0x60, 0x02 };
+}
+
+
+
+void mipSimReset()
+{
+    sim().received.clear();
+    sim().requestBytes.clear();
+    sim().requests.clear();
+    sim().isScripted = false;
+    sim().log.clear();
+    resetAnswers();
+}
+
+void mipSimSetAnswer(uint8_t command, const MiPSimBytes& response)
+{
+    sim().answers[command] = response;
+}
+
+void mipSimSetScripted(bool isScripted)
+{
+    endRequest();
+    sim().isScripted = isScripted;
+}
+
+size_t mipSimRequestCount()
+{
+    endRequest();
+    return sim().requests.size();
+}
+
+MiPSimBytes mipSimTakeRequest()
+{
+    endRequest();
+    if (sim().requests.empty())
+    {
+        return MiPSimBytes();
+    }
+
+    MiPSimBytes request = sim().requests.front();
+    sim().requests.pop_front();
+    return request;
+}
+
+void mipSimRespond(const MiPSimBytes& response)
+{
+    static const char hexDigits[] = "0123456789ABCDEF";
+
+    for (uint8_t value : response)
+    {
+        sim().received.push_back(hexDigits[value >> 4]);
+        sim().received.push_back(hexDigits[value & 0xF]);
+    }
+}
+
+void mipSimAdvance(uint32_t milliseconds)
+{
+    sim().micros += milliseconds * 1000ULL;
+}
+
+const std::string& mipSimLog()
+{
+    return sim().log;
+}
+
+
+
+// Every look at the clock moves it on a little so that the library's busy waits always finish.
+unsigned long micros()
+{
+    endRequest();
+    return (unsigned long)++sim().micros;
+}
+
+unsigned long millis()
+{
+    endRequest();
+    return (unsigned long)(++sim().micros / 1000);
+}
+
+void delay(unsigned long milliseconds)
+{
+    endRequest();
+    sim().micros += milliseconds * 1000ULL;
+}
+
+void delayMicroseconds(unsigned int microseconds)
+{
+    endRequest();
+    sim().micros += microseconds;
+}
+
+void yield()
+{
+    endRequest();
+    sim().micros += 10;
+}
+
+
+
+void HardwareSerial::begin(unsigned long baudRate)
+{
+    if (this == &Serial)
+    {
+        sim().received.clear();
+        sim().requestBytes.clear();
+    }
+}
+
+int HardwareSerial::available()
+{
+    endRequest();
+    return this == &Serial ? sim().received.size() : 0;
+}
+
+int HardwareSerial::read()
+{
+    endRequest();
+    if (this != &Serial || sim().received.empty())
+    {
+        return -1;
+    }
+
+    uint8_t value = sim().received.front();
+    sim().received.pop_front();
+    return value;
+}
+
+int HardwareSerial::peek()
+{
+    endRequest();
+    return this != &Serial || sim().received.empty() ? -1 : sim().received.front();
+}
+
+size_t HardwareSerial::readBytes(uint8_t* pBuffer, size_t length)
+{
+    size_t count = 0;
+
+    while (count < length && available() > 0)
+    {
+        pBuffer[count++] = read();
+    }
+    return count;
+}
+
+size_t HardwareSerial::write(uint8_t value)
+{
+    if (this == &Serial)
+    {
+        sim().requestBytes.push_back(value);
+    }
+    else
+    {
+        sim().log += (char)value;
+    }
+    return 1;
+}
+
+int HardwareSerial::availableForWrite()
+{
+    return 128;
+}
+
+
+
+size_t Print::write(const uint8_t* pBuffer, size_t length)
+{
+    for (size_t i = 0 ; i < length ; i++)
+    {
+        write(pBuffer[i]);
+    }
+    return length;
+}
+
+size_t Print::printf(const char* pFormat, ...)
+{
+    char    buffer[256];
+    va_list args;
+
+    va_start(args, pFormat);
+    int length = vsnprintf(buffer, sizeof(buffer), pFormat, args);
+    va_end(args);
+
+    return write((const uint8_t*)buffer, length < (int)sizeof(buffer) ? length : sizeof(buffer) - 1);
+}
+
+size_t Print::printf_P(const char* pFormat, ...)
+{
+    char    buffer[256];
+    va_list args;
+
+    va_start(args, pFormat);
+    int length = vsnprintf(buffer, sizeof(buffer), pFormat, args);
+    va_end(args);
+
+    return write((const uint8_t*)buffer, length < (int)sizeof(buffer) ? length : sizeof(buffer) - 1);
+}
+
+size_t Print::print(const __FlashStringHelper* pText)
+{
+    return print((const char*)pText);
+}
+
+size_t Print::print(const String& text)
+{
+    return write((const uint8_t*)text.c_str(), text.length());
+}
+
+size_t Print::print(const char* pText)
+{
+    return write((const uint8_t*)pText, strlen(pText));
+}
+
+size_t Print::print(char value)
+{
+    return write((uint8_t)value);
+}
+
+size_t Print::print(int value, int base)
+{
+    return printf("%d", value);
+}
+
+size_t Print::print(unsigned int value, int base)
+{
+    return printf("%u", value);
+}
+
+size_t Print::print(long value, int base)
+{
+    return printf("%ld", value);
+}
+
+size_t Print::print(unsigned long value, int base)
+{
+    return printf("%lu", value);
+}
+
+size_t Print::print(double value, int digits)
+{
+    return printf("%.*f", digits, value);
+}
+
+size_t Print::println()
+{
+    return print("\r\n");
+}
+
+
+
+void EspClass::deepSleep(uint64_t microseconds)
+{
+    sim().log += "[deep sleep]\r\n";
+}
+
+uint32_t EspClass::getCycleCount()
+{
+    return (uint32_t)(sim().micros * getCpuFreqMHz());
+}
+
+// The 512 bytes of RTC user memory, addressed in 4 byte blocks.
+bool EspClass::rtcUserMemoryRead(uint32_t offset, uint32_t* pData, size_t size)
+{
+    if (offset * 4 + size > sizeof(sim().rtcMemory))
+    {
+        return false;
+    }
+    memcpy(pData, &sim().rtcMemory[offset], size);
+    return true;
+}
+
+bool EspClass::rtcUserMemoryWrite(uint32_t offset, uint32_t* pData, size_t size)
+{
+    if (offset * 4 + size > sizeof(sim().rtcMemory))
+    {
+        return false;
+    }
+    memcpy(&sim().rtcMemory[offset], pData, size);
+    return true;
+}
@@ -0,0 +1,56 @@
+/* Copyright (C) 2018  Samuel Trassare (https://github.com/tiogaplanet)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* Host side stand-in for the ESP8266 and the MiP on the other end of its UART, used by the host tests.
+
+   Time only moves when the library calls delay(), yield() or reads the clock, so tests run instantly and always the
+   same way. The simulated MiP sees each request the library writes to Serial as a whole. By default it answers the
+   requests it has a canned answer for straight away, which is enough for begin() to connect. Once scripted mode is
+   turned on it answers nothing by itself: the test takes each request off the queue and decides when, and with
+   what, MiP responds.
+*/
+#ifndef MIP_SIM_H
+#define MIP_SIM_H
+
+#include <Arduino.h>
+#include <string>
+#include <vector>
+
+typedef std::vector<uint8_t> MiPSimBytes;
+
+// Forget all requests, queued responses and canned answers, leave scripted mode and clear the captured log. Call it
+// at the start of each test, before MiP::begin().
+void        mipSimReset();
+
+// Canned answer which MiP sends whenever it receives the command, when not in scripted mode.
+void        mipSimSetAnswer(uint8_t command, const MiPSimBytes& response);
+
+// In scripted mode every request is queued for the test instead of being answered.
+void        mipSimSetScripted(bool isScripted);
+
+// Number of queued requests and the oldest of them, which is removed from the queue. Returns an empty request if
+// none are queued.
+size_t      mipSimRequestCount();
+MiPSimBytes mipSimTakeRequest();
+
+// Send a response from MiP. It is encoded as hex text, two characters per byte, as MiP does.
+void        mipSimRespond(const MiPSimBytes& response);
+
+// Let time pass without the library running.
+void        mipSimAdvance(uint32_t milliseconds);
+
+// Everything the library has written to Serial1 since the last reset.
+const std::string& mipSimLog();
+
+#endif // MIP_SIM_H
@@ -0,0 +1,113 @@
+/* Copyright (C) 2018  Samuel Trassare (https://github.com/tiogaplanet)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* Just enough of the ESP8266 Arduino core for the library to build on the PC. The functions are implemented by
+   mip_sim.cpp. Flash is ordinary memory here so the PROGMEM helpers map onto the standard C functions.
+*/
+#ifndef ARDUINO_H
+#define ARDUINO_H
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef uint8_t  byte;
+typedef uint8_t  uint8;
+typedef uint32_t uint32;
+
+#define PROGMEM
+#define ICACHE_RAM_ATTR
+#define IRAM_ATTR
+#define PGM_P          const char*
+#define PSTR(s)        (s)
+
+class __FlashStringHelper;
+#define F(s)           (reinterpret_cast<const __FlashStringHelper*>(PSTR(s)))
+#define FPSTR(p)       (reinterpret_cast<const __FlashStringHelper*>(p))
+
+#define pgm_read_byte(p)  (*(const uint8_t*)(p))
+#define pgm_read_word(p)  (*(const uint16_t*)(p))
+#define pgm_read_dword(p) (*(const uint32_t*)(p))
+#define memcpy_P          memcpy
+#define strlen_P          strlen
+#define strcmp_P          strcmp
+#define strncmp_P         strncmp
+#define strncpy_P         strncpy
+#define snprintf_P        snprintf
+#define vsnprintf_P       vsnprintf
+
+inline size_t strlcpy_P(char* pDest, const char* pSrc, size_t size)
+{
+    size_t length = strlen(pSrc);
+
+    if (size > 0)
+    {
+        size_t count = length < size - 1 ? length : size - 1;
+        memcpy(pDest, pSrc, count);
+        pDest[count] = '\0';
+    }
+    return length;
+}
+
+unsigned long millis();
+unsigned long micros();
+void          delay(unsigned long milliseconds);
+void          delayMicroseconds(unsigned int microseconds);
+void          yield();
+
+#include "WString.h"
+#include "Print.h"
+#include "Stream.h"
+
+class HardwareSerial : public Stream
+{
+public:
+    void   begin(unsigned long baudRate);
+    void   end() {}
+    void   swap() {}
+    int    available();
+    int    read();
+    int    peek();
+    size_t readBytes(uint8_t* pBuffer, size_t length);
+    size_t readBytes(char* pBuffer, size_t length)
+    {
+        return readBytes((uint8_t*)pBuffer, length);
+    }
+    size_t write(uint8_t value);
+    int    availableForWrite();
+    using Print::write;
+};
+
+extern HardwareSerial Serial;
+extern HardwareSerial Serial1;
+
+class EspClass
+{
+public:
+    void     deepSleep(uint64_t microseconds);
+    uint32_t getCycleCount();
+    uint32_t getCpuFreqMHz()
+    {
+        return 80;
+    }
+    bool     rtcUserMemoryRead(uint32_t offset, uint32_t* pData, size_t size);
+    bool     rtcUserMemoryWrite(uint32_t offset, uint32_t* pData, size_t size);
+};
+
+extern EspClass ESP;
+
+#endif // ARDUINO_H
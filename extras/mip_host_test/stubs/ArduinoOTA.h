@@ -0,0 +1,54 @@
+/* Copyright (C) 2018  Samuel Trassare (https://github.com/tiogaplanet)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#ifndef ARDUINOOTA_H
+#define ARDUINOOTA_H
+
+#include <functional>
+
+typedef int ota_error_t;
+
+enum
+{
+    OTA_AUTH_ERROR,
+    OTA_BEGIN_ERROR,
+    OTA_CONNECT_ERROR,
+    OTA_RECEIVE_ERROR,
+    OTA_END_ERROR
+};
+
+enum
+{
+    U_FLASH,
+    U_SPIFFS
+};
+
+class ArduinoOTAClass
+{
+public:
+    void onStart(std::function<void()> handler) {}
+    void onEnd(std::function<void()> handler) {}
+    void onProgress(std::function<void(unsigned int, unsigned int)> handler) {}
+    void onError(std::function<void(ota_error_t)> handler) {}
+    void begin() {}
+    void handle() {}
+    int  getCommand()
+    {
+        return U_FLASH;
+    }
+};
+
+extern ArduinoOTAClass ArduinoOTA;
+
+#endif // ARDUINOOTA_H
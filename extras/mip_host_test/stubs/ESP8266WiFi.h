@@ -0,0 +1,52 @@
+/* Copyright (C) 2018  Samuel Trassare (https://github.com/tiogaplanet)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* The WiFi calls made by MiP::begin(ssid, password, hostname). The host tests never bring up WiFi so they do
+   nothing.
+*/
+#ifndef ESP8266WIFI_H
+#define ESP8266WIFI_H
+
+#include "Arduino.h"
+
+#define WL_CONNECTED 3
+
+class IPAddress
+{
+public:
+    uint8_t operator[](int index) const
+    {
+        return 0;
+    }
+};
+
+class ESP8266WiFiClass
+{
+public:
+    void      hostname(const char* pHostname) {}
+    void      begin(const char* pSsid, const char* pPassword) {}
+    int       waitForConnectResult()
+    {
+        return WL_CONNECTED;
+    }
+    void      reconnect() {}
+    IPAddress localIP()
+    {
+        return IPAddress();
+    }
+};
+
+extern ESP8266WiFiClass WiFi;
+
+#endif // ESP8266WIFI_H
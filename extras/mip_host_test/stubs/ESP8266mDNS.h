@@ -0,0 +1,29 @@
+/* Copyright (C) 2018  Samuel Trassare (https://github.com/tiogaplanet)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#ifndef ESP8266MDNS_H
+#define ESP8266MDNS_H
+
+class MDNSResponder
+{
+public:
+    bool begin(const char* pHostname)
+    {
+        return true;
+    }
+};
+
+extern MDNSResponder MDNS;
+
+#endif // ESP8266MDNS_H
@@ -0,0 +1,65 @@
+/* Copyright (C) 2018  Samuel Trassare (https://github.com/tiogaplanet)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* Arduino's Print class, with numbers always printed in decimal.
+*/
+#ifndef PRINT_H
+#define PRINT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "WString.h"
+
+class __FlashStringHelper;
+
+class Print
+{
+public:
+    virtual ~Print() {}
+
+    virtual size_t write(uint8_t value) = 0;
+    virtual size_t write(const uint8_t* pBuffer, size_t length);
+    size_t write(const char* pBuffer, size_t length)
+    {
+        return write((const uint8_t*)pBuffer, length);
+    }
+    virtual int    availableForWrite()
+    {
+        return 0;
+    }
+    virtual void   flush() {}
+
+    size_t printf(const char* pFormat, ...) __attribute__((format(printf, 2, 3)));
+    size_t printf_P(const char* pFormat, ...) __attribute__((format(printf, 2, 3)));
+
+    size_t print(const __FlashStringHelper* pText);
+    size_t print(const String& text);
+    size_t print(const char* pText);
+    size_t print(char value);
+    size_t print(int value, int base = 10);
+    size_t print(unsigned int value, int base = 10);
+    size_t print(long value, int base = 10);
+    size_t print(unsigned long value, int base = 10);
+    size_t print(double value, int digits = 2);
+
+    size_t println();
+    template<class T>
+    size_t println(T value)
+    {
+        size_t length = print(value);
+        return length + println();
+    }
+};
+
+#endif // PRINT_H
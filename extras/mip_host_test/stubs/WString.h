@@ -0,0 +1,41 @@
+/* Copyright (C) 2018  Samuel Trassare (https://github.com/tiogaplanet)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* The few parts of Arduino's String class which the library uses.
+*/
+#ifndef WSTRING_H
+#define WSTRING_H
+
+#include <string>
+
+class String
+{
+public:
+    String() {}
+    String(const char* pText) : m_text(pText ? pText : "") {}
+
+    const char* c_str() const
+    {
+        return m_text.c_str();
+    }
+    unsigned int length() const
+    {
+        return m_text.length();
+    }
+
+protected:
+    std::string m_text;
+};
+
+#endif // WSTRING_H
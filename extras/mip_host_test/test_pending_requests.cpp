@@ -0,0 +1,275 @@
+/* Copyright (C) 2018  Samuel Trassare (https://github.com/tiogaplanet)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* Host tests for the table of pending asynchronous requests behind the read*Async() methods. A simulated MiP
+   (mip_sim.h) is scripted to answer, answer out of order or never answer the requests which the library sends.
+
+   Build and run them on the PC from this directory with any C++17 compiler:
+       g++ -std=c++17 -Istubs -I../../src -o test_pending_requests test_pending_requests.cpp mip_sim.cpp \
+           ../../src/mip_esp8266.cpp ../../src/mip_protocol.cpp ../../src/mip_log.cpp ../../src/mip_profile.cpp \
+           ../../src/mip_format.cpp
+       ./test_pending_requests
+
+   It prints each failed check and exits with 1 if there were any.
+*/
+#include "mip_sim.h"
+#include <mip_esp8266.h>
+#include <mip_protocol.h>
+
+
+// Same as the timeout used by mip_esp8266.cpp.
+#define RESPONSE_TIMEOUT 100
+
+#define CHECK(EXPRESSION) check((EXPRESSION), #EXPRESSION, __LINE__)
+
+static uint32_t g_failures;
+// Never destroyed since ~MiP() talks to MiP one last time, which can't be done once Serial is gone at exit.
+static MiP&     g_mip = *new MiP;
+
+
+
+static void check(bool isPassed, const char* pExpression, int line)
+{
+    if (!isPassed)
+    {
+        printf("FAILED line %d: %s\n", line, pExpression);
+        g_failures++;
+    }
+}
+
+// Connects to a freshly reset MiP and then hands the requests over to the test.
+static void startTest(const char* pName)
+{
+    printf("%s\n", pName);
+    mipSimReset();
+    CHECK(g_mip.begin());
+    mipSimSetScripted(true);
+}
+
+static bool isRequest(const MiPSimBytes& request, uint8_t command)
+{
+    return request.size() == 1 && request[0] == command;
+}
+
+template<class T>
+static void waitUntilReady(MiPFuture<T>& future)
+{
+    for (int i = 0 ; i < 1000 && !future.ready() ; i++)
+    {
+        g_mip.handle();
+    }
+}
+
+static int8_t  g_continuationResult;
+static uint8_t g_continuationVolume;
+static int     g_continuationCalls;
+
+static void onVolume(int8_t result, const uint8_t& volume, void* pContext)
+{
+    g_continuationResult = result;
+    g_continuationVolume = volume;
+    g_continuationCalls++;
+}
+
+
+
+static void testInOrder()
+{
+    startTest("in order completion");
+
+    MiPFuture<uint8_t> volume = g_mip.readVolumeAsync();
+    MiPFuture<int8_t>  weight = g_mip.readWeightAsync();
+    CHECK(g_mip.pendingRequestCount() == 2);
+    CHECK(isRequest(mipSimTakeRequest(), MIP_CMD_GET_VOLUME));
+    CHECK(isRequest(mipSimTakeRequest(), MIP_CMD_GET_WEIGHT));
+    CHECK(!volume.ready());
+    CHECK(!weight.ready());
+
+    mipSimRespond({ MIP_CMD_GET_VOLUME, 5 });
+    mipSimRespond({ MIP_CMD_GET_WEIGHT, 0xF0 });
+    CHECK(volume.get() == 5);
+    CHECK(g_mip.lastCallResult() == MIP_ERROR_NONE);
+    CHECK(weight.get() == -16);
+    CHECK(g_mip.lastCallResult() == MIP_ERROR_NONE);
+    CHECK(g_mip.pendingRequestCount() == 0);
+}
+
+static void testOutOfOrder()
+{
+    startTest("out of order completion");
+
+    MiPFuture<uint8_t>     volume = g_mip.readVolumeAsync();
+    MiPFuture<MiPChestLED> chestLED = g_mip.readChestLEDAsync();
+    MiPFuture<int8_t>      weight = g_mip.readWeightAsync();
+    CHECK(mipSimRequestCount() == 3);
+
+    // Responses are matched up by their command byte rather than by the order the requests were sent in.
+    mipSimRespond({ MIP_CMD_GET_WEIGHT, 0x05 });
+    mipSimRespond({ MIP_CMD_GET_CHEST_LED, 0x10, 0x20, 0x30, 0, 0 });
+    waitUntilReady(weight);
+    CHECK(weight.ready());
+    CHECK(chestLED.ready());
+    CHECK(!volume.ready());
+
+    // And they can be collected in any order too.
+    MiPChestLED led = chestLED.get();
+    CHECK(g_mip.lastCallResult() == MIP_ERROR_NONE);
+    CHECK(led.red == 0x10 && led.green == 0x20 && led.blue == 0x30);
+    CHECK(weight.get() == 5);
+
+    mipSimRespond({ MIP_CMD_GET_VOLUME, 7 });
+    CHECK(volume.get() == 7);
+    CHECK(g_mip.pendingRequestCount() == 0);
+
+    // Two requests for the same command are answered in the order they were sent.
+    MiPFuture<uint8_t> first = g_mip.readVolumeAsync();
+    MiPFuture<uint8_t> second = g_mip.readVolumeAsync();
+    mipSimRespond({ MIP_CMD_GET_VOLUME, 1 });
+    mipSimRespond({ MIP_CMD_GET_VOLUME, 2 });
+    CHECK(second.get() == 2);
+    CHECK(first.get() == 1);
+}
+
+static void testTimeout()
+{
+    startTest("timeout");
+
+    MiPFuture<uint8_t> lost = g_mip.readVolumeAsync();
+    MiPFuture<int8_t>  answered = g_mip.readWeightAsync();
+    mipSimRespond({ MIP_CMD_GET_WEIGHT, 3 });
+
+    mipSimAdvance(RESPONSE_TIMEOUT / 2);
+    g_mip.handle();
+    CHECK(!lost.ready());
+
+    mipSimAdvance(RESPONSE_TIMEOUT);
+    CHECK(lost.ready());
+    CHECK(lost.result() == MIP_ERROR_TIMEOUT);
+    lost.get();
+    CHECK(g_mip.lastCallResult() == MIP_ERROR_TIMEOUT);
+    CHECK(answered.get() == 3);
+    CHECK(g_mip.lastCallResult() == MIP_ERROR_NONE);
+    CHECK(g_mip.pendingRequestCount() == 0);
+
+    // A response which turns up after its request timed out doesn't complete a later request.
+    mipSimRespond({ MIP_CMD_GET_VOLUME, 9 });
+    g_mip.handle();
+    mipSimTakeRequest();
+    mipSimTakeRequest();
+    MiPFuture<uint8_t> later = g_mip.readVolumeAsync();
+    mipSimRespond({ MIP_CMD_GET_VOLUME, 4 });
+    CHECK(later.get() == 4);
+}
+
+static void testThen()
+{
+    startTest("then() continuations");
+
+    g_continuationCalls = 0;
+    MiPFuture<uint8_t> volume = g_mip.readVolumeAsync();
+    volume.then(onVolume);
+    g_mip.handle();
+    CHECK(g_continuationCalls == 0);
+
+    // The continuation runs from handle() and frees the entry.
+    mipSimRespond({ MIP_CMD_GET_VOLUME, 6 });
+    g_mip.handle();
+    CHECK(g_continuationCalls == 1);
+    CHECK(g_continuationResult == MIP_ERROR_NONE);
+    CHECK(g_continuationVolume == 6);
+    CHECK(g_mip.pendingRequestCount() == 0);
+
+    // It also runs when the request times out.
+    MiPFuture<uint8_t> lost = g_mip.readVolumeAsync();
+    lost.then(onVolume);
+    mipSimAdvance(RESPONSE_TIMEOUT + 1);
+    g_mip.handle();
+    CHECK(g_continuationCalls == 2);
+    CHECK(g_continuationResult == MIP_ERROR_TIMEOUT);
+    CHECK(g_mip.pendingRequestCount() == 0);
+}
+
+static void testExhaustion()
+{
+    startTest("table exhaustion and recycling");
+
+    MiPFuture<uint8_t>* pFutures[MIP_MAX_PENDING_REQUESTS];
+    for (uint8_t i = 0 ; i < MIP_MAX_PENDING_REQUESTS ; i++)
+    {
+        pFutures[i] = new MiPFuture<uint8_t>(g_mip.readVolumeAsync());
+    }
+    CHECK(mipSimRequestCount() == MIP_MAX_PENDING_REQUESTS);
+    CHECK(g_mip.pendingRequestCount() == MIP_MAX_PENDING_REQUESTS);
+
+    // With every entry waiting on MiP, another request fails right away without being sent.
+    MiPFuture<int8_t> busy = g_mip.readWeightAsync();
+    CHECK(busy.ready());
+    CHECK(busy.result() == MIP_ERROR_BUSY);
+    CHECK(mipSimRequestCount() == MIP_MAX_PENDING_REQUESTS);
+    busy.get();
+    CHECK(g_mip.lastCallResult() == MIP_ERROR_BUSY);
+
+    // Once they have all been answered but not read, a new request recycles the oldest entry.
+    for (uint8_t i = 0 ; i < MIP_MAX_PENDING_REQUESTS ; i++)
+    {
+        mipSimRespond({ MIP_CMD_GET_VOLUME, i });
+    }
+    waitUntilReady(*pFutures[MIP_MAX_PENDING_REQUESTS - 1]);
+    MiPFuture<int8_t> weight = g_mip.readWeightAsync();
+    mipSimRespond({ MIP_CMD_GET_WEIGHT, 2 });
+    CHECK(weight.get() == 2);
+
+    // The future which lost its entry reports that rather than a default value.
+    CHECK(pFutures[0]->ready());
+    CHECK(pFutures[0]->result() == MIP_ERROR_BUSY);
+    CHECK(pFutures[0]->get() == 0);
+    CHECK(g_mip.lastCallResult() == MIP_ERROR_BUSY);
+    for (uint8_t i = 1 ; i < MIP_MAX_PENDING_REQUESTS ; i++)
+    {
+        CHECK(pFutures[i]->get() == i);
+        CHECK(g_mip.lastCallResult() == MIP_ERROR_NONE);
+    }
+
+    // So does a copy of a future whose result has already been read.
+    MiPFuture<uint8_t> volume = g_mip.readVolumeAsync();
+    MiPFuture<uint8_t> copy = volume;
+    mipSimRespond({ MIP_CMD_GET_VOLUME, 3 });
+    CHECK(volume.get() == 3);
+    CHECK(copy.get() == 0);
+    CHECK(g_mip.lastCallResult() == MIP_ERROR_BUSY);
+
+    for (uint8_t i = 0 ; i < MIP_MAX_PENDING_REQUESTS ; i++)
+    {
+        delete pFutures[i];
+    }
+}
+
+
+
+int main()
+{
+    testInOrder();
+    testOutOfOrder();
+    testTimeout();
+    testThen();
+    testExhaustion();
+
+    if (g_failures > 0)
+    {
+        printf("%u checks failed\n", g_failures);
+        return 1;
+    }
+    printf("All tests passed\n");
+    return 0;
+}
@@ -0,0 +1,613 @@
+/* Copyright (C) 2018  Samuel Trassare (https://github.com/tiogaplanet)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* Host side decoder for the binary records which MiPDebug sends instead of text (see BINARY_SYNC in mip_debug.h).
+
+   Build it on the PC with any C++17 compiler:
+       g++ -std=c++17 -O2 -o mip_log_decode mip_log_decode.cpp
+
+   Generate the dictionary from the sources of the sketch and the library. Every string literal in them is hashed
+   the same way as MIP_DEBUG_ID() so that the format string of each record can be found again:
+       mip_log_decode --generate ~/Arduino/libraries/MiP_ESP8266_Library/src ~/Arduino/MySketch > mip_log.dict
+
+   Then decode a capture, or standard input, with it. For telnet, send the binary command first:
+       (echo binary; cat) | nc mip-0x01.local 23 | mip_log_decode mip_log.dict
+   For UDP, after calling debug.setBinaryUdp(pcAddress, 4444) in the sketch:
+       nc -lu 4444 | mip_log_decode mip_log.dict
+
+   Any bytes outside of records, such as the responses to telnet commands, are passed through as they are.
+*/
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+
+// These must match mip_debug.h.
+static const uint8_t  BINARY_SYNC = 0xF0;
+static const uint32_t BINARY_TEXT_ID = 0;
+
+typedef std::unordered_map<uint32_t, std::string> Dictionary;
+
+
+
+// Same FNV-1a hash as mipDebugHash() in mip_debug.h.
+static uint32_t hashFormat(const std::string& format)
+{
+    uint32_t hash = 2166136261UL;
+
+    for (unsigned char character : format)
+    {
+        hash ^= character;
+        hash *= 16777619UL;
+    }
+
+    return hash;
+}
+
+
+
+// Decodes the escape sequence at text[i], just after the backslash, and moves i past it.
+static char unescape(const std::string& text, size_t& i)
+{
+    char character = text[i++];
+
+    switch (character)
+    {
+    case 'n':
+        return '\n';
+    case 'r':
+        return '\r';
+    case 't':
+        return '\t';
+    case 'a':
+        return '\a';
+    case 'b':
+        return '\b';
+    case 'f':
+        return '\f';
+    case 'v':
+        return '\v';
+    case 'e':
+        return '\x1B';
+    case 'x':
+    {
+        int value = 0;
+        while (i < text.size() && isxdigit((unsigned char)text[i]))
+        {
+            value = value * 16 + (isdigit((unsigned char)text[i]) ? text[i] - '0' : (tolower(text[i]) - 'a' + 10));
+            i++;
+        }
+        return (char)value;
+    }
+    default:
+        if (character >= '0' && character <= '7')
+        {
+            int value = character - '0';
+            for (int digits = 1 ; digits < 3 && i < text.size() && text[i] >= '0' && text[i] <= '7' ; digits++)
+            {
+                value = value * 8 + text[i++] - '0';
+            }
+            return (char)value;
+        }
+        // \\, \", \' and \?.
+        return character;
+    }
+}
+
+// Adds every string literal in a source file to the dictionary. Adjacent literals are joined as the compiler would.
+static void scanSource(const std::string& text, Dictionary& dictionary)
+{
+    std::string literal;
+    bool        isInLiteral = false;
+    size_t      i = 0;
+
+    auto addLiteral = [&]()
+    {
+        if (isInLiteral)
+        {
+            dictionary[hashFormat(literal)] = literal;
+            literal.clear();
+            isInLiteral = false;
+        }
+    };
+
+    while (i < text.size())
+    {
+        char character = text[i];
+
+        if (character == '"')
+        {
+            // Part of the current literal if only whitespace has been seen since the last one.
+            i++;
+            isInLiteral = true;
+            while (i < text.size() && text[i] != '"' && text[i] != '\n')
+            {
+                if (text[i] == '\\' && i + 1 < text.size())
+                {
+                    i++;
+                    literal += unescape(text, i);
+                }
+                else
+                {
+                    literal += text[i++];
+                }
+            }
+            i++;
+        }
+        else if (character == '/' && i + 1 < text.size() && text[i + 1] == '/')
+        {
+            i = text.find('\n', i);
+            i = i == std::string::npos ? text.size() : i;
+        }
+        else if (character == '/' && i + 1 < text.size() && text[i + 1] == '*')
+        {
+            i = text.find("*/", i + 2);
+            i = i == std::string::npos ? text.size() : i + 2;
+        }
+        else if (character == '\'')
+        {
+            // Skip character literals so that '"' isn't taken for the start of a string.
+            i++;
+            while (i < text.size() && text[i] != '\'' && text[i] != '\n')
+            {
+                i += text[i] == '\\' ? 2 : 1;
+            }
+            i++;
+        }
+        else if (isspace((unsigned char)character))
+        {
+            i++;
+        }
+        else
+        {
+            addLiteral();
+            i++;
+        }
+    }
+    addLiteral();
+}
+
+// Writes one dictionary entry per line: the ID in hex, a tab and the format string with its control characters,
+// backslashes and non-ASCII bytes escaped in octal.
+static int generate(int argc, char* argv[])
+{
+    Dictionary dictionary;
+
+    for (int i = 2 ; i < argc ; i++)
+    {
+        std::vector<fs::path> files;
+        if (fs::is_directory(argv[i]))
+        {
+            for (const auto& entry : fs::recursive_directory_iterator(argv[i]))
+            {
+                std::string extension = entry.path().extension().string();
+                if (entry.is_regular_file() && (extension == ".cpp" || extension == ".h" || extension == ".ino" ||
+                                                extension == ".c"))
+                {
+                    files.push_back(entry.path());
+                }
+            }
+        }
+        else
+        {
+            files.push_back(argv[i]);
+        }
+
+        for (const auto& file : files)
+        {
+            std::ifstream     input(file, std::ios::binary);
+            std::stringstream text;
+
+            if (!input)
+            {
+                std::cerr << "mip_log_decode: can't read " << file << "\n";
+                return 1;
+            }
+            text << input.rdbuf();
+            scanSource(text.str(), dictionary);
+        }
+    }
+
+    for (const auto& entry : dictionary)
+    {
+        printf("%08x\t", entry.first);
+        for (unsigned char character : entry.second)
+        {
+            if (character == '\\')
+            {
+                printf("\\\\");
+            }
+            else if (character < 0x20 || character >= 0x7F)
+            {
+                printf("\\%03o", character);
+            }
+            else
+            {
+                putchar(character);
+            }
+        }
+        putchar('\n');
+    }
+
+    return 0;
+}
+
+static bool loadDictionary(const char* pPath, Dictionary& dictionary)
+{
+    std::ifstream input(pPath);
+    std::string   line;
+
+    if (!input)
+    {
+        return false;
+    }
+    while (std::getline(input, line))
+    {
+        size_t tab = line.find('\t');
+        if (tab == std::string::npos)
+        {
+            continue;
+        }
+
+        std::string format;
+        for (size_t i = tab + 1 ; i < line.size() ; )
+        {
+            if (line[i] == '\\' && i + 1 < line.size())
+            {
+                i++;
+                format += unescape(line, i);
+            }
+            else
+            {
+                format += line[i++];
+            }
+        }
+        dictionary[(uint32_t)strtoul(line.substr(0, tab).c_str(), NULL, 16)] = format;
+    }
+
+    return true;
+}
+
+
+
+// Reads the encoded arguments of a record in the order that the conversions in its format string consume them.
+class ArgReader
+{
+public:
+    ArgReader(const std::vector<uint8_t>& args) : m_args(args), m_offset(0)
+    {
+    }
+
+    bool readVarint(uint64_t& value)
+    {
+        value = 0;
+        for (int shift = 0 ; m_offset < m_args.size() && shift < 64 ; shift += 7)
+        {
+            uint8_t byte = m_args[m_offset++];
+            value |= (uint64_t)(byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool readSigned(int64_t& value)
+    {
+        uint64_t zigzag;
+        if (!readVarint(zigzag))
+        {
+            return false;
+        }
+        value = (int64_t)(zigzag >> 1) ^ -(int64_t)(zigzag & 1);
+        return true;
+    }
+
+    bool readDouble(double& value)
+    {
+        if (m_offset + sizeof(value) > m_args.size())
+        {
+            return false;
+        }
+        memcpy(&value, &m_args[m_offset], sizeof(value));
+        m_offset += sizeof(value);
+        return true;
+    }
+
+    bool readString(std::string& value)
+    {
+        if (m_offset >= m_args.size())
+        {
+            return false;
+        }
+        size_t length = m_args[m_offset++];
+        if (m_offset + length > m_args.size())
+        {
+            return false;
+        }
+        value.assign((const char*)&m_args[m_offset], length);
+        m_offset += length;
+        return true;
+    }
+
+protected:
+    const std::vector<uint8_t>& m_args;
+    size_t                      m_offset;
+};
+
+// Rebuilds the text of a record from its format string the way MiPDebug would have formatted it on the ESP8266, where
+// int and long are 32 bits. Conversions whose arguments are missing, because they didn't fit in the record, are
+// shown as "?".
+static std::string formatRecord(const std::string& format, const std::vector<uint8_t>& args)
+{
+    ArgReader   reader(args);
+    std::string text;
+    bool        isComplete = true;
+
+    for (size_t i = 0 ; i < format.size() ; i++)
+    {
+        if (format[i] != '%')
+        {
+            text += format[i];
+            continue;
+        }
+
+        // Build the conversion for the host's snprintf(), with any '*' replaced by its argument and without the length.
+        std::string spec = "%";
+        int         longs = 0;
+        int         shorts = 0;
+        char        conversion = '\0';
+        for (i++ ; i < format.size() ; i++)
+        {
+            char character = format[i];
+            if (strchr("-+ #0123456789.", character))
+            {
+                spec += character;
+            }
+            else if (character == '*')
+            {
+                int64_t value = 0;
+                isComplete = isComplete && reader.readSigned(value);
+                spec += std::to_string(value);
+            }
+            else if (character == 'l')
+            {
+                longs++;
+            }
+            else if (character == 'j')
+            {
+                longs = 2;
+            }
+            else if (character == 'h')
+            {
+                shorts++;
+            }
+            else if (!strchr("Lzt", character))
+            {
+                conversion = character;
+                break;
+            }
+        }
+
+        char    buffer[512];
+        int64_t signedValue;
+        uint64_t unsignedValue;
+        double  floatValue;
+        std::string stringValue;
+        buffer[0] = '\0';
+        switch (conversion)
+        {
+        case '%':
+            strcpy(buffer, "%");
+            break;
+        case 'd':
+        case 'i':
+            isComplete = isComplete && reader.readSigned(signedValue);
+            if (isComplete)
+            {
+                signedValue = longs >= 2 ? signedValue : shorts == 1 ? (int16_t)signedValue :
+                              shorts >= 2 ? (int8_t)signedValue : (int32_t)signedValue;
+                snprintf(buffer, sizeof(buffer), (spec + "lld").c_str(), (long long)signedValue);
+            }
+            break;
+        case 'u':
+        case 'x':
+        case 'X':
+        case 'o':
+        case 'c':
+        case 'p':
+            isComplete = isComplete && reader.readVarint(unsignedValue);
+            if (!isComplete)
+            {
+                break;
+            }
+            if (conversion == 'c')
+            {
+                snprintf(buffer, sizeof(buffer), (spec + "c").c_str(), (int)(unsigned char)unsignedValue);
+            }
+            else if (conversion == 'p')
+            {
+                snprintf(buffer, sizeof(buffer), "0x%08x", (unsigned)unsignedValue);
+            }
+            else
+            {
+                unsignedValue = longs >= 2 ? unsignedValue : shorts == 1 ? (uint16_t)unsignedValue :
+                                shorts >= 2 ? (uint8_t)unsignedValue : (uint32_t)unsignedValue;
+                snprintf(buffer, sizeof(buffer), (spec + "ll" + conversion).c_str(), (unsigned long long)unsignedValue);
+            }
+            break;
+        case 'e':
+        case 'E':
+        case 'f':
+        case 'F':
+        case 'g':
+        case 'G':
+            isComplete = isComplete && reader.readDouble(floatValue);
+            if (isComplete)
+            {
+                snprintf(buffer, sizeof(buffer), (spec + conversion).c_str(), floatValue);
+            }
+            break;
+        case 's':
+        case 'S':
+            isComplete = isComplete && reader.readString(stringValue);
+            if (isComplete)
+            {
+                snprintf(buffer, sizeof(buffer), (spec + "s").c_str(), stringValue.c_str());
+            }
+            break;
+        default:
+            // MiPDebug stops encoding at a conversion it doesn't know.
+            isComplete = false;
+            break;
+        }
+        text += isComplete ? buffer : "?";
+    }
+
+    return text;
+}
+
+static int decode(const Dictionary& dictionary, std::istream& input)
+{
+    static const char levelNames[] = { 'P', 'v', 'd', 'i', 'w', 'e', 'a', 'n' };
+    bool isLineStart = true;
+    int  character;
+
+    while ((character = input.get()) != EOF)
+    {
+        if ((character & 0xF8) != BINARY_SYNC)
+        {
+            // Text outside of the records, such as responses to telnet commands.
+            if (character != '\r')
+            {
+                putchar(character);
+            }
+            continue;
+        }
+
+        uint8_t  level = character & 0x07;
+        uint8_t  idBytes[4];
+        uint32_t id;
+        uint64_t time = 0;
+        int      shift = 0;
+
+        if (!input.read((char*)idBytes, sizeof(idBytes)))
+        {
+            break;
+        }
+        id = idBytes[0] | (idBytes[1] << 8) | (idBytes[2] << 16) | ((uint32_t)idBytes[3] << 24);
+        while ((character = input.get()) != EOF)
+        {
+            time |= (uint64_t)(character & 0x7F) << shift;
+            shift += 7;
+            if ((character & 0x80) == 0)
+            {
+                break;
+            }
+        }
+        int length = input.get();
+        if (character == EOF || length == EOF)
+        {
+            break;
+        }
+        std::vector<uint8_t> args(length);
+        if (length > 0 && !input.read((char*)args.data(), length))
+        {
+            break;
+        }
+
+        std::string text;
+        if (id == BINARY_TEXT_ID)
+        {
+            text.assign(args.begin(), args.end());
+        }
+        else
+        {
+            auto entry = dictionary.find(id);
+            if (entry == dictionary.end())
+            {
+                char unknown[64];
+                snprintf(unknown, sizeof(unknown), "<unknown message %08x, %d bytes>\n", id, length);
+                text = unknown;
+            }
+            else
+            {
+                text = formatRecord(entry->second, args);
+            }
+        }
+        if (text.empty())
+        {
+            continue;
+        }
+
+        if (isLineStart)
+        {
+            printf("(%c t:%llums) ", levelNames[level], (unsigned long long)time);
+        }
+        for (char textCharacter : text)
+        {
+            if (textCharacter != '\r')
+            {
+                putchar(textCharacter);
+            }
+        }
+        isLineStart = text.back() == '\n';
+        fflush(stdout);
+    }
+
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc >= 3 && strcmp(argv[1], "--generate") == 0)
+    {
+        return generate(argc, argv);
+    }
+    if (argc < 2 || argc > 3 || argv[1][0] == '-')
+    {
+        fprintf(stderr, "Usage: mip_log_decode --generate sources... > dictionary\n"
+                        "       mip_log_decode dictionary [capture]\n");
+        return 1;
+    }
+
+    Dictionary dictionary;
+    if (!loadDictionary(argv[1], dictionary))
+    {
+        fprintf(stderr, "mip_log_decode: can't read %s\n", argv[1]);
+        return 1;
+    }
+
+    if (argc == 3)
+    {
+        std::ifstream input(argv[2], std::ios::binary);
+        if (!input)
+        {
+            fprintf(stderr, "mip_log_decode: can't read %s\n", argv[2]);
+            return 1;
+        }
+        return decode(dictionary, input);
+    }
+    return decode(dictionary, std::cin);
+}
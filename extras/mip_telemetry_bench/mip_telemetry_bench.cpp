@@ -0,0 +1,168 @@
+/* Copyright (C) 2018  Samuel Trassare (https://github.com/tiogaplanet)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* Host side benchmark for the integer telemetry decoders in src/mip_protocol.h. It first checks that the battery
+   lookup table and the integer odometer scaling give the same answers as the float and double math which the library
+   used to do, then times each of them against it.
+
+   mip_protocol.cpp is built against the Arduino stubs of the host tests. Build and run it on the PC with any C++17
+   compiler:
+       g++ -O2 -I../../src -I../mip_host_test/stubs -o mip_telemetry_bench mip_telemetry_bench.cpp \
+           ../../src/mip_protocol.cpp
+       ./mip_telemetry_bench
+
+   The PC has a floating point unit, so the gap is far wider on the ESP8266 where float math is done in software.
+   The FixedPointTelemetry example times the same comparison on the robot.
+*/
+#include <chrono>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+#include "mip_protocol.h"
+
+
+// Number of calls timed for each function.
+static const uint32_t ITERATIONS = 20000000;
+
+// Written by every timed call so that the compiler can't optimize them away.
+static volatile uint32_t g_sink;
+
+static std::vector<uint32_t> g_ticks;
+
+
+
+// The float battery conversion which parseStatus() used to do, in volts.
+static float floatBatteryVoltage(uint8_t batteryLevel)
+{
+    return (float)(((batteryLevel - 0x4D) / (float)(0x7C - 0x4D)) * (6.4f - 4.0f)) + 4.0f;
+}
+
+// The double odometer conversion which parseOdometer() used to do, in centimetres.
+static float doubleOdometerCentimetres(uint32_t ticks)
+{
+    return (float)((double)ticks / 48.5);
+}
+
+static bool checkBattery()
+{
+    bool isPassing = true;
+
+    // The table rounds to the nearest millivolt so it must be within half a millivolt of the float math, allowing
+    // for the float's own rounding.
+    for (int level = 0 ; level < 256 ; level++)
+    {
+        double   expected = floatBatteryVoltage(level) * 1000.0;
+        uint16_t actual = mipDecodeBatteryMillivolts(level);
+
+        if (fabs(actual - expected) > 0.5 + 0.01)
+        {
+            printf("FAILED mipDecodeBatteryMillivolts(0x%02X): expected %.3f mV, got %u mV\n", level, expected, actual);
+            isPassing = false;
+        }
+    }
+    return isPassing;
+}
+
+static bool checkOdometer()
+{
+    bool isPassing = true;
+
+    for (uint32_t ticks : g_ticks)
+    {
+        // Millimetres are truncated, so they must match the exact 64-bit result and be within a millimetre of the
+        // double math.
+        uint32_t exact = (uint32_t)((uint64_t)ticks * 100 / MIP_ODOMETER_TICKS_PER_10CM);
+        uint32_t actual = mipDecodeOdometerMillimetres(ticks);
+        double   expected = (double)ticks / 4.85;
+
+        if (actual != exact || fabs(actual - expected) >= 1.0)
+        {
+            printf("FAILED mipDecodeOdometerMillimetres(%" PRIu32 "): expected %" PRIu32 " mm (%.3f), got %" PRIu32
+                   " mm\n", ticks, exact, expected, actual);
+            isPassing = false;
+        }
+    }
+    return isPassing;
+}
+
+template<typename FUNCTION>
+static double timeCalls(FUNCTION function)
+{
+    auto     start = std::chrono::steady_clock::now();
+    uint32_t index = 0;
+
+    for (uint32_t i = 0 ; i < ITERATIONS ; i++)
+    {
+        g_sink = function(g_ticks[index]);
+        index = index + 1 < g_ticks.size() ? index + 1 : 0;
+    }
+
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / ITERATIONS;
+}
+
+static void report(const char* pTest, const char* pName, double nanoseconds, double baseline)
+{
+    printf("%-22s %-34s %8.2f ns %8.2fx\n", pTest, pName, nanoseconds, baseline / nanoseconds);
+}
+
+
+
+int main()
+{
+    // Edge cases, then tick counts spread over the whole 32-bit range, then the small counts seen most.
+    const uint32_t edges[] = { 0, 1, 96, 97, 98, 484, 485, 486, 970, 65535, 65536, 0x7FFFFFFF, 0x80000000,
+                               0xFFFFFFFE, 0xFFFFFFFF };
+    g_ticks.assign(edges, edges + sizeof(edges) / sizeof(edges[0]));
+    uint32_t random = 12345;
+    for (int i = 0 ; i < 1000 ; i++)
+    {
+        random = random * 1103515245 + 12345;
+        g_ticks.push_back(random);
+        g_ticks.push_back(random % 100000);
+    }
+
+    bool isPassing = checkBattery();
+    isPassing &= checkOdometer();
+    if (!isPassing)
+    {
+        return 1;
+    }
+    printf("All conversion checks passed\n\n");
+
+    double baseline;
+
+    baseline = timeCalls([](uint32_t ticks)
+    {
+        return (uint32_t)(floatBatteryVoltage((uint8_t)ticks) * 1000.0f);
+    });
+    report("battery millivolts", "float math", baseline, baseline);
+    report("", "mipDecodeBatteryMillivolts()", timeCalls([](uint32_t ticks)
+    {
+        return (uint32_t)mipDecodeBatteryMillivolts((uint8_t)ticks);
+    }), baseline);
+
+    baseline = timeCalls([](uint32_t ticks)
+    {
+        return (uint32_t)(doubleOdometerCentimetres(ticks) * 10.0f);
+    });
+    report("odometer millimetres", "double math", baseline, baseline);
+    report("", "mipDecodeOdometerMillimetres()", timeCalls([](uint32_t ticks)
+    {
+        return mipDecodeOdometerMillimetres(ticks);
+    }), baseline);
+
+    return 0;
+}
@@ -0,0 +1,157 @@
+/* Copyright (C) 2018  Samuel Trassare (https://github.com/tiogaplanet)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* This is the implementation of the cooperative scheduler for MiP coroutine scripts.
+*/
+#include "mip_coroutine.h"
+
+#if defined(__cpp_impl_coroutine)
+
+// Pool from which all coroutine frames are allocated.
+static uint8_t g_framePool[MIP_MAX_TASKS][MIP_TASK_FRAME_SIZE] __attribute__((aligned(8)));
+static bool    g_frameInUse[MIP_MAX_TASKS];
+
+
+
+void* MiPTask::promise_type::operator new(size_t size) noexcept
+{
+    if (size > MIP_TASK_FRAME_SIZE)
+    {
+        MIP_DEBUG_ERROR_PRINTF("MiP: Task frame too large: %d\n", size);
+        return NULL;
+    }
+
+    for (uint8_t i = 0 ; i < MIP_MAX_TASKS ; i++)
+    {
+        if (!g_frameInUse[i])
+        {
+            g_frameInUse[i] = true;
+            return g_framePool[i];
+        }
+    }
+
+    MIP_DEBUG_ERROR_PRINTLN(F("MiP: No free task frames"));
+    return NULL;
+}
+
+void MiPTask::promise_type::operator delete(void* pFrame) noexcept
+{
+    for (uint8_t i = 0 ; i < MIP_MAX_TASKS ; i++)
+    {
+        if (pFrame == g_framePool[i])
+        {
+            g_frameInUse[i] = false;
+            return;
+        }
+    }
+}
+
+
+
+MiPScheduler::MiPScheduler(MiP& mip) : m_mip(mip)
+{
+}
+
+MiPScheduler::~MiPScheduler()
+{
+    for (uint8_t i = 0 ; i < MIP_MAX_TASKS ; i++)
+    {
+        if (m_tasks[i])
+        {
+            m_tasks[i].destroy();
+            m_tasks[i] = NULL;
+        }
+    }
+}
+
+bool MiPScheduler::start(MiPTask&& task)
+{
+    if (!task.m_handle)
+    {
+        return false;
+    }
+
+    for (uint8_t i = 0 ; i < MIP_MAX_TASKS ; i++)
+    {
+        if (!m_tasks[i])
+        {
+            // The scheduler now owns the frame.
+            m_tasks[i] = task.m_handle;
+            task.m_handle = NULL;
+            return true;
+        }
+    }
+    return false;
+}
+
+void MiPScheduler::handle()
+{
+    // Process responses to outstanding asynchronous requests that scripts might be waiting on.
+    m_mip.handle();
+
+    for (uint8_t i = 0 ; i < MIP_MAX_TASKS ; i++)
+    {
+        std::coroutine_handle<MiPTask::promise_type> task = m_tasks[i];
+        if (!task)
+        {
+            continue;
+        }
+
+        MiPTask::promise_type& promise = task.promise();
+        if (promise.pWaitingOn != NULL && !promise.pWaitingOn->isReady())
+        {
+            continue;
+        }
+
+        // Run the script until it waits on something else or finishes.
+        promise.pWaitingOn = NULL;
+        task.resume();
+        if (task.done())
+        {
+            task.destroy();
+            m_tasks[i] = NULL;
+        }
+    }
+}
+
+uint8_t MiPScheduler::activeTasks()
+{
+    uint8_t count = 0;
+
+    for (uint8_t i = 0 ; i < MIP_MAX_TASKS ; i++)
+    {
+        if (m_tasks[i])
+        {
+            count++;
+        }
+    }
+    return count;
+}
+
+MiPSleepAwaitable MiPScheduler::sleepFor(uint32_t milliseconds)
+{
+    return MiPSleepAwaitable(milliseconds);
+}
+
+MiPGestureAwaitable MiPScheduler::nextGesture()
+{
+    return MiPGestureAwaitable(m_mip);
+}
+
+MiPClapAwaitable MiPScheduler::nextClap()
+{
+    return MiPClapAwaitable(m_mip);
+}
+
+#endif // defined(__cpp_impl_coroutine)
@@ -0,0 +1,272 @@
+/* Copyright (C) 2018  Samuel Trassare (https://github.com/tiogaplanet)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* This header file describes the optional C++20 coroutine support for writing MiP scripts top to bottom without
+   blocking in delay(). A script is a function returning MiPTask which uses co_await to wait on time, gestures, claps
+   or the MiPFuture objects returned by the MiP read*Async() methods. MiPScheduler runs many such scripts side by
+   side from loop().
+
+   Coroutine frames are carved out of a fixed pool so no heap is used. The sketch must be built with -fcoroutines
+   (or -std=c++20) for any of this to be available.
+*/
+#ifndef MIP_COROUTINE_H
+#define MIP_COROUTINE_H
+
+#include "mip_esp8266.h"
+
+#if defined(__cpp_impl_coroutine)
+
+#include <coroutine>
+
+
+// Maximum number of scripts which can be running at once. Each one consumes a frame from the pool.
+#ifndef MIP_MAX_TASKS
+  #define MIP_MAX_TASKS 4
+#endif
+
+// Size of each coroutine frame in the pool. A script's frame holds its local variables and the state of the
+// operation on which it is currently waiting. Scripts needing a larger frame will fail to start.
+#ifndef MIP_TASK_FRAME_SIZE
+  #define MIP_TASK_FRAME_SIZE 256
+#endif
+
+
+// Base class for everything a script can wait on. The scheduler polls isReady() to learn when the script can resume.
+class MiPAwaitable
+{
+public:
+    virtual bool isReady() = 0;
+};
+
+class MiPTask
+{
+public:
+    class promise_type
+    {
+    public:
+        MiPTask get_return_object()
+        {
+            return MiPTask(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+        static MiPTask get_return_object_on_allocation_failure()
+        {
+            return MiPTask();
+        }
+        std::suspend_always initial_suspend() noexcept
+        {
+            return std::suspend_always();
+        }
+        std::suspend_always final_suspend() noexcept
+        {
+            return std::suspend_always();
+        }
+        void return_void()
+        {
+        }
+        void unhandled_exception()
+        {
+        }
+
+        static void* operator new(size_t size) noexcept;
+        static void  operator delete(void* pFrame) noexcept;
+
+        MiPAwaitable* pWaitingOn = NULL;
+    };
+
+    MiPTask()
+    {
+    }
+    MiPTask(MiPTask&& other)
+    {
+        m_handle = other.m_handle;
+        other.m_handle = NULL;
+    }
+    ~MiPTask()
+    {
+        // Script was never handed off to a scheduler so free up its frame.
+        if (m_handle)
+        {
+            m_handle.destroy();
+        }
+    }
+
+    // Will return false if there wasn't a free frame in the pool for this script.
+    bool isValid()
+    {
+        return (bool)m_handle;
+    }
+
+protected:
+    friend class MiPScheduler;
+
+    explicit MiPTask(std::coroutine_handle<promise_type> handle)
+    {
+        m_handle = handle;
+    }
+    MiPTask(const MiPTask& other) = delete;
+    MiPTask& operator=(const MiPTask& other) = delete;
+
+    std::coroutine_handle<promise_type> m_handle;
+};
+
+// Awaitable returned by MiPScheduler::sleepFor().
+class MiPSleepAwaitable : public MiPAwaitable
+{
+public:
+    MiPSleepAwaitable(uint32_t milliseconds)
+    {
+        m_startTime = millis();
+        m_duration = milliseconds;
+    }
+
+    bool await_ready()
+    {
+        return m_duration == 0;
+    }
+    void await_suspend(std::coroutine_handle<MiPTask::promise_type> handle)
+    {
+        handle.promise().pWaitingOn = this;
+    }
+    void await_resume()
+    {
+    }
+    virtual bool isReady()
+    {
+        return millis() - m_startTime >= m_duration;
+    }
+
+protected:
+    uint32_t m_startTime;
+    uint32_t m_duration;
+};
+
+// Awaitable returned by MiPScheduler::nextGesture().
+class MiPGestureAwaitable : public MiPAwaitable
+{
+public:
+    MiPGestureAwaitable(MiP& mip) : m_mip(mip)
+    {
+    }
+
+    bool await_ready()
+    {
+        return isReady();
+    }
+    void await_suspend(std::coroutine_handle<MiPTask::promise_type> handle)
+    {
+        handle.promise().pWaitingOn = this;
+    }
+    MiPGesture await_resume()
+    {
+        return m_mip.readGestureEvent();
+    }
+    virtual bool isReady()
+    {
+        return m_mip.availableGestureEvents() > 0;
+    }
+
+protected:
+    MiP& m_mip;
+};
+
+// Awaitable returned by MiPScheduler::nextClap().
+class MiPClapAwaitable : public MiPAwaitable
+{
+public:
+    MiPClapAwaitable(MiP& mip) : m_mip(mip)
+    {
+    }
+
+    bool await_ready()
+    {
+        return isReady();
+    }
+    void await_suspend(std::coroutine_handle<MiPTask::promise_type> handle)
+    {
+        handle.promise().pWaitingOn = this;
+    }
+    uint8_t await_resume()
+    {
+        return m_mip.readClapEvent();
+    }
+    virtual bool isReady()
+    {
+        return m_mip.availableClapEvents() > 0;
+    }
+
+protected:
+    MiP& m_mip;
+};
+
+// Allows a script to co_await any MiPFuture, such as the one returned by MiP::readDistanceTravelledAsync().
+template<class T>
+class MiPFutureAwaitable : public MiPAwaitable
+{
+public:
+    MiPFutureAwaitable(const MiPFuture<T>& future) : m_future(future)
+    {
+    }
+
+    bool await_ready()
+    {
+        return m_future.ready();
+    }
+    void await_suspend(std::coroutine_handle<MiPTask::promise_type> handle)
+    {
+        handle.promise().pWaitingOn = this;
+    }
+    T await_resume()
+    {
+        return m_future.get();
+    }
+    virtual bool isReady()
+    {
+        return m_future.ready();
+    }
+
+protected:
+    MiPFuture<T> m_future;
+};
+
+template<class T>
+MiPFutureAwaitable<T> operator co_await(const MiPFuture<T>& future)
+{
+    return MiPFutureAwaitable<T>(future);
+}
+
+class MiPScheduler
+{
+public:
+    MiPScheduler(MiP& mip);
+    ~MiPScheduler();
+
+    // Hands a script over to the scheduler. Returns false if the script couldn't be allocated or all MIP_MAX_TASKS
+    // task slots are already in use.
+    bool    start(MiPTask&& task);
+    // Must be called each time through loop(). Resumes every script whose awaited condition has been met.
+    void    handle();
+    uint8_t activeTasks();
+
+    MiPSleepAwaitable   sleepFor(uint32_t milliseconds);
+    MiPGestureAwaitable nextGesture();
+    MiPClapAwaitable    nextClap();
+
+protected:
+    MiP&                                         m_mip;
+    std::coroutine_handle<MiPTask::promise_type> m_tasks[MIP_MAX_TASKS];
+};
+
+#endif // defined(__cpp_impl_coroutine)
+
+#endif // MIP_COROUTINE_H
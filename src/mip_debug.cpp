@@ -17,174 +17,106 @@
    Written by Samuel Trassare and based on Joao Lopes' original RemoteDebug library.
 */
 #include "mip_debug.h"
+#include "mip_esp8266.h"
+#include "mip_flash_log.h"
+#include "mip_format.h"
+#include "mip_profile.h"
 #include <Arduino.h>
 
 // Define a version number just for this telnet server, not the overall mip_esp8266 library.
-#define VERSION "1.0.0"
+#define VERSION "1.2.0"
+
+static_assert((COMMAND_HASH_SIZE & (COMMAND_HASH_SIZE - 1)) == 0, "COMMAND_HASH_SIZE must be a power of 2");
+static_assert(COMMAND_HASH_SIZE > MAX_COMMANDS, "COMMAND_HASH_SIZE must be larger than MAX_COMMANDS");
 
 // The telnet server instance.
 WiFiServer telnetServer(TELNET_PORT);
-WiFiClient telnetClient;
 
 void MiPDebug::begin(String hostname, uint8_t startingDebugLevel)
 {
     telnetServer.begin();
     telnetServer.setNoDelay(true);
 
-    // Reserve space to buffer output.
-    m_bufferPrint.reserve(BUFFER_PRINT);
-
-#ifdef CLIENT_BUFFERING
-    // Reserve space for the send buffer.
-    m_bufferPrint.reserve(MAX_SIZE_SEND);
-#endif
-
     // Host name of this device.
     m_hostname = hostname;
-    m_clientDebugLevel = startingDebugLevel;
+    m_defaultOptions.debugLevel = startingDebugLevel;
+    m_serialOptions.debugLevel = startingDebugLevel;
     m_lastDebugLevel = startingDebugLevel;
+    updateActiveLevel();
 }
 
 void MiPDebug::stop()
 {
-    // Stop the client.
-    if (telnetClient && telnetClient.connected())
+    // Stop the clients.
+    for (uint8_t i = 0 ; i < MAX_TELNET_CLIENTS ; i++)
     {
-        telnetClient.stop();
+        if (m_sessions[i].isConnected)
+        {
+            m_sessions[i].client.stop();
+            m_sessions[i].isConnected = false;
+        }
     }
+    updateActiveLevel();
 
     // Stop the server.
     telnetServer.stop();
 }
 
-// Handle the connection.  Must be called each time through the loop().
+// Handle the connections.  Must be called each time through the loop().
 void MiPDebug::handle()
 {
+    MIP_PROFILE_SCOPE("net.debug");
+
 #ifdef ALPHA_VERSION
     static uint32_t lastTime = millis();
+    uint32_t diff = (millis() - lastTime);
+
+    lastTime = millis();
 #endif
 
-    // Debug level is profiler. Set the level before.
-    if (m_clientDebugLevel == PROFILER)
+    // Look for a newly connected client.
+    if (telnetServer.hasClient())
     {
-        if (millis() > m_levelProfilerDisable)
-        {
-            m_clientDebugLevel = m_levelBeforeProfiler;
-            if (m_connected)
-            {
-                telnetClient.println("* Debug level profile is now inactive.");
-            }
-        }
+        acceptClient();
     }
 
-#ifdef ALPHA_VERSION
-    // Automatically change to profiler level if time between handles is greater than n millis.
-    if (m_autoLevelProfiler > 0 &&m_clientDebugLevel != PROFILER)
+    for (uint8_t i = 0 ; i < MAX_TELNET_CLIENTS ; i++)
     {
-        uint32_t diff = (millis() - lastTime);
+        Session& session = m_sessions[i];
 
-        if (diff >= m_autoLevelProfiler)
+        // Is the client still connected? Let's check to reduce overhead if there's no active connection.
+        session.isConnected = (session.isConnected && session.client && session.client.connected());
+        if (!session.isConnected)
         {
-            m_levelBeforeProfiler = m_clientDebugLevel;
-            m_clientDebugLevel = PROFILER;
-            m_levelProfilerDisable = 1000; // Disable it at 1 second.
-            if (m_connected)
-            {
-                telnetClient.printf("* Debug level profile is now active - time between handles: %u\r\n", diff);
-            }
+            continue;
         }
-        lastTime = millis();
-    }
-#endif
-
-    // Look for a connected client.
-    if (telnetServer.hasClient())
-    {
-
-        if (telnetClient && telnetClient.connected())
-        {
-
-            // Verify if the connecting IP is same as the previous connection.
 
-            WiFiClient newClient;
-            newClient = telnetServer.available();
-            String ip = newClient.remoteIP().toString();
-
-            if (ip == telnetClient.remoteIP().toString())
-            {
-                // Reconnect.
-                telnetClient.stop();
-                telnetClient = newClient;
-            }
-            else
-            {
-                // Disconnect. Do not allow more than one connection.
-                newClient.stop();
-
-                return;
-            }
-        }
-        else
+        // Debug level is profiler. Set the level before.
+        if (session.options.debugLevel == PROFILER && millis() > session.options.levelProfilerDisable)
         {
-            // New TCP client.
-            telnetClient = telnetServer.available();
+            session.options.debugLevel = session.options.levelBeforeProfiler;
+            ResponsePrint(*this, session).println("* Debug level profile is now inactive.");
         }
-        if (!telnetClient)
+
+#ifdef ALPHA_VERSION
+        // Automatically change to profiler level if time between handles is greater than n millis.
+        if (m_autoLevelProfiler > 0 && session.options.debugLevel != PROFILER && diff >= m_autoLevelProfiler)
         {
-            // There's no client connected yet so just return.
-            return;
+            session.options.levelBeforeProfiler = session.options.debugLevel;
+            session.options.debugLevel = PROFILER;
+            session.options.levelProfilerDisable = 1000; // Disable it at 1 second.
+            ResponsePrint(*this, session).printf("* Debug level profile is now active - time between handles: %u\r\n",
+                                                 diff);
         }
-
-        // Set the client.  setNoDelay() offers faster execution.
-        telnetClient.setNoDelay(true);
-
-        // Clear input buffer to prevent strange characters being written to output.
-        telnetClient.flush();
-
-        // Clear the buffer.
-        m_bufferPrint = "";
-
-        // Mark now as the last time of activity.
-        m_lastTimeCommand = millis();
-
-        // Clear the current command.
-        m_command = "";
-
-        // And clear the last command.
-        m_lastCommand = "";
-
-        // Set the last print time to now.
-        m_lastTimePrint = millis();
-
-        // Show the initial help message.
-        showHelp();
-
-#ifdef CLIENT_BUFFERING
-        // Client buffering - send data in intervals to avoid delays or if it is too big.
-        m_bufferSend = "";
-        m_sizeBufferSend = 0;
-        m_lastTimeSend = millis();
 #endif
 
-        // Read the input stream.
-        delay(100);
-        while (telnetClient.available()) {
-            telnetClient.read();
-        }
-    }
-
-    // Is a client connected? Let's check to reduce overhead if there's no active connection.
-    m_connected = (telnetClient && telnetClient.connected());
-
-    // Get the user's command from telnet.
-    if (m_connected)
-    {
+        // Get the user's command from telnet.
         char last = ' '; // To avoid processing the "\r\n" twice.
 
-        while (telnetClient.available()) {
+        while (session.isConnected && session.client.available()) {
 
             // Get a single character.
-            char character = telnetClient.read();
+            char character = session.client.read();
 
             // Check for a newline (CR or LF) just once time.
             if (isCRLF(character) == true)
@@ -192,59 +124,203 @@ void MiPDebug::handle()
                 if (isCRLF(last) == false)
                 {
                     // Process the command.
-                    if (m_command.length() > 0)
+                    if (session.commandLength > 0)
                     {
-                        // Store the last command.
-                        m_lastCommand =m_command;
-                        processCommand();
+                        session.command[session.commandLength] = '\0';
+                        processCommand(session);
                     }
                 }
 
                 // Initialize it for next command.
-                m_command = "";
+                session.commandLength = 0;
 
             }
-            else if (isPrintable(character))
+            else if (isPrintable(character) && session.commandLength < MAX_COMMAND_LENGTH)
             {
-                // Concatenate the characted to the command string.
-                m_command.concat(character);
+                // Append the character to the command. Anything past MAX_COMMAND_LENGTH is dropped.
+                session.command[session.commandLength++] = character;
             }
 
             // Set this character as the last received character.
             last = character;
         }
-
-#ifdef CLIENT_BUFFERING
-        // Client buffering - send data in intervals to avoid delays or if its is too big
-
-        if ((millis() - m_lastTimeSend) >= DELAY_TO_SEND || m_sizeBufferSend >= MAX_SIZE_SEND)
+        if (!session.isConnected)
         {
-            telnetClient.print(m_bufferSend);
-            m_bufferSend = "";
-            m_sizeBufferSend = 0;
-            m_lastTimeSend = millis();
+            continue;
         }
-#endif
+
+        // Send the queued output once a full segment is waiting or its oldest line has waited long enough.
+        sendOutput(session, false);
 
         if( MAX_TIME_INACTIVE > 0)
         {
           // Inactivity - close connection if no commands have been received from the user in a
           // defined interval.
-          if ((millis() - m_lastTimeCommand) > MAX_TIME_INACTIVE)
+          if ((millis() - session.lastTimeCommand) > MAX_TIME_INACTIVE)
           {
-              telnetClient.println("* Closing session due to inactivity.");
-              telnetClient.stop();
-              m_connected = false;
+              closeSession(session, "* Closing session due to inactivity.");
           }
         }
     }
+
+    // Write out the flash log a page at a time.
+    if (m_pFlashLog)
+    {
+        m_pFlashLog->handle();
+    }
+
+    // Send the waiting binary records once the oldest has waited long enough.
+    if (m_udpLength > 0 && (millis() - m_udpTime) >= DELAY_TO_SEND)
+    {
+        sendUdp();
+    }
+
+    updateActiveLevel();
+}
+
+// This is an internal protected method which hands a newly connected telnet client a free session.
+void MiPDebug::acceptClient()
+{
+    WiFiClient newClient = telnetServer.available();
+    Session*   pSession = NULL;
+
+    for (uint8_t i = 0 ; i < MAX_TELNET_CLIENTS && pSession == NULL ; i++)
+    {
+        if (!m_sessions[i].isConnected)
+        {
+            pSession = &m_sessions[i];
+        }
+    }
+
+    // With every session taken, a client which connects again from the same address most likely lost its earlier
+    // connection so let it take over that session.
+    for (uint8_t i = 0 ; i < MAX_TELNET_CLIENTS && pSession == NULL ; i++)
+    {
+        if (m_sessions[i].client.remoteIP() == newClient.remoteIP())
+        {
+            pSession = &m_sessions[i];
+            pSession->client.stop();
+        }
+    }
+
+    if (pSession == NULL)
+    {
+        // Disconnect. Do not allow more than MAX_TELNET_CLIENTS connections.
+        newClient.println("* Too many telnet clients are already connected.");
+        newClient.stop();
+        return;
+    }
+
+    Session& session = *pSession;
+    session.client = newClient;
+    session.isConnected = true;
+
+    // Set the client.  setNoDelay() offers faster execution and without sync mode write() returns once the data is
+    // queued in lwIP rather than waiting for the client to acknowledge it.
+    session.client.setNoDelay(true);
+    session.client.setSync(false);
+
+    // Clear input buffer to prevent strange characters being written to output.
+    session.client.flush();
+
+    // Start with the options set by the sketch.
+    session.options = m_defaultOptions;
+
+    // Mark now as the last time of activity.
+    session.lastTimeCommand = millis();
+
+    // Clear the current command.
+    session.commandLength = 0;
+
+    // Start with an empty output ring.
+    session.sendHead = 0;
+    session.sendCount = 0;
+    session.droppedLines = 0;
+    session.isDroppingLine = false;
+
+    // Show the initial help message.
+    {
+        ResponsePrint response(*this, session);
+        showHelp(response);
+    }
+
+    // Read the input stream.
+    delay(100);
+    while (session.client.available()) {
+        session.client.read();
+    }
+
+    updateActiveLevel();
+}
+
+// This is an internal protected method which tells a telnet client why it is being disconnected and then closes its
+// session.
+void MiPDebug::closeSession(Session& session, const char* pReason)
+{
+    sendOutput(session, true);
+    session.client.println(pReason);
+    session.client.stop();
+    session.isConnected = false;
+}
+
+// Total number of lines dropped because a telnet client wasn't keeping up with the output.
+uint32_t MiPDebug::droppedLines()
+{
+    return m_droppedLines;
+}
+
+// This is an internal protected method which finds the lowest debug level shown by any output so that isLevelActive()
+// only needs a single comparison. The lowest levels shown as text and as binary records are kept too so that messages
+// are only formatted or encoded when an output needs them.
+void MiPDebug::updateActiveLevel()
+{
+    uint8_t textLevel = m_serialEnabled ? m_serialOptions.debugLevel : NONE;
+    uint8_t binaryLevel = m_udpPort != 0 ? m_udpOptions.debugLevel : NONE;
+
+    if (m_pFlashLog && m_flashOptions.debugLevel < textLevel)
+    {
+        textLevel = m_flashOptions.debugLevel;
+    }
+
+    for (uint8_t i = 0 ; i < MAX_TELNET_CLIENTS ; i++)
+    {
+        const Options& options = m_sessions[i].options;
+
+        if (!m_sessions[i].isConnected)
+        {
+            continue;
+        }
+        if (options.isBinary && options.debugLevel < binaryLevel)
+        {
+            binaryLevel = options.debugLevel;
+        }
+        else if (!options.isBinary && options.debugLevel < textLevel)
+        {
+            textLevel = options.debugLevel;
+        }
+    }
+    m_textLevel = textLevel;
+    m_binaryLevel = binaryLevel;
+    m_activeLevel = textLevel < binaryLevel ? textLevel : binaryLevel;
+}
+
+// Number of telnet clients currently connected.
+uint8_t MiPDebug::connectedClients()
+{
+    uint8_t count = 0;
+
+    for (uint8_t i = 0 ; i < MAX_TELNET_CLIENTS ; i++)
+    {
+        count += m_sessions[i].isConnected;
+    }
+    return count;
 }
 
 // If the option is enabled, send debug output to serial too.
 void MiPDebug::setSerialEnabled(bool enable)
 {
     m_serialEnabled = enable;
-    m_showColors = false;
+    updateActiveLevel();
 }
 
 // Allow the telnet client to reset the D1 mini Pack.
@@ -256,14 +332,26 @@ void MiPDebug::setResetCmdEnabled(bool enable)
 // Show time in milliseconds.
 void MiPDebug::showTime(bool show)
 {
-    m_showTime = show;
+    m_serialOptions.showTime = show;
+    m_defaultOptions.showTime = show;
+    for (uint8_t i = 0 ; i < MAX_TELNET_CLIENTS ; i++)
+    {
+        m_sessions[i].options.showTime = show;
+    }
 }
 
 // Show profiler - The time in milliseconds between debug messages.
 void MiPDebug::showProfiler(bool show, uint32_t minTime)
 {
-    m_showProfiler = show;
-    m_minTimeShowProfiler = minTime;
+    m_serialOptions.showProfiler = show;
+    m_serialOptions.minTimeShowProfiler = minTime;
+    m_defaultOptions.showProfiler = show;
+    m_defaultOptions.minTimeShowProfiler = minTime;
+    for (uint8_t i = 0 ; i < MAX_TELNET_CLIENTS ; i++)
+    {
+        m_sessions[i].options.showProfiler = show;
+        m_sessions[i].options.minTimeShowProfiler = minTime;
+    }
 }
 
 #ifdef ALPHA_VERSION
@@ -278,31 +366,29 @@ void MiPDebug::autoProfilerLevel(uint32_t millisElapsed)
 // Show the debug level.
 void MiPDebug::showDebugLevel(bool show)
 {
-    m_showDebugLevel = show;
+    m_serialOptions.showDebugLevel = show;
+    m_defaultOptions.showDebugLevel = show;
+    for (uint8_t i = 0 ; i < MAX_TELNET_CLIENTS ; i++)
+    {
+        m_sessions[i].options.showDebugLevel = show;
+    }
 }
 
-// Show colors.
-
+// Show colors. Colors are never sent to Serial1.
 void MiPDebug::showColors(bool show)
 {
-    if (m_serialEnabled == false)
-    {
-        m_showColors = show;
-    }
-    else
+    m_defaultOptions.showColors = show;
+    for (uint8_t i = 0 ; i < MAX_TELNET_CLIENTS ; i++)
     {
-        m_showColors = false; // Disable this for Serial1.
+        m_sessions[i].options.showColors = show;
     }
 }
 
 // Is a particular debug level active?  Useful for printing messages at a desired level.
 bool MiPDebug::isActive(uint8_t debugLevel)
 {
-    // Active -> Debug level ok and
-    //           telnet connected or
-    //           Serial enabled.
-    bool ret = (debugLevel >= m_clientDebugLevel
-            && (m_connected || m_serialEnabled));
+    // Active -> Debug level ok for Serial1 or at least one connected telnet client.
+    bool ret = (debugLevel >= m_activeLevel);
 
     if (ret)
     {
@@ -324,602 +410,1654 @@ void MiPDebug::setCallBackProjectCmds(void (*callback)())
     m_callbackProjectCmds = callback;
 }
 
-// Print the user's debug message.
+// Print the user's debug message. Runs of characters are copied into the print buffer in bulk and the buffer is sent
+// each time a line is completed or the buffer fills up.
 size_t MiPDebug::write(const uint8_t *buffer, size_t size)
 {
-    for(size_t i = 0; i < size; i++) {
-        write((uint8_t)buffer[i]);
-    }
-
-    return size;
-}
-
-// Print the user's debug message.
-size_t MiPDebug::write(uint8_t character)
-{
-    uint32_t elapsed = 0;
-    size_t ret = 0;
+    size_t remaining = size;
 
-    // Was a newline written earlier?
-    if (m_newLine)
+    // Output which doesn't come from a format string is sent to the binary outputs as text records.
+    if (!m_isRecorded && m_lastDebugLevel >= m_binaryLevel)
     {
-        String show = "";
-
-        // Show debug level if the option is turned on.
-        if (m_showDebugLevel)
+        for (size_t offset = 0 ; offset < size ; offset += BINARY_MAX_ARGS)
         {
-            if (m_showColors == false)
-            {
-                switch (m_lastDebugLevel)
-                {
-                    case PROFILER:
-                        show = "P";
-                        break;
-                    case VERBOSE:
-                        show = "v";
-                        break;
-                    case DEBUG:
-                        show = "d";
-                        break;
-                    case INFO:
-                        show = "i";
-                        break;
-                    case WARNING:
-                        show = "w";
-                        break;
-                    case ERROR:
-                        show = "e";
-                        break;
-                }
-            }
-            else
-            {
-                // Show colors if the option is turned on.
-                switch (m_lastDebugLevel)
-                {
-                    case PROFILER:
-                        show = "P";
-                        break;
-                    case VERBOSE:
-                        show = "v";
-                        break;
-                    case DEBUG:
-                        show = COLOR_BACKGROUND_GREEN;
-                        show.concat("d");
-                        break;
-                    case INFO:
-                        show = COLOR_BACKGROUND_WHITE;
-                        show.concat("i");
-                        break;
-                    case WARNING:
-                        show = COLOR_BACKGROUND_YELLOW;
-                        show.concat("w");
-                        break;
-                    case ERROR:
-                        show = COLOR_BACKGROUND_RED;
-                        show.concat("e");
-                        break;
-                    }
-                if (show.length() > 1)
-                {
-                    show.concat(COLOR_RESET);
-                }
-            }
+            size_t count = size - offset;
+            sendRecord(BINARY_TEXT_ID, buffer + offset, count < BINARY_MAX_ARGS ? count : BINARY_MAX_ARGS);
         }
+    }
+    if (m_newLine && m_lastDebugLevel < m_textLevel)
+    {
+        // No text output shows this line.
+        return size;
+    }
 
-        // Show time in milliseconds if the option is set.
-        if (m_showTime)
+    while (remaining > 0)
+    {
+        // Was a newline written earlier?
+        if (m_newLine)
         {
-            if (show != "")
-            {
-                show.concat(" ");
-            }
-            show.concat("t:");
-            show.concat(millis());
-            show.concat("ms");
+            beginLine();
         }
 
-        // Show profiler (time between messages) if the option is set.
-        if (m_showProfiler)
+        // Copy everything up to the next newline, or as much of it as fits.
+        const uint8_t* pNewLine = (const uint8_t*)memchr(buffer, '\n', remaining);
+        size_t count = pNewLine ? (size_t)(pNewLine - buffer) : remaining;
+        if (count > (size_t)(BUFFER_PRINT - m_bufferLength))
         {
-            elapsed = (millis() - m_lastTimePrint);
-            bool resetColors = false;
-            if (show != "")
-            {
-                show.concat(" ");
-            }
-            if (m_showColors)
-            {
-                if (elapsed < 250)
-                {
-                    ; // No color for this.
-                }
-                else if (elapsed < 1000)
-                {
-                    show.concat(COLOR_BACKGROUND_CYAN);
-                    resetColors = true;
-                }
-                else if (elapsed < 3000)
-                {
-                    show.concat(COLOR_BACKGROUND_YELLOW);
-                    resetColors = true;
-                }
-                else if (elapsed < 5000)
-                {
-                    show.concat(COLOR_BACKGROUND_MAGENTA);
-                    resetColors = true;
-                }
-                else
-                {
-                    show.concat(COLOR_BACKGROUND_RED);
-                    resetColors = true;
-                }
-            }
-            show.concat("p:^");
-            show.concat(formatNumber(elapsed, 4));
-            show.concat("ms");
-            if (resetColors)
-            {
-                show.concat(COLOR_RESET);
-            }
-            m_lastTimePrint = millis();
+            count = BUFFER_PRINT - m_bufferLength;
         }
+        appendToBuffer((const char*)buffer, count);
+        buffer += count;
+        remaining -= count;
 
-        if (show != "")
+        if (remaining > 0 && *buffer == '\n')
         {
-            String send = "(";
-            send.concat(show);
-            send.concat(") ");
+            // For Windows clients.
+            appendToBuffer("\r\n", 2);
+            buffer++;
+            remaining--;
 
-            // Copy to the telnet buffer.
-            if (m_connected || m_serialEnabled)
-            {
-                m_bufferPrint = send;
-            }
+            m_newLine = true;
+            sendBuffer();
+        }
+        else if (m_bufferLength >= BUFFER_PRINT)
+        {
+            sendBuffer();
         }
-        m_newLine = false;
     }
 
-    bool doPrint = false;
+    return size;
+}
 
-    // Is the current character a newline?
-    if (character == '\n')
-    {
-        // For Windows clients.
-        m_bufferPrint.concat("\r");
+// Print the user's debug message.
+size_t MiPDebug::write(uint8_t character)
+{
+    return write(&character, 1);
+}
 
-        m_newLine = true;
-        doPrint = true;
+// Print a formatted debug message. Unlike Print::printf(), this never allocates from the heap.
+size_t MiPDebug::printf(const char* pFormat, ...)
+{
+    va_list args;
 
-    // If the output buffer is full then set the bool to print.
-    }
-    else if (m_bufferPrint.length() == BUFFER_PRINT)
-    {
-        doPrint = true;
-    }
+    // The ESP8266 can read a format string in RAM the same way as one in flash.
+    va_start(args, pFormat);
+    size_t length = sendMessage(0, pFormat, args);
+    va_end(args);
 
-    // Write to the telnet buffer.
-    m_bufferPrint.concat((char) character);
+    return length;
+}
 
-    // Send the buffered characters.
-    if (doPrint)
-    {
-        bool noPrint = false;
+// Print a debug message formatted with a format string stored in flash.
+size_t MiPDebug::printf_P(PGM_P pFormat, ...)
+{
+    va_list args;
 
-        if (m_showProfiler && elapsed < m_minTimeShowProfiler)
-        {
-            noPrint = true;
+    va_start(args, pFormat);
+    size_t length = sendMessage(0, pFormat, args);
+    va_end(args);
 
-        // Check the filter before printing output.
-        }
-        else if (m_filterActive)
-        {
-            String aux = m_bufferPrint;
-            aux.toLowerCase();
+    return length;
+}
 
-            // No match found so don't print.
-            if (aux.indexOf(m_filter) == -1)
-            {
-                noPrint = true;
-            }
-        }
+// Print a debug message at the specified level.
+size_t MiPDebug::debugf_P(uint8_t debugLevel, PGM_P pFormat, ...)
+{
+    va_list args;
 
-        if (noPrint == false)
-        {
-            // Send to telnet buffer.
-            if (m_connected)
-            {
-#ifndef CLIENT_BUFFERING
-                telnetClient.print(m_bufferPrint);
-#else
-                uint8_t size = m_bufferPrint.length();
+    m_lastDebugLevel = debugLevel;
 
-                // Is the buffer too big?
-                if ((m_sizeBufferSend + size) >= MAX_SIZE_SEND)
-                {
-                    // Send it.
-                    telnetClient.print(m_bufferSend);
-                    m_bufferSend = "";
-                    m_sizeBufferSend = 0;
-                    m_lastTimeSend = millis();
-                }
+    va_start(args, pFormat);
+    size_t length = sendMessage(0, pFormat, args);
+    va_end(args);
 
-                // Add to send buffer.
-                m_bufferSend.concat(m_bufferPrint);
-                m_sizeBufferSend += size;
+    return length;
+}
 
-                // Client buffering - send data in intervals to avoid delays or if it is too big.
-                if ((millis() - m_lastTimeSend) >= DELAY_TO_SEND)
-                {
-                    telnetClient.print(m_bufferSend);
-                    m_bufferSend = "";
-                    m_sizeBufferSend = 0;
-                    m_lastTimeSend = millis();
-                }
-#endif
-            }
+// Print a debug message at the specified level. This is what the mDebug*() macros call once isLevelActive() has
+// found that the level is being shown.
+size_t MiPDebug::debugf_P(uint8_t debugLevel, uint32_t id, PGM_P pFormat, ...)
+{
+    va_list args;
 
-            // Echo to serial without buffering.
-            if (m_serialEnabled)
-            {
-                Serial1.print(m_bufferPrint);
-            }
-        }
+    m_lastDebugLevel = debugLevel;
 
-        // Empty the buffer.
-        ret = m_bufferPrint.length();
-        m_bufferPrint = "";
-    }
+    va_start(args, pFormat);
+    size_t length = sendMessage(id, pFormat, args);
+    va_end(args);
 
-    return ret;
+    return length;
 }
 
-// Expand "CR/LF" characters to "\\r" and "\\n".
-String MiPDebug::expand(String string)
+// This is an internal protected method which sends a formatted message at the last debug level. The arguments are
+// encoded into a binary record for the binary outputs and the message is only formatted as text if a text output
+// shows it. An id of 0 means that the caller didn't have the format's hash, so it is only worked out here when a
+// binary output is going to use it.
+size_t MiPDebug::sendMessage(uint32_t id, PGM_P pFormat, va_list args)
 {
-    string.replace("\r", "\\r");
-    string.replace("\n", "\\n");
-
-    return string;
-}
-
-// This is an internal protected method that displays the help dialog.
-void MiPDebug::showHelp()
-{
-    String help = "";
-
-    help.concat("*** Welcome to MiP's debug terminal.  This is version ");
-    help.concat(VERSION);
-    help.concat(".\r\n");
-    help.concat("* Hostname: ");
-    help.concat(m_hostname);
-    help.concat("\r\n");
-    help.concat("* IP: ");
-    help.concat(WiFi.localIP().toString());
-    help.concat("\r\n");
-    help.concat("* MAC address: ");
-    help.concat(WiFi.macAddress());
-    help.concat("\r\n");
-    help.concat("* Free heap RAM: ");
-    help.concat(ESP.getFreeHeap());
-    help.concat("\r\n");
-    help.concat("******************************************************\r\n");
-    help.concat("* Commands:\r\n");
-    help.concat("    ? or help -> display these help commands\r\n");
-    help.concat("    q -> quit (close this connection)\r\n");
-    help.concat("    m -> display available memory\r\n");
-    help.concat("    v -> set debug level to verbose\r\n");
-    help.concat("    d -> set debug level to debug\r\n");
-    help.concat("    i -> set debug level to info\r\n");
-    help.concat("    w -> set debug level to warning\r\n");
-    help.concat("    e -> set debug level to errors\r\n");
-    help.concat("    l -> show debug level\r\n");
-    help.concat("    t -> show time in milliseconds\r\n");
-    help.concat("    profiler:\r\n");
-    help.concat("      p      -> show time between actual and last message (in millis)\r\n");
-    help.concat("      p min  -> show only if time is this minimal\r\n");
-    help.concat("      P time -> set debug level to profiler\r\n");
-#ifdef ALPHA_VERSION
-    help.concat("      A time -> set auto debug level to profiler\r\n");
-#endif
-    help.concat("    c -> show colors\r\n");
-    help.concat("    filter:\r\n");
-    help.concat("          filter <string> -> show only debug messages containing this value\r\n");
-    help.concat("          nofilter        -> disable the filter\r\n");
-    help.concat("    cpu80  -> Set the ESP8266 CPU to 80 MHz\r\n");
-    help.concat("    cpu160 -> Set the ESP8266 CPU to 160 MHz\r\n");
-    if (m_resetCommandEnabled)
+    if (m_lastDebugLevel >= m_binaryLevel)
     {
-        help.concat("    reset -> reset the D1 mini Pack\r\n");
-    }
+        uint8_t encoded[BINARY_MAX_ARGS];
+        va_list argsCopy;
 
-    if (m_helpProjectCmds != "" && m_callbackProjectCmds)
+        if (id == 0)
+        {
+            id = hashFormat(pFormat);
+        }
+        va_copy(argsCopy, args);
+        sendRecord(id, encoded, encodeArgs(encoded, sizeof(encoded), pFormat, argsCopy));
+        va_end(argsCopy);
+    }
+    if (m_newLine && m_lastDebugLevel < m_textLevel)
     {
-        help.concat("\r\n");
-        help.concat("    * Project commands:\r\n");
-        String show = "\r\n";
-        show.concat(m_helpProjectCmds);
-
-        // Indent this.
-        show.replace("\n", "\n    ");
-        help.concat(show);
+        return 0;
     }
 
-    help.concat("\r\n");
-    help.concat(
-            "* Please type the command and press enter to execute.(? or h for this help)\r\n");
-    help.concat("***\r\n");
+    char message[BUFFER_PRINT + 1];
+    int  length = vsnprintf_P(message, sizeof(message), pFormat, args);
 
-    telnetClient.print(help);
-}
+    m_isRecorded = true;
+    length = write((const uint8_t*)message, length < (int)sizeof(message) ? length : sizeof(message) - 1);
+    m_isRecorded = false;
 
-// This is an internal protected method to get the last command received.
-String MiPDebug::getLastCommand()
-{
-    return m_lastCommand;
+    return length;
 }
 
-// This is an internal protected method to clear the last command received.
-
-void MiPDebug::clearLastCommand()
+// This is an internal protected method which starts a new line in the print buffer. The prefix with the debug level,
+// time and profiler information is added separately for each output when the line is sent.
+void MiPDebug::beginLine()
 {
-    m_lastCommand = "";
+    m_newLine = false;
+    m_isLineContinued = false;
+    m_bufferLength = 0;
+    m_lineLevel = m_lastDebugLevel;
+    m_lineTime = millis();
+    m_lineElapsed = m_lineTime - m_lastTimePrint;
+    m_lastTimePrint = m_lineTime;
 }
 
-// This is an internal protected method to process the user's command received from telnet.
-void MiPDebug::processCommand()
+// This is an internal protected method which appends characters to the print buffer. Anything which doesn't fit is
+// dropped although callers are expected to send the buffer before it fills up.
+void MiPDebug::appendToBuffer(const char* pText, size_t length)
 {
-    telnetClient.print("* Debug: Command received: ");
-    telnetClient.println(m_command);
+    size_t space = sizeof(m_bufferPrint) - BUFFER_PREFIX - m_bufferLength;
 
-    String options = "";
-    uint8_t pos = m_command.indexOf(" ");
-    if (pos > 0)
+    if (length > space)
     {
-        options = m_command.substring(pos + 1);
+        length = space;
     }
+    memcpy(&m_bufferPrint[BUFFER_PREFIX + m_bufferLength], pText, length);
+    m_bufferLength += length;
+}
 
-    // Set time of last command received.
-    m_lastTimeCommand = millis();
+// This is an internal protected method which formats the prefix that an output with these options shows at the start
+// of each line into the room left for it just in front of the line in the print buffer. Returns the length of the
+// prefix, which is 0 if no prefix is shown.
+size_t MiPDebug::formatPrefix(const Options& options)
+{
+    char   pPrefix[BUFFER_PREFIX];
+    size_t prefixSize = sizeof(pPrefix);
+    size_t length = 0;
 
-    // Process the command.
-    if (m_command == "h" || m_command == "?" || m_command == "help")
-    {
-        showHelp();
-    }
-    else if (m_command == "q")
+    // Appends to the prefix, dropping anything which doesn't fit.
+    auto append = [&](const char* pText)
     {
-        // Quit.
-        telnetClient.println("* Closing telnet connection ...");
+        size_t textLength = strlen(pText);
+        if (textLength > prefixSize - length)
+        {
+            textLength = prefixSize - length;
+        }
+        memcpy(&pPrefix[length], pText, textLength);
+        length += textLength;
+    };
 
-        telnetClient.stop();
+    append("(");
 
-    }
-    else if (m_command == "m")
+    // Show debug level if the option is turned on.
+    if (options.showDebugLevel && m_lineLevel <= ERROR)
     {
-        telnetClient.print("* Free heap RAM: ");
-        telnetClient.println(ESP.getFreeHeap());
-    }
-    else if (m_command == "cpu80")
-    {
-        // Change ESP8266 CPU frequency to 80 MHz.
-        system_update_cpu_freq(80);
-        telnetClient.println("ESP8266 CPU changed to 80 MHz");
+        static const char* const levelNames[] = { "P", "v", "d", "i", "w", "e" };
+        static const char* const levelColors[] =
+        {
+            NULL, NULL, COLOR_BACKGROUND_GREEN, COLOR_BACKGROUND_WHITE, COLOR_BACKGROUND_YELLOW, COLOR_BACKGROUND_RED
+        };
 
+        // Show colors if the option is turned on.
+        const char* pColor = options.showColors ? levelColors[m_lineLevel] : NULL;
+        if (pColor)
+        {
+            append(pColor);
+        }
+        append(levelNames[m_lineLevel]);
+        if (pColor)
+        {
+            append(COLOR_RESET);
+        }
     }
-    else if (m_command == "cpu160")
+
+    // Show time in milliseconds if the option is set.
+    if (options.showTime)
     {
-        // Change ESP8266 CPU frequency to 160 MHz.
-        system_update_cpu_freq(160);
-        telnetClient.println("ESP8266 CPU changed to 160 MHz");
+        char number[MIP_FORMAT_NUMBER_SIZE];
+
+        if (length > 1)
+        {
+            append(" ");
+        }
+        mipFormatUnsigned(number, sizeof(number), m_lineTime);
+        append("t:");
+        append(number);
+        append("ms");
     }
-    else if (m_command == "v")
+
+    // Show profiler (time between messages) if the option is set.
+    if (options.showProfiler)
     {
-        // Set the debug level.
-        m_clientDebugLevel = VERBOSE;
+        const char* pColor = NULL;
+        char        number[MIP_FORMAT_NUMBER_SIZE];
 
-        telnetClient.println("* Debug level set to Verbose");
+        if (length > 1)
+        {
+            append(" ");
+        }
+        if (options.showColors)
+        {
+            if (m_lineElapsed < 250)
+            {
+                ; // No color for this.
+            }
+            else if (m_lineElapsed < 1000)
+            {
+                pColor = COLOR_BACKGROUND_CYAN;
+            }
+            else if (m_lineElapsed < 3000)
+            {
+                pColor = COLOR_BACKGROUND_YELLOW;
+            }
+            else if (m_lineElapsed < 5000)
+            {
+                pColor = COLOR_BACKGROUND_MAGENTA;
+            }
+            else
+            {
+                pColor = COLOR_BACKGROUND_RED;
+            }
+        }
+        if (pColor)
+        {
+            append(pColor);
+        }
+        mipFormatUnsigned(number, sizeof(number), m_lineElapsed, 4, '0');
+        append("p:^");
+        append(number);
+        append("ms");
+        if (pColor)
+        {
+            append(COLOR_RESET);
+        }
     }
-    else if (m_command == "d")
+
+    // Only keep the prefix if something was shown.
+    if (length <= 1)
     {
-        // Set the debug level.
-        m_clientDebugLevel = DEBUG;
+        return 0;
+    }
+    append(") ");
+    memcpy(&m_bufferPrint[BUFFER_PREFIX - length], pPrefix, length);
+
+    return length;
+}
 
-        telnetClient.println("* Debug level set to Debug");
+// This is an internal protected method which checks whether an output with these options shows the line in the print
+// buffer.
+bool MiPDebug::isLineShown(const Options& options)
+{
+    if (m_lineLevel < options.debugLevel)
+    {
+        return false;
+    }
+    if (options.showProfiler && m_lineElapsed < options.minTimeShowProfiler)
+    {
+        return false;
     }
-    else if (m_command == "i")
+
+    // Check the filter before printing output.
+    return !options.filter.isActive() || options.filter.matches(&m_bufferPrint[BUFFER_PREFIX], m_bufferLength);
+}
+
+// This is an internal protected method which sends the print buffer to Serial1 and every connected telnet client
+// which shows it and then empties it. The line is only formatted once, only the prefix differs between outputs.
+void MiPDebug::sendBuffer()
+{
+    const uint8_t* pLine;
+    size_t         lineLength;
+
+    // Echo to serial without buffering.
+    if (m_serialEnabled && isLineShown(m_serialOptions))
     {
-        // Set the debug level.
-        m_clientDebugLevel = INFO;
+        lineLength = m_bufferLength + (m_isLineContinued ? 0 : formatPrefix(m_serialOptions));
+        pLine = (const uint8_t*)&m_bufferPrint[BUFFER_PREFIX + m_bufferLength - lineLength];
+        Serial1.write(pLine, lineLength);
+    }
 
-        telnetClient.println("* Debug level set to Info");
+    // Queue for the flash log, which only writes to flash later from handle().
+    if (m_pFlashLog && isLineShown(m_flashOptions))
+    {
+        lineLength = m_bufferLength + (m_isLineContinued ? 0 : formatPrefix(m_flashOptions));
+        pLine = (const uint8_t*)&m_bufferPrint[BUFFER_PREFIX + m_bufferLength - lineLength];
+        m_pFlashLog->write((const char*)pLine, lineLength);
     }
-    else if (m_command == "w")
+
+    for (uint8_t i = 0 ; i < MAX_TELNET_CLIENTS ; i++)
     {
-        // Set the debug level.
-        m_clientDebugLevel = WARNING;
+        Session& session = m_sessions[i];
+
+        if (!session.isConnected || session.options.isBinary || !isLineShown(session.options))
+        {
+            continue;
+        }
 
-        telnetClient.println("* Debug level set to Warning");
+        // The prefix is formatted in front of the line so that they are queued together.
+        lineLength = m_bufferLength + (m_isLineContinued ? 0 : formatPrefix(session.options));
+        pLine = (const uint8_t*)&m_bufferPrint[BUFFER_PREFIX + m_bufferLength - lineLength];
+
+        // Queue for the telnet client.
+        queueOutput(session, (const char*)pLine, lineLength, m_isLineContinued);
+        sendOutput(session, false);
     }
-    else if (m_command == "e")
+
+    // Empty the buffer. Anything which follows without a newline continues the same line.
+    m_bufferLength = 0;
+    m_isLineContinued = !m_newLine;
+}
+
+// This is an internal protected method which queues output for a telnet client. A line which doesn't fit in the ring
+// is dropped whole, along with any pieces of it which follow, and the client is told how many lines were dropped
+// before the next line which does fit.
+void MiPDebug::queueOutput(Session& session, const char* pData, size_t length, bool isContinued)
+{
+    char   notice[48];
+    size_t noticeLength = 0;
+
+    if (session.isDroppingLine && isContinued)
     {
-        // Set the debug level.
-        m_clientDebugLevel = ERROR;
+        // The start of this line was dropped so drop the rest of it too.
+        return;
+    }
+    session.isDroppingLine = false;
 
-        telnetClient.println("* Debug level set to Error");
+    if (session.droppedLines > 0)
+    {
+        noticeLength = snprintf(notice, sizeof(notice), "* Debug: %u lines dropped\r\n", session.droppedLines);
     }
-    else if (m_command == "l")
+    if (noticeLength + length > (size_t)(BUFFER_SEND - session.sendCount))
     {
-        // Show the debug level.
-        m_showDebugLevel = !m_showDebugLevel;
+        session.droppedLines++;
+        m_droppedLines++;
+        session.isDroppingLine = true;
+        return;
+    }
 
-        telnetClient.printf("* Show debug level: %s\r\n",
-                m_showDebugLevel ? "on" : "off");
+    if (session.sendCount == 0)
+    {
+        session.sendTime = millis();
     }
-    else if (m_command == "t")
+    appendToRing(session, notice, noticeLength);
+    appendToRing(session, pData, length);
+    session.droppedLines = 0;
+}
+
+// This is an internal protected method which copies data into a telnet client's output ring. The caller has already
+// checked that it fits.
+void MiPDebug::appendToRing(Session& session, const char* pData, size_t length)
+{
+    while (length > 0)
     {
-        // Show the time.
-        m_showTime = !m_showTime;
+        size_t count = BUFFER_SEND - session.sendHead;
+        if (count > length)
+        {
+            count = length;
+        }
+        memcpy(&session.bufferSend[session.sendHead], pData, count);
+        session.sendHead = (session.sendHead + count) % BUFFER_SEND;
+        session.sendCount += count;
+        pData += count;
+        length -= count;
+    }
+}
+
+// This is an internal protected method which sends as much of a telnet client's queued output as its TCP window
+// accepts without blocking. Unless forced, only full segments are sent until the oldest queued line has waited
+// DELAY_TO_SEND milliseconds.
+void MiPDebug::sendOutput(Session& session, bool isForced)
+{
+    bool isDue = isForced || (millis() - session.sendTime) >= DELAY_TO_SEND;
+
+    while (session.sendCount > 0 && (isDue || session.sendCount >= MAX_SIZE_SEND))
+    {
+        size_t tail = (session.sendHead + BUFFER_SEND - session.sendCount) % BUFFER_SEND;
+        size_t count = session.sendCount;
+
+        // Don't run past the end of the ring, a segment or the space left in the client's TCP window.
+        if (count > BUFFER_SEND - tail)
+        {
+            count = BUFFER_SEND - tail;
+        }
+        if (count > MAX_SIZE_SEND)
+        {
+            count = MAX_SIZE_SEND;
+        }
+        int space = session.client.availableForWrite();
+        if (space <= 0)
+        {
+            break;
+        }
+        if (count > (size_t)space)
+        {
+            count = space;
+        }
 
-        telnetClient.printf("* Show time: %s\r\n", m_showTime ? "on" : "off");
+        size_t written = session.client.write((const uint8_t*)&session.bufferSend[tail], count);
+        session.sendCount -= written;
+        if (written < count)
+        {
+            break;
+        }
     }
-    else if (m_command == "p")
+}
+
+
+// This is an internal protected method which hashes a format string, in RAM or flash, the same way as mipDebugHash().
+uint32_t MiPDebug::hashFormat(PGM_P pFormat)
+{
+    uint32_t hash = 2166136261UL;
+    uint8_t  character;
+
+    while ((character = pgm_read_byte(pFormat++)) != '\0')
     {
-        // Show the profiler status.
-        m_showProfiler = !m_showProfiler;
-        m_minTimeShowProfiler = 0;
+        hash ^= character;
+        hash *= 16777619UL;
+    }
+
+    return hash;
+}
+
+// Appends a varint, 7 bits per byte with the top bit set on all but the last byte, to pOut. Returns its length.
+static size_t putVarint(uint8_t* pOut, uint64_t value)
+{
+    size_t length = 0;
 
-        telnetClient.printf("* Show profiler: %s\r\n",
-                m_showProfiler ? "on" : "off");
+    while (value >= 0x80)
+    {
+        pOut[length++] = (uint8_t)value | 0x80;
+        value >>= 7;
     }
-    else if (m_command.startsWith("p "))
+    pOut[length++] = (uint8_t)value;
+
+    return length;
+}
+
+// This is an internal protected method which encodes the arguments of a printf style format string into pArgs as they
+// are pulled from args. Integers are varints, zigzag encoded for %d and %i so that small negative numbers stay short,
+// floating point values are the 8 bytes of the double and strings are their length in a byte followed by their
+// characters. Encoding stops at the first argument which doesn't fit. Returns the length of the encoded arguments.
+size_t MiPDebug::encodeArgs(uint8_t* pArgs, size_t size, PGM_P pFormat, va_list args)
+{
+    // Room for the longest varint.
+    const size_t maxVarint = 10;
+    size_t       length = 0;
+    char         character;
+
+    while ((character = pgm_read_byte(pFormat++)) != '\0')
     {
-        // Show profiler with minimal time.
-        if (options.length() > 0)
+        if (character != '%')
+        {
+            continue;
+        }
+
+        // Skip the flags, width, precision and length. A '*' width or precision takes an int argument of its own.
+        uint8_t longs = 0;
+        while ((character = pgm_read_byte(pFormat++)) != '\0' && strchr("-+ #0123456789.*hlLjzt", character))
+        {
+            if (character == 'l')
+            {
+                longs++;
+            }
+            else if (character == 'j')
+            {
+                longs = 2;
+            }
+            else if (character == '*')
+            {
+                if (length + maxVarint > size)
+                {
+                    return length;
+                }
+                int32_t value = va_arg(args, int);
+                length += putVarint(&pArgs[length], ((uint32_t)value << 1) ^ (uint32_t)(value >> 31));
+            }
+        }
+
+        int64_t  value;
+        uint64_t unsignedValue;
+        double   floatValue;
+        switch (character)
+        {
+        case '\0':
+            return length;
+        case '%':
+            break;
+        case 'd':
+        case 'i':
+            if (length + maxVarint > size)
+            {
+                return length;
+            }
+            value = longs >= 2 ? va_arg(args, long long) : longs ? va_arg(args, long) : va_arg(args, int);
+            length += putVarint(&pArgs[length], ((uint64_t)value << 1) ^ (uint64_t)(value >> 63));
+            break;
+        case 'u':
+        case 'x':
+        case 'X':
+        case 'o':
+        case 'c':
+        case 'p':
+            if (length + maxVarint > size)
+            {
+                return length;
+            }
+            if (character == 'p')
+            {
+                unsignedValue = (uintptr_t)va_arg(args, void*);
+            }
+            else
+            {
+                unsignedValue = longs >= 2 ? va_arg(args, unsigned long long) :
+                                longs ? va_arg(args, unsigned long) : va_arg(args, unsigned int);
+            }
+            length += putVarint(&pArgs[length], unsignedValue);
+            break;
+        case 'e':
+        case 'E':
+        case 'f':
+        case 'F':
+        case 'g':
+        case 'G':
+            if (length + sizeof(floatValue) > size)
+            {
+                return length;
+            }
+            floatValue = va_arg(args, double);
+            memcpy(&pArgs[length], &floatValue, sizeof(floatValue));
+            length += sizeof(floatValue);
+            break;
+        case 's':
+        case 'S':
         {
-            int32_t aux = options.toInt();
-            if (aux > 0)
+            // Both RAM and flash strings can be read a byte at a time.
+            const char* pText = va_arg(args, const char*);
+            size_t      textLength = 0;
+
+            if (length >= size)
+            {
+                return length;
+            }
+            if (pText == NULL)
             {
-                m_showProfiler = true;
-                m_minTimeShowProfiler = aux;
-                telnetClient.printf(
-                        "* Show profiler: on (with minimal time: %u)\r\n",
-                       m_minTimeShowProfiler);
+                pText = "(null)";
             }
+            while (length + 1 + textLength < size && textLength < 0xFF &&
+                   (character = pgm_read_byte(pText + textLength)) != '\0')
+            {
+                pArgs[length + 1 + textLength++] = character;
+            }
+            pArgs[length] = textLength;
+            length += 1 + textLength;
+            break;
+        }
+        default:
+            // The decoder stops at the same conversion.
+            return length;
         }
     }
-    else if (m_command == "P")
+
+    return length;
+}
+
+// This is an internal protected method which sends a binary record at the last debug level to the telnet clients
+// which take binary records and show that level, and to the UDP port.
+void MiPDebug::sendRecord(uint32_t id, const uint8_t* pArgs, size_t length)
+{
+    // The sync byte, ID, time of up to 5 bytes, argument length and arguments.
+    uint8_t record[1 + sizeof(id) + 5 + 1 + BINARY_MAX_ARGS];
+    size_t  recordLength = 0;
+
+    record[recordLength++] = BINARY_SYNC | m_lastDebugLevel;
+    memcpy(&record[recordLength], &id, sizeof(id));
+    recordLength += sizeof(id);
+    recordLength += putVarint(&record[recordLength], millis());
+    record[recordLength++] = length;
+    memcpy(&record[recordLength], pArgs, length);
+    recordLength += length;
+
+    for (uint8_t i = 0 ; i < MAX_TELNET_CLIENTS ; i++)
     {
-        // Debug level profile.
-        m_levelBeforeProfiler =m_clientDebugLevel;
-        m_clientDebugLevel = PROFILER;
+        Session& session = m_sessions[i];
+
+        if (session.isConnected && session.options.isBinary && m_lastDebugLevel >= session.options.debugLevel)
+        {
+            queueOutput(session, (const char*)record, recordLength, false);
+            sendOutput(session, false);
+        }
+    }
 
-        if (m_showProfiler == false)
+    if (m_udpPort != 0 && m_lastDebugLevel >= m_udpOptions.debugLevel)
+    {
+        if (m_udpLength + recordLength > sizeof(m_udpBuffer))
+        {
+            sendUdp();
+        }
+        if (m_udpLength == 0)
         {
-            m_showProfiler = true;
+            m_udpTime = millis();
         }
+        memcpy(&m_udpBuffer[m_udpLength], record, recordLength);
+        m_udpLength += recordLength;
+    }
+}
+
+// This is an internal protected method which sends the waiting binary records in a UDP datagram.
+void MiPDebug::sendUdp()
+{
+    if (m_udp.beginPacket(m_udpAddress, m_udpPort))
+    {
+        m_udp.write(m_udpBuffer, m_udpLength);
+        m_udp.endPacket();
+    }
+    m_udpLength = 0;
+}
+
+// Expand "CR/LF" characters to "\\r" and "\\n".
+String MiPDebug::expand(String string)
+{
+    string.replace("\r", "\\r");
+    string.replace("\n", "\\n");
 
-        // Default of 1 second.
-        m_levelProfilerDisable = 1000;
+    return string;
+}
+
+// This is an internal protected method that displays the help dialog.
+void MiPDebug::showHelp(Print& output)
+{
+    output.print("*** Welcome to MiP's debug terminal.  This is version ");
+    output.print(VERSION);
+    output.print(".\r\n");
+    output.print("* Hostname: ");
+    output.print(m_hostname);
+    output.print("\r\n");
+    output.print("* IP: ");
+    output.print(WiFi.localIP().toString());
+    output.print("\r\n");
+    output.print("* MAC address: ");
+    output.print(WiFi.macAddress());
+    output.print("\r\n");
+    output.printf("* Telnet clients: %u of %u\r\n", connectedClients(), MAX_TELNET_CLIENTS);
+    output.print("* Free heap RAM: ");
+    output.print(ESP.getFreeHeap());
+    output.print("\r\n");
+    output.print("******************************************************\r\n");
+    output.print("* Commands:\r\n");
+    for (uint8_t i = 0 ; i < m_commandCount ; i++)
+    {
+        const Command& command = m_commands[i];
+        char           name[MAX_COMMAND_LENGTH + 1];
 
-        if (options.length() > 0)
+        // Aliases are registered without help so that they aren't listed twice.
+        if (command.pHelp == NULL || (command.handler == commandReset && !m_resetCommandEnabled))
         {
-            int32_t aux = options.toInt();
-            if (aux > 0)
-            {
-                m_levelProfilerDisable = millis() + aux;
-            }
+            continue;
         }
 
-        telnetClient.printf(
-                "* Debug level set to Profiler (disable in %u millis)\r\n",
-               m_levelProfilerDisable);
+        strlcpy_P(name, command.pName, sizeof(name));
+        output.printf("    %-8s ", name);
+        output.print(FPSTR(command.pHelp));
+        output.print("\r\n");
     }
-    else if (m_command == "A")
+
+    if (m_helpProjectCmds != "" && m_callbackProjectCmds)
     {
-        // Auto debug level profile.  Default of 1 second.
-        m_autoLevelProfiler = 1000;
+        output.print("\r\n");
+        output.print("    * Project commands:\r\n");
+        output.print("\r\n    ");
 
-        if (options.length() > 0)
+        // Indent this.
+        for (const char* pHelp = m_helpProjectCmds.c_str() ; *pHelp ; pHelp++)
         {
-            int32_t aux = options.toInt();
-            if (aux > 0)
+            output.write(*pHelp);
+            if (*pHelp == '\n')
             {
-                m_autoLevelProfiler = aux;
+                output.print("    ");
             }
         }
-
-        telnetClient.printf(
-                "* Auto profiler debug level active (time >= %u millis)\r\n",
-               m_autoLevelProfiler);
     }
-    else if (m_command == "c")
+
+    output.print("\r\n");
+    output.print("* Please type the command and press enter to execute.(? or h for this help)\r\n");
+    output.print("***\r\n");
+}
+
+// This is an internal protected method to get the last command received.
+String MiPDebug::getLastCommand()
+{
+    return String(m_lastCommand);
+}
+
+// This is an internal protected method to clear the last command received.
+
+void MiPDebug::clearLastCommand()
+{
+    m_lastCommand[0] = '\0';
+}
+
+MiPDebug::MiPDebug()
+{
+    registerBuiltinCommands();
+}
+
+bool MiPDebug::registerCommand(PGM_P pName, PGM_P pHelp, MiPDebugCommandHandler handler, void* pContext /* = NULL */)
+{
+    char name[MAX_COMMAND_LENGTH + 1];
+
+    strlcpy_P(name, pName, sizeof(name));
+
+    int8_t index = findCommand(name);
+    if (index < 0)
     {
-        // Show status of colors.
-        m_showColors = !m_showColors;
+        if (m_commandCount >= MAX_COMMANDS)
+        {
+            return false;
+        }
+        index = m_commandCount++;
 
-        telnetClient.printf("* Show colors: %s\r\n",
-                m_showColors ? "on" : "off");
+        // Take the first free slot along the probe sequence for this name.
+        uint16_t hash = hashCommand(name);
+        uint8_t  slot = hash & (COMMAND_HASH_SIZE - 1);
+        while (m_commandIndex[slot] != 0)
+        {
+            slot = (slot + 1) & (COMMAND_HASH_SIZE - 1);
+        }
+        m_commandIndex[slot] = index + 1;
+        m_commands[index].hash = hash;
     }
-    else if (m_command.startsWith("filter ") && options.length() > 0)
+
+    Command& command = m_commands[index];
+    command.pName = pName;
+    command.pHelp = pHelp;
+    command.handler = handler;
+    command.pContext = pContext;
+
+    return true;
+}
+
+// This is an internal protected method which hashes a command name with FNV-1a for the command index.
+uint16_t MiPDebug::hashCommand(const char* pName)
+{
+    uint32_t hash = 2166136261UL;
+
+    while (*pName)
     {
-        setFilter(options);
+        hash ^= (uint8_t)*pName++;
+        hash *= 16777619UL;
     }
-    else if (m_command == "nofilter")
+
+    return (uint16_t)(hash ^ (hash >> 16));
+}
+
+// This is an internal protected method which returns the index of the named command in m_commands or -1 if there is
+// no such command.
+int8_t MiPDebug::findCommand(const char* pName)
+{
+    uint16_t hash = hashCommand(pName);
+    uint8_t  slot = hash & (COMMAND_HASH_SIZE - 1);
+
+    // The index is never full so the probe always ends at an empty slot.
+    while (m_commandIndex[slot] != 0)
     {
-        setNoFilter();
+        const Command& command = m_commands[m_commandIndex[slot] - 1];
+        if (command.hash == hash && strcmp_P(pName, command.pName) == 0)
+        {
+            return m_commandIndex[slot] - 1;
+        }
+        slot = (slot + 1) & (COMMAND_HASH_SIZE - 1);
     }
-    else if (m_command == "reset" && m_resetCommandEnabled)
-    {
-        telnetClient.println("* Reset...");
 
-        telnetClient.println("* Closing telnet connection...");
+    return -1;
+}
+
+// This is an internal protected method which adds the commands built into the telnet server to the command table.
+void MiPDebug::registerBuiltinCommands()
+{
+    registerCommand(PSTR("?"), PSTR("-> display these help commands"), commandHelp, this);
+    registerCommand(PSTR("h"), NULL, commandHelp, this);
+    registerCommand(PSTR("help"), NULL, commandHelp, this);
+    registerCommand(PSTR("q"), PSTR("-> quit (close this connection)"), commandQuit, this);
+    registerCommand(PSTR("m"), PSTR("-> display available memory"), commandMemory, this);
+    registerCommand(PSTR("v"), PSTR("-> set debug level to verbose"), commandLevel, this);
+    registerCommand(PSTR("d"), PSTR("-> set debug level to debug"), commandLevel, this);
+    registerCommand(PSTR("i"), PSTR("-> set debug level to info"), commandLevel, this);
+    registerCommand(PSTR("w"), PSTR("-> set debug level to warning"), commandLevel, this);
+    registerCommand(PSTR("e"), PSTR("-> set debug level to errors"), commandLevel, this);
+    registerCommand(PSTR("l"), PSTR("-> show debug level"), commandShow, this);
+    registerCommand(PSTR("t"), PSTR("-> show time in milliseconds"), commandShow, this);
+    registerCommand(PSTR("c"), PSTR("-> show colors"), commandShow, this);
+    registerCommand(PSTR("p"), PSTR("[min] -> show time between actual and last message (in millis), only if at "
+                                    "least min"), commandProfiler, this);
+    registerCommand(PSTR("P"), PSTR("[time] -> set debug level to profiler for time millis"),
+                    commandProfilerLevel, this);
+#ifdef ALPHA_VERSION
+    registerCommand(PSTR("A"), PSTR("[time] -> set auto debug level to profiler"), commandAutoProfiler, this);
+#endif
+    registerCommand(PSTR("prof"), PSTR("[reset] -> show or clear the time spent in each profiled scope (in micros)"),
+                    commandScopes, this);
+    registerCommand(PSTR("loop"), PSTR("[reset] -> show or clear the time between MiP handle() calls and the worst "
+                                       "stall"), commandLoop, this);
+    registerCommand(PSTR("filter"), PSTR("[strings] -> show only debug messages containing one of these values "
+                                         "(\"quote\" values with spaces, -value hides messages containing it)"),
+                    commandFilter, this);
+    registerCommand(PSTR("nofilter"), PSTR("-> disable the filter"), commandNoFilter, this);
+    registerCommand(PSTR("binary"), PSTR("[off] -> send binary records instead of text (see extras/mip_log_decode)"),
+                    commandBinary, this);
+    registerCommand(PSTR("cpu80"), PSTR("-> Set the ESP8266 CPU to 80 MHz"), commandCpu, this);
+    registerCommand(PSTR("cpu160"), PSTR("-> Set the ESP8266 CPU to 160 MHz"), commandCpu, this);
+    registerCommand(PSTR("reset"), PSTR("-> reset the D1 mini Pack"), commandReset, this);
+}
+
+// This is an internal protected method to process the user's command received from telnet.
+void MiPDebug::processCommand(Session& session)
+{
+    // Keep the response after the output which was queued before the command.
+    sendOutput(session, true);
+
+    ResponsePrint response(*this, session);
+    MiPDebugArgs  args(response, session.command);
 
-        telnetClient.println("* Resetting the D1 mini Pack...");
+    response.print("* Debug: Command received: ");
+    response.println(session.command);
 
-        telnetClient.stop();
-        telnetServer.stop();
+    // Store the last command.
+    strlcpy(m_lastCommand, session.command, sizeof(m_lastCommand));
 
-        delay(500);
+    // Set time of last command received.
+    session.lastTimeCommand = millis();
 
-        ESP.restart();
+    int8_t index = findCommand(args.name());
+    if (index >= 0 && (m_commands[index].handler != commandReset || m_resetCommandEnabled))
+    {
+        m_pCommandSession = &session;
+        m_commands[index].handler(args, m_commands[index].pContext);
+        m_pCommandSession = NULL;
     }
-    else
+    else if (m_callbackProjectCmds)
     {
         // Project commands - set by the user.
-
-        if (m_callbackProjectCmds)
-        {
-            m_callbackProjectCmds();
-        }
+        response.flush();
+        m_pCommandSession = &session;
+        m_callbackProjectCmds();
+        m_pCommandSession = NULL;
+    }
+    else
+    {
+        response.print("* Debug: Unknown command (? or h for help)\r\n");
     }
 }
 
-// This is an internal protected method to set a filter.
-void MiPDebug::setFilter(String filter)
+void MiPDebug::commandHelp(MiPDebugArgs& args, void* pContext)
+{
+    ((MiPDebug*)pContext)->showHelp(args.output);
+}
+
+void MiPDebug::commandQuit(MiPDebugArgs& args, void* pContext)
 {
-    m_filter = filter;
-    m_filter.toLowerCase();
-    m_filterActive = true;
+    MiPDebug* pDebug = (MiPDebug*)pContext;
 
-    telnetClient.print("* Debug: Filter active: ");
-    telnetClient.println(m_filter);
+    args.output.flush();
+    pDebug->closeSession(*pDebug->m_pCommandSession, "* Closing telnet connection ...");
 }
 
-// This is an internal protected method to remove a filter.
-void MiPDebug::setNoFilter()
+void MiPDebug::commandMemory(MiPDebugArgs& args, void* pContext)
+{
+    args.output.print("* Free heap RAM: ");
+    args.output.println(ESP.getFreeHeap());
+}
+
+void MiPDebug::commandCpu(MiPDebugArgs& args, void* pContext)
 {
-    m_filter = "";
-    m_filterActive = false;
+    // Change ESP8266 CPU frequency to 80 or 160 MHz.
+    uint8_t frequency = strcmp(args.name(), "cpu80") == 0 ? 80 : 160;
 
-    telnetClient.println("* Debug: Filter disabled");
+    system_update_cpu_freq(frequency);
+    args.output.printf("ESP8266 CPU changed to %u MHz\r\n", frequency);
 }
 
-// This is an internal protected method to format numbers.
-String MiPDebug::formatNumber(uint32_t value, uint8_t size, char insert)
+void MiPDebug::commandLevel(MiPDebugArgs& args, void* pContext)
 {
-    // Pad zeroes to the left.
-    String ret = "";
+    Options& options = ((MiPDebug*)pContext)->m_pCommandSession->options;
 
-    for (uint8_t i = 1; i <= size; i++) {
-        uint32_t max = pow(10, i);
-        if (value < max)
-        {
-            for (uint8_t j = (size - i); j > 0; j--) {
-                ret.concat(insert);
-            }
-            break;
-        }
+    // Set the debug level.
+    switch (args.name()[0])
+    {
+    case 'v':
+        options.debugLevel = VERBOSE;
+        args.output.println("* Debug level set to Verbose");
+        break;
+    case 'd':
+        options.debugLevel = DEBUG;
+        args.output.println("* Debug level set to Debug");
+        break;
+    case 'i':
+        options.debugLevel = INFO;
+        args.output.println("* Debug level set to Info");
+        break;
+    case 'w':
+        options.debugLevel = WARNING;
+        args.output.println("* Debug level set to Warning");
+        break;
+    default:
+        options.debugLevel = ERROR;
+        args.output.println("* Debug level set to Error");
+        break;
     }
+}
 
-    ret.concat(value);
+void MiPDebug::commandShow(MiPDebugArgs& args, void* pContext)
+{
+    Options& options = ((MiPDebug*)pContext)->m_pCommandSession->options;
 
-    return ret;
+    switch (args.name()[0])
+    {
+    case 'l':
+        // Show the debug level.
+        options.showDebugLevel = !options.showDebugLevel;
+        args.output.printf("* Show debug level: %s\r\n", options.showDebugLevel ? "on" : "off");
+        break;
+    case 't':
+        // Show the time.
+        options.showTime = !options.showTime;
+        args.output.printf("* Show time: %s\r\n", options.showTime ? "on" : "off");
+        break;
+    default:
+        // Show status of colors.
+        options.showColors = !options.showColors;
+        args.output.printf("* Show colors: %s\r\n", options.showColors ? "on" : "off");
+        break;
+    }
 }
 
-// This is an internal protected method to determine if a character is a carriage return or
-// line feed.
-bool MiPDebug::isCRLF(char character)
+void MiPDebug::commandProfiler(MiPDebugArgs& args, void* pContext)
 {
-    return (character == '\r' || character == '\n');
+    Options& options = ((MiPDebug*)pContext)->m_pCommandSession->options;
+
+    if (args.count() == 0)
+    {
+        // Show the profiler status.
+        options.showProfiler = !options.showProfiler;
+        options.minTimeShowProfiler = 0;
+
+        args.output.printf("* Show profiler: %s\r\n", options.showProfiler ? "on" : "off");
+        return;
+    }
+
+    // Show profiler with minimal time.
+    int32_t minTime = args.toInt(0);
+    if (minTime > 0)
+    {
+        options.showProfiler = true;
+        options.minTimeShowProfiler = minTime;
+        args.output.printf("* Show profiler: on (with minimal time: %u)\r\n", options.minTimeShowProfiler);
+    }
+}
+
+void MiPDebug::commandProfilerLevel(MiPDebugArgs& args, void* pContext)
+{
+    Options& options = ((MiPDebug*)pContext)->m_pCommandSession->options;
+
+    // Debug level profile.
+    options.levelBeforeProfiler = options.debugLevel;
+    options.debugLevel = PROFILER;
+    options.showProfiler = true;
+
+    // Default of 1 second.
+    int32_t time = args.toInt(0, 1000);
+    if (time <= 0)
+    {
+        time = 1000;
+    }
+    options.levelProfilerDisable = millis() + time;
+
+    args.output.printf("* Debug level set to Profiler (disable in %d millis)\r\n", time);
+}
+
+void MiPDebug::commandAutoProfiler(MiPDebugArgs& args, void* pContext)
+{
+    MiPDebug* pDebug = (MiPDebug*)pContext;
+
+    // Auto debug level profile.  Default of 1 second.
+    int32_t time = args.toInt(0, 1000);
+    pDebug->m_autoLevelProfiler = time > 0 ? time : 1000;
+
+    args.output.printf("* Auto profiler debug level active (time >= %u millis)\r\n", pDebug->m_autoLevelProfiler);
+}
+
+void MiPDebug::commandFilter(MiPDebugArgs& args, void* pContext)
+{
+    MiPDebug* pDebug = (MiPDebug*)pContext;
+    Options&  options = pDebug->m_pCommandSession->options;
+
+    if (args.count() == 0)
+    {
+        args.output.print("* Debug: Filter: ");
+        args.output.println(options.filter.isActive() ? options.filter.text() : "disabled");
+    }
+    else if (pDebug->setFilter(options, args.text()))
+    {
+        args.output.print("* Debug: Filter active: ");
+        args.output.println(options.filter.text());
+    }
+    else
+    {
+        printFilterTooLong(args.output);
+    }
+}
+
+void MiPDebug::commandNoFilter(MiPDebugArgs& args, void* pContext)
+{
+    ((MiPDebug*)pContext)->m_pCommandSession->options.filter.clear();
+
+    args.output.println("* Debug: Filter disabled");
+}
+
+void MiPDebug::commandScopes(MiPDebugArgs& args, void* pContext)
+{
+    if (strcmp(args[0], "reset") == 0)
+    {
+        mipProfileReset();
+
+        args.output.println("* Debug: Scope profiles cleared");
+        return;
+    }
+
+    // Show the scope histograms.
+    mipProfileDump(args.output);
+}
+
+void MiPDebug::commandLoop(MiPDebugArgs& args, void* pContext)
+{
+    if (strcmp(args[0], "reset") == 0)
+    {
+        mipLoopReset();
+
+        args.output.println("* Debug: Loop intervals cleared");
+        return;
+    }
+
+    // Show the loop intervals and stalls.
+    mipLoopDump(args.output);
+}
+
+void MiPDebug::commandReset(MiPDebugArgs& args, void* pContext)
+{
+    args.output.println("* Reset...");
+    args.output.println("* Closing telnet connection...");
+    args.output.println("* Resetting the D1 mini Pack...");
+    args.output.flush();
+
+    MiPDebug* pDebug = (MiPDebug*)pContext;
+    if (pDebug->m_pFlashLog)
+    {
+        // Keep everything logged up to the reset.
+        pDebug->m_pFlashLog->flush();
+    }
+    pDebug->stop();
+
+    delay(500);
+
+    ESP.restart();
+}
+
+void MiPDebug::commandFlashLog(MiPDebugArgs& args, void* pContext)
+{
+    MiPFlashLog&     flashLog = *((MiPDebug*)pContext)->m_pFlashLog;
+    MiPFlashLogStats stats;
+
+    if (strcmp(args[0], "clear") == 0)
+    {
+        args.output.println(flashLog.clear() ? "* Debug: Flash log cleared" : "* Debug: Flash log clear failed");
+        return;
+    }
+    if (strcmp(args[0], "stats") == 0)
+    {
+        flashLog.readStats(stats);
+        args.output.printf("* Flash log: %u bytes stored, segment %u, %u rotations\r\n", stats.storedBytes,
+                           stats.sequence, stats.rotations);
+        args.output.printf("* Logged %u bytes, wrote %u bytes in %u writes, %u lines dropped\r\n", stats.bytesLogged,
+                           stats.bytesWritten, stats.writes, stats.droppedLines);
+        return;
+    }
+
+    // Show the end of the log.
+    flashLog.dump(args.output, args.toInt(0, 2048));
+}
+
+void MiPDebug::commandBinary(MiPDebugArgs& args, void* pContext)
+{
+    MiPDebug* pDebug = (MiPDebug*)pContext;
+    Options&  options = pDebug->m_pCommandSession->options;
+
+    options.isBinary = strcmp(args[0], "off") != 0;
+    args.output.printf("* Debug: Binary records %s\r\n",
+                       options.isBinary ? "on, decode them with mip_log_decode" : "off");
+    pDebug->updateActiveLevel();
+}
+
+// The robot commands added by registerMiPCommands(). They can't talk to MiP while it is already waiting on a request,
+// which is the case when MiPDebug::handle() is run as one of MiP's idle tasks.
+static bool isMiPBusy(MiP& mip, Print& output)
+{
+    if (mip.isRunningIdleTasks())
+    {
+        output.println("* MiP is waiting on a request, try again from loop()");
+        return true;
+    }
+    return false;
+}
+
+static void mipStatsCommand(MiPDebugArgs& args, void* pContext)
+{
+    MiP&         mip = *(MiP*)pContext;
+    MiPLinkStats stats;
+
+    if (strcmp(args[0], "reset") == 0)
+    {
+        mip.clearTransportStats();
+
+        args.output.println("* Round trip times, queue stats and discarded bytes cleared");
+        return;
+    }
+
+    mip.readLinkStats(stats);
+    args.output.printf("* Link: %u baud, %u%% busy (tx %u%%, rx %u%%)%s\r\n", stats.baudRate,
+                       mip.readLinkUtilization(), stats.txUtilization, stats.rxUtilization,
+                       mip.isLinkDown() ? ", down" : "");
+    args.output.printf("* Bytes sent: %u, received: %u\r\n", stats.bytesSent, stats.bytesReceived);
+    args.output.printf("* Timeouts: %u, bad responses: %u, reconnects: %u, recent failures: %u of 32\r\n",
+                       stats.timeouts, stats.badResponses, stats.reconnects, stats.recentFailures);
+    args.output.printf("* Discarded bytes: %u, throttled requests: %u, dropped log messages: %u\r\n",
+                       stats.discardedBytes, stats.throttledRequests, mipLogDropped());
+}
+
+static void mipRoundTripCommand(MiPDebugArgs& args, void* pContext)
+{
+    MiP&              mip = *(MiP*)pContext;
+    MiPCommandLatency latencies[MIP_LATENCY_COMMANDS];
+    uint8_t           count = mip.readCommandLatencies(latencies, MIP_LATENCY_COMMANDS);
+
+    args.output.printf("%-7s %8s %8s %8s %8s %8s %8s\r\n", "command", "count", "timeouts", "p50 us", "p95 us",
+                       "p99 us", "max us");
+    for (uint8_t i = 0 ; i < count ; i++)
+    {
+        const MiPCommandLatency& latency = latencies[i];
+
+        args.output.printf("0x%02X    %8u %8u %8u %8u %8u %8u\r\n", latency.command, latency.count, latency.timeouts,
+                           latency.p50, latency.p95, latency.p99, latency.max);
+    }
+}
+
+static void mipSnapshotCommand(MiPDebugArgs& args, void* pContext)
+{
+    MiP&        mip = *(MiP*)pContext;
+    MiPSnapshot snapshot;
+
+    if (isMiPBusy(mip, args.output))
+    {
+        return;
+    }
+
+    mip.readSnapshot(snapshot);
+
+    // Shown as volts and centimetres from the fixed point millivolts and millimetres.
+    char volts[MIP_FORMAT_NUMBER_SIZE];
+    char centimetres[MIP_FORMAT_NUMBER_SIZE];
+    mipFormatFixed(volts, sizeof(volts), snapshot.status.batteryMillivolts, 3);
+    mipFormatFixed(centimetres, sizeof(centimetres), snapshot.distanceMillimetres, 1);
+
+    args.output.printf("* Snapshot read in %u ms (valid fields 0x%03X)\r\n", snapshot.readTime, snapshot.valid);
+    args.output.printf("* Battery: %s V, position: %u, weight: %d, volume: %u\r\n",
+                       volts, snapshot.status.position, snapshot.weight, snapshot.volume);
+    args.output.printf("* Distance: %s cm\r\n", centimetres);
+    args.output.printf("* Chest LED: %u,%u,%u, head LEDs: %u %u %u %u\r\n",
+                       snapshot.chestLED.red, snapshot.chestLED.green, snapshot.chestLED.blue,
+                       snapshot.headLEDs.led1, snapshot.headLEDs.led2, snapshot.headLEDs.led3, snapshot.headLEDs.led4);
+    args.output.printf("* Game mode: %u, gesture/radar mode: %u, IR remote control: %s\r\n", snapshot.gameMode,
+                       snapshot.gestureRadarMode, snapshot.irRemoteControlEnabled ? "on" : "off");
+}
+
+static void mipQueuesCommand(MiPDebugArgs& args, void* pContext)
+{
+    static const char* const queueNames[MIP_QUEUE_COUNT] = { "clap", "gesture", "IR code", "detected MiP" };
+    MiP&                     mip = *(MiP*)pContext;
+
+    args.output.printf("* Pending requests: %u of %u\r\n", mip.pendingRequestCount(), MIP_MAX_PENDING_REQUESTS);
+    for (uint8_t i = 0 ; i < MIP_QUEUE_COUNT ; i++)
+    {
+        MiPQueueStats stats;
+
+        mip.readQueueStats((MiPEventQueue)i, stats);
+        args.output.printf("* %s events: %u of %u waiting, at most %u, %u overwritten\r\n", queueNames[i],
+                           stats.count, stats.capacity, stats.highWater, stats.overflows);
+    }
+}
+
+static void mipSoundCommand(MiPDebugArgs& args, void* pContext)
+{
+    MiP&    mip = *(MiP*)pContext;
+    int32_t sound = args.toInt(0, -1);
+    int32_t volume = args.toInt(1, MIP_VOLUME_DEFAULT);
+
+    if (sound < 0)
+    {
+        args.output.println("* Usage: sound index [volume]");
+        return;
+    }
+    if (isMiPBusy(mip, args.output))
+    {
+        return;
+    }
+
+    mip.playSound((MiPSoundIndex)sound, (MiPVolume)volume);
+    if (mip.didLastCallFail())
+    {
+        args.output.printf("* Sound %d failed (error %d)\r\n", sound, mip.lastCallResult());
+        return;
+    }
+    args.output.printf("* Playing sound %d\r\n", sound);
+}
+
+void MiPDebug::registerMiPCommands(MiP& mip)
+{
+    registerCommand(PSTR("stats"), PSTR("[reset] -> show MiP link statistics or clear the transport stats"),
+                    mipStatsCommand, &mip);
+    registerCommand(PSTR("rtt"), PSTR("-> show the round trip time of each command sent to MiP"),
+                    mipRoundTripCommand, &mip);
+    registerCommand(PSTR("snapshot"), PSTR("-> read and show all of MiP's state"), mipSnapshotCommand, &mip);
+    registerCommand(PSTR("queues"), PSTR("-> show the pending requests and MiP event queue occupancy"),
+                    mipQueuesCommand, &mip);
+    registerCommand(PSTR("sound"), PSTR("index [volume] -> play one of MiP's sounds (volume 0 to 7)"),
+                    mipSoundCommand, &mip);
+}
+
+void MiPDebug::setBinaryUdp(IPAddress address, uint16_t port, uint8_t debugLevel /* = DEBUG */)
+{
+    if (m_udpLength > 0)
+    {
+        sendUdp();
+    }
+    m_udpAddress = address;
+    m_udpPort = port;
+    m_udpOptions.debugLevel = debugLevel;
+    m_udpOptions.isBinary = true;
+    updateActiveLevel();
+}
+
+void MiPDebug::setFlashLog(MiPFlashLog& flashLog, uint8_t debugLevel /* = INFO */)
+{
+    m_pFlashLog = &flashLog;
+    m_flashOptions.debugLevel = debugLevel;
+    m_flashOptions.showTime = true;
+    updateActiveLevel();
+
+    registerCommand(PSTR("flog"), PSTR("[bytes|stats|clear] -> show the end of the flash log (default 2048 bytes), its "
+                                       "statistics, or clear it"), commandFlashLog, this);
+}
+
+size_t MiPDebug::ResponsePrint::write(uint8_t character)
+{
+    return write(&character, 1);
+}
+
+size_t MiPDebug::ResponsePrint::write(const uint8_t *buffer, size_t size)
+{
+    size_t remaining = size;
+
+    while (remaining > 0)
+    {
+        if (m_length == sizeof(m_buffer))
+        {
+            flush();
+        }
+
+        size_t count = sizeof(m_buffer) - m_length;
+        if (count > remaining)
+        {
+            count = remaining;
+        }
+        memcpy(&m_buffer[m_length], buffer, count);
+        m_length += count;
+        buffer += count;
+        remaining -= count;
+    }
+
+    return size;
+}
+
+// Queues the collected response for the client and sends what its TCP window takes. Room is made first by sending
+// what is already queued. If the response still doesn't fit then the rest of it is dropped, and the client is told
+// how many lines were lost, rather than waiting on the client.
+void MiPDebug::ResponsePrint::flush()
+{
+    if (m_length > 0 && m_session.isConnected)
+    {
+        m_debug.sendOutput(m_session, true);
+        m_debug.queueOutput(m_session, m_buffer, m_length, m_isContinued);
+        m_debug.sendOutput(m_session, true);
+        m_isContinued = true;
+    }
+    m_length = 0;
+}
+
+MiPDebugArgs::MiPDebugArgs(Print& output, const char* pLine) : output(output)
+{
+    while (*pLine == ' ')
+    {
+        pLine++;
+    }
+
+    // Keep the text after the command name as typed.
+    m_pText = pLine;
+    while (*m_pText && *m_pText != ' ')
+    {
+        m_pText++;
+    }
+    while (*m_pText == ' ')
+    {
+        m_pText++;
+    }
+
+    // Split a copy of the line into words. Any words past MAX_COMMAND_ARGS are left in the last argument.
+    strlcpy(m_line, pLine, sizeof(m_line));
+    m_count = 0;
+    char* pWord = m_line;
+    while (*pWord && m_count <= MAX_COMMAND_ARGS)
+    {
+        m_words[m_count++] = pWord;
+        if (m_count > MAX_COMMAND_ARGS)
+        {
+            break;
+        }
+        while (*pWord && *pWord != ' ')
+        {
+            pWord++;
+        }
+        while (*pWord == ' ')
+        {
+            *pWord++ = '\0';
+        }
+    }
+    if (m_count == 0)
+    {
+        m_words[m_count++] = m_line;
+    }
+}
+
+int32_t MiPDebugArgs::toInt(uint8_t index, int32_t defaultValue /* = 0 */) const
+{
+    const char* pArg = (*this)[index];
+    char*       pEnd;
+
+    long value = strtol(pArg, &pEnd, 10);
+    if (pEnd == pArg || *pEnd != '\0')
+    {
+        return defaultValue;
+    }
+
+    return value;
+}
+
+// Show only the debug messages which match the filter, ignoring case. See MiPDebugFilter for the syntax.
+bool MiPDebug::setFilter(String filter)
+{
+    // Every output gets the same filter so they all succeed or fail together.
+    bool isSet = setFilter(m_serialOptions, filter.c_str());
+    setFilter(m_defaultOptions, filter.c_str());
+    for (uint8_t i = 0 ; i < MAX_TELNET_CLIENTS ; i++)
+    {
+        setFilter(m_sessions[i].options, filter.c_str());
+    }
+
+    // When called from a project command, tell the telnet client which sent it.
+    if (!isSet && m_pCommandSession)
+    {
+        ResponsePrint response(*this, *m_pCommandSession);
+        printFilterTooLong(response);
+    }
+    return isSet;
+}
+
+// Remove the filter.
+void MiPDebug::setNoFilter()
+{
+    setFilter("");
+}
+
+// This is an internal protected method to set the filter for one output. An empty filter disables it. Returns false,
+// leaving the filter disabled, if the filter exceeds the FILTER_MAX_* limits.
+bool MiPDebug::setFilter(Options& options, const char* pFilter)
+{
+    return options.filter.compile(pFilter);
+}
+
+// This is an internal protected method which explains why a filter was rejected.
+void MiPDebug::printFilterTooLong(Print& output)
+{
+    output.printf("* Debug: Filter too long (at most %d values and %d characters)\r\n",
+                  FILTER_MAX_PATTERNS, FILTER_MAX_CHARS);
+}
+
+// This is an internal protected method to determine if a character is a carriage return or
+// line feed.
+bool MiPDebug::isCRLF(char character)
+{
+    return (character == '\r' || character == '\n');
+}
+
+
+
+void MiPDebugFilter::clear()
+{
+    memset(m_states, 0, sizeof(m_states));
+    m_stateCount = 1;
+    m_patternCount = 0;
+    m_includeMask = 0;
+    m_excludeMask = 0;
+    m_text[0] = '\0';
+}
+
+// Compiles the space separated patterns into the automaton. Returns false, leaving the filter cleared, if there are too
+// many patterns or characters.
+bool MiPDebugFilter::compile(const char* pPatterns)
+{
+    clear();
+    if (strlen(pPatterns) > FILTER_MAX_TEXT)
+    {
+        return false;
+    }
+
+    const char* pCurr = pPatterns;
+    while (*pCurr)
+    {
+        // Skip the spaces between patterns.
+        if (*pCurr == ' ')
+        {
+            pCurr++;
+            continue;
+        }
+
+        bool isExclude = (*pCurr == '-' && pCurr[1] != '\0' && pCurr[1] != ' ');
+        if (isExclude)
+        {
+            pCurr++;
+        }
+
+        // A quoted pattern runs to the closing quote, anything else runs to the next space.
+        char terminator = ' ';
+        if (*pCurr == '"')
+        {
+            terminator = '"';
+            pCurr++;
+        }
+        const char* pStart = pCurr;
+        while (*pCurr && *pCurr != terminator)
+        {
+            pCurr++;
+        }
+
+        if (pCurr > pStart && !addPattern(pStart, pCurr - pStart, isExclude))
+        {
+            clear();
+            return false;
+        }
+        if (*pCurr == '"')
+        {
+            pCurr++;
+        }
+    }
+
+    if (m_patternCount > 0)
+    {
+        buildFailLinks();
+        strcpy(m_text, pPatterns);
+    }
+    return true;
+}
+
+// This internal protected method adds the states for one pattern to the trie.
+bool MiPDebugFilter::addPattern(const char* pPattern, size_t length, bool isExclude)
+{
+    uint8_t state = 0;
+
+    if (m_patternCount >= FILTER_MAX_PATTERNS)
+    {
+        return false;
+    }
+
+    for (size_t i = 0 ; i < length ; i++)
+    {
+        char    character = tolower((unsigned char)pPattern[i]);
+        uint8_t child = findChild(state, character);
+
+        if (child == 0)
+        {
+            if (m_stateCount >= sizeof(m_states) / sizeof(m_states[0]))
+            {
+                return false;
+            }
+            child = m_stateCount++;
+            m_states[child].character = character;
+            m_states[child].nextSibling = m_states[state].firstChild;
+            m_states[state].firstChild = child;
+        }
+        state = child;
+    }
+
+    uint8_t mask = 1 << m_patternCount++;
+    m_states[state].outputs |= mask;
+    if (isExclude)
+    {
+        m_excludeMask |= mask;
+    }
+    else
+    {
+        m_includeMask |= mask;
+    }
+
+    return true;
+}
+
+// This internal protected method links each state to the state for the longest suffix of its path which is also the
+// start of a pattern. It walks the trie breadth first so that those suffix states always have their links already.
+void MiPDebugFilter::buildFailLinks()
+{
+    uint8_t queue[FILTER_MAX_CHARS + 1];
+    uint8_t head = 0;
+    uint8_t tail = 0;
+
+    for (uint8_t child = m_states[0].firstChild ; child != 0 ; child = m_states[child].nextSibling)
+    {
+        m_states[child].fail = 0;
+        queue[tail++] = child;
+    }
+
+    while (head < tail)
+    {
+        uint8_t state = queue[head++];
+
+        for (uint8_t child = m_states[state].firstChild ; child != 0 ; child = m_states[child].nextSibling)
+        {
+            char    character = m_states[child].character;
+            uint8_t fail = m_states[state].fail;
+            uint8_t next;
+
+            while ((next = findChild(fail, character)) == 0 && fail != 0)
+            {
+                fail = m_states[fail].fail;
+            }
+            m_states[child].fail = next;
+            m_states[child].outputs |= m_states[next].outputs;
+            queue[tail++] = child;
+        }
+    }
+}
+
+// This internal protected method returns the child of the state reached with this character or 0 if there is none.
+uint8_t MiPDebugFilter::findChild(uint8_t state, char character) const
+{
+    for (uint8_t child = m_states[state].firstChild ; child != 0 ; child = m_states[child].nextSibling)
+    {
+        if (m_states[child].character == character)
+        {
+            return child;
+        }
+    }
+    return 0;
+}
+
+// Checks the line against the patterns in a single pass.
+bool MiPDebugFilter::matches(const char* pLine, size_t length) const
+{
+    uint8_t state = 0;
+    uint8_t matched = 0;
+
+    for (size_t i = 0 ; i < length ; i++)
+    {
+        char    character = tolower((unsigned char)pLine[i]);
+        uint8_t next;
+
+        while ((next = findChild(state, character)) == 0 && state != 0)
+        {
+            state = m_states[state].fail;
+        }
+        state = next;
+
+        matched |= m_states[state].outputs;
+        if (matched & m_excludeMask)
+        {
+            return false;
+        }
+        if ((matched & m_includeMask) && m_excludeMask == 0)
+        {
+            // Nothing left which could hide the line.
+            return true;
+        }
+    }
+
+    return m_includeMask == 0 || (matched & m_includeMask);
 }
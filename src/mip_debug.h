@@ -20,6 +20,8 @@
 #define MIPDEBUG_H
 
 #include <ESP8266WiFi.h>
+#include <WiFiUdp.h>
+#include <type_traits>
 #include "Arduino.h"
 #include "Print.h"
 
@@ -27,33 +29,117 @@ extern "C" {
 bool system_update_cpu_freq(uint8 freq);
 }
 
-// Define an mechanism for quickly calling the various debug levels provided by the system.
-#define mDebug(...)   { if (debug.isActive(debug.ANY)) debug.printf(__VA_ARGS__); }
-#define mDebugP(...) { if (debug.isActive(debug.PROFILER)) debug.printf(__VA_ARGS__); }
-#define mDebugV(...) { if (debug.isActive(debug.VERBOSE)) debug.printf(__VA_ARGS__); }
-#define mDebugD(...) { if (debug.isActive(debug.DEBUG)) debug.printf(__VA_ARGS__); }
-#define mDebugI(...) { if (debug.isActive(debug.INFO)) debug.printf(__VA_ARGS__); }
-#define mDebugW(...) { if (debug.isActive(debug.WARNING)) debug.printf(__VA_ARGS__); }
-#define mDebugE(...) { if (debug.isActive(debug.ERROR)) debug.printf(__VA_ARGS__); }
+// Messages below this debug level are removed from the build entirely, along with their format strings. Define it
+// before including mip_debug.h, for example to 3 (INFO) so that verbose and debug messages cost nothing in a release.
+// Messages at or above it are still filtered at run time by the level the telnet user selects.
+#ifndef MIP_DEBUG_MIN_LEVEL
+  #define MIP_DEBUG_MIN_LEVEL 0
+#endif
+
+// FNV-1a hash of a format string, used as the message ID of binary records. extras/mip_log_decode hashes the format
+// strings it finds in the sources the same way to turn the records back into text.
+constexpr uint32_t mipDebugHash(const char* pText, uint32_t hash = 2166136261UL)
+{
+    return *pText ? mipDebugHash(pText + 1, (hash ^ (uint8_t)*pText) * 16777619UL) : hash;
+}
+
+// The message ID of a format string literal, worked out by the compiler.
+#define MIP_DEBUG_ID(FORMAT) (std::integral_constant<uint32_t, mipDebugHash(FORMAT)>::value)
+
+// Define an mechanism for quickly calling the various debug levels provided by the system. Format strings are kept in
+// flash and must be string literals.
+#define mDebugAt(LEVEL, FORMAT, ...) \
+    { if (debug.isLevelActive(LEVEL)) debug.debugf_P(LEVEL, MIP_DEBUG_ID(FORMAT), PSTR(FORMAT), ##__VA_ARGS__); }
+
+#if MIP_DEBUG_MIN_LEVEL <= 6 // ANY
+  #define mDebug(FORMAT, ...)  mDebugAt(MiPDebug::ANY, FORMAT, ##__VA_ARGS__)
+#else
+  #define mDebug(...)
+#endif
+#if MIP_DEBUG_MIN_LEVEL <= 0 // PROFILER
+  #define mDebugP(FORMAT, ...) mDebugAt(MiPDebug::PROFILER, FORMAT, ##__VA_ARGS__)
+#else
+  #define mDebugP(...)
+#endif
+#if MIP_DEBUG_MIN_LEVEL <= 1 // VERBOSE
+  #define mDebugV(FORMAT, ...) mDebugAt(MiPDebug::VERBOSE, FORMAT, ##__VA_ARGS__)
+#else
+  #define mDebugV(...)
+#endif
+#if MIP_DEBUG_MIN_LEVEL <= 2 // DEBUG
+  #define mDebugD(FORMAT, ...) mDebugAt(MiPDebug::DEBUG, FORMAT, ##__VA_ARGS__)
+#else
+  #define mDebugD(...)
+#endif
+#if MIP_DEBUG_MIN_LEVEL <= 3 // INFO
+  #define mDebugI(FORMAT, ...) mDebugAt(MiPDebug::INFO, FORMAT, ##__VA_ARGS__)
+#else
+  #define mDebugI(...)
+#endif
+#if MIP_DEBUG_MIN_LEVEL <= 4 // WARNING
+  #define mDebugW(FORMAT, ...) mDebugAt(MiPDebug::WARNING, FORMAT, ##__VA_ARGS__)
+#else
+  #define mDebugW(...)
+#endif
+#if MIP_DEBUG_MIN_LEVEL <= 5 // ERROR
+  #define mDebugE(FORMAT, ...) mDebugAt(MiPDebug::ERROR, FORMAT, ##__VA_ARGS__)
+#else
+  #define mDebugE(...)
+#endif
 
 // The default port for the telnet service.
 #define TELNET_PORT 23
 
+// Maximum number of telnet clients which can be connected at once.
+#ifndef MAX_TELNET_CLIENTS
+#define MAX_TELNET_CLIENTS 3
+#endif
+
 // Maximum time for inactivity (in milliseconds). Set it to 0 to disable timeout.
 // Default: 1 hour
 #define MAX_TIME_INACTIVE 3600000
 
-// Defines the buffer size for buffered output.
+// Defines the buffer size for buffered output. Lines longer than this are sent in pieces.
 #define BUFFER_PRINT 150
 
-// Defines some values for buffering output.
-//#define CLIENT_BUFFERING true
-#ifdef CLIENT_BUFFERING
-// Minimum time before sending the buffer.
+// Limits on the filter set with setFilter() or the telnet filter command: the number of patterns, their total length
+// and the length of the filter text as it was typed.
+#define FILTER_MAX_PATTERNS 8
+#define FILTER_MAX_CHARS 48
+#define FILTER_MAX_TEXT 64
+
+// Room left in front of the buffered output for the debug level, time and profiler prefix of each line.
+#define BUFFER_PREFIX 64
+
+// Output to each telnet client is queued in a ring of BUFFER_SEND bytes and coalesced into TCP segments of up to
+// MAX_SIZE_SEND bytes, the TCP MSS of the default lwIP build. A partly filled segment is sent once the oldest line in it
+// has waited DELAY_TO_SEND milliseconds. Lines which don't fit in the ring, because the client isn't keeping up, are
+// dropped and counted rather than blocking the sketch.
+#ifndef BUFFER_SEND
+#define BUFFER_SEND 1024
+#endif
+#define MAX_SIZE_SEND 536
 #define DELAY_TO_SEND 10
-// Maximum size of packet (limit of TCP/IP).
-#define MAX_SIZE_SEND 1460
+
+// Maximum number of telnet commands, both built in and added with registerCommand(). Commands are found through a hash
+// index of COMMAND_HASH_SIZE slots, which must be a power of 2 larger than MAX_COMMANDS.
+#ifndef MAX_COMMANDS
+#define MAX_COMMANDS 40
 #endif
+#define COMMAND_HASH_SIZE 64
+
+// Longest command line accepted from a telnet client and the number of arguments split out of it for the handler.
+#define MAX_COMMAND_LENGTH 63
+#define MAX_COMMAND_ARGS 6
+
+// Binary records, sent instead of text to telnet clients which ask for them with the binary command and to the UDP port
+// set with setBinaryUdp(). Each record is BINARY_SYNC + the debug level, a byte which never appears in ASCII text,
+// followed by the 32-bit message ID, the time in milliseconds as a varint, the length of the arguments in a byte and
+// the arguments themselves. Output which doesn't come from a format string is sent with the BINARY_TEXT_ID ID and the
+// text as its argument.
+#define BINARY_SYNC 0xF0
+#define BINARY_TEXT_ID 0
+#define BINARY_MAX_ARGS 128
 
 // ANSI color codes.
 #define COLOR_RESET "\x1B[0m"
@@ -84,9 +170,117 @@ bool system_update_cpu_freq(uint8 freq);
 
 
 
+// Filter which checks lines against a set of include and exclude patterns, ignoring case. The patterns are compiled
+// once into an Aho-Corasick automaton so each line is checked in a single pass over it, whatever the number of
+// patterns.
+//
+// Patterns are separated by spaces and can be put in double quotes to include spaces. A pattern starting with '-'
+// excludes the lines which contain it. A line is shown if it contains any of the include patterns, or there are none,
+// and none of the exclude patterns.
+class MiPDebugFilter
+{
+public:
+    MiPDebugFilter()
+    {
+        clear();
+    }
+
+    void clear();
+    bool compile(const char* pPatterns);
+    bool matches(const char* pLine, size_t length) const;
+
+    bool isActive() const
+    {
+        return m_patternCount > 0;
+    }
+
+    const char* text() const
+    {
+        return m_text;
+    }
+
+protected:
+    // One node of the automaton. The children of a node are kept in a linked list to keep the table small.
+    class State
+    {
+    public:
+        char    character;                  // Character which leads to this state from its parent.
+        uint8_t firstChild;                 // First state reached from this one or 0 if none.
+        uint8_t nextSibling;                // Next state with the same parent or 0 if none.
+        uint8_t fail;                       // State to fall back to when there is no child for the next character.
+        uint8_t outputs;                    // Bit mask of the patterns which have been matched on reaching this state.
+    };
+
+    bool    addPattern(const char* pPattern, size_t length, bool isExclude);
+    void    buildFailLinks();
+    uint8_t findChild(uint8_t state, char character) const;
+
+    State   m_states[FILTER_MAX_CHARS + 1]; // State 0 is the root.
+    uint8_t m_stateCount;
+    uint8_t m_patternCount;
+    uint8_t m_includeMask;                  // Bit mask of the include patterns.
+    uint8_t m_excludeMask;                  // Bit mask of the exclude patterns.
+    char    m_text[FILTER_MAX_TEXT + 1];    // The filter as it was set, for display.
+};
+
+
+class MiP;
+class MiPFlashLog;
+
+
+// The arguments typed after the name of a telnet command, split at spaces, along with the output for the command's
+// response.
+class MiPDebugArgs
+{
+public:
+    MiPDebugArgs(Print& output, const char* pLine);
+
+    // The command name as typed.
+    const char* name() const
+    {
+        return m_words[0];
+    }
+
+    // Number of arguments after the command name.
+    uint8_t count() const
+    {
+        return m_count - 1;
+    }
+
+    // The argument at index, starting from 0, or "" if there are fewer arguments.
+    const char* operator[](uint8_t index) const
+    {
+        return index < count() ? m_words[index + 1] : "";
+    }
+
+    // The argument at index as an integer, or defaultValue if it is missing or isn't a number.
+    int32_t toInt(uint8_t index, int32_t defaultValue = 0) const;
+
+    // Everything after the command name as it was typed, for commands which parse it themselves.
+    const char* text() const
+    {
+        return m_pText;
+    }
+
+    // Where the command should print its response. Output is sent to the telnet client in as few packets as possible.
+    Print& output;
+
+protected:
+    char        m_line[MAX_COMMAND_LENGTH + 1];     // Copy of the command line, split into words in place.
+    const char* m_words[MAX_COMMAND_ARGS + 1];      // The command name followed by its arguments.
+    uint8_t     m_count;
+    const char* m_pText;
+};
+
+// Handler for a telnet command. pContext is the pointer which was passed to registerCommand().
+typedef void (*MiPDebugCommandHandler)(MiPDebugArgs& args, void* pContext);
+
+
 class MiPDebug: public Print
 {
 public:
+    MiPDebug();
+
     void begin(String hostname, uint8_t startingDebugLevel = VERBOSE);
     void stop();
 
@@ -98,6 +292,25 @@ public:
     String getLastCommand();
     void clearLastCommand();
 
+    // Add a telnet command. The name and help text must be stored in flash, with PSTR() for example. The help text is
+    // shown after the name by the help command, so it can start with the syntax of any arguments. Registering an
+    // existing name replaces that command. Returns false if MAX_COMMANDS are already registered. Commands which aren't
+    // found are still passed to the callback set with setCallBackProjectCmds().
+    bool registerCommand(PGM_P pName, PGM_P pHelp, MiPDebugCommandHandler handler, void* pContext = NULL);
+
+    // Add the stats, rtt, snapshot, queues and sound telnet commands for this MiP.
+    void registerMiPCommands(MiP& mip);
+
+    // Also keep the debug output at or above this level in a flash log, which must already have been started, so that
+    // it survives a reset. Adds the flog telnet command for reading it back.
+    void setFlashLog(MiPFlashLog& flashLog, uint8_t debugLevel = INFO);
+
+    // Send the debug output at or above this level as binary records to a UDP port, for example on the PC running
+    // extras/mip_log_decode. Records are coalesced into datagrams like telnet output. Pass port 0 to stop.
+    void setBinaryUdp(IPAddress address, uint16_t port, uint8_t debugLevel = DEBUG);
+
+    // These set the options for Serial1, every connected telnet client and the clients which connect later. Each
+    // telnet client can then change its own options with commands.
     void showTime(bool show);
     void showProfiler(bool show, uint32_t minTime = 0);
     void showDebugLevel(bool show);
@@ -105,15 +318,41 @@ public:
 
     void autoProfilerLevel(uint32_t millisElapsed);
 
-    void setFilter(String filter);
+    // Returns false, leaving every output unfiltered, if the filter exceeds the FILTER_MAX_* limits.
+    bool setFilter(String filter);
     void setNoFilter();
 
+    // Number of telnet clients currently connected.
+    uint8_t connectedClients();
+
+    // Total number of lines dropped because a telnet client wasn't keeping up with the output.
+    uint32_t droppedLines();
+
     bool isActive(uint8_t debugLevel = DEBUG);
 
+    // Fast check used by the mDebug*() macros. Unlike isActive(), it has no side effects so it can be inlined into
+    // every call site. The level is only recorded by debugf_P() once the message is actually printed.
+    bool isLevelActive(uint8_t debugLevel) const
+    {
+        return __builtin_expect(debugLevel >= m_activeLevel, false);
+    }
+
+    // Print a debug message at the specified level using a format string stored in flash.
+    size_t debugf_P(uint8_t debugLevel, PGM_P pFormat, ...);
+
+    // The same with the message ID of the format string for binary records, as the mDebug*() macros pass it. Without
+    // it the ID is hashed from the format string at run time.
+    size_t debugf_P(uint8_t debugLevel, uint32_t id, PGM_P pFormat, ...);
+
     // These are the extended write methods for the Print class.
     virtual size_t write(uint8_t);
     virtual size_t write(const uint8_t *buffer, size_t size);
 
+    // These replace the Print class versions which can allocate from the heap. Messages longer than BUFFER_PRINT
+    // characters are truncated.
+    size_t printf(const char* pFormat, ...) __attribute__((format(printf, 2, 3)));
+    size_t printf_P(PGM_P pFormat, ...);
+
     // Definitions for each of the debug levels.
     static const uint8_t PROFILER = 0;  // Used to show time of execution of pieces of code (profiler).
     static const uint8_t VERBOSE = 1;   // Used to show verbose messages.
@@ -122,45 +361,163 @@ public:
     static const uint8_t WARNING = 4;   // Used to show warning messages.
     static const uint8_t ERROR = 5;     // Used to show error messages.
     static const uint8_t ANY = 6;       // Used to show messages at any debug level.
+    static const uint8_t NONE = 7;      // No output is active so no messages are shown.
 
     // Expand "CR/LF" characters to "\\r" and "\\n".
     String expand(String string);
 
 protected:
-    void   showHelp();
-    void   processCommand();
-    String formatNumber(uint32_t value, uint8_t size, char insert='0');
+    // The debug level and display options for one destination of debug output: Serial1 or a telnet client.
+    class Options
+    {
+    public:
+        uint8_t  debugLevel = DEBUG;            // The debug level set by the user.
+        uint8_t  levelBeforeProfiler = DEBUG;   // Last level before setting the profiler level.
+        uint32_t levelProfilerDisable = 0;      // Time in millis to disable the profiler level.
+        bool     showTime = false;              // Show time in milliseconds.
+        bool     showProfiler = false;          // Show time between messages.
+        uint32_t minTimeShowProfiler = 0;       // Minimum time to show profiler.
+        bool     showDebugLevel = true;         // Show debug level on each debug message.
+        bool     showColors = false;            // Show colors.
+        bool     isBinary = false;              // Send binary records rather than text. The filter isn't used.
+        MiPDebugFilter filter;                  // Only show lines which match this filter, if active.
+    };
+
+    // A connected telnet client.
+    class Session
+    {
+    public:
+        WiFiClient client;                      // The connection to the client.
+        bool       isConnected = false;         // Was the client still connected at the last call to handle()?
+        Options    options;                     // The client's own debug level and display options.
+        char       command[MAX_COMMAND_LENGTH + 1]; // The current command received from the user.
+        uint8_t    commandLength = 0;           // Number of characters in the current command.
+        uint32_t   lastTimeCommand = 0;         // Time that the last command was received.
+        char       bufferSend[BUFFER_SEND];     // Ring of output waiting to be sent to the client.
+        uint16_t   sendHead = 0;                // Where the next byte is queued in the ring.
+        uint16_t   sendCount = 0;               // Number of bytes queued in the ring.
+        uint32_t   sendTime = 0;                // Time at which the oldest byte in the ring was queued.
+        uint16_t   droppedLines = 0;            // Lines dropped since the last line which was queued.
+        bool       isDroppingLine = false;      // Is the rest of the current line being dropped too?
+    };
+
+    // An entry in the command table.
+    class Command
+    {
+    public:
+        PGM_P                  pName;
+        PGM_P                  pHelp;
+        MiPDebugCommandHandler handler;
+        void*                  pContext;
+        uint16_t               hash;
+    };
+
+    // Collects the response to a command so that it is sent to the telnet client in as few packets as possible. It
+    // goes through the client's output ring like any other output so that a slow client can't block the sketch.
+    class ResponsePrint : public Print
+    {
+    public:
+        ResponsePrint(MiPDebug& debug, Session& session) : m_debug(debug), m_session(session)
+        {
+        }
+
+        ~ResponsePrint()
+        {
+            flush();
+        }
+
+        virtual size_t write(uint8_t character);
+        virtual size_t write(const uint8_t *buffer, size_t size);
+        virtual void   flush();
+
+    protected:
+        MiPDebug& m_debug;
+        Session&  m_session;
+        char      m_buffer[MAX_SIZE_SEND];
+        uint16_t  m_length = 0;
+        bool      m_isContinued = false;
+    };
+
+    static uint16_t hashCommand(const char* pName);
+    int8_t findCommand(const char* pName);
+    void   registerBuiltinCommands();
+
+    static void commandHelp(MiPDebugArgs& args, void* pContext);
+    static void commandQuit(MiPDebugArgs& args, void* pContext);
+    static void commandMemory(MiPDebugArgs& args, void* pContext);
+    static void commandCpu(MiPDebugArgs& args, void* pContext);
+    static void commandLevel(MiPDebugArgs& args, void* pContext);
+    static void commandShow(MiPDebugArgs& args, void* pContext);
+    static void commandProfiler(MiPDebugArgs& args, void* pContext);
+    static void commandProfilerLevel(MiPDebugArgs& args, void* pContext);
+    static void commandAutoProfiler(MiPDebugArgs& args, void* pContext);
+    static void commandFilter(MiPDebugArgs& args, void* pContext);
+    static void commandNoFilter(MiPDebugArgs& args, void* pContext);
+    static void commandScopes(MiPDebugArgs& args, void* pContext);
+    static void commandLoop(MiPDebugArgs& args, void* pContext);
+    static void commandReset(MiPDebugArgs& args, void* pContext);
+    static void commandFlashLog(MiPDebugArgs& args, void* pContext);
+    static void commandBinary(MiPDebugArgs& args, void* pContext);
+
+    void   acceptClient();
+    void   closeSession(Session& session, const char* pReason);
+    void   updateActiveLevel();
+    void   showHelp(Print& output);
+    void   processCommand(Session& session);
     bool   isCRLF(char character);
+    void   beginLine();
+    void   appendToBuffer(const char* pText, size_t length);
+    size_t formatPrefix(const Options& options);
+    bool   isLineShown(const Options& options);
+    void   sendBuffer();
+    bool   setFilter(Options& options, const char* pFilter);
+    static void printFilterTooLong(Print& output);
+    void   queueOutput(Session& session, const char* pData, size_t length, bool isContinued);
+    void   appendToRing(Session& session, const char* pData, size_t length);
+    void   sendOutput(Session& session, bool isForced);
+    static uint32_t hashFormat(PGM_P pFormat);
+    size_t sendMessage(uint32_t id, PGM_P pFormat, va_list args);
+    static size_t encodeArgs(uint8_t* pArgs, size_t size, PGM_P pFormat, va_list args);
+    void   sendRecord(uint32_t id, const uint8_t* pArgs, size_t length);
+    void   sendUdp();
 
     String   m_hostname = "";               // The user-defined hostname for the telnet server.
-    bool     m_connected = false;           // Is a client connected?
-    uint8_t  m_clientDebugLevel = DEBUG;    // The debug level set by the user in telnet.
-    uint8_t  m_lastDebugLevel = DEBUG;      // Last debug level set by active().
+    Session  m_sessions[MAX_TELNET_CLIENTS]; // The telnet clients which can be connected at once.
+    Options  m_serialOptions;               // Options for output to Serial1.
+    Options  m_defaultOptions;              // Options given to telnet clients when they connect.
+    Options  m_flashOptions;                // Options for output to the flash log.
+    MiPFlashLog* m_pFlashLog = NULL;        // The flash log set with setFlashLog(), if any.
+    uint8_t  m_activeLevel = NONE;          // Lowest debug level shown by Serial1 or any connected client.
+    uint8_t  m_textLevel = NONE;            // Lowest debug level shown by an output which takes text.
+    uint8_t  m_binaryLevel = NONE;          // Lowest debug level shown by an output which takes binary records.
+    uint8_t  m_lastDebugLevel = DEBUG;      // Last debug level set by isActive() or debugf_P().
     uint32_t m_lastTimePrint = millis();    // The last time a line was printed.
-    uint8_t  m_levelBeforeProfiler = DEBUG; // Last level before setting the profiler level.
-    uint32_t m_levelProfilerDisable = 0;    // Time in millis to disable the profiler level.
     uint32_t m_autoLevelProfiler = 0;       // Automatic change to profiler level if time between handles is greater than n millis
-    bool     m_showTime = false;            // Show time in milliseconds.
-    bool     m_showProfiler = false;        // Show time between messages.
-    uint32_t m_minTimeShowProfiler = 0;     // Minimum time to show profiler.
-    bool     m_showDebugLevel = true;       // Show debug level on each debug message.
-    bool     m_showColors = false;          // Show colors.
     bool     m_serialEnabled = false;       // Send debug messages to serial too.
     bool     m_resetCommandEnabled = false; // Allow the telnet server to reset the ESP8266.
     bool     m_newLine = true;              // New line write ?
-    String   m_command = "";                // The current command received from the user.
-    String   m_lastCommand = "";            // The last command received from the user.
-    uint32_t m_lastTimeCommand = millis();  // Time that the last command was received.
+    bool     m_isLineContinued = false;     // Has the start of the current line already been sent?
+    char     m_lastCommand[MAX_COMMAND_LENGTH + 1] = ""; // The last command received from the user.
     String   m_helpProjectCmds = "";        // Help commands set by the project (sketch).
     void     (*m_callbackProjectCmds)();    // Callable for project commands.
-    String   m_filter = "";                 // The filter string.
-    bool     m_filterActive = false;        // Is the filter active?
-    String   m_bufferPrint = "";            // Print buffer for telnet output.
-#ifdef CLIENT_BUFFERING
-    String   m_bufferSend = "";             // Buffer for sending data to telnet client.
-    uint16_t m_sizeBufferSend = 0;          // The size of the buffer.
-    uint32_t m_lastTimeSend = 0;            // The last time the command sent data.
-#endif
+    char     m_bufferPrint[BUFFER_PREFIX + BUFFER_PRINT + 2]; // Print buffer for output, with room for the prefix and "\r\n".
+    uint16_t m_bufferLength = 0;            // Number of characters in the print buffer, not counting the prefix.
+    uint8_t  m_lineLevel = DEBUG;           // Debug level of the line in the print buffer.
+    uint32_t m_lineTime = 0;                // Time at which the current line was started.
+    uint32_t m_lineElapsed = 0;             // Time since the previous line when the current line was started.
+    uint32_t m_droppedLines = 0;            // Total number of lines dropped for all telnet clients.
+    Command  m_commands[MAX_COMMANDS];      // The telnet commands, in the order they were registered.
+    uint8_t  m_commandCount = 0;            // Number of entries used in m_commands.
+    uint8_t  m_commandIndex[COMMAND_HASH_SIZE] = {}; // Hash index into m_commands. Each slot holds an index + 1 or 0.
+    Session* m_pCommandSession = NULL;      // The session whose command is being run.
+    bool     m_isRecorded = false;          // Has the text being written already been sent as a binary record?
+    WiFiUDP  m_udp;                         // Binary records sent with setBinaryUdp().
+    Options  m_udpOptions;                  // Options for the binary records sent over UDP.
+    IPAddress m_udpAddress;
+    uint16_t m_udpPort = 0;
+    uint8_t  m_udpBuffer[MAX_SIZE_SEND];    // Records waiting to be sent in the next datagram.
+    uint16_t m_udpLength = 0;
+    uint32_t m_udpTime = 0;                 // Time at which the oldest record in the datagram was queued.
 };
 
 #endif
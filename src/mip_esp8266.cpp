@@ -16,6 +16,8 @@
    Porting done by Samuel Trassare.
 */
 #include "mip_esp8266.h"
+#include "mip_protocol.h"
+#include "mip_format.h"
 
 
 // Number of times that begin() method should try to initialize the MiP.
@@ -24,6 +26,12 @@
 // Number of milliseconds to wait between retries in begin().
 #define MIP_BEGIN_RETRY_WAIT 500
 
+// Number of milliseconds to wait between attempts to reconnect to MiP once the link is down.
+#define MIP_RECONNECT_INTERVAL 5000
+
+// Longest wait between reconnect attempts. The wait doubles after each failed attempt until it reaches this.
+#define MIP_RECONNECT_MAX_INTERVAL 60000
+
 // Number of times to retry methods other than begin().
 #define MIP_MAX_RETRIES 2
 
@@ -42,6 +50,17 @@
 // requests.
 #define MIP_CONTINUOUS_DRIVE_DELAY 50
 
+// Layout of the flight recorder in RTC user memory. A header of a signature and the total number of events recorded
+// is followed by the records themselves. The ESP8266 has 128 blocks of 4 bytes of RTC user memory.
+#define MIP_FLIGHT_RTC_SIGNATURE     0x4D695046
+#define MIP_FLIGHT_RTC_HEADER_BLOCKS 2
+#define MIP_FLIGHT_RTC_RECORD_BLOCKS (sizeof(MiPFlightRecord) / 4)
+
+static_assert(sizeof(MiPFlightRecord) % 4 == 0, "MiPFlightRecord must be a whole number of RTC memory blocks");
+static_assert(MIP_FLIGHT_RECORDER_RTC_OFFSET + MIP_FLIGHT_RTC_HEADER_BLOCKS +
+              MIP_FLIGHT_RTC_RECORD_BLOCKS * MIP_FLIGHT_RECORDER_LENGTH <= 128,
+              "Flight recorder doesn't fit in RTC user memory");
+
 // EEPROM base address.  When reading or writing to EEPROM the user will pass an offset that is added to this base address.
 #define MIP_BASE_EEPROM_ADDRESS 0x20
 
@@ -57,54 +76,6 @@
 // Baud rate used for the esp8266 debug channel.
 #define ESP8266_DEBUG_BAUD_RATE 74880
 
-// MiP Protocol Commands.
-// These command codes are placed in the first byte of requests sent to the MiP and responses sent back from the MiP.
-// See https://github.com/WowWeeLabs/MiP-BLE-Protocol/blob/master/MiP-Protocol.md for more information.
-#define MIP_CMD_RECEIVE_IR_DONGLE_CODE  0x03
-#define MIP_CMD_GET_DETECTED_MIP        0x04
-#define MIP_CMD_PLAY_SOUND              0x06
-#define MIP_CMD_SET_POSITION            0x08
-#define MIP_CMD_GET_GESTURE_RESPONSE    0x0A
-#define MIP_CMD_SET_GESTURE_RADAR_MODE  0x0C
-#define MIP_CMD_GET_RADAR_RESPONSE      0x0C
-#define MIP_CMD_GET_GESTURE_RADAR_MODE  0x0D
-#define MIP_CMD_SET_DETECTION_MODE      0x0E
-#define MIP_CMD_SET_IR_REMOTE_CONTROL   0x10
-#define MIP_CMD_GET_IR_REMOTE_CONTROL   0x11
-#define MIP_CMD_SET_USER_DATA           0x12
-#define MIP_CMD_GET_USER_DATA           0x13
-#define MIP_CMD_GET_SOFTWARE_VERSION    0x14
-#define MIP_CMD_SET_VOLUME              0x15
-#define MIP_CMD_GET_VOLUME              0x16
-#define MIP_CMD_GET_HARDWARE_INFO       0x19
-#define MIP_CMD_SHAKE_RESPONSE          0x1A
-#define MIP_CMD_CLAP_RESPONSE           0x1D
-#define MIP_CMD_ENABLE_CLAP             0x1E
-#define MIP_CMD_GET_CLAP_SETTINGS       0x1F
-#define MIP_CMD_SET_CLAP_DELAY          0x20
-#define MIP_CMD_GET_UP                  0x23
-#define MIP_CMD_DISTANCE_DRIVE          0x70
-#define MIP_CMD_DRIVE_FORWARD           0x71
-#define MIP_CMD_DRIVE_BACKWARD          0x72
-#define MIP_CMD_TURN_LEFT               0x73
-#define MIP_CMD_TURN_RIGHT              0x74
-#define MIP_CMD_SET_GAME_MODE           0x76
-#define MIP_CMD_STOP                    0x77
-#define MIP_CMD_CONTINUOUS_DRIVE        0x78
-#define MIP_CMD_GET_STATUS              0x79
-#define MIP_CMD_GET_WEIGHT              0x81
-#define MIP_CMD_GET_GAME_MODE           0x82
-#define MIP_CMD_GET_CHEST_LED           0x83
-#define MIP_CMD_SET_CHEST_LED           0x84
-#define MIP_CMD_READ_ODOMETER           0x85
-#define MIP_CMD_RESET_ODOMETER          0x86
-#define MIP_CMD_FLASH_CHEST_LED         0x89
-#define MIP_CMD_SET_HEAD_LEDS           0x8A
-#define MIP_CMD_GET_HEAD_LEDS           0x8B
-#define MIP_CMD_SEND_IR_DONGLE_CODE     0x8C
-#define MIP_CMD_SLEEP                   0xFA
-#define MIP_CMD_DISCONNECT_APP          0xFE
-
 
 // expectResponse parameter values for transportSendRequest() parameter.
 #define MIP_EXPECT_NO_RESPONSE 0
@@ -118,18 +89,32 @@
 
 
 
-// Define an assert mechanism that can be used to log and halt when the user is found to be calling the API incorrectly.
+// Define an assert mechanism that can be used to log and halt when the library finds its own internal state to be
+// inconsistent.
 #define MIP_ASSERT(EXPRESSION) if (!(EXPRESSION)) mipAssert(__LINE__);
 
 static void mipAssert(uint32_t lineNumber)
 {
     MIP_DEBUG_ERROR_PRINTF("MiP Assert: mip_esp8266.cpp: %d\n", lineNumber);
+    mipLogFlush();
 
     while (1)
     {
     }
 }
 
+// Parameters passed in by the user are checked with MIP_VERIFY_PARAM instead. Rather than halting, it logs the problem
+// and returns from the calling method with MIP_ERROR_PARAM set as the last error. The optional second argument is the
+// value to return from methods which don't return void.
+#define MIP_VERIFY_PARAM(EXPRESSION, ...) if (!(EXPRESSION)) { mipInvalidParam(__LINE__); \
+                                                               m_lastError = MIP_ERROR_PARAM; \
+                                                               return __VA_ARGS__; }
+
+static void mipInvalidParam(uint32_t lineNumber)
+{
+    MIP_DEBUG_ERROR_PRINTF("MiP: Invalid parameter: mip_esp8266.cpp: %d\n", lineNumber);
+}
+
 
 
 MiP::MiP()
@@ -161,6 +146,46 @@ void MiP::clear()
     m_gestureEvents.clear();
     m_detectedMiPEvents.clear();
     m_irCodeEvents.clear();
+    for (size_t i = 0 ; i < MIP_MAX_PENDING_REQUESTS ; i++)
+    {
+        m_pendingRequests[i].clear();
+    }
+    m_nextSequence = 1;
+    for (size_t i = 0 ; i < MIP_PREFETCH_COUNT ; i++)
+    {
+        m_prefetch[i].clear();
+    }
+    m_prefetchInFlight = false;
+    m_baudRate = 0;
+    m_linkByteTime = 0;
+    m_linkWindowStart = millis();
+    m_linkTx.clear();
+    m_linkRx.clear();
+    m_throttledRequests = 0;
+    m_linkThrottleThreshold = MIP_LINK_DEFAULT_THROTTLE_THRESHOLD;
+    for (size_t i = 0 ; i < MIP_MAX_IDLE_TASKS ; i++)
+    {
+        m_idleTasks[i].clear();
+    }
+    m_isIdling = false;
+    m_linkHistory = 0;
+    m_linkTimeouts = 0;
+    m_linkBadResponses = 0;
+    m_reconnects = 0;
+    m_discardedBytes = 0;
+    m_requestSentMicros = 0;
+    for (size_t i = 0 ; i < MIP_LATENCY_COMMANDS ; i++)
+    {
+        m_latencies[i].clear();
+    }
+    m_latencyCount = 0;
+    m_nextReconnectTime = 0;
+    m_reconnectFailures = 0;
+    m_linkHealthThreshold = MIP_LINK_HEALTH_DEFAULT_THRESHOLD;
+    m_isReconnecting = false;
+    m_restoreState.clear();
+    clearFlightRecorder();
+    m_keepFlightRecorderInRtc = false;
     m_irId = 0x00;
     memset(m_ssid, 0, sizeof(m_ssid));
     memset(m_password, 0, sizeof(m_password));
@@ -257,6 +282,10 @@ bool MiP::begin()
     // error is detected. If this wasn't done then the calls to rawSend() and rawGetStatus() below would fail.
     m_flags |= MRI_FLAG_INITIALIZED;
 
+    // Failed attempts are expected here, so keep them out of the link health history as reconnect() does. Otherwise
+    // they would trigger a reconnect from within begin().
+    m_isReconnecting = true;
+
     // Sometimes the init fails. It seems to happen when the MiP is busy at power-up doing other things like
     // attempting to balance.
     int8_t retry;
@@ -267,6 +296,7 @@ bool MiP::begin()
         if (result == MIP_ERROR_NONE)
         {
             // Connection succeeded at 115200.
+            m_isReconnecting = false;
             return true;
         }
 
@@ -275,13 +305,17 @@ bool MiP::begin()
         if (result == MIP_ERROR_NONE)
         {
             // Connection succeeded at 9600.
+            m_isReconnecting = false;
             return true;
         }
     }
 
-    // Get here if the connection attempt to MiP never succeeds.
+    // Get here if the connection attempt to MiP never succeeds. Rather than giving up for good, leave it to the link
+    // health monitor to try again later.
     m_flags &= ~MRI_FLAG_INITIALIZED;
-    end();
+    m_flags |= MIP_FLAG_LINK_DOWN;
+    m_isReconnecting = false;
+    scheduleReconnect();
     return false;
 }
 
@@ -293,6 +327,13 @@ int8_t MiP::attemptMiPConnection(uint32_t baudRate)
     Serial.begin(baudRate);
     Serial.swap();
 
+    // Start the link accounting afresh at this baud rate.
+    m_baudRate = baudRate;
+    m_linkByteTime = mipByteWireTime(baudRate);
+    m_linkWindowStart = millis();
+    m_linkTx.clear();
+    m_linkRx.clear();
+
     // Send 0xFF to the MiP via UART to enable the UART communication channel in the MiP.
     const uint8_t initMipCommand[] = { 0xFF };
     rawSend(initMipCommand, sizeof(initMipCommand));
@@ -336,7 +377,8 @@ void MiP::end()
     Serial.swap();
     Serial.end();
 
-    // Shutdown the debugging channel.
+    // Shutdown the debugging channel once any queued debug messages have been written out.
+    mipLogFlush();
     Serial1.end();
 
     // Put the D1 mini into deep sleep indefinitely.  MiP will need to be power cycled before the
@@ -373,6 +415,24 @@ void MiP::printLastCallResult()
         case MIP_ERROR_MAX_RETRIES:
             MIP_DEBUG_ERROR_PRINTLN(F("MIP_ERROR_MAX_RETRIES (Exceeded maximum number of retries to get this operation to succeed)"));
             break;
+        case MIP_ERROR_BUSY:
+            MIP_DEBUG_ERROR_PRINTLN(F("MIP_ERROR_BUSY (Too many asynchronous requests are already outstanding)"));
+            break;
+        case MIP_ERROR_PARAM:
+            MIP_DEBUG_ERROR_PRINTLN(F("MIP_ERROR_PARAM (A parameter passed to the API was out of range)"));
+            break;
+        case MIP_ERROR_STALE:
+            MIP_DEBUG_ERROR_PRINTLN(F("MIP_ERROR_STALE (Prefetched value is older than its maximum staleness)"));
+            break;
+        case MIP_ERROR_THROTTLED:
+            MIP_DEBUG_ERROR_PRINTLN(F("MIP_ERROR_THROTTLED (Request dropped since the link to MiP is over its bandwidth budget)"));
+            break;
+        case MIP_ERROR_LINK_DOWN:
+            MIP_DEBUG_ERROR_PRINTLN(F("MIP_ERROR_LINK_DOWN (Request not sent since the link to MiP is down)"));
+            break;
+        case MIP_ERROR_NOT_STARTED:
+            MIP_DEBUG_ERROR_PRINTLN(F("MIP_ERROR_NOT_STARTED (Request not sent since begin() hasn't been called)"));
+            break;
         default:
             MIP_DEBUG_ERROR_PRINTLN(F("unknown error"));
             break;
@@ -523,28 +583,37 @@ MiPGesture MiP::readGestureEvent()
 // recovery happens at a higher level of the driver.
 void MiP::rawSetGestureRadarMode(MiPGestureRadarMode mode)
 {
-    uint8_t command[1+1];
+    uint8_t command[MIP_REQUEST_LEN(MIP_CMD_SET_GESTURE_RADAR_MODE)];
 
     command[0] = MIP_CMD_SET_GESTURE_RADAR_MODE;
     command[1] = mode;
     rawSend(command, sizeof(command));
+
+    m_restoreState.gestureRadarMode = mode;
+    m_restoreState.valid |= MiPRestoreState::MIP_RESTORE_GESTURE_RADAR_MODE;
 }
 
 // This internal protected method sends the get gesture/radar mode command with minimal error handling. The error
 // recovery happens at a higher level of the driver.
 int8_t MiP::rawGetGestureRadarMode(MiPGestureRadarMode& mode)
 {
-    const uint8_t getGestureRadarMode[1] = { MIP_CMD_GET_GESTURE_RADAR_MODE };
-    uint8_t       response[1+1];
-    size_t        responseLength;
-    int8_t        result;
+    const uint8_t   getGestureRadarMode[MIP_REQUEST_LEN(MIP_CMD_GET_GESTURE_RADAR_MODE)] = { MIP_CMD_GET_GESTURE_RADAR_MODE };
+    MiPResponseView response;
+    int8_t          result;
 
-    result = rawReceive(getGestureRadarMode, sizeof(getGestureRadarMode), response, sizeof(response), responseLength);
+    result = rawReceive(getGestureRadarMode, sizeof(getGestureRadarMode), MIP_RESPONSE_LEN(MIP_CMD_GET_GESTURE_RADAR_MODE),
+                        response);
     if (result)
     {
         return result;
     }
-    if (responseLength != 2 ||
+    return parseGestureRadarMode(mode, response.pBuffer, response.length);
+}
+
+// This internal protected method takes the gesture/radar mode response and validates it.
+int8_t MiP::parseGestureRadarMode(MiPGestureRadarMode& mode, const uint8_t response[], size_t responseLength)
+{
+    if (responseLength != MIP_RESPONSE_LEN(MIP_CMD_GET_GESTURE_RADAR_MODE) ||
         response[0] != MIP_CMD_GET_GESTURE_RADAR_MODE ||
         (response[1] != MIP_GESTURE_RADAR_DISABLED &&
          response[1] != MIP_GESTURE &&
@@ -561,6 +630,8 @@ int8_t MiP::rawGetGestureRadarMode(MiPGestureRadarMode& mode)
 
 void MiP::writeChestLED(uint8_t red, uint8_t green, uint8_t blue)
 {
+    MIP_PROFILE_SCOPE("led.chest");
+
     int8_t result;
 
     // The blue channel is actually only 6-bit and not a full 8-bit so zero out lower 2 bits (the MiP does this too).
@@ -604,12 +675,14 @@ void MiP::writeChestLED(uint8_t red, uint8_t green, uint8_t blue)
 
 void MiP::writeChestLED(uint8_t red, uint8_t green, uint8_t blue, uint16_t onTime, uint16_t offTime)
 {
+    MIP_PROFILE_SCOPE("led.chest");
+
     int8_t result;
 
     // on/off time are in units of 20 msecs.
-    MIP_ASSERT( onTime / 20 <= 255 && offTime / 20 <= 255 );
-    onTime = (onTime + 10) / 20;
-    offTime = (offTime + 10) / 20;
+    MIP_VERIFY_PARAM( mipEncodeFlashTime(onTime) <= 255 && mipEncodeFlashTime(offTime) <= 255 );
+    onTime = mipEncodeFlashTime(onTime);
+    offTime = mipEncodeFlashTime(offTime);
 
     // The blue channel is actually only 6-bit and not a full 8-bit so zero out lower 2 bits (the MiP does this too).
     blue &= ~3;
@@ -687,9 +760,9 @@ void MiP::unverifiedWriteChestLED(uint8_t red, uint8_t green, uint8_t blue)
 void MiP::unverifiedWriteChestLED(uint8_t red, uint8_t green, uint8_t blue, uint16_t onTime, uint16_t offTime)
 {
     // on/off time are in units of 20 msecs.
-    MIP_ASSERT( onTime / 20 <= 255 && offTime / 20 <= 255 );
-    onTime = (onTime + 10) / 20;
-    offTime = (offTime + 10) / 20;
+    MIP_VERIFY_PARAM( mipEncodeFlashTime(onTime) <= 255 && mipEncodeFlashTime(offTime) <= 255 );
+    onTime = mipEncodeFlashTime(onTime);
+    offTime = mipEncodeFlashTime(offTime);
 
     rawFlashChestLED(red, green, blue, onTime, offTime);
 }
@@ -703,20 +776,26 @@ void MiP::unverifiedWriteChestLED(const MiPChestLED& chestLED)
 // recovery happens at a higher level of the driver.
 void MiP::rawSetChestLED(uint8_t red, uint8_t green, uint8_t blue)
 {
-    uint8_t command[1+3];
+    uint8_t command[MIP_REQUEST_LEN(MIP_CMD_SET_CHEST_LED)];
 
     command[0] = MIP_CMD_SET_CHEST_LED;
     command[1] = red;
     command[2] = green;
     command[3] = blue;
     rawSend(command, sizeof(command));
+
+    m_restoreState.chestLED.red = red;
+    m_restoreState.chestLED.green = green;
+    m_restoreState.chestLED.blue = blue;
+    m_restoreState.valid |= MiPRestoreState::MIP_RESTORE_CHEST_LED;
+    m_restoreState.valid &= ~MiPRestoreState::MIP_RESTORE_CHEST_LED_FLASH;
 }
 
 // This internal protected method sends the flash chest LED command with no error checking. The error handling /
 // recovery happens at a higher level of the driver.
 void MiP::rawFlashChestLED(uint8_t red, uint8_t green, uint8_t blue, uint16_t onTime, uint16_t offTime)
 {
-    uint8_t command[1+5];
+    uint8_t command[MIP_REQUEST_LEN(MIP_CMD_FLASH_CHEST_LED)];
 
     command[0] = MIP_CMD_FLASH_CHEST_LED;
     command[1] = red;
@@ -726,24 +805,37 @@ void MiP::rawFlashChestLED(uint8_t red, uint8_t green, uint8_t blue, uint16_t on
     command[5] = offTime;
 
     rawSend(command, sizeof(command));
+
+    m_restoreState.chestLED.red = red;
+    m_restoreState.chestLED.green = green;
+    m_restoreState.chestLED.blue = blue;
+    m_restoreState.chestLED.onTime = onTime;
+    m_restoreState.chestLED.offTime = offTime;
+    m_restoreState.valid |= MiPRestoreState::MIP_RESTORE_CHEST_LED | MiPRestoreState::MIP_RESTORE_CHEST_LED_FLASH;
 }
 
 // This internal protected method sends the get chest LED command with minimal error handling. The error
 // recovery happens at a higher level of the driver.
 int8_t MiP::rawGetChestLED(MiPChestLED& chestLED)
 {
-    const uint8_t getChestLED[1] = { MIP_CMD_GET_CHEST_LED };
-    uint8_t       response[1+5];
-    size_t        responseLength;
-    int           result;
+    const uint8_t   getChestLED[MIP_REQUEST_LEN(MIP_CMD_GET_CHEST_LED)] = { MIP_CMD_GET_CHEST_LED };
+    MiPResponseView response;
+    int             result;
 
     chestLED.clear();
-    result = rawReceive(getChestLED, sizeof(getChestLED), response, sizeof(response), responseLength);
+    result = rawReceive(getChestLED, sizeof(getChestLED), MIP_RESPONSE_LEN(MIP_CMD_GET_CHEST_LED), response);
     if (result)
     {
         return result;
     }
-    if (responseLength != sizeof(response) || response[0] != MIP_CMD_GET_CHEST_LED )
+    return parseChestLED(chestLED, response.pBuffer, response.length);
+}
+
+// This internal protected method takes the chest LED response, validates it and converts the on/off times into
+// milliseconds.
+int8_t MiP::parseChestLED(MiPChestLED& chestLED, const uint8_t response[], size_t responseLength)
+{
+    if (responseLength != MIP_RESPONSE_LEN(MIP_CMD_GET_CHEST_LED) || response[0] != MIP_CMD_GET_CHEST_LED )
     {
         return MIP_ERROR_BAD_RESPONSE;
     }
@@ -760,6 +852,8 @@ int8_t MiP::rawGetChestLED(MiPChestLED& chestLED)
 
 void MiP::writeHeadLEDs(MiPHeadLED led1, MiPHeadLED led2, MiPHeadLED led3, MiPHeadLED led4)
 {
+    MIP_PROFILE_SCOPE("led.head");
+
     int8_t result;
 
     // Send the set command and then issue the corresponding get command. Retry if the get fails or doesn't return the
@@ -841,7 +935,7 @@ void MiP::unverifiedWriteHeadLEDs(const MiPHeadLEDs& headLEDs)
 // recovery happens at a higher level of the driver.
 void MiP::rawSetHeadLEDs(MiPHeadLED led1, MiPHeadLED led2, MiPHeadLED led3, MiPHeadLED led4)
 {
-    uint8_t command[1+4];
+    uint8_t command[MIP_REQUEST_LEN(MIP_CMD_SET_HEAD_LEDS)];
 
     command[0] = MIP_CMD_SET_HEAD_LEDS;
     command[1] = led1;
@@ -850,24 +944,35 @@ void MiP::rawSetHeadLEDs(MiPHeadLED led1, MiPHeadLED led2, MiPHeadLED led3, MiPH
     command[4] = led4;
 
     rawSend(command, sizeof(command));
+
+    m_restoreState.headLEDs.led1 = led1;
+    m_restoreState.headLEDs.led2 = led2;
+    m_restoreState.headLEDs.led3 = led3;
+    m_restoreState.headLEDs.led4 = led4;
+    m_restoreState.valid |= MiPRestoreState::MIP_RESTORE_HEAD_LEDS;
 }
 
 // This internal protected method sends the get head LEDs command with minimal error handling. The error
 // recovery happens at a higher level of the driver.
 int8_t MiP::rawGetHeadLEDs(MiPHeadLEDs& headLEDs)
 {
-    const uint8_t getHeadLEDs[1] = { MIP_CMD_GET_HEAD_LEDS };
-    uint8_t       response[1+4];
-    size_t        responseLength;
-    int           result;
+    const uint8_t   getHeadLEDs[MIP_REQUEST_LEN(MIP_CMD_GET_HEAD_LEDS)] = { MIP_CMD_GET_HEAD_LEDS };
+    MiPResponseView response;
+    int             result;
 
     headLEDs.clear();
-    result = rawReceive(getHeadLEDs, sizeof(getHeadLEDs), response, sizeof(response), responseLength);
+    result = rawReceive(getHeadLEDs, sizeof(getHeadLEDs), MIP_RESPONSE_LEN(MIP_CMD_GET_HEAD_LEDS), response);
     if (result)
     {
         return result;
     }
-    if (responseLength != sizeof(response) ||
+    return parseHeadLEDs(headLEDs, response.pBuffer, response.length);
+}
+
+// This internal protected method takes the head LEDs response and validates it.
+int8_t MiP::parseHeadLEDs(MiPHeadLEDs& headLEDs, const uint8_t response[], size_t responseLength)
+{
+    if (responseLength != MIP_RESPONSE_LEN(MIP_CMD_GET_HEAD_LEDS) ||
         response[0] != (uint8_t)MIP_CMD_GET_HEAD_LEDS ||
         !isValidHeadLED(response[1]) ||
         !isValidHeadLED(response[2]) ||
@@ -894,10 +999,12 @@ bool MiP::isValidHeadLED(uint8_t led)
 
 void MiP::continuousDrive(int8_t velocity, int8_t turnRate)
 {
-    uint8_t command[1+2];
+    MIP_PROFILE_SCOPE("drive.continuous");
 
-    MIP_ASSERT( velocity >= -32 && velocity <= 32 );
-    MIP_ASSERT( turnRate >= -32 && turnRate <= 32 );
+    uint8_t command[MIP_REQUEST_LEN(MIP_CMD_CONTINUOUS_DRIVE)];
+
+    MIP_VERIFY_PARAM( velocity >= -32 && velocity <= 32 );
+    MIP_VERIFY_PARAM( turnRate >= -32 && turnRate <= 32 );
 
     // Ignore requests if they come in too fast so that it can be done in a tight loop but not overload MiP.
     if (millis() - m_lastContinuousDriveTime < MIP_CONTINUOUS_DRIVE_DELAY)
@@ -907,44 +1014,27 @@ void MiP::continuousDrive(int8_t velocity, int8_t turnRate)
     }
     m_lastContinuousDriveTime = millis();
 
-    command[0] = MIP_CMD_CONTINUOUS_DRIVE;
-
-    if (velocity == 0)
-    {
-        command[1] = 0x00;
-    }
-    else if (velocity < 0)
-    {
-        command[1] = 0x20 + (-velocity);
-    }
-    else
+    // Drive commands are streamed so dropping one when the link is too busy just results in a small stutter.
+    if (isLinkOverBudget())
     {
-        command[1] = velocity;
+        m_throttledRequests++;
+        m_lastError = MIP_ERROR_THROTTLED;
+        return;
     }
 
-    if (turnRate == 0)
-    {
-        command[2] = 0x00;
-    }
-    else if (turnRate < 0)
-    {
-        command[2] = 0x60 + (-turnRate);
-    }
-    else
-    {
-        command[2] = 0x40 + turnRate;
-    }
+    command[0] = MIP_CMD_CONTINUOUS_DRIVE;
+    command[1] = mipEncodeVelocity(velocity);
+    command[2] = mipEncodeTurnRate(turnRate);
 
     // Send this command blindly with no error checking since there is no way to determine if it has failed.
     rawSend(command, sizeof(command));
-    m_lastError = MIP_ERROR_NONE;
 }
 
 void MiP::distanceDrive(MiPDriveDirection driveDirection, uint8_t cm, MiPTurnDirection turnDirection, uint16_t degrees)
 {
-    uint8_t command[1+5];
+    uint8_t command[MIP_REQUEST_LEN(MIP_CMD_DISTANCE_DRIVE)];
 
-    MIP_ASSERT( degrees <= 360 );
+    MIP_VERIFY_PARAM( degrees <= 360 );
 
     command[0] = MIP_CMD_DISTANCE_DRIVE;
     command[1] = driveDirection;
@@ -955,105 +1045,91 @@ void MiP::distanceDrive(MiPDriveDirection driveDirection, uint8_t cm, MiPTurnDir
 
     // Send this command blindly with no error checking since there is no way to determine if it has failed.
     rawSend(command, sizeof(command));
-    m_lastError = MIP_ERROR_NONE;
 }
 
 void MiP::turnLeft(uint16_t degrees, uint8_t speed)
 {
-    // The turn command is in units of 5 degrees.
-    uint8_t angle = degrees / 5;
-    uint8_t command[1+2];
+    uint8_t command[MIP_REQUEST_LEN(MIP_CMD_TURN_LEFT)];
 
-    MIP_ASSERT( degrees <= 255 * 5 );
-    MIP_ASSERT( speed <= 24 );
+    MIP_VERIFY_PARAM( degrees <= 255 * 5 );
+    MIP_VERIFY_PARAM( speed <= 24 );
 
     command[0] = MIP_CMD_TURN_LEFT;
-    command[1] = angle;
+    command[1] = mipEncodeTurnAngle(degrees);
     command[2] = speed;
 
     // Send this command blindly with no error checking since there is no way to determine if it has failed.
     rawSend(command, sizeof(command));
-    m_lastError = MIP_ERROR_NONE;
 }
 
 void MiP::turnRight(uint16_t degrees, uint8_t speed)
 {
-    // The turn command is in units of 5 degrees.
-    uint8_t angle = degrees / 5;
-    uint8_t command[1+2];
+    uint8_t command[MIP_REQUEST_LEN(MIP_CMD_TURN_RIGHT)];
 
-    MIP_ASSERT( degrees <= 255 * 5 );
-    MIP_ASSERT( speed <= 24 );
+    MIP_VERIFY_PARAM( degrees <= 255 * 5 );
+    MIP_VERIFY_PARAM( speed <= 24 );
 
     command[0] = MIP_CMD_TURN_RIGHT;
-    command[1] = angle;
+    command[1] = mipEncodeTurnAngle(degrees);
     command[2] = speed;
 
     // Send this command blindly with no error checking since there is no way to determine if it has failed.
     rawSend(command, sizeof(command));
-    m_lastError = MIP_ERROR_NONE;
 }
 
 void MiP::driveForward(uint8_t speed, uint16_t time)
 {
-    // The time parameters is in units of 7 milliseconds.
-    uint8_t command[1+2];
+    uint8_t command[MIP_REQUEST_LEN(MIP_CMD_DRIVE_FORWARD)];
 
-    MIP_ASSERT( speed <= 30 );
-    MIP_ASSERT( time <= 255 * 7 );
+    MIP_VERIFY_PARAM( speed <= 30 );
+    MIP_VERIFY_PARAM( time <= 255 * 7 );
 
     command[0] = MIP_CMD_DRIVE_FORWARD;
     command[1] = speed;
-    command[2] = time / 7;
+    command[2] = mipEncodeDriveTime(time);
 
     // Send this command blindly with no error checking since there is no way to determine if it has failed.
     rawSend(command, sizeof(command));
-    m_lastError = MIP_ERROR_NONE;
 }
 
 void MiP::driveBackward(uint8_t speed, uint16_t time)
 {
-    // The time parameters is in units of 7 milliseconds.
-    uint8_t command[1+2];
+    uint8_t command[MIP_REQUEST_LEN(MIP_CMD_DRIVE_BACKWARD)];
 
-    MIP_ASSERT( speed <= 30 );
-    MIP_ASSERT( time <= 255 * 7 );
+    MIP_VERIFY_PARAM( speed <= 30 );
+    MIP_VERIFY_PARAM( time <= 255 * 7 );
 
     command[0] = MIP_CMD_DRIVE_BACKWARD;
     command[1] = speed;
-    command[2] = time / 7;
+    command[2] = mipEncodeDriveTime(time);
 
     // Send this command blindly with no error checking since there is no way to determine if it has failed.
     rawSend(command, sizeof(command));
-    m_lastError = MIP_ERROR_NONE;
 }
 
 void MiP::stop()
 {
-    uint8_t command[1];
+    uint8_t command[MIP_REQUEST_LEN(MIP_CMD_STOP)];
 
     // Send this command blindly with no error checking since there is no way to determine if it has failed.
     command[0] = MIP_CMD_STOP;
     rawSend(command, sizeof(command));
-    m_lastError = MIP_ERROR_NONE;
 }
 
 void MiP::fallForward()
 {
     fallDown(MIP_FALL_FACE_DOWN);
-    m_lastError = MIP_ERROR_NONE;
 }
 
 void MiP::fallBackward()
 {
     fallDown(MIP_FALL_ON_BACK);
-    m_lastError = MIP_ERROR_NONE;
 }
 
 // This internal protected method sends the desired set position command to fall forward or backward.
 void MiP::fallDown(MiPFallDirection direction)
 {
-    uint8_t command[1+1];
+    uint8_t command[MIP_REQUEST_LEN(MIP_CMD_SET_POSITION)];
 
     command[0] = MIP_CMD_SET_POSITION;
     command[1] = direction;
@@ -1064,14 +1140,13 @@ void MiP::fallDown(MiPFallDirection direction)
 
 void MiP::getUp(MiPGetUp getup /* = MIP_GETUP_FROM_EITHER */)
 {
-    uint8_t command[1+1];
+    uint8_t command[MIP_REQUEST_LEN(MIP_CMD_GET_UP)];
 
     command[0] = MIP_CMD_GET_UP;
     command[1] = getup;
 
     // Send this command blindly with no error checking since there is no easy way to determine if it has failed.
     rawSend(command, sizeof(command));
-    m_lastError = MIP_ERROR_NONE;
 }
 
 
@@ -1092,19 +1167,19 @@ void MiP::beginSoundList()
 void MiP::addEntryToSoundList(MiPSoundIndex sound, uint16_t delay /* = 0 */, MiPVolume volume /* = MIP_VOLUME_DEFAULT */)
 {
     // Must call beginSoundList() before calling this function.
-    MIP_ASSERT ( m_soundIndex != -1 );
+    MIP_VERIFY_PARAM ( m_soundIndex != -1 );
 
     // Delay is in units of 30 msecs and can't exceed 255 * 30.
-    MIP_ASSERT( delay <= 255 * 30 );
+    MIP_VERIFY_PARAM( delay <= 255 * 30 );
 
     // Volume can only be set to values between 0 and 7 or 0xFF (which means keep volume as it was).
-    MIP_ASSERT ( volume <= MIP_VOLUME_7 || volume == MIP_VOLUME_DEFAULT );
+    MIP_VERIFY_PARAM ( volume <= MIP_VOLUME_7 || volume == MIP_VOLUME_DEFAULT );
 
     // Need to issue volume command if volume is being changed.
     if (volume != MIP_VOLUME_DEFAULT && volume != m_playVolume)
     {
         // The sound list can only hold 8 sound entries.
-        MIP_ASSERT ( m_soundIndex < 8 );
+        MIP_VERIFY_PARAM ( m_soundIndex < 8 );
         m_playCommand[1 + m_soundIndex * 2] = MIP_SOUND_VOLUME_OFF + volume;
         m_playCommand[1 + m_soundIndex * 2 + 1] = 0;
         m_playVolume = volume;
@@ -1112,9 +1187,9 @@ void MiP::addEntryToSoundList(MiPSoundIndex sound, uint16_t delay /* = 0 */, MiP
     }
 
     // The sound list can only hold 8 sound entries.
-    MIP_ASSERT ( m_soundIndex < 8 );
+    MIP_VERIFY_PARAM ( m_soundIndex < 8 );
     m_playCommand[1 + m_soundIndex * 2] = sound;
-    m_playCommand[1 + m_soundIndex * 2 + 1] = delay / 30;
+    m_playCommand[1 + m_soundIndex * 2 + 1] = mipEncodeSoundDelay(delay);
     m_soundIndex++;
 
     m_lastError = MIP_ERROR_NONE;
@@ -1123,7 +1198,8 @@ void MiP::addEntryToSoundList(MiPSoundIndex sound, uint16_t delay /* = 0 */, MiP
 void MiP::playSoundList(uint8_t repeatCount /* = 0 */)
 {
     // Must call beginSoundList() and addSoundToList() before calling this function.
-    MIP_ASSERT ( m_soundIndex >= 1 );
+    MIP_VERIFY_PARAM ( m_soundIndex >= 1 );
+    static_assert(sizeof(m_playCommand) == MIP_REQUEST_LEN(MIP_CMD_PLAY_SOUND), "m_playCommand size mismatch");
 
     m_playCommand[0] = MIP_CMD_PLAY_SOUND;
 
@@ -1142,14 +1218,14 @@ void MiP::playSoundList(uint8_t repeatCount /* = 0 */)
 
     // Set the index to 8 to flag that no more items can be added to the sound list but you can still play it again.
     m_soundIndex = 8;
-
-    m_lastError = MIP_ERROR_NONE;
 }
 
 void MiP::writeVolume(uint8_t volume)
 {
     int8_t result;
 
+    MIP_VERIFY_PARAM( volume <= 7 );
+
     // Send the set command and then issue the corresponding get command. Retry if the get fails or doesn't return the
     // expected new setting.
     for (uint8_t retry = 0 ; retry < MIP_MAX_RETRIES ; retry++)
@@ -1211,32 +1287,38 @@ uint8_t MiP::readVolume()
 // recovery happens at a higher level of the driver.
 void MiP::rawSetVolume(uint8_t volume)
 {
-    uint8_t command[1+1];
-
-    MIP_ASSERT( volume <= 7 );
+    uint8_t command[MIP_REQUEST_LEN(MIP_CMD_SET_VOLUME)];
 
     command[0] = MIP_CMD_SET_VOLUME;
     command[1] = volume;
 
     rawSend(command, sizeof(command));
+
+    m_restoreState.volume = volume;
+    m_restoreState.valid |= MiPRestoreState::MIP_RESTORE_VOLUME;
 }
 
 // This internal protected method sends the get volume command with minimal error handling. The error
 // recovery happens at a higher level of the driver.
 int8_t MiP::rawGetVolume(uint8_t& volume)
 {
-    const uint8_t getVolume[1] = { MIP_CMD_GET_VOLUME };
-    uint8_t       response[1+1];
-    size_t        responseLength;
-    int8_t        result;
+    const uint8_t   getVolume[MIP_REQUEST_LEN(MIP_CMD_GET_VOLUME)] = { MIP_CMD_GET_VOLUME };
+    MiPResponseView response;
+    int8_t          result;
 
     volume = 0;
-    result = rawReceive(getVolume, sizeof(getVolume), response, sizeof(response), responseLength);
+    result = rawReceive(getVolume, sizeof(getVolume), MIP_RESPONSE_LEN(MIP_CMD_GET_VOLUME), response);
     if (result)
     {
         return result;
     }
-    if (responseLength != sizeof(response) ||
+    return parseVolume(volume, response.pBuffer, response.length);
+}
+
+// This internal protected method takes the volume response and validates it.
+int8_t MiP::parseVolume(uint8_t& volume, const uint8_t response[], size_t responseLength)
+{
+    if (responseLength != MIP_RESPONSE_LEN(MIP_CMD_GET_VOLUME) ||
         response[0] != MIP_CMD_GET_VOLUME ||
         response[1] > 7)
     {
@@ -1244,23 +1326,57 @@ int8_t MiP::rawGetVolume(uint8_t& volume)
     }
 
     volume = response[1];
-    return result;
+    return MIP_ERROR_NONE;
 }
 
 
 float MiP::readDistanceTravelled()
+{
+    uint32_t ticks;
+
+    if (readOdometerTicks(ticks) != MIP_ERROR_NONE)
+    {
+        return 0.0f;
+    }
+    return ticks * (10.0f / MIP_ODOMETER_TICKS_PER_10CM);
+}
+
+uint32_t MiP::readDistanceTravelledTicks()
+{
+    uint32_t ticks;
+
+    if (readOdometerTicks(ticks) != MIP_ERROR_NONE)
+    {
+        return 0;
+    }
+    return ticks;
+}
+
+uint32_t MiP::readDistanceTravelledMillimetres()
+{
+    uint32_t ticks;
+
+    if (readOdometerTicks(ticks) != MIP_ERROR_NONE)
+    {
+        return 0;
+    }
+    return mipDecodeOdometerMillimetres(ticks);
+}
+
+// This internal protected method issues the read odometer command and retries if an error is encountered. The last
+// error is updated with the final result.
+int8_t MiP::readOdometerTicks(uint32_t& ticks)
 {
     int8_t result;
 
     // Retry the read if it should fail on the first attempt.
     for (uint8_t retry = 0 ; retry < MIP_MAX_RETRIES ; retry++)
     {
-        float distance;
-        result = rawReadOdometer(distance);
+        result = rawReadOdometer(ticks);
         if (result == MIP_ERROR_NONE)
         {
             m_lastError = MIP_ERROR_NONE;
-            return distance;
+            return MIP_ERROR_NONE;
         }
 
         // An error was encountered so we will loop around and try again.
@@ -1269,12 +1385,12 @@ float MiP::readDistanceTravelled()
     }
 
     m_lastError = result;
-    return 0.0f;
+    return result;
 }
 
 void MiP::resetDistanceTravelled()
 {
-    uint8_t command[1];
+    uint8_t command[MIP_REQUEST_LEN(MIP_CMD_RESET_ODOMETER)];
 
     command[0] = MIP_CMD_RESET_ODOMETER;
 
@@ -1284,21 +1400,41 @@ void MiP::resetDistanceTravelled()
 
 // This internal protected method sends the read odometer command with minimal error handling. The error
 // recovery happens at a higher level of the driver.
-int8_t MiP::rawReadOdometer(float& distanceInCm)
+int8_t MiP::rawReadOdometer(uint32_t& ticks)
+{
+    const uint8_t   readOdometer[MIP_REQUEST_LEN(MIP_CMD_READ_ODOMETER)] = { MIP_CMD_READ_ODOMETER };
+    MiPResponseView response;
+    int             result;
+
+    ticks = 0;
+    result = rawReceive(readOdometer, sizeof(readOdometer), MIP_RESPONSE_LEN(MIP_CMD_READ_ODOMETER), response);
+    if (result)
+    {
+        return result;
+    }
+    return parseOdometerTicks(ticks, response.pBuffer, response.length);
+}
+
+// This internal protected method takes the odometer response, validates it and converts it into centimeters.
+int8_t MiP::parseOdometer(float& distanceInCm, const uint8_t response[], size_t responseLength)
 {
-    const uint8_t readOdometer[1] = { MIP_CMD_READ_ODOMETER };
-    uint8_t       response[1+4];
-    size_t        responseLength;
-    uint32_t      ticks;
-    int           result;
+    uint32_t ticks;
+    int8_t   result;
 
     distanceInCm = 0.0f;
-    result = rawReceive(readOdometer, sizeof(readOdometer), response, sizeof(response), responseLength);
+    result = parseOdometerTicks(ticks, response, responseLength);
     if (result)
     {
         return result;
     }
-    if (responseLength != sizeof(response) ||
+    distanceInCm = ticks * (10.0f / MIP_ODOMETER_TICKS_PER_10CM);
+    return MIP_ERROR_NONE;
+}
+
+// This internal protected method takes the odometer response, validates it and extracts the raw tick count.
+int8_t MiP::parseOdometerTicks(uint32_t& ticks, const uint8_t response[], size_t responseLength)
+{
+    if (responseLength != MIP_RESPONSE_LEN(MIP_CMD_READ_ODOMETER) ||
         response[0] != MIP_CMD_READ_ODOMETER)
     {
         return MIP_ERROR_BAD_RESPONSE;
@@ -1306,19 +1442,22 @@ int8_t MiP::rawReadOdometer(float& distanceInCm)
 
     // Tick count is stored as big-endian in response buffer.
     ticks = (uint32_t)response[1] << 24 | (uint32_t)response[2] << 16 | (uint32_t)response[3] << 8 | response[4];
-    // Odometer has 48.5 ticks / cm.
-    distanceInCm = (float)((double)ticks / 48.5);
-    return result;
+    return MIP_ERROR_NONE;
 }
 
 
 float MiP::readBatteryVoltage()
+{
+    return readBatteryMillivolts() / 1000.0f;
+}
+
+uint16_t MiP::readBatteryMillivolts()
 {
     // Fetch bytes from the Serial receive buffer and process any event data found within.
     processAllResponseData();
 
     m_lastError = MIP_ERROR_NONE;
-    return m_lastStatus.battery;
+    return m_lastStatus.batteryMillivolts;
 }
 
 MiPPosition MiP::readPosition()
@@ -1369,33 +1508,32 @@ bool MiP::isOnBackWithKickstand()
 // recovery happens at a higher level of the driver in begin(). All status updates after begin() come from events.
 int8_t MiP::rawGetStatus(MiPStatus& status)
 {
-    const uint8_t getStatus[1] = { MIP_CMD_GET_STATUS };
-    uint8_t       response[1+2];
-    size_t        responseLength;
-    int           result;
+    const uint8_t   getStatus[MIP_REQUEST_LEN(MIP_CMD_GET_STATUS)] = { MIP_CMD_GET_STATUS };
+    MiPResponseView response;
+    int             result;
 
     status.clear();
-    result = rawReceive(getStatus, sizeof(getStatus), response, sizeof(response), responseLength);
+    result = rawReceive(getStatus, sizeof(getStatus), MIP_RESPONSE_LEN(MIP_CMD_GET_STATUS), response);
     if (result)
     {
         return result;
     }
-    return parseStatus(status, response, responseLength);
+    return parseStatus(status, response.pBuffer, response.length);
 }
 
 // This internal protected method takes the status response, validates it, converts it into convenient units and
 // packs the result into a MiPStatus class.
 int8_t MiP::parseStatus(MiPStatus& status, const uint8_t response[], size_t responseLength)
 {
-    if (responseLength != 3 ||
+    if (responseLength != MIP_RESPONSE_LEN(MIP_CMD_GET_STATUS) ||
         response[0] != MIP_CMD_GET_STATUS ||
         response[2] > MIP_POSITION_ON_BACK_WITH_KICKSTAND)
     {
         return MIP_ERROR_BAD_RESPONSE;
     }
 
-    // Convert battery integer value to floating point voltage value.
-    status.battery = (float)(((response[1] - 0x4D) / (float)(0x7C - 0x4D)) * (6.4f - 4.0f)) + 4.0f;
+    // Convert battery level to millivolts with a table lookup rather than floating point math.
+    status.batteryMillivolts = mipDecodeBatteryMillivolts(response[1]);
     status.position = (MiPPosition)response[2];
     return MIP_ERROR_NONE;
 }
@@ -1442,24 +1580,23 @@ int8_t MiP::readWeight()
 // recovery happens at a higher level of the driver.
 int8_t MiP::rawGetWeight(int8_t& weight)
 {
-    const uint8_t getWeight[1] = { MIP_CMD_GET_WEIGHT };
-    uint8_t       response[1+1];
-    size_t        responseLength;
-    int           result;
+    const uint8_t   getWeight[MIP_REQUEST_LEN(MIP_CMD_GET_WEIGHT)] = { MIP_CMD_GET_WEIGHT };
+    MiPResponseView response;
+    int             result;
 
     weight = 0.0f;
-    result = rawReceive(getWeight, sizeof(getWeight), response, sizeof(response), responseLength);
+    result = rawReceive(getWeight, sizeof(getWeight), MIP_RESPONSE_LEN(MIP_CMD_GET_WEIGHT), response);
     if (result)
     {
         return result;
     }
-    return parseWeight(weight, response, responseLength);
+    return parseWeight(weight, response.pBuffer, response.length);
 }
 
 // This internal protected method takes the weight response and validates it.
 int8_t MiP::parseWeight(int8_t& weight, const uint8_t response[], size_t responseLength)
 {
-    if (responseLength != 2 ||
+    if (responseLength != MIP_RESPONSE_LEN(MIP_CMD_GET_WEIGHT) ||
         response[0] != MIP_CMD_GET_WEIGHT)
     {
         return MIP_ERROR_BAD_RESPONSE;
@@ -1558,25 +1695,31 @@ void MiP::writeClapDelay(uint16_t delayTime)
 // recovery happens at a higher level of the driver.
 void MiP::rawEnableClap(MiPClapEnabled enabled)
 {
-    uint8_t command[1+1];
+    uint8_t command[MIP_REQUEST_LEN(MIP_CMD_ENABLE_CLAP)];
 
     command[0] = MIP_CMD_ENABLE_CLAP;
     command[1] = enabled;
 
     rawSend(command, sizeof(command));
+
+    m_restoreState.clapEnabled = enabled;
+    m_restoreState.valid |= MiPRestoreState::MIP_RESTORE_CLAP_ENABLED;
 }
 
 // This internal protected method sends the set clap delay command with no error checking. The error handling /
 // recovery happens at a higher level of the driver.
 void MiP::rawSetClapDelay(uint16_t delay)
 {
-    uint8_t command[1+2];
+    uint8_t command[MIP_REQUEST_LEN(MIP_CMD_SET_CLAP_DELAY)];
 
     command[0] = MIP_CMD_SET_CLAP_DELAY;
     command[1] = delay >> 8;
     command[2] = delay & 0xFF;
 
     rawSend(command, sizeof(command));
+
+    m_restoreState.clapDelay = delay;
+    m_restoreState.valid |= MiPRestoreState::MIP_RESTORE_CLAP_DELAY;
 }
 
 bool MiP::areClapEventsEnabled()
@@ -1661,18 +1804,24 @@ uint8_t MiP::readClapEvent()
 // recovery happens at a higher level of the driver.
 int8_t MiP::rawGetClapSettings(MiPClapSettings& settings)
 {
-    const uint8_t getClapSettings[1] = { MIP_CMD_GET_CLAP_SETTINGS };
-    uint8_t       response[1+3];
-    size_t        responseLength;
-    int8_t        result;
+    const uint8_t   getClapSettings[MIP_REQUEST_LEN(MIP_CMD_GET_CLAP_SETTINGS)] = { MIP_CMD_GET_CLAP_SETTINGS };
+    MiPResponseView response;
+    int8_t          result;
 
     settings.clear();
-    result = rawReceive(getClapSettings, sizeof(getClapSettings), response, sizeof(response), responseLength);
+    result = rawReceive(getClapSettings, sizeof(getClapSettings), MIP_RESPONSE_LEN(MIP_CMD_GET_CLAP_SETTINGS),
+                        response);
     if (result)
     {
         return result;
     }
-    if (responseLength != sizeof(response) ||
+    return parseClapSettings(settings, response.pBuffer, response.length);
+}
+
+// This internal protected method takes the clap settings response and validates it.
+int8_t MiP::parseClapSettings(MiPClapSettings& settings, const uint8_t response[], size_t responseLength)
+{
+    if (responseLength != MIP_RESPONSE_LEN(MIP_CMD_GET_CLAP_SETTINGS) ||
         response[0] != MIP_CMD_GET_CLAP_SETTINGS ||
         (response[1] != MIP_CLAP_DISABLED && response[1] != MIP_CLAP_ENABLED))
     {
@@ -1750,18 +1899,24 @@ void MiP::readHardwareInfo(MiPHardwareInfo& hardware)
 // recovery happens at a higher level of the driver.
 int8_t MiP::rawGetSoftwareVersion(MiPSoftwareVersion& software)
 {
-    const uint8_t getSoftwareVersion[1] = { MIP_CMD_GET_SOFTWARE_VERSION };
-    uint8_t       response[1+4];
-    size_t        responseLength;
-    int8_t        result;
+    const uint8_t   getSoftwareVersion[MIP_REQUEST_LEN(MIP_CMD_GET_SOFTWARE_VERSION)] = { MIP_CMD_GET_SOFTWARE_VERSION };
+    MiPResponseView response;
+    int8_t          result;
 
     software.clear();
-    result = rawReceive(getSoftwareVersion, sizeof(getSoftwareVersion), response, sizeof(response), responseLength);
+    result = rawReceive(getSoftwareVersion, sizeof(getSoftwareVersion), MIP_RESPONSE_LEN(MIP_CMD_GET_SOFTWARE_VERSION),
+                        response);
     if (result)
     {
         return result;
     }
-    if (responseLength != sizeof(response) || response[0] != MIP_CMD_GET_SOFTWARE_VERSION)
+    return parseSoftwareVersion(software, response.pBuffer, response.length);
+}
+
+// This internal protected method takes the software version response and validates it.
+int8_t MiP::parseSoftwareVersion(MiPSoftwareVersion& software, const uint8_t response[], size_t responseLength)
+{
+    if (responseLength != MIP_RESPONSE_LEN(MIP_CMD_GET_SOFTWARE_VERSION) || response[0] != MIP_CMD_GET_SOFTWARE_VERSION)
     {
         return MIP_ERROR_BAD_RESPONSE;
     }
@@ -1770,32 +1925,38 @@ int8_t MiP::rawGetSoftwareVersion(MiPSoftwareVersion& software)
     software.month = response[2];
     software.day = response[3];
     software.uniqueVersion = response[4];
-    return result;
+    return MIP_ERROR_NONE;
 }
 
 // This internal protected method sends the get hardware info command with minimal error handling. The error
 // recovery happens at a higher level of the driver.
 int8_t MiP::rawGetHardwareInfo(MiPHardwareInfo& hardware)
 {
-    const uint8_t getHardwareInfo[1] = { MIP_CMD_GET_HARDWARE_INFO };
-    uint8_t       response[1+2];
-    size_t        responseLength;
-    int8_t        result;
+    const uint8_t   getHardwareInfo[MIP_REQUEST_LEN(MIP_CMD_GET_HARDWARE_INFO)] = { MIP_CMD_GET_HARDWARE_INFO };
+    MiPResponseView response;
+    int8_t          result;
 
     hardware.clear();
-    result = rawReceive(getHardwareInfo, sizeof(getHardwareInfo), response, sizeof(response), responseLength);
+    result = rawReceive(getHardwareInfo, sizeof(getHardwareInfo), MIP_RESPONSE_LEN(MIP_CMD_GET_HARDWARE_INFO),
+                        response);
     if (result)
     {
         return result;
     }
-    if (responseLength != sizeof(response) || response[0] != MIP_CMD_GET_HARDWARE_INFO)
+    return parseHardwareInfo(hardware, response.pBuffer, response.length);
+}
+
+// This internal protected method takes the hardware info response and validates it.
+int8_t MiP::parseHardwareInfo(MiPHardwareInfo& hardware, const uint8_t response[], size_t responseLength)
+{
+    if (responseLength != MIP_RESPONSE_LEN(MIP_CMD_GET_HARDWARE_INFO) || response[0] != MIP_CMD_GET_HARDWARE_INFO)
     {
         return MIP_ERROR_BAD_RESPONSE;
     }
 
     hardware.voiceChip = response[1];
     hardware.hardware = response[2];
-    return result;
+    return MIP_ERROR_NONE;
 }
 
 
@@ -1923,7 +2084,7 @@ void MiP::verifiedSetGameMode(MiPGameMode desiredMode)
 // recovery happens at a higher level of the driver.
 void MiP::rawSetGameMode(MiPGameMode mode)
 {
-    uint8_t command[1+1];
+    uint8_t command[MIP_REQUEST_LEN(MIP_CMD_SET_GAME_MODE)];
 
     // Might not accept command if currently running another game mode so Stop first.
     stop();
@@ -1931,26 +2092,43 @@ void MiP::rawSetGameMode(MiPGameMode mode)
     command[0] = MIP_CMD_SET_GAME_MODE;
     command[1] = mode;
     rawSend(command, sizeof(command));
+
+    m_restoreState.gameMode = mode;
+    m_restoreState.valid |= MiPRestoreState::MIP_RESTORE_GAME_MODE;
 }
 
 // This internal protected method sends the get game mode command with minimal error handling. The error
 // recovery happens at a higher level of the driver.
 int8_t MiP::rawGetGameMode(MiPGameMode& mode)
 {
-    const uint8_t getGameMode[1] = { MIP_CMD_GET_GAME_MODE };
-    uint8_t       response[1+1];
-    size_t        responseLength;
-    int8_t        result;
+    const uint8_t   getGameMode[MIP_REQUEST_LEN(MIP_CMD_GET_GAME_MODE)] = { MIP_CMD_GET_GAME_MODE };
+    MiPResponseView response;
+    int8_t          result;
 
     // Might not accept get game mode command when currently running a game mode so Stop first.
     stop();
 
-    result = rawReceive(getGameMode, sizeof(getGameMode), response, sizeof(response), responseLength);
+    result = rawReceive(getGameMode, sizeof(getGameMode), MIP_RESPONSE_LEN(MIP_CMD_GET_GAME_MODE), response);
+    if (result)
+    {
+        return result;
+    }
+    result = parseGameMode(mode, response.pBuffer, response.length);
     if (result)
     {
         return result;
     }
-    if (responseLength != 2 ||
+
+    // Restart the game mode now that we have successfully retrieved it.
+    rawSetGameMode(mode);
+
+    return MIP_ERROR_NONE;
+}
+
+// This internal protected method takes the game mode response and validates it.
+int8_t MiP::parseGameMode(MiPGameMode& mode, const uint8_t response[], size_t responseLength)
+{
+    if (responseLength != MIP_RESPONSE_LEN(MIP_CMD_GET_GAME_MODE) ||
         response[0] != MIP_CMD_GET_GAME_MODE ||
         (response[1] != MIP_APP_MODE &&
          response[1] != MIP_CAGE_MODE &&
@@ -1965,10 +2143,6 @@ int8_t MiP::rawGetGameMode(MiPGameMode& mode)
     }
 
     mode = (MiPGameMode)response[1];
-
-    // Restart the game mode now that we have successfully retrieved it.
-    rawSetGameMode(mode);
-
     return MIP_ERROR_NONE;
 }
 
@@ -1979,7 +2153,7 @@ void MiP::setUserData(uint8_t addressOffset, uint8_t userData)
     uint8_t address = MIP_BASE_EEPROM_ADDRESS + addressOffset;
 
     // Address must be between 0x20 and 0x2F, inclusive.
-    MIP_ASSERT( MIP_BASE_EEPROM_ADDRESS <= address && address <= MIP_LAST_EEPROM_ADDRESS );
+    MIP_VERIFY_PARAM( MIP_BASE_EEPROM_ADDRESS <= address && address <= MIP_LAST_EEPROM_ADDRESS );
 
     int8_t result;
 
@@ -2020,7 +2194,7 @@ uint8_t MiP::getUserData(uint8_t addressOffset)
     uint8_t address = MIP_BASE_EEPROM_ADDRESS + addressOffset;
 
     // Address must be between 0x20 and 0x2F, inclusive.
-    MIP_ASSERT( MIP_BASE_EEPROM_ADDRESS <= address && address <= MIP_LAST_EEPROM_ADDRESS );
+    MIP_VERIFY_PARAM( MIP_BASE_EEPROM_ADDRESS <= address && address <= MIP_LAST_EEPROM_ADDRESS, 0 );
 
    int8_t result;
 
@@ -2048,7 +2222,7 @@ uint8_t MiP::getUserData(uint8_t addressOffset)
 // The error handling and recovery happens at a higher level of the driver.
 void MiP::rawSetUserData(uint8_t address, uint8_t userData)
 {
-    uint8_t command[1+2];
+    uint8_t command[MIP_REQUEST_LEN(MIP_CMD_SET_USER_DATA)];
 
     command[0] = MIP_CMD_SET_USER_DATA;
     command[1] = address;
@@ -2060,18 +2234,17 @@ void MiP::rawSetUserData(uint8_t address, uint8_t userData)
 // The error and recovery happens at a higher level of the driver.
 int8_t MiP::rawGetUserData(uint8_t address, uint8_t& userData)
 {
-    uint8_t getUserData[1+1] = { MIP_CMD_GET_USER_DATA };
+    uint8_t         getUserData[MIP_REQUEST_LEN(MIP_CMD_GET_USER_DATA)] = { MIP_CMD_GET_USER_DATA };
     getUserData[1] = address;
-    uint8_t       response[1+2];
-    size_t        responseLength;
-    int8_t        result;
+    MiPResponseView response;
+    int8_t          result;
 
-    result = rawReceive(getUserData, sizeof(getUserData), response, sizeof(response), responseLength);
+    result = rawReceive(getUserData, sizeof(getUserData), MIP_RESPONSE_LEN(MIP_CMD_GET_USER_DATA), response);
     if (result)
     {
         return result;
     }
-    if (responseLength != 3 ||
+    if (response.length != MIP_RESPONSE_LEN(MIP_CMD_GET_USER_DATA) ||
         response[0] != MIP_CMD_GET_USER_DATA ||
         response[1] != address)
     {
@@ -2086,6 +2259,9 @@ int8_t MiP::rawGetUserData(uint8_t address, uint8_t& userData)
 
 void MiP::enableMiPDetectionMode(uint8_t id, uint8_t txPower)
 {
+    // According to WowWee documentation, TX power must be between 1 and 120.
+    MIP_VERIFY_PARAM( 0x01 <= txPower && txPower <= 0x78 );
+
     m_irId = id;
 
     rawSetMiPDetectionMode(id, txPower);
@@ -2131,15 +2307,17 @@ uint8_t MiP::availableDetectedMiPEvents()
 // handling. The error recovery happens at a higher level of the driver.
 void MiP::rawSetMiPDetectionMode(uint8_t id, uint8_t txPower)
 {
-    uint8_t command[1+2];
-
-    MIP_ASSERT( 0x01 <= txPower && txPower <= 0x78 );
+    uint8_t command[MIP_REQUEST_LEN(MIP_CMD_SET_DETECTION_MODE)];
 
     command[0] = MIP_CMD_SET_DETECTION_MODE;
     command[1] = id;
     command[2] = txPower;
 
     rawSend(command, sizeof(command));
+
+    m_restoreState.detectionId = id;
+    m_restoreState.detectionTxPower = txPower;
+    m_restoreState.valid |= MiPRestoreState::MIP_RESTORE_DETECTION_MODE;
 }
 
 void MiP::enableIRRemoteControl()
@@ -2154,18 +2332,18 @@ void MiP::disableIRRemoteControl()
 
 bool MiP::isIRRemoteControlEnabled()
 {
-    const uint8_t remoteControlEnabled[1] = { MIP_CMD_GET_IR_REMOTE_CONTROL };
-    uint8_t       response[1+1];
-    size_t        responseLength;
-    int8_t        result;
+    const uint8_t   remoteControlEnabled[MIP_REQUEST_LEN(MIP_CMD_GET_IR_REMOTE_CONTROL)] = { MIP_CMD_GET_IR_REMOTE_CONTROL };
+    MiPResponseView response;
+    int8_t          result;
 
-    result = rawReceive(remoteControlEnabled, sizeof(remoteControlEnabled), response, sizeof(response), responseLength);
+    result = rawReceive(remoteControlEnabled, sizeof(remoteControlEnabled), MIP_RESPONSE_LEN(MIP_CMD_GET_IR_REMOTE_CONTROL),
+                        response);
 
     if (result)
     {
         return result;
     }
-    if (responseLength != sizeof(response) ||
+    if (response.length != MIP_RESPONSE_LEN(MIP_CMD_GET_IR_REMOTE_CONTROL) ||
         response[0] != MIP_CMD_GET_IR_REMOTE_CONTROL)
     {
         return MIP_ERROR_BAD_RESPONSE;
@@ -2176,7 +2354,7 @@ bool MiP::isIRRemoteControlEnabled()
 
 void MiP::sendIRDongleCode(uint16_t sendCode, uint8_t transmitPower)
 {
-    uint8_t command[1+6];
+    uint8_t command[MIP_REQUEST_LEN(MIP_CMD_SEND_IR_DONGLE_CODE)];
     command[0] = MIP_CMD_SEND_IR_DONGLE_CODE;
     command[1] = 0x00;
     command[2] = 0x00;
@@ -2253,7 +2431,7 @@ void MiP::verifiedIRRemoteControl(uint8_t desiredRemoteControlMode)
 // handling. The error recovery happens at a higher level of the driver.
 void MiP::rawSetIRRemoteControl(uint8_t remoteControl)
 {
-    uint8_t command[1+1];
+    uint8_t command[MIP_REQUEST_LEN(MIP_CMD_SET_IR_REMOTE_CONTROL)];
 
     MIP_ASSERT( remoteControl == MIP_IR_REMOTE_CONTROL_ENABLE ||  remoteControl == MIP_IR_REMOTE_CONTROL_DISABLE);
 
@@ -2261,142 +2439,1450 @@ void MiP::rawSetIRRemoteControl(uint8_t remoteControl)
     command[1] = remoteControl;
 
     rawSend(command, sizeof(command));
+
+    m_restoreState.irRemoteControl = remoteControl;
+    m_restoreState.valid |= MiPRestoreState::MIP_RESTORE_IR_REMOTE_CONTROL;
 }
 
 // This internal protected method sends the get IR remote control status command with minimal
 // error handling. The error recovery happens at a higher level of the driver.
 int8_t MiP::rawGetIRRemoteControl(uint8_t& remoteControl)
 {
-    const uint8_t getIRRemoteControl[1] = { MIP_CMD_GET_IR_REMOTE_CONTROL };
-    uint8_t       response[1+1];
-    size_t        responseLength;
-    int8_t        result;
+    const uint8_t   getIRRemoteControl[MIP_REQUEST_LEN(MIP_CMD_GET_IR_REMOTE_CONTROL)] = { MIP_CMD_GET_IR_REMOTE_CONTROL };
+    MiPResponseView response;
+    int8_t          result;
 
-    result = rawReceive(getIRRemoteControl, sizeof(getIRRemoteControl), response, sizeof(response), responseLength);
+    result = rawReceive(getIRRemoteControl, sizeof(getIRRemoteControl), MIP_RESPONSE_LEN(MIP_CMD_GET_IR_REMOTE_CONTROL),
+                        response);
     if (result)
     {
         return result;
     }
-    if (responseLength != sizeof(response) ||
+    return parseIRRemoteControl(remoteControl, response.pBuffer, response.length);
+}
+
+// This internal protected method takes the IR remote control status response and validates it.
+int8_t MiP::parseIRRemoteControl(uint8_t& remoteControl, const uint8_t response[], size_t responseLength)
+{
+    if (responseLength != MIP_RESPONSE_LEN(MIP_CMD_GET_IR_REMOTE_CONTROL) ||
         response[0] != MIP_CMD_GET_IR_REMOTE_CONTROL)
     {
         return MIP_ERROR_BAD_RESPONSE;
     }
 
     remoteControl = response[1];
-    return result;
+    return MIP_ERROR_NONE;
 }
 
 
-
-void MiP::rawSend(const uint8_t request[], size_t requestLength)
+void MiP::readSnapshot(MiPSnapshot& snapshot)
 {
-    transportSendRequest(request, requestLength, MIP_EXPECT_NO_RESPONSE);
+    // The requests are all sent back to back, as fast as the pending request table allows, and only then are the
+    // responses collected. This saves waiting out a full round trip for each piece of state.
+    static const uint8_t requests[] =
+    {
+        MIP_CMD_GET_STATUS,
+        MIP_CMD_GET_WEIGHT,
+        MIP_CMD_READ_ODOMETER,
+        MIP_CMD_GET_VOLUME,
+        MIP_CMD_GET_CHEST_LED,
+        MIP_CMD_GET_HEAD_LEDS,
+        MIP_CMD_GET_CLAP_SETTINGS,
+        MIP_CMD_GET_GAME_MODE,
+        MIP_CMD_GET_GESTURE_RADAR_MODE,
+        MIP_CMD_GET_IR_REMOTE_CONTROL
+    };
+    const size_t requestCount = sizeof(requests) / sizeof(requests[0]);
+    uint8_t      slots[requestCount];
+    uint16_t     sequences[requestCount];
+    size_t       nextToSend = 0;
+    size_t       nextToCollect = 0;
+    int8_t       result = MIP_ERROR_NONE;
+    uint32_t     startTime = millis();
+
+    snapshot.clear();
+
+    while (nextToCollect < requestCount)
+    {
+        // Only use free entries so that completed responses which haven't been collected yet aren't recycled.
+        while (nextToSend < requestCount && freePendingRequests() > 0)
+        {
+            allocatePendingRequest(requests[nextToSend], slots[nextToSend], sequences[nextToSend]);
+            nextToSend++;
+        }
+
+        // Wait for the oldest outstanding response.
+        MiPPendingRequest* pRequest;
+        while ((pRequest = findPendingRequest(slots[nextToCollect], sequences[nextToCollect])) != NULL &&
+               pRequest->state != MiPPendingRequest::MIP_PENDING_COMPLETE)
+        {
+            pollPendingRequests();
+            idle();
+        }
+
+        int8_t requestResult = MIP_ERROR_BAD_RESPONSE;
+        if (pRequest != NULL)
+        {
+            requestResult = pRequest->result;
+            if (requestResult == MIP_ERROR_NONE)
+            {
+                requestResult = parseSnapshotResponse(snapshot, pRequest->response, pRequest->responseLength);
+            }
+            pRequest->clear();
+        }
+        if (requestResult != MIP_ERROR_NONE && result == MIP_ERROR_NONE)
+        {
+            // Report the first failure but keep collecting the rest of the snapshot.
+            result = requestResult;
+        }
+        nextToCollect++;
+    }
+
+    // Restart the game mode now that we have successfully retrieved it.
+    if (snapshot.valid & MIP_SNAPSHOT_GAME_MODE)
+    {
+        rawSetGameMode(snapshot.gameMode);
+    }
+
+    snapshot.readTime = millis() - startTime;
+    m_lastError = result;
 }
 
-int8_t MiP::rawReceive(const uint8_t request[], size_t requestLength,
-                          uint8_t responseBuffer[], size_t responseBufferSize, size_t& responseLength)
+// This internal protected method parses a single response collected by readSnapshot() into the matching field of the
+// snapshot.
+int8_t MiP::parseSnapshotResponse(MiPSnapshot& snapshot, const uint8_t response[], size_t responseLength)
 {
-    transportSendRequest(request, requestLength, MIP_EXPECT_RESPONSE);
-    return transportGetResponse(responseBuffer, responseBufferSize, &responseLength);
+    int8_t   result;
+    uint8_t  remoteControl = MIP_IR_REMOTE_CONTROL_DISABLE;
+    uint32_t ticks;
+
+    switch (response[0])
+    {
+    case MIP_CMD_GET_STATUS:
+        result = parseStatus(snapshot.status, response, responseLength);
+        if (result == MIP_ERROR_NONE)
+        {
+            m_lastStatus = snapshot.status;
+            snapshot.valid |= MIP_SNAPSHOT_STATUS;
+        }
+        return result;
+    case MIP_CMD_GET_WEIGHT:
+        result = parseWeight(snapshot.weight, response, responseLength);
+        if (result == MIP_ERROR_NONE)
+        {
+            m_lastWeight = snapshot.weight;
+            m_flags |= MIP_FLAG_WEIGHT_VALID;
+            snapshot.valid |= MIP_SNAPSHOT_WEIGHT;
+        }
+        return result;
+    case MIP_CMD_READ_ODOMETER:
+        result = parseOdometerTicks(ticks, response, responseLength);
+        if (result == MIP_ERROR_NONE)
+        {
+            snapshot.distanceMillimetres = mipDecodeOdometerMillimetres(ticks);
+            snapshot.valid |= MIP_SNAPSHOT_DISTANCE;
+        }
+        return result;
+    case MIP_CMD_GET_VOLUME:
+        result = parseVolume(snapshot.volume, response, responseLength);
+        snapshot.valid |= (result == MIP_ERROR_NONE) ? MIP_SNAPSHOT_VOLUME : 0;
+        return result;
+    case MIP_CMD_GET_CHEST_LED:
+        result = parseChestLED(snapshot.chestLED, response, responseLength);
+        snapshot.valid |= (result == MIP_ERROR_NONE) ? MIP_SNAPSHOT_CHEST_LED : 0;
+        return result;
+    case MIP_CMD_GET_HEAD_LEDS:
+        result = parseHeadLEDs(snapshot.headLEDs, response, responseLength);
+        snapshot.valid |= (result == MIP_ERROR_NONE) ? MIP_SNAPSHOT_HEAD_LEDS : 0;
+        return result;
+    case MIP_CMD_GET_CLAP_SETTINGS:
+        result = parseClapSettings(snapshot.clapSettings, response, responseLength);
+        snapshot.valid |= (result == MIP_ERROR_NONE) ? MIP_SNAPSHOT_CLAP_SETTINGS : 0;
+        return result;
+    case MIP_CMD_GET_GAME_MODE:
+        result = parseGameMode(snapshot.gameMode, response, responseLength);
+        snapshot.valid |= (result == MIP_ERROR_NONE) ? MIP_SNAPSHOT_GAME_MODE : 0;
+        return result;
+    case MIP_CMD_GET_GESTURE_RADAR_MODE:
+        result = parseGestureRadarMode(snapshot.gestureRadarMode, response, responseLength);
+        snapshot.valid |= (result == MIP_ERROR_NONE) ? MIP_SNAPSHOT_GESTURE_RADAR_MODE : 0;
+        return result;
+    case MIP_CMD_GET_IR_REMOTE_CONTROL:
+        result = parseIRRemoteControl(remoteControl, response, responseLength);
+        if (result == MIP_ERROR_NONE)
+        {
+            snapshot.irRemoteControlEnabled = (remoteControl == MIP_IR_REMOTE_CONTROL_ENABLE);
+            snapshot.valid |= MIP_SNAPSHOT_IR_REMOTE_CONTROL;
+        }
+        return result;
+    default:
+        return MIP_ERROR_BAD_RESPONSE;
+    }
 }
 
 
 
-void MiP::transportSendRequest(const uint8_t* pRequest, size_t requestLength, int expectResponse)
+MiPFuture<float> MiP::readDistanceTravelledAsync()
 {
-    // Must call begin() and have it return 'true' before calling sending commands to the MiP.
-    MIP_ASSERT( isInitialized() );
+    return beginAsyncRequest<float>(MIP_CMD_READ_ODOMETER, parseOdometer);
+}
 
-    // Let the MiP process the last request before letting another request be issued.
-    while (millis() - m_lastRequestTime < MIP_REQUEST_DELAY)
-    {
-    }
+MiPFuture<int8_t> MiP::readWeightAsync()
+{
+    return beginAsyncRequest<int8_t>(MIP_CMD_GET_WEIGHT, parseWeight);
+}
 
-    // Remember the command byte (first byte) if expecting a response to this request since the response should start
-    // with the same byte.
-    if (expectResponse)
-    {
-        m_expectedResponseCommand = pRequest[0];
-    }
-    else
-    {
-        m_expectedResponseCommand = 0;
-    }
-    m_expectedResponseSize = 0;
-    m_responseBuffer[0] = 0;
+MiPFuture<uint8_t> MiP::readVolumeAsync()
+{
+    return beginAsyncRequest<uint8_t>(MIP_CMD_GET_VOLUME, parseVolume);
+}
 
-    // Send the specified bytes to the MiP via the UART.
-    while (requestLength-- > 0)
-    {
-        Serial.write(*pRequest++);
-    }
+MiPFuture<MiPSoftwareVersion> MiP::readSoftwareVersionAsync()
+{
+    return beginAsyncRequest<MiPSoftwareVersion>(MIP_CMD_GET_SOFTWARE_VERSION, parseSoftwareVersion);
+}
 
-    m_lastRequestTime = millis();
+MiPFuture<MiPHardwareInfo> MiP::readHardwareInfoAsync()
+{
+    return beginAsyncRequest<MiPHardwareInfo>(MIP_CMD_GET_HARDWARE_INFO, parseHardwareInfo);
 }
 
-int8_t MiP::transportGetResponse(uint8_t* pResponseBuffer, size_t responseBufferSize, size_t* pResponseLength)
+MiPFuture<MiPChestLED> MiP::readChestLEDAsync()
 {
-    // Must call begin() and have it return 'true' before calling sending commands to the MiP.
-    MIP_ASSERT( isInitialized() );
+    return beginAsyncRequest<MiPChestLED>(MIP_CMD_GET_CHEST_LED, parseChestLED);
+}
 
-    // Caller is attempting to get a response that is larger than support by the MiP and this library.
-    MIP_ASSERT( responseBufferSize <= MIP_RESPONSE_MAX_LEN);
+MiPFuture<MiPHeadLEDs> MiP::readHeadLEDsAsync()
+{
+    return beginAsyncRequest<MiPHeadLEDs>(MIP_CMD_GET_HEAD_LEDS, parseHeadLEDs);
+}
 
-    // UNDONE: I think it would be my bug if the following assert ever fired.
-    MIP_ASSERT( m_expectedResponseCommand != 0 );
+MiPFuture<MiPClapSettings> MiP::readClapSettingsAsync()
+{
+    return beginAsyncRequest<MiPClapSettings>(MIP_CMD_GET_CLAP_SETTINGS, parseClapSettings);
+}
 
-    // Process all received bytes (which might include out of band notifications) until we find the response to the
+void MiP::handle()
+{
+    MIP_PROFILE_SCOPE("handle");
+
+    mipLoopTick();
+    mipLogService();
+    checkLinkHealth();
+    pollPendingRequests();
+    servicePrefetch();
+}
+
+void MiP::enablePrefetch(MiPPrefetchProperty property, uint32_t interval, uint32_t maxStaleness /* = 0 */,
+                         MiPStalePolicy policy /* = MIP_STALE_ALLOW */)
+{
+    MIP_VERIFY_PARAM( property < MIP_PREFETCH_COUNT );
+
+    MiPPrefetchEntry& entry = m_prefetch[property];
+    entry.interval = interval;
+    entry.maxStaleness = maxStaleness;
+    entry.policy = policy;
+    // Make the first request on the next call to handle().
+    entry.lastRequestTime = millis() - interval;
+    entry.enabled = true;
+    m_lastError = MIP_ERROR_NONE;
+}
+
+void MiP::disablePrefetch(MiPPrefetchProperty property)
+{
+    MIP_VERIFY_PARAM( property < MIP_PREFETCH_COUNT );
+
+    m_prefetch[property].enabled = false;
+    m_lastError = MIP_ERROR_NONE;
+}
+
+uint32_t MiP::prefetchAge(MiPPrefetchProperty property)
+{
+    MIP_VERIFY_PARAM( property < MIP_PREFETCH_COUNT, 0xFFFFFFFF );
+
+    m_lastError = MIP_ERROR_NONE;
+    if (!m_prefetch[property].valid)
+    {
+        return 0xFFFFFFFF;
+    }
+    return millis() - m_prefetch[property].timestamp;
+}
+
+uint32_t MiP::readPrefetchedDistanceTicks()
+{
+    uint32_t value;
+
+    readPrefetched(MIP_PREFETCH_DISTANCE, value);
+    return value;
+}
+
+int8_t MiP::readPrefetchedWeight()
+{
+    uint32_t value;
+
+    readPrefetched(MIP_PREFETCH_WEIGHT, value);
+    return (int8_t)value;
+}
+
+uint8_t MiP::readPrefetchedVolume()
+{
+    uint32_t value;
+
+    readPrefetched(MIP_PREFETCH_VOLUME, value);
+    return (uint8_t)value;
+}
+
+// This internal protected method returns the cached value of a property after applying its staleness policy. The
+// last error is set accordingly.
+bool MiP::readPrefetched(MiPPrefetchProperty property, uint32_t& value)
+{
+    MiPPrefetchEntry& entry = m_prefetch[property];
+
+    // Pick up any responses which have already arrived.
+    pollPendingRequests();
+
+    value = entry.value;
+    bool isStale = !entry.valid || (entry.maxStaleness != 0 && millis() - entry.timestamp > entry.maxStaleness);
+    if (!isStale)
+    {
+        m_lastError = MIP_ERROR_NONE;
+        return true;
+    }
+
+    switch (entry.policy)
+    {
+    case MIP_STALE_REFRESH:
+        m_lastError = fetchPrefetchProperty(property, value);
+        if (m_lastError == MIP_ERROR_NONE)
+        {
+            updatePrefetch(property, value);
+            return true;
+        }
+        return false;
+    case MIP_STALE_ERROR:
+        m_lastError = MIP_ERROR_STALE;
+        return false;
+    default:
+        m_lastError = entry.valid ? MIP_ERROR_NONE : MIP_ERROR_NO_EVENT;
+        return entry.valid;
+    }
+}
+
+// This internal protected method reads a property from MiP while blocking, retrying if an error is encountered.
+int8_t MiP::fetchPrefetchProperty(MiPPrefetchProperty property, uint32_t& value)
+{
+    int8_t result = MIP_ERROR_BAD_RESPONSE;
+
+    for (uint8_t retry = 0 ; retry < MIP_MAX_RETRIES ; retry++)
+    {
+        switch (property)
+        {
+        case MIP_PREFETCH_DISTANCE:
+            result = rawReadOdometer(value);
+            break;
+        case MIP_PREFETCH_WEIGHT:
+            int8_t weight;
+            result = rawGetWeight(weight);
+            value = (uint32_t)(int32_t)weight;
+            break;
+        case MIP_PREFETCH_VOLUME:
+            uint8_t volume;
+            result = rawGetVolume(volume);
+            value = volume;
+            break;
+        default:
+            return MIP_ERROR_PARAM;
+        }
+        if (result == MIP_ERROR_NONE)
+        {
+            return MIP_ERROR_NONE;
+        }
+
+        // An error was encountered so we will loop around and try again.
+        // Wait for a bit before the next retry.
+        delay(MIP_RETRY_WAIT);
+    }
+    return result;
+}
+
+// This internal protected method stores a freshly received value for a property.
+void MiP::updatePrefetch(MiPPrefetchProperty property, uint32_t value)
+{
+    MiPPrefetchEntry& entry = m_prefetch[property];
+
+    entry.value = value;
+    entry.timestamp = millis();
+    entry.valid = true;
+}
+
+// This internal protected method is called from handle() to issue the next background prefetch request, if one is
+// due. It only uses the link when it is otherwise idle: a single prefetch is in flight at a time, no other
+// asynchronous requests can be waiting and MIP_PREFETCH_RESERVED_REQUESTS entries are left for the application.
+void MiP::servicePrefetch()
+{
+    if (m_prefetchInFlight || freePendingRequests() <= MIP_PREFETCH_RESERVED_REQUESTS)
+    {
+        return;
+    }
+    for (uint8_t i = 0 ; i < MIP_MAX_PENDING_REQUESTS ; i++)
+    {
+        if (m_pendingRequests[i].state == MiPPendingRequest::MIP_PENDING_WAITING)
+        {
+            return;
+        }
+    }
+
+    // Service the most overdue property first.
+    uint32_t currentTime = millis();
+    int8_t   next = -1;
+    uint32_t nextOverdue = 0;
+    for (uint8_t i = 0 ; i < MIP_PREFETCH_COUNT ; i++)
+    {
+        MiPPrefetchEntry& entry = m_prefetch[i];
+        uint32_t          elapsed = currentTime - entry.lastRequestTime;
+
+        if (entry.enabled && elapsed >= entry.interval && (next < 0 || elapsed - entry.interval > nextOverdue))
+        {
+            next = i;
+            nextOverdue = elapsed - entry.interval;
+        }
+    }
+    if (next < 0)
+    {
+        return;
+    }
+
+    // Skip this poll if the link is too busy. The cached value just gets a bit older until the next interval.
+    m_prefetch[next].lastRequestTime = currentTime;
+    if (isLinkOverBudget())
+    {
+        m_throttledRequests++;
+        return;
+    }
+
+    m_prefetchInFlight = true;
+    switch (next)
+    {
+    case MIP_PREFETCH_DISTANCE:
+        beginAsyncRequest<uint32_t>(MIP_CMD_READ_ODOMETER, parseOdometerTicks).then(onPrefetchedDistance, this);
+        break;
+    case MIP_PREFETCH_WEIGHT:
+        beginAsyncRequest<int8_t>(MIP_CMD_GET_WEIGHT, parseWeight).then(onPrefetchedWeight, this);
+        break;
+    case MIP_PREFETCH_VOLUME:
+        beginAsyncRequest<uint8_t>(MIP_CMD_GET_VOLUME, parseVolume).then(onPrefetchedVolume, this);
+        break;
+    }
+}
+
+// These internal protected methods are the continuations for the background prefetch requests.
+void MiP::onPrefetchedDistance(int8_t result, const uint32_t& ticks, void* pContext)
+{
+    MiP* pThis = (MiP*)pContext;
+
+    pThis->m_prefetchInFlight = false;
+    if (result == MIP_ERROR_NONE)
+    {
+        pThis->updatePrefetch(MIP_PREFETCH_DISTANCE, ticks);
+    }
+}
+
+void MiP::onPrefetchedWeight(int8_t result, const int8_t& weight, void* pContext)
+{
+    MiP* pThis = (MiP*)pContext;
+
+    pThis->m_prefetchInFlight = false;
+    if (result == MIP_ERROR_NONE)
+    {
+        pThis->updatePrefetch(MIP_PREFETCH_WEIGHT, (uint32_t)(int32_t)weight);
+    }
+}
+
+void MiP::onPrefetchedVolume(int8_t result, const uint8_t& volume, void* pContext)
+{
+    MiP* pThis = (MiP*)pContext;
+
+    pThis->m_prefetchInFlight = false;
+    if (result == MIP_ERROR_NONE)
+    {
+        pThis->updatePrefetch(MIP_PREFETCH_VOLUME, volume);
+    }
+}
+
+uint8_t MiP::readLinkUtilization()
+{
+    updateLinkWindow();
+
+    uint8_t txUtilization = linkUtilization(m_linkTx);
+    uint8_t rxUtilization = linkUtilization(m_linkRx);
+    return txUtilization > rxUtilization ? txUtilization : rxUtilization;
+}
+
+void MiP::readLinkStats(MiPLinkStats& stats)
+{
+    updateLinkWindow();
+
+    stats.baudRate = m_baudRate;
+    stats.bytesSent = m_linkTx.totalBytes;
+    stats.bytesReceived = m_linkRx.totalBytes;
+    stats.throttledRequests = m_throttledRequests;
+    stats.timeouts = m_linkTimeouts;
+    stats.badResponses = m_linkBadResponses;
+    stats.reconnects = m_reconnects;
+    stats.discardedBytes = m_discardedBytes;
+    stats.recentFailures = __builtin_popcount(m_linkHistory);
+    stats.txUtilization = linkUtilization(m_linkTx);
+    stats.rxUtilization = linkUtilization(m_linkRx);
+}
+
+bool MiP::isLinkOverBudget()
+{
+    return readLinkUtilization() > m_linkThrottleThreshold;
+}
+
+void MiP::setLinkThrottleThreshold(uint8_t percent)
+{
+    MIP_VERIFY_PARAM( percent <= 100 );
+
+    m_linkThrottleThreshold = percent;
+    m_lastError = MIP_ERROR_NONE;
+}
+
+uint32_t MiP::estimateCommandWireTime(uint8_t command, uint32_t baudRate /* = 0 */)
+{
+    MiPCommandInfo info;
+
+    if (baudRate == 0)
+    {
+        baudRate = m_baudRate;
+    }
+    MIP_VERIFY_PARAM( baudRate != 0, 0 );
+    MIP_VERIFY_PARAM( mipLookupCommand(command, info), 0 );
+
+    m_lastError = MIP_ERROR_NONE;
+    return (mipRequestWireBytes(info) + mipResponseWireBytes(info)) * mipByteWireTime(baudRate);
+}
+
+void MiP::readQueueStats(MiPEventQueue queue, MiPQueueStats& stats)
+{
+    stats.clear();
+    MIP_VERIFY_PARAM( queue < MIP_QUEUE_COUNT );
+
+    switch (queue)
+    {
+    case MIP_QUEUE_CLAP:
+        stats.count = m_clapEvents.available();
+        stats.capacity = m_clapEvents.capacity();
+        stats.highWater = m_clapEvents.highWater();
+        stats.overflows = m_clapEvents.overflows();
+        break;
+    case MIP_QUEUE_GESTURE:
+        stats.count = m_gestureEvents.available();
+        stats.capacity = m_gestureEvents.capacity();
+        stats.highWater = m_gestureEvents.highWater();
+        stats.overflows = m_gestureEvents.overflows();
+        break;
+    case MIP_QUEUE_IR_CODE:
+        stats.count = m_irCodeEvents.available();
+        stats.capacity = m_irCodeEvents.capacity();
+        stats.highWater = m_irCodeEvents.highWater();
+        stats.overflows = m_irCodeEvents.overflows();
+        break;
+    default:
+        stats.count = m_detectedMiPEvents.available();
+        stats.capacity = m_detectedMiPEvents.capacity();
+        stats.highWater = m_detectedMiPEvents.highWater();
+        stats.overflows = m_detectedMiPEvents.overflows();
+        break;
+    }
+    m_lastError = MIP_ERROR_NONE;
+}
+
+uint8_t MiP::readCommandLatencies(MiPCommandLatency latencies[], uint8_t maxEntries)
+{
+    uint8_t count = m_latencyCount < maxEntries ? m_latencyCount : maxEntries;
+
+    for (uint8_t i = 0 ; i < count ; i++)
+    {
+        const MiPLatencyEntry& entry = m_latencies[i];
+        MiPCommandLatency&     latency = latencies[i];
+
+        latency.command = entry.command;
+        latency.count = entry.roundTrips.count;
+        latency.timeouts = entry.timeouts;
+        latency.p50 = entry.roundTrips.percentile(50);
+        latency.p95 = entry.roundTrips.percentile(95);
+        latency.p99 = entry.roundTrips.percentile(99);
+        latency.max = entry.roundTrips.maxValue;
+    }
+
+    m_lastError = MIP_ERROR_NONE;
+    return count;
+}
+
+void MiP::clearTransportStats()
+{
+    for (uint8_t i = 0 ; i < MIP_LATENCY_COMMANDS ; i++)
+    {
+        m_latencies[i].clear();
+    }
+    m_latencyCount = 0;
+    m_discardedBytes = 0;
+    m_clapEvents.clearStats();
+    m_gestureEvents.clearStats();
+    m_irCodeEvents.clearStats();
+    m_detectedMiPEvents.clearStats();
+    m_lastError = MIP_ERROR_NONE;
+}
+
+// This internal protected method returns the round trip time table entry for a command, adding one if there is room.
+// Returns NULL if the table is already full of other commands.
+MiPLatencyEntry* MiP::findLatencyEntry(uint8_t command)
+{
+    for (uint8_t i = 0 ; i < m_latencyCount ; i++)
+    {
+        if (m_latencies[i].command == command)
+        {
+            return &m_latencies[i];
+        }
+    }
+    if (m_latencyCount >= MIP_LATENCY_COMMANDS)
+    {
+        return NULL;
+    }
+
+    MiPLatencyEntry* pEntry = &m_latencies[m_latencyCount++];
+    pEntry->clear();
+    pEntry->command = command;
+    return pEntry;
+}
+
+// This internal protected method adds the time since a request was sent to the round trip times of its command.
+void MiP::recordRoundTrip(uint8_t command, uint32_t sentMicros)
+{
+    MiPLatencyEntry* pEntry = findLatencyEntry(command);
+
+    if (pEntry != NULL)
+    {
+        pEntry->roundTrips.record(micros() - sentMicros);
+    }
+}
+
+// This internal protected method counts a response which never arrived against its command.
+void MiP::recordCommandTimeout(uint8_t command)
+{
+    MiPLatencyEntry* pEntry = findLatencyEntry(command);
+
+    if (pEntry != NULL)
+    {
+        pEntry->timeouts++;
+    }
+}
+
+// This internal protected method charges the wire time for byteCount characters to one direction of the link.
+void MiP::accountLinkTraffic(MiPLinkUsage& usage, size_t byteCount)
+{
+    updateLinkWindow();
+
+    usage.totalBytes += byteCount;
+    usage.currentMicros += byteCount * m_linkByteTime;
+}
+
+// This internal protected method moves the link accounting on to a new window once the current one has expired.
+void MiP::updateLinkWindow()
+{
+    uint32_t elapsed = millis() - m_linkWindowStart;
+
+    if (elapsed < MIP_LINK_WINDOW)
+    {
+        return;
+    }
+
+    // If a whole window went by without any accounting then it was idle.
+    bool isPreviousIdle = elapsed >= 2 * MIP_LINK_WINDOW;
+    m_linkTx.previousMicros = isPreviousIdle ? 0 : m_linkTx.currentMicros;
+    m_linkTx.currentMicros = 0;
+    m_linkRx.previousMicros = isPreviousIdle ? 0 : m_linkRx.currentMicros;
+    m_linkRx.currentMicros = 0;
+    m_linkWindowStart += elapsed - elapsed % MIP_LINK_WINDOW;
+}
+
+// This internal protected method returns the percentage of the last MIP_LINK_WINDOW milliseconds that one direction
+// of the link was busy. The previous window is weighted by how much of it still falls within that period.
+uint8_t MiP::linkUtilization(const MiPLinkUsage& usage)
+{
+    uint32_t elapsed = millis() - m_linkWindowStart;
+    uint32_t busyMicros = usage.previousMicros / MIP_LINK_WINDOW * (MIP_LINK_WINDOW - elapsed) + usage.currentMicros;
+    uint32_t percent = busyMicros / (MIP_LINK_WINDOW * 10);
+
+    return percent > 100 ? 100 : percent;
+}
+
+bool MiP::addIdleTask(MiPIdleTask task, void* pContext /* = NULL */)
+{
+    MIP_VERIFY_PARAM( task != NULL, false );
+
+    for (uint8_t i = 0 ; i < MIP_MAX_IDLE_TASKS ; i++)
+    {
+        if (m_idleTasks[i].task == NULL)
+        {
+            m_idleTasks[i].task = task;
+            m_idleTasks[i].pContext = pContext;
+            m_lastError = MIP_ERROR_NONE;
+            return true;
+        }
+    }
+
+    MIP_DEBUG_WARN_PRINTLN(F("MiP: Too many idle tasks"));
+    m_lastError = MIP_ERROR_BUSY;
+    return false;
+}
+
+void MiP::removeIdleTask(MiPIdleTask task, void* pContext /* = NULL */)
+{
+    for (uint8_t i = 0 ; i < MIP_MAX_IDLE_TASKS ; i++)
+    {
+        if (m_idleTasks[i].task == task && m_idleTasks[i].pContext == pContext)
+        {
+            m_idleTasks[i].clear();
+        }
+    }
+    m_lastError = MIP_ERROR_NONE;
+}
+
+void MiP::setLinkHealthThreshold(uint8_t failureThreshold)
+{
+    MIP_VERIFY_PARAM( failureThreshold <= 32 );
+
+    m_linkHealthThreshold = failureThreshold;
+    m_lastError = MIP_ERROR_NONE;
+}
+
+bool MiP::isLinkDown()
+{
+    return (m_flags & MIP_FLAG_LINK_DOWN) != 0;
+}
+
+bool MiP::reconnect()
+{
+    // Must call begin() before the link can be reestablished.
+    if (!isInitialized() && !isLinkDown())
+    {
+        MIP_DEBUG_ERROR_PRINTLN(F("MiP: reconnect() called before begin()"));
+        m_lastError = MIP_ERROR_NOT_STARTED;
+        return false;
+    }
+
+    bool wasInitialized = isInitialized();
+
+    MIP_DEBUG_WARN_PRINTLN(F("MiP: Reconnecting"));
+    m_isReconnecting = true;
+
+    // Nothing sent before the reconnect is going to be answered now.
+    failWaitingRequests();
+    m_expectedResponseCommand = 0;
+    m_expectedResponseSize = 0;
+
+    // Let the transport send the handshake.
+    m_flags |= MRI_FLAG_INITIALIZED;
+    m_flags &= ~MIP_FLAG_LINK_DOWN;
+    m_lastRequestTime = millis() - MIP_REQUEST_DELAY;
+
+    // Start with the baud rate which worked last time.
+    uint32_t firstBaudRate = (m_baudRate == MIP_SLOW_BAUD_RATE) ? MIP_SLOW_BAUD_RATE : MIP_FAST_BAUD_RATE;
+    uint32_t secondBaudRate = (firstBaudRate == MIP_SLOW_BAUD_RATE) ? MIP_FAST_BAUD_RATE : MIP_SLOW_BAUD_RATE;
+    int8_t   result = attemptMiPConnection(firstBaudRate);
+    if (result != MIP_ERROR_NONE)
+    {
+        result = attemptMiPConnection(secondBaudRate);
+    }
+    if (result != MIP_ERROR_NONE)
+    {
+        MIP_DEBUG_ERROR_PRINTLN(F("MiP: Reconnect failed"));
+        recordFlightEvent(MIP_FLIGHT_RECONNECT, (const uint8_t*)"\x00", 1);
+        if (!wasInitialized)
+        {
+            m_flags &= ~MRI_FLAG_INITIALIZED;
+        }
+        m_flags |= MIP_FLAG_LINK_DOWN;
+        scheduleReconnect();
+        m_isReconnecting = false;
+        m_lastError = result;
+        return false;
+    }
+
+    restoreState();
+    recordFlightEvent(MIP_FLIGHT_RECONNECT, (const uint8_t*)"\x01", 1);
+    m_linkHistory = 0;
+    m_reconnectFailures = 0;
+    m_reconnects++;
+    m_isReconnecting = false;
+    m_lastError = MIP_ERROR_NONE;
+    return true;
+}
+
+// This internal protected method adds the outcome of an exchange with MiP to the link health history. Each bit of
+// m_linkHistory is one exchange, with a 1 for a failure and the most recent in bit 0.
+void MiP::recordLinkResult(int8_t result)
+{
+    // Failures while reconnecting are expected and are reported by reconnect() itself.
+    if (m_isReconnecting)
+    {
+        return;
+    }
+
+    m_linkHistory <<= 1;
+    switch (result)
+    {
+    case MIP_ERROR_NONE:
+        break;
+    case MIP_ERROR_TIMEOUT:
+        m_linkTimeouts++;
+        m_linkHistory |= 1;
+        break;
+    default:
+        m_linkBadResponses++;
+        m_linkHistory |= 1;
+        break;
+    }
+}
+
+// This internal protected method sets when the next attempt to reconnect to MiP is due after an attempt has failed.
+// The wait doubles with each consecutive failure, up to MIP_RECONNECT_MAX_INTERVAL, so that a MiP which has been
+// switched off doesn't stall the sketch for over a second every few seconds.
+void MiP::scheduleReconnect()
+{
+    uint32_t interval = MIP_RECONNECT_INTERVAL;
+
+    for (uint8_t i = 0 ; i < m_reconnectFailures && interval < MIP_RECONNECT_MAX_INTERVAL ; i++)
+    {
+        interval *= 2;
+    }
+    if (interval > MIP_RECONNECT_MAX_INTERVAL)
+    {
+        interval = MIP_RECONNECT_MAX_INTERVAL;
+    }
+    if (m_reconnectFailures < 255)
+    {
+        m_reconnectFailures++;
+    }
+    m_nextReconnectTime = millis() + interval;
+}
+
+// This internal protected method is called before each request and from handle() to reconnect to MiP if the link has
+// gone bad or is down and due for another attempt.
+void MiP::checkLinkHealth()
+{
+    if (m_isReconnecting || m_linkHealthThreshold == 0)
+    {
+        return;
+    }
+
+    if (isLinkDown())
+    {
+        if ((int32_t)(millis() - m_nextReconnectTime) >= 0)
+        {
+            reconnect();
+        }
+        return;
+    }
+    if (isInitialized() && __builtin_popcount(m_linkHistory) >= m_linkHealthThreshold)
+    {
+        MIP_DEBUG_WARN_PRINTF("MiP: Link unhealthy (%d of last 32 exchanges failed)\n", __builtin_popcount(m_linkHistory));
+        reconnect();
+    }
+}
+
+// This internal protected method completes every asynchronous request which is still waiting on a response with
+// MIP_ERROR_TIMEOUT. Their continuations will run on the next call to handle().
+void MiP::failWaitingRequests()
+{
+    for (uint8_t i = 0 ; i < MIP_MAX_PENDING_REQUESTS ; i++)
+    {
+        MiPPendingRequest* pRequest = &m_pendingRequests[i];
+        if (pRequest->state == MiPPendingRequest::MIP_PENDING_WAITING)
+        {
+            pRequest->result = MIP_ERROR_TIMEOUT;
+            pRequest->state = MiPPendingRequest::MIP_PENDING_COMPLETE;
+        }
+    }
+}
+
+// This internal protected method resends the settings which were last written to MiP, after it has been reconnected.
+// The game mode goes last since starting a game might make MiP ignore the other settings.
+void MiP::restoreState()
+{
+    MiPRestoreState state = m_restoreState;
+
+    if (state.valid & MiPRestoreState::MIP_RESTORE_VOLUME)
+    {
+        rawSetVolume(state.volume);
+    }
+    if (state.valid & MiPRestoreState::MIP_RESTORE_CHEST_LED_FLASH)
+    {
+        rawFlashChestLED(state.chestLED.red, state.chestLED.green, state.chestLED.blue,
+                         state.chestLED.onTime, state.chestLED.offTime);
+    }
+    else if (state.valid & MiPRestoreState::MIP_RESTORE_CHEST_LED)
+    {
+        rawSetChestLED(state.chestLED.red, state.chestLED.green, state.chestLED.blue);
+    }
+    if (state.valid & MiPRestoreState::MIP_RESTORE_HEAD_LEDS)
+    {
+        rawSetHeadLEDs(state.headLEDs.led1, state.headLEDs.led2, state.headLEDs.led3, state.headLEDs.led4);
+    }
+    if (state.valid & MiPRestoreState::MIP_RESTORE_GESTURE_RADAR_MODE)
+    {
+        rawSetGestureRadarMode(state.gestureRadarMode);
+    }
+    if (state.valid & MiPRestoreState::MIP_RESTORE_CLAP_ENABLED)
+    {
+        rawEnableClap(state.clapEnabled);
+    }
+    if (state.valid & MiPRestoreState::MIP_RESTORE_CLAP_DELAY)
+    {
+        rawSetClapDelay(state.clapDelay);
+    }
+    if (state.valid & MiPRestoreState::MIP_RESTORE_IR_REMOTE_CONTROL)
+    {
+        rawSetIRRemoteControl(state.irRemoteControl);
+    }
+    if (state.valid & MiPRestoreState::MIP_RESTORE_DETECTION_MODE)
+    {
+        rawSetMiPDetectionMode(state.detectionId, state.detectionTxPower);
+    }
+    if (state.valid & MiPRestoreState::MIP_RESTORE_GAME_MODE)
+    {
+        rawSetGameMode(state.gameMode);
+    }
+}
+
+uint8_t MiP::readFlightRecords(MiPFlightRecord records[], uint8_t maxRecords)
+{
+    uint8_t count = m_flightRecordCount < MIP_FLIGHT_RECORDER_LENGTH ? m_flightRecordCount : MIP_FLIGHT_RECORDER_LENGTH;
+
+    // Return the newest records if there isn't room for all of them.
+    if (count > maxRecords)
+    {
+        count = maxRecords;
+    }
+
+    uint8_t index = (m_nextFlightRecord + MIP_FLIGHT_RECORDER_LENGTH - count) % MIP_FLIGHT_RECORDER_LENGTH;
+    for (uint8_t i = 0 ; i < count ; i++)
+    {
+        records[i] = m_flightRecords[index];
+        index = (index + 1) % MIP_FLIGHT_RECORDER_LENGTH;
+    }
+    return count;
+}
+
+void MiP::dumpFlightRecorder(Print& output)
+{
+    uint8_t count = m_flightRecordCount < MIP_FLIGHT_RECORDER_LENGTH ? m_flightRecordCount : MIP_FLIGHT_RECORDER_LENGTH;
+    uint8_t index = (m_nextFlightRecord + MIP_FLIGHT_RECORDER_LENGTH - count) % MIP_FLIGHT_RECORDER_LENGTH;
+
+    output.printf_P(PSTR("MiP flight recorder: last %u of %u events\r\n"), count, m_flightRecordCount);
+    for (uint8_t i = 0 ; i < count ; i++, index = (index + 1) % MIP_FLIGHT_RECORDER_LENGTH)
+    {
+        const MiPFlightRecord& record = m_flightRecords[index];
+
+        char number[MIP_FORMAT_NUMBER_SIZE];
+
+        mipFormatUnsigned(number, sizeof(number), record.time, 10);
+        output.print(number);
+        output.print(' ');
+        switch (record.event)
+        {
+        case MIP_FLIGHT_SEND:
+            output.print(F("SEND    "));
+            break;
+        case MIP_FLIGHT_RESPONSE:
+            output.print(F("RESPONSE"));
+            break;
+        case MIP_FLIGHT_ASYNC_RESPONSE:
+            output.print(F("ASYNC   "));
+            break;
+        case MIP_FLIGHT_OOB:
+            output.print(F("OOB     "));
+            break;
+        case MIP_FLIGHT_TIMEOUT:
+            output.print(F("TIMEOUT "));
+            break;
+        case MIP_FLIGHT_BAD_RESPONSE:
+            output.print(F("BAD     "));
+            break;
+        case MIP_FLIGHT_DISCARD:
+            output.print(F("DISCARD "));
+            break;
+        case MIP_FLIGHT_RECONNECT:
+            output.print(F("RECONN  "));
+            break;
+        default:
+            output.print(F("?       "));
+            break;
+        }
+
+        // The bytes are formatted into one buffer, " XX" each, and written out together.
+        char    hexBytes[MIP_FLIGHT_RECORD_BYTES * 3 + 1];
+        size_t  hexLength = 0;
+        uint8_t kept = record.length < MIP_FLIGHT_RECORD_BYTES ? record.length : MIP_FLIGHT_RECORD_BYTES;
+        for (uint8_t j = 0 ; j < kept ; j++)
+        {
+            hexBytes[hexLength++] = ' ';
+            hexLength += mipFormatHex(&hexBytes[hexLength], sizeof(hexBytes) - hexLength, record.bytes[j], 2);
+        }
+        output.write((const uint8_t*)hexBytes, hexLength);
+        if (kept < record.length)
+        {
+            output.printf_P(PSTR(" ... (%u bytes)"), record.length);
+        }
+        output.print(F("\r\n"));
+    }
+}
+
+void MiP::clearFlightRecorder()
+{
+    for (uint8_t i = 0 ; i < MIP_FLIGHT_RECORDER_LENGTH ; i++)
+    {
+        m_flightRecords[i].clear();
+    }
+    m_flightRecordCount = 0;
+    m_nextFlightRecord = 0;
+}
+
+void MiP::keepFlightRecorderInRtc(bool keep)
+{
+    m_keepFlightRecorderInRtc = keep;
+    if (!keep)
+    {
+        return;
+    }
+
+    // Bring the RTC copy up to date with what has been recorded so far.
+    for (uint8_t i = 0 ; i < MIP_FLIGHT_RECORDER_LENGTH ; i++)
+    {
+        saveFlightRecordToRtc(i);
+    }
+}
+
+bool MiP::restoreFlightRecorderFromRtc()
+{
+    uint32_t header[MIP_FLIGHT_RTC_HEADER_BLOCKS];
+
+    if (!ESP.rtcUserMemoryRead(MIP_FLIGHT_RECORDER_RTC_OFFSET, header, sizeof(header)) ||
+        header[0] != MIP_FLIGHT_RTC_SIGNATURE)
+    {
+        return false;
+    }
+    if (!ESP.rtcUserMemoryRead(MIP_FLIGHT_RECORDER_RTC_OFFSET + MIP_FLIGHT_RTC_HEADER_BLOCKS,
+                               (uint32_t*)m_flightRecords, sizeof(m_flightRecords)))
+    {
+        clearFlightRecorder();
+        return false;
+    }
+
+    // Only trust the count if every record which it says has been written holds a known event. Otherwise the RTC
+    // memory was corrupted or left behind by something else which happened to match the signature.
+    uint8_t count = header[1] < MIP_FLIGHT_RECORDER_LENGTH ? header[1] : MIP_FLIGHT_RECORDER_LENGTH;
+    for (uint8_t i = 0 ; i < count ; i++)
+    {
+        if (m_flightRecords[i].event < MIP_FLIGHT_SEND || m_flightRecords[i].event > MIP_FLIGHT_RECONNECT)
+        {
+            clearFlightRecorder();
+            return false;
+        }
+    }
+
+    m_flightRecordCount = header[1];
+    m_nextFlightRecord = m_flightRecordCount % MIP_FLIGHT_RECORDER_LENGTH;
+    return true;
+}
+
+// This internal protected method adds an event to the flight recorder, overwriting the oldest record once it is full.
+// It is called for every transport event so it just copies a few bytes.
+void MiP::recordFlightEvent(MiPFlightEvent event, const uint8_t* pBytes, size_t length)
+{
+    uint8_t          index = m_nextFlightRecord;
+    MiPFlightRecord& record = m_flightRecords[index];
+
+    record.time = millis();
+    record.event = event;
+    record.length = length > 0xFF ? 0xFF : length;
+    memcpy(record.bytes, pBytes, length < MIP_FLIGHT_RECORD_BYTES ? length : MIP_FLIGHT_RECORD_BYTES);
+
+    m_nextFlightRecord = (index + 1 == MIP_FLIGHT_RECORDER_LENGTH) ? 0 : index + 1;
+    m_flightRecordCount++;
+
+    if (m_keepFlightRecorderInRtc)
+    {
+        saveFlightRecordToRtc(index);
+    }
+}
+
+// This internal protected method copies one flight recorder record, along with the header which says how many
+// events have been recorded, into RTC memory.
+void MiP::saveFlightRecordToRtc(uint8_t index)
+{
+    uint32_t header[MIP_FLIGHT_RTC_HEADER_BLOCKS] = { MIP_FLIGHT_RTC_SIGNATURE, m_flightRecordCount };
+    uint32_t offset = MIP_FLIGHT_RECORDER_RTC_OFFSET + MIP_FLIGHT_RTC_HEADER_BLOCKS + index * MIP_FLIGHT_RTC_RECORD_BLOCKS;
+
+    ESP.rtcUserMemoryWrite(offset, (uint32_t*)&m_flightRecords[index], sizeof(m_flightRecords[index]));
+    ESP.rtcUserMemoryWrite(MIP_FLIGHT_RECORDER_RTC_OFFSET, header, sizeof(header));
+}
+
+// This internal protected method is called from every loop which busy waits on MiP. It gives the SDK a chance to run,
+// writes out queued debug messages and then runs the registered idle tasks.
+void MiP::idle()
+{
+    yield();
+    mipLogService();
+
+    // Don't let idle tasks nest if one of them ends up waiting too.
+    if (m_isIdling)
+    {
+        return;
+    }
+    m_isIdling = true;
+    for (uint8_t i = 0 ; i < MIP_MAX_IDLE_TASKS ; i++)
+    {
+        if (m_idleTasks[i].task != NULL)
+        {
+            MIP_ACTIVITY("idle task", MIP_ACTIVITY_NO_COMMAND);
+            m_idleTasks[i].task(m_idleTasks[i].pContext);
+        }
+    }
+    m_isIdling = false;
+}
+
+// This internal protected method claims an entry in the pending request table and sends the single byte request
+// for the specified command. The response will be matched up with this entry by processAllResponseData().
+int8_t MiP::allocatePendingRequest(uint8_t command, uint8_t& slot, uint16_t& sequence)
+{
+    MiPPendingRequest* pRequest = NULL;
+    MiPCommandInfo     info;
+
+    // The response length comes from the protocol table so the command must be one which MiP answers.
+    mipLookupCommand(command, info);
+    MIP_ASSERT( info.requestLength == 1 && info.responseLength != 0 );
+
+    // Prefer a free entry but fall back to the oldest completed entry which nobody is waiting on, so that futures which
+    // are never read can't use up the table. A future whose entry is recycled this way reports MIP_ERROR_BUSY.
+    for (uint8_t i = 0 ; i < MIP_MAX_PENDING_REQUESTS ; i++)
+    {
+        MiPPendingRequest* pCurr = &m_pendingRequests[i];
+        if (pCurr->state == MiPPendingRequest::MIP_PENDING_FREE)
+        {
+            pRequest = pCurr;
+            slot = i;
+            break;
+        }
+        if (pCurr->state == MiPPendingRequest::MIP_PENDING_COMPLETE && pCurr->pDispatch == NULL &&
+            (pRequest == NULL || (int16_t)(pCurr->sequence - pRequest->sequence) < 0))
+        {
+            pRequest = pCurr;
+            slot = i;
+        }
+    }
+    if (pRequest == NULL)
+    {
+        MIP_DEBUG_WARN_PRINTLN(F("MiP: Too many pending requests"));
+        sequence = 0;
+        return MIP_ERROR_BUSY;
+    }
+
+    // Sequence number 0 is reserved to indicate a future which isn't associated with a table entry.
+    if (m_nextSequence == 0)
+    {
+        m_nextSequence++;
+    }
+    pRequest->clear();
+    pRequest->command = command;
+    pRequest->responseLength = info.responseLength;
+    pRequest->sequence = m_nextSequence++;
+
+    // Only mark the entry as waiting once the request is sent so that a reconnect triggered by sending it can't fail it.
+    // If the link is down, or begin() hasn't been called, then the request is never sent so it completes straight
+    // away.
+    int8_t result = transportSendRequest(&command, sizeof(command), MIP_EXPECT_NO_RESPONSE);
+    if (result == MIP_ERROR_NONE)
+    {
+        pRequest->state = MiPPendingRequest::MIP_PENDING_WAITING;
+    }
+    else
+    {
+        pRequest->result = result;
+        pRequest->state = MiPPendingRequest::MIP_PENDING_COMPLETE;
+    }
+    pRequest->startTime = millis();
+    pRequest->sentMicros = micros();
+
+    sequence = pRequest->sequence;
+    return MIP_ERROR_NONE;
+}
+
+uint8_t MiP::pendingRequestCount()
+{
+    return MIP_MAX_PENDING_REQUESTS - freePendingRequests();
+}
+
+// This internal protected method returns the number of entries in the pending request table which aren't in use.
+uint8_t MiP::freePendingRequests()
+{
+    uint8_t count = 0;
+
+    for (uint8_t i = 0 ; i < MIP_MAX_PENDING_REQUESTS ; i++)
+    {
+        if (m_pendingRequests[i].state == MiPPendingRequest::MIP_PENDING_FREE)
+        {
+            count++;
+        }
+    }
+    return count;
+}
+
+// This internal protected method returns the pending request table entry still associated with the specified
+// future or NULL if it has since been released.
+MiPPendingRequest* MiP::findPendingRequest(uint8_t slot, uint16_t sequence)
+{
+    if (slot >= MIP_MAX_PENDING_REQUESTS)
+    {
+        return NULL;
+    }
+
+    MiPPendingRequest* pRequest = &m_pendingRequests[slot];
+    if (pRequest->state == MiPPendingRequest::MIP_PENDING_FREE || pRequest->sequence != sequence)
+    {
+        return NULL;
+    }
+    return pRequest;
+}
+
+// This internal protected method finds the oldest pending request waiting on a response with the specified command
+// byte. MiP answers requests in the order they were sent so the oldest one is the one this response belongs to.
+MiPPendingRequest* MiP::findWaitingRequest(uint8_t commandByte)
+{
+    MiPPendingRequest* pOldest = NULL;
+
+    for (uint8_t i = 0 ; i < MIP_MAX_PENDING_REQUESTS ; i++)
+    {
+        MiPPendingRequest* pCurr = &m_pendingRequests[i];
+        if (pCurr->state == MiPPendingRequest::MIP_PENDING_WAITING && pCurr->command == commandByte &&
+            (pOldest == NULL || (int16_t)(pCurr->sequence - pOldest->sequence) < 0))
+        {
+            pOldest = pCurr;
+        }
+    }
+    return pOldest;
+}
+
+// This internal protected method processes any received responses, times out requests which have waited too long
+// and then runs the continuations of any completed requests.
+void MiP::pollPendingRequests()
+{
+    processAllResponseData();
+
+    for (uint8_t i = 0 ; i < MIP_MAX_PENDING_REQUESTS ; i++)
+    {
+        MiPPendingRequest* pRequest = &m_pendingRequests[i];
+        if (pRequest->state == MiPPendingRequest::MIP_PENDING_WAITING &&
+            millis() - pRequest->startTime >= MIP_RESPONSE_TIMEOUT)
+        {
+            MIP_DEBUG_WARN_PRINTLN(F("MiP: Async response timeout"));
+            recordLinkResult(MIP_ERROR_TIMEOUT);
+            recordFlightEvent(MIP_FLIGHT_TIMEOUT, &pRequest->command, sizeof(pRequest->command));
+            recordCommandTimeout(pRequest->command);
+            pRequest->result = MIP_ERROR_TIMEOUT;
+            pRequest->state = MiPPendingRequest::MIP_PENDING_COMPLETE;
+        }
+        if (pRequest->state == MiPPendingRequest::MIP_PENDING_COMPLETE && pRequest->pDispatch != NULL)
+        {
+            // Free up the entry before running the continuation so that it can issue another request.
+            MiPPendingRequest completed = *pRequest;
+            pRequest->clear();
+            completed.pDispatch(completed);
+        }
+    }
+}
+
+void MiP::rawSend(const uint8_t request[], size_t requestLength)
+{
+    // There is no response to check, but at least report requests which were dropped rather than sent.
+    m_lastError = transportSendRequest(request, requestLength, MIP_EXPECT_NO_RESPONSE);
+}
+
+int8_t MiP::rawReceive(const uint8_t request[], size_t requestLength,
+                          uint8_t responseBuffer[], size_t responseBufferSize, size_t& responseLength)
+{
+    transportSendRequest(request, requestLength, MIP_EXPECT_RESPONSE);
+    return transportGetResponse(responseBuffer, responseBufferSize, &responseLength);
+}
+
+int8_t MiP::rawReceive(const uint8_t request[], size_t requestLength, size_t responseSize, MiPResponseView& response)
+{
+    transportSendRequest(request, requestLength, MIP_EXPECT_RESPONSE);
+    return transportGetResponse(responseSize, response);
+}
+
+
+
+// This internal protected method sends a request to MiP. Returns MIP_ERROR_LINK_DOWN or MIP_ERROR_NOT_STARTED if
+// it was dropped rather than sent.
+int8_t MiP::transportSendRequest(const uint8_t* pRequest, size_t requestLength, int expectResponse)
+{
+    MIP_PROFILE_SCOPE("transport.send");
+    MIP_ACTIVITY("transportSendRequest", pRequest[0]);
+
+    // Reconnect first if the link has gone bad. Requests are dropped while the link is down.
+    checkLinkHealth();
+    if (isLinkDown())
+    {
+        return MIP_ERROR_LINK_DOWN;
+    }
+
+    // Must call begin() before sending commands to the MiP.
+    if (!isInitialized())
+    {
+        MIP_DEBUG_ERROR_PRINTLN(F("MiP: Must call begin() before sending requests"));
+        return MIP_ERROR_NOT_STARTED;
+    }
+
+    // Let the MiP process the last request before letting another request be issued.
+    while (millis() - m_lastRequestTime < MIP_REQUEST_DELAY)
+    {
+        idle();
+    }
+
+    // Remember the command byte (first byte) if expecting a response to this request since the response should start
+    // with the same byte.
+    if (expectResponse)
+    {
+        m_expectedResponseCommand = pRequest[0];
+    }
+    else
+    {
+        m_expectedResponseCommand = 0;
+    }
+    m_expectedResponseSize = 0;
+    m_responseBuffer[0] = 0;
+
+    // Send the specified bytes to the MiP via the UART.
+    recordFlightEvent(MIP_FLIGHT_SEND, pRequest, requestLength);
+    accountLinkTraffic(m_linkTx, requestLength);
+    while (requestLength-- > 0)
+    {
+        Serial.write(*pRequest++);
+    }
+
+    m_lastRequestTime = millis();
+    m_requestSentMicros = micros();
+    return MIP_ERROR_NONE;
+}
+
+int8_t MiP::transportGetResponse(uint8_t* pResponseBuffer, size_t responseBufferSize, size_t* pResponseLength)
+{
+    MiPResponseView response;
+
+    int8_t result = transportGetResponse(responseBufferSize, response);
+    if (result != MIP_ERROR_NONE)
+    {
+        return result;
+    }
+
+    // Copy reponse data into caller provided buffer.
+    memcpy(pResponseBuffer, response.pBuffer, response.length);
+    *pResponseLength = response.length;
+    m_responseBuffer[0] = 0;
+
+    return MIP_ERROR_NONE;
+}
+
+// This internal protected method waits for the response to the last request and leaves it in m_responseBuffer where
+// the returned view points. The view is only valid until the next request is sent.
+int8_t MiP::transportGetResponse(size_t responseSize, MiPResponseView& response)
+{
+    MIP_PROFILE_SCOPE("transport.response");
+    MIP_ACTIVITY("transportGetResponse", m_expectedResponseCommand);
+
+    // The request was never sent if the link is down.
+    if (isLinkDown())
+    {
+        response.clear();
+        return MIP_ERROR_LINK_DOWN;
+    }
+
+    // Nor was it sent if begin() hasn't been called.
+    if (!isInitialized())
+    {
+        response.clear();
+        return MIP_ERROR_NOT_STARTED;
+    }
+
+    // Caller is attempting to get a response that is larger than support by the MiP and this library. The request has
+    // already been sent so stop expecting a response to it, which is then discarded when it arrives.
+    response.clear();
+    if (responseSize > MIP_RESPONSE_MAX_LEN)
+    {
+        m_expectedResponseCommand = 0;
+    }
+    MIP_VERIFY_PARAM( responseSize <= MIP_RESPONSE_MAX_LEN, MIP_ERROR_PARAM );
+
+    // UNDONE: I think it would be my bug if the following assert ever fired.
+    MIP_ASSERT( m_expectedResponseCommand != 0 );
+
+    // Process all received bytes (which might include out of band notifications) until we find the response to the
     // last request made. Will timeout after a second.
-    m_expectedResponseSize = (uint8_t)responseBufferSize;
+    m_expectedResponseSize = (uint8_t)responseSize;
     uint32_t startTime = millis();
     bool responseFound = false;
     do
     {
         responseFound = processAllResponseData();
+        if (!responseFound)
+        {
+            idle();
+        }
     } while (!responseFound && (uint32_t)millis() - startTime < MIP_RESPONSE_TIMEOUT);
     if (!responseFound)
     {
         // Never received the expected response within the timeout window.
         MIP_DEBUG_WARN_PRINTLN(F("MiP: Response timeout"));
+        recordLinkResult(MIP_ERROR_TIMEOUT);
+        recordFlightEvent(MIP_FLIGHT_TIMEOUT, &m_expectedResponseCommand, sizeof(m_expectedResponseCommand));
+        recordCommandTimeout(m_expectedResponseCommand);
         return MIP_ERROR_TIMEOUT;
     }
 
-    // Copy reponse data into caller provided buffer and clear state in transport about the expected response.
-    memcpy(pResponseBuffer, m_responseBuffer, m_expectedResponseSize);
-    *pResponseLength = m_expectedResponseSize;
+    // Point the caller at the response data and clear state in transport about the expected response. The data itself
+    // stays in m_responseBuffer until the next request is sent.
+    response.pBuffer = m_responseBuffer;
+    response.length = m_expectedResponseSize;
     m_expectedResponseCommand = 0;
     m_expectedResponseSize = 0;
-    m_responseBuffer[0] = 0;
+    recordLinkResult(MIP_ERROR_NONE);
 
     return MIP_ERROR_NONE;
 }
 
 bool MiP::processAllResponseData()
 {
+    MIP_PROFILE_SCOPE("parse.responses");
+
     bool    responseFound = false;
-    uint8_t buffer[(MIP_RESPONSE_MAX_LEN - 1) * 2];
-    size_t  bytesToRead;
-    size_t  bytesRead;
 
     while (Serial.available() >= 2)
     {
         uint8_t highNibble = Serial.read();
         uint8_t lowNibble = Serial.read();
+        accountLinkTraffic(m_linkRx, 2);
         uint8_t commandByte = (parseHexDigit(highNibble) << 4) | parseHexDigit(lowNibble);
+        MiPPendingRequest* pRequest;
 
         if (m_expectedResponseCommand != 0 && commandByte == m_expectedResponseCommand)
         {
-            // Store away the command byte that we just read into response buffer so that it isn't lost.
-            m_responseBuffer[0] = commandByte;
-
-            // Already read the command byte into element 0 of the response buffer earlier so just need to read in the
-            // rest of the expected response bytes now.
-            bytesToRead = m_expectedResponseSize - 1;
-            bytesRead = Serial.readBytes(buffer, bytesToRead * 2);
-            if (bytesRead == bytesToRead * 2)
+            if (readResponseData(m_responseBuffer, commandByte, m_expectedResponseSize))
             {
-                copyHexTextToBinary(&m_responseBuffer[1], buffer, bytesToRead);
+                recordFlightEvent(MIP_FLIGHT_RESPONSE, m_responseBuffer, m_expectedResponseSize);
+                recordRoundTrip(commandByte, m_requestSentMicros);
                 responseFound = true;
                 // Continue to process any other bytes in the recieve buffer.
                 // This would allow something like a rawGetStatus() call to receive the actual data returned for this
@@ -2405,10 +3891,31 @@ bool MiP::processAllResponseData()
             else
             {
                 // Timed out waiting for all of the response data.
+                recordFlightEvent(MIP_FLIGHT_BAD_RESPONSE, &commandByte, sizeof(commandByte));
                 m_expectedResponseCommand = 0;
                 m_expectedResponseSize = 0;
                 m_responseBuffer[0] = 0;
-                MIP_DEBUG_ERROR_PRINTF("MiP: Response too short: %d, %d\n", bytesRead, bytesToRead * 2);
+                break;
+            }
+        }
+        else if ((pRequest = findWaitingRequest(commandByte)) != NULL)
+        {
+            // Response to an asynchronous request.
+            pRequest->state = MiPPendingRequest::MIP_PENDING_COMPLETE;
+            if (readResponseData(pRequest->response, commandByte, pRequest->responseLength))
+            {
+                recordFlightEvent(MIP_FLIGHT_ASYNC_RESPONSE, pRequest->response, pRequest->responseLength);
+                recordRoundTrip(commandByte, pRequest->sentMicros);
+                pRequest->result = MIP_ERROR_NONE;
+            }
+            else
+            {
+                recordFlightEvent(MIP_FLIGHT_BAD_RESPONSE, &commandByte, sizeof(commandByte));
+                pRequest->result = MIP_ERROR_BAD_RESPONSE;
+            }
+            recordLinkResult(pRequest->result);
+            if (pRequest->result != MIP_ERROR_NONE)
+            {
                 break;
             }
         }
@@ -2421,6 +3928,32 @@ bool MiP::processAllResponseData()
     return responseFound;
 }
 
+// This internal protected method reads in the rest of a response whose command byte has already been read from the
+// serial port. The decoded response, including the command byte, is placed in pResponse.
+bool MiP::readResponseData(uint8_t* pResponse, uint8_t commandByte, size_t responseSize)
+{
+    uint8_t buffer[(MIP_RESPONSE_MAX_LEN - 1) * 2];
+    size_t  bytesToRead;
+    size_t  bytesRead;
+
+    // Store away the command byte that we just read into response buffer so that it isn't lost.
+    pResponse[0] = commandByte;
+
+    // Already read the command byte into element 0 of the response buffer earlier so just need to read in the
+    // rest of the expected response bytes now.
+    bytesToRead = responseSize - 1;
+    bytesRead = Serial.readBytes(buffer, bytesToRead * 2);
+    accountLinkTraffic(m_linkRx, bytesRead);
+    if (bytesRead != bytesToRead * 2)
+    {
+        MIP_DEBUG_ERROR_PRINTF("MiP: Response too short: %d, %d\n", bytesRead, bytesToRead * 2);
+        return false;
+    }
+
+    copyHexTextToBinary(&pResponse[1], buffer, bytesToRead);
+    return true;
+}
+
 void MiP::copyHexTextToBinary(uint8_t* pDest, uint8_t* pSrc, uint8_t length)
 {
     while (length-- > 0)
@@ -2453,57 +3986,57 @@ uint8_t MiP::parseHexDigit(uint8_t digit)
 
 void MiP::processOobResponseData(uint8_t commandByte)
 {
-    size_t length = 0;
-    size_t bytesRead;
+    MIP_PROFILE_SCOPE("parse.oob");
+
+    MiPCommandInfo info;
+    size_t         length = 0;
+    size_t         bytesRead;
 
     // The number of additional bytes to read depends on which notification has been found in serial buffer.
-    switch (commandByte)
+    if (!mipLookupCommand(commandByte, info) || (info.flags & MIP_CMD_FLAG_OOB) == 0)
     {
-    case MIP_CMD_GET_RADAR_RESPONSE:
-    case MIP_CMD_GET_GESTURE_RESPONSE:
-    case MIP_CMD_CLAP_RESPONSE:
-    case MIP_CMD_GET_WEIGHT:
-    case MIP_CMD_GET_DETECTED_MIP:
-        length = 1;
-        break;
-    case MIP_CMD_SHAKE_RESPONSE:
-        length = 0;
-        break;
-    case MIP_CMD_GET_STATUS:
-        length = 2;
-        break;
-    case MIP_CMD_RECEIVE_IR_DONGLE_CODE:
-        // MIP_CMD_RECEIVE_IR_DONGLE_CODE is the only message delivered by MiP that has a
-        // variable length so we need to read the next byte which contains the length.
+        uint8_t discardedBytes = discardUnexpectedSerialData();
+        MIP_DEBUG_ERROR_PRINTF("MiP: Bad OOB command byte: 0x%02x (discarded %d bytes)\n", commandByte, discardedBytes);
+        recordLinkResult(MIP_ERROR_BAD_RESPONSE);
+        return;
+    }
+    length = info.responseLength - 1;
+
+    if (info.flags & MIP_CMD_FLAG_VARIABLE_LENGTH)
+    {
+        // Variable length notifications, like MIP_CMD_RECEIVE_IR_DONGLE_CODE, have the length in the next byte.
         uint8_t nibbles[2];
         bytesRead = Serial.readBytes(nibbles, sizeof(nibbles));
+        accountLinkTraffic(m_linkRx, bytesRead);
         if (bytesRead != sizeof(nibbles))
         {
-            MIP_DEBUG_ERROR_PRINTLN(F("MiP: Missing IR code length"));
+            MIP_DEBUG_ERROR_PRINTF("MiP: Missing OOB length: 0x%02x\n", commandByte);
+            recordLinkResult(MIP_ERROR_BAD_RESPONSE);
+            recordFlightEvent(MIP_FLIGHT_BAD_RESPONSE, &commandByte, sizeof(commandByte));
             return;
         }
         length = (parseHexDigit(nibbles[0]) << 4) | parseHexDigit(nibbles[1]);
-        if (length < 2 || length > 4)
+        if (length < info.minResponseLength - 1u || length > info.responseLength - 1u)
         {
             uint8_t discardedBytes = discardUnexpectedSerialData();
-            MIP_DEBUG_ERROR_PRINTF("MiP: Bad IR code length: 0x%02x (discarded %d bytes)\n", length, discardedBytes);
+            MIP_DEBUG_ERROR_PRINTF("MiP: Bad OOB length: 0x%02x, 0x%02x (discarded %d bytes)\n", commandByte, length,
+                                   discardedBytes);
+            recordLinkResult(MIP_ERROR_BAD_RESPONSE);
+            recordFlightEvent(MIP_FLIGHT_BAD_RESPONSE, &commandByte, sizeof(commandByte));
             return;
         }
-        break;
-    default:
-        uint8_t discardedBytes = discardUnexpectedSerialData();
-        MIP_DEBUG_ERROR_PRINTF("MiP: Bad OOB command byte: 0x%02x (discarded %d bytes)\n", commandByte, discardedBytes);
-        return;
     }
 
-    // Read in the additional bytes of the notification.  The "4" comes from maximum length
-    // which is a response for MIP_CMD_RECEIVE_IR_DONGLE_CODE.
-    uint8_t buffer[4 * 2];
+    // Read in the additional bytes of the notification.
+    uint8_t buffer[(MIP_RESPONSE_MAX_LEN - 1) * 2];
     bytesRead = Serial.readBytes(buffer, length * 2);
+    accountLinkTraffic(m_linkRx, bytesRead);
 
     if (bytesRead != length * 2)
     {
         MIP_DEBUG_ERROR_PRINTF("MiP: OOB too short: %d, %d", bytesRead, length * 2);
+        recordLinkResult(MIP_ERROR_BAD_RESPONSE);
+        recordFlightEvent(MIP_FLIGHT_BAD_RESPONSE, &commandByte, sizeof(commandByte));
         return;
     }
 
@@ -2511,6 +4044,7 @@ void MiP::processOobResponseData(uint8_t commandByte)
     uint8_t response[MIP_RESPONSE_MAX_LEN];
     response[0] = commandByte;
     copyHexTextToBinary(&response[1], buffer, length);
+    recordFlightEvent(MIP_FLIGHT_OOB, response, length + 1);
 
     // Have 32 bits ready in case of an IR event.
     uint32_t irCode = 0;
@@ -2540,6 +4074,8 @@ void MiP::processOobResponseData(uint8_t commandByte)
     case MIP_CMD_GET_WEIGHT:
         m_lastWeight = response[1];
         m_flags |= MIP_FLAG_WEIGHT_VALID;
+        // Weight notifications are as good as a prefetch.
+        updatePrefetch(MIP_PREFETCH_WEIGHT, (uint32_t)(int32_t)m_lastWeight);
         break;
     case MIP_CMD_CLAP_RESPONSE:
         m_clapEvents.push(response[1]);
@@ -2556,7 +4092,7 @@ void MiP::processOobResponseData(uint8_t commandByte)
         m_irCodeEvents.push(irCode);
         break;
     default:
-        // Invalid notification command bytes were already handled in the previous switch so should never get here.
+        // Invalid notification command bytes were already rejected by the table lookup so should never get here.
         MIP_ASSERT ( false );
         break;
     }
@@ -2564,17 +4100,35 @@ void MiP::processOobResponseData(uint8_t commandByte)
 
 uint8_t MiP::discardUnexpectedSerialData()
 {
-    uint8_t discardedBytes = 0;
+    uint8_t  discarded[MIP_FLIGHT_RECORD_BYTES];
+    uint8_t  discardedBytes = 0;
+    // Wait long enough for the next serial byte to be received if MiP is still actively sending. Use a couple of
+    // character times at the connected baud rate or the time for a character at 115200 baud if not connected yet.
+    uint32_t quietTime = m_linkByteTime != 0 ? 2 * m_linkByteTime : 100;
 
     // Unexpected response data encountered. Throw away all data in serial buffer since it is hard to tell
     // where next response begins.
     while (Serial.available() > 0)
     {
+        uint8_t discardedByte = Serial.read();
+        if (discardedBytes < sizeof(discarded))
+        {
+            discarded[discardedBytes] = discardedByte;
+        }
         discardedBytes++;
-        Serial.read();
-        // Delay long enough for next serial byte to be received if MiP is still actively sending at 115200 baud.
-        delayMicroseconds(100);
+        accountLinkTraffic(m_linkRx, 1);
+
+        uint32_t startTime = micros();
+        while (Serial.available() == 0 && micros() - startTime < quietTime)
+        {
+            idle();
+        }
+    }
+    if (discardedBytes > 0)
+    {
+        recordFlightEvent(MIP_FLIGHT_DISCARD, discarded, discardedBytes);
     }
+    m_discardedBytes += discardedBytes;
     return discardedBytes;
 }
 
@@ -26,6 +26,8 @@
 #include <ESP8266mDNS.h>
 #include <WiFiUdp.h>
 #include <ArduinoOTA.h>
+#include "mip_log.h"
+#include "mip_profile.h"
 
 
 // Setup some debug levels for reporting library status via Serial1.
@@ -39,29 +41,31 @@
   #define MIP_DEBUG_LEVEL MIP_DEBUG_NONE
 #endif
 
-// Create the macros for conditional printing of debug messages via Serial1.
+// Create the macros for conditional printing of debug messages via Serial1. Messages are queued by the deferred
+// logger in mip_log.h and written out later from handle() or while the library waits on MiP so that logging doesn't
+// block the code that is being debugged. The format passed to the *_PRINTF() macros must be a string literal.
 #if MIP_DEBUG_LEVEL >= MIP_DEBUG_ERROR
-  #define MIP_DEBUG_ERROR_PRINT(...)   Serial1.print(F("[ERROR] ")); Serial1.print(__VA_ARGS__)
-  #define MIP_DEBUG_ERROR_PRINTLN(...) Serial1.print(F("[ERROR] ")); Serial1.println(__VA_ARGS__)
-  #define MIP_DEBUG_ERROR_PRINTF(...)  Serial1.print(F("[ERROR] ")); Serial1.printf(__VA_ARGS__)
+  #define MIP_DEBUG_ERROR_PRINT(...)            mipLogPrint(MIP_DEBUG_ERROR, 0, __VA_ARGS__)
+  #define MIP_DEBUG_ERROR_PRINTLN(...)          mipLogPrint(MIP_DEBUG_ERROR, MIP_LOG_FLAG_NEWLINE, __VA_ARGS__)
+  #define MIP_DEBUG_ERROR_PRINTF(FORMAT, ...)   mipLogPrintf(MIP_DEBUG_ERROR, PSTR(FORMAT), ##__VA_ARGS__)
 #else
   #define MIP_DEBUG_ERROR_PRINT(...)
   #define MIP_DEBUG_ERROR_PRINTLN(...)
   #define MIP_DEBUG_ERROR_PRINTF(...)
 #endif
 #if MIP_DEBUG_LEVEL >= MIP_DEBUG_WARN
-  #define MIP_DEBUG_WARN_PRINT(...)   Serial1.print(F("[WARN] ")); Serial1.print(__VA_ARGS__)
-  #define MIP_DEBUG_WARN_PRINTLN(...) Serial1.print(F("[WARN] ")); Serial1.println(__VA_ARGS__)
-  #define MIP_DEBUG_WARN_PRINTF(...)  Serial1.print(F("[WARN] ")); Serial1.printf(__VA_ARGS__)
+  #define MIP_DEBUG_WARN_PRINT(...)             mipLogPrint(MIP_DEBUG_WARN, 0, __VA_ARGS__)
+  #define MIP_DEBUG_WARN_PRINTLN(...)           mipLogPrint(MIP_DEBUG_WARN, MIP_LOG_FLAG_NEWLINE, __VA_ARGS__)
+  #define MIP_DEBUG_WARN_PRINTF(FORMAT, ...)    mipLogPrintf(MIP_DEBUG_WARN, PSTR(FORMAT), ##__VA_ARGS__)
 #else
   #define MIP_DEBUG_WARN_PRINT(...)
   #define MIP_DEBUG_WARN_PRINTLN(...)
   #define MIP_DEBUG_WARN_PRINTF(...)
 #endif
 #if MIP_DEBUG_LEVEL >= MIP_DEBUG_INFO
-  #define MIP_DEBUG_INFO_PRINT(...)   Serial1.print(F("[INFO] ")); Serial1.print(__VA_ARGS__)
-  #define MIP_DEBUG_INFO_PRINTLN(...) Serial1.print(F("[INFO] ")); Serial1.println(__VA_ARGS__)
-  #define MIP_DEBUG_INFO_PRINTF(...)  Serial1.print(F("[INFO] ")); Serial1.printf(__VA_ARGS__)
+  #define MIP_DEBUG_INFO_PRINT(...)             mipLogPrint(MIP_DEBUG_INFO, 0, __VA_ARGS__)
+  #define MIP_DEBUG_INFO_PRINTLN(...)           mipLogPrint(MIP_DEBUG_INFO, MIP_LOG_FLAG_NEWLINE, __VA_ARGS__)
+  #define MIP_DEBUG_INFO_PRINTF(FORMAT, ...)    mipLogPrintf(MIP_DEBUG_INFO, PSTR(FORMAT), ##__VA_ARGS__)
 #else
   #define MIP_DEBUG_INFO_PRINT(...)
   #define MIP_DEBUG_INFO_PRINTLN(...)
@@ -74,11 +78,57 @@
 #define MIP_ERROR_NO_EVENT      2 // No event has arrived from MiP yet.
 #define MIP_ERROR_BAD_RESPONSE  3 // Unexpected response from MiP.
 #define MIP_ERROR_MAX_RETRIES   4 // Exceeded maximum number of retries to get this operation to succeed.
+#define MIP_ERROR_BUSY          5 // Too many asynchronous requests are already outstanding.
+#define MIP_ERROR_PARAM         6 // A parameter passed to the API was out of range.
+#define MIP_ERROR_STALE         7 // Prefetched value is older than the maximum staleness allowed for it.
+#define MIP_ERROR_THROTTLED     8 // Request was dropped since the link to MiP is over its bandwidth budget.
+#define MIP_ERROR_LINK_DOWN     9 // Request wasn't sent since the link to MiP is down.
+#define MIP_ERROR_NOT_STARTED   10 // Request wasn't sent since begin() hasn't been called.
 
 // Maximum length of MiP request and response buffer lengths.
 #define MIP_REQUEST_MAX_LEN     (17 + 1)    // Longest request is MIP_CMD_PLAY_SOUND.
 #define MIP_RESPONSE_MAX_LEN    (5 + 1)     // Longest response is MIP_CMD_REQUEST_CHEST_LED.
 
+// Maximum number of asynchronous requests (see the read*Async() methods) which can be outstanding at once.
+#define MIP_MAX_PENDING_REQUESTS 8
+
+// Number of pending request table entries which background prefetching (see enablePrefetch()) leaves free for the
+// application's own asynchronous requests.
+#define MIP_PREFETCH_RESERVED_REQUESTS 4
+
+// Length of the window, in milliseconds, over which the utilization of the UART link to MiP is measured.
+#define MIP_LINK_WINDOW 1000
+
+// Default link utilization percentage above which low priority traffic is throttled (see setLinkThrottleThreshold()).
+#define MIP_LINK_DEFAULT_THROTTLE_THRESHOLD 75
+
+// Default number of failed exchanges, out of the last 32 with MiP, which trigger a reconnect (see
+// setLinkHealthThreshold()).
+#define MIP_LINK_HEALTH_DEFAULT_THRESHOLD 8
+
+// Maximum number of idle tasks which can be registered with addIdleTask().
+#define MIP_MAX_IDLE_TASKS 4
+
+// Number of different commands whose round trip times are tracked (see readCommandLatencies()). Commands are added
+// as they are first sent. Once the table is full, any other commands aren't tracked.
+#ifndef MIP_LATENCY_COMMANDS
+  #define MIP_LATENCY_COMMANDS 8
+#endif
+
+// Number of the most recent transport events kept by the flight recorder (see readFlightRecords()). This is as many
+// as fit in RTC user memory after the area used by eboot.
+#define MIP_FLIGHT_RECORDER_LENGTH 23
+
+// Number of raw bytes kept in each flight recorder record. Longer requests, like MIP_CMD_PLAY_SOUND, are truncated.
+#define MIP_FLIGHT_RECORD_BYTES 10
+
+// Offset, in 4 byte blocks, into the RTC user memory where keepFlightRecorderInRtc() keeps the flight recorder. It
+// needs 2 + 4 * MIP_FLIGHT_RECORDER_LENGTH blocks. The first 32 blocks are left alone since eboot keeps its OTA
+// update command there.
+#ifndef MIP_FLIGHT_RECORDER_RTC_OFFSET
+  #define MIP_FLIGHT_RECORDER_RTC_OFFSET 32
+#endif
+
 enum MiPGestureRadarMode
 {
     MIP_GESTURE_RADAR_DISABLED = 0x00,
@@ -281,6 +331,46 @@ enum MiPVolume
     MIP_VOLUME_DEFAULT = 0xFF
 };
 
+// Properties which can be polled in the background with MiP::enablePrefetch().
+enum MiPPrefetchProperty
+{
+    MIP_PREFETCH_DISTANCE = 0,  // Odometer ticks, see readPrefetchedDistanceTicks().
+    MIP_PREFETCH_WEIGHT,        // See readPrefetchedWeight().
+    MIP_PREFETCH_VOLUME,        // See readPrefetchedVolume().
+    MIP_PREFETCH_COUNT
+};
+
+// What the readPrefetched*() methods do when the cached value is older than its maximum staleness.
+enum MiPStalePolicy
+{
+    MIP_STALE_ALLOW   = 0,      // Return the cached value anyway. Check prefetchAge() to see how old it is.
+    MIP_STALE_ERROR   = 1,      // Return the cached value but set lastCallResult() to MIP_ERROR_STALE.
+    MIP_STALE_REFRESH = 2       // Block while a fresh value is read from MiP.
+};
+
+// Events which can be kept by the transport's flight recorder (see MiP::readFlightRecords()).
+enum MiPFlightEvent
+{
+    MIP_FLIGHT_SEND           = 1, // Request sent to MiP.
+    MIP_FLIGHT_RESPONSE       = 2, // Response to a blocking request.
+    MIP_FLIGHT_ASYNC_RESPONSE = 3, // Response to an asynchronous request.
+    MIP_FLIGHT_OOB            = 4, // Out of band notification.
+    MIP_FLIGHT_TIMEOUT        = 5, // Response never arrived. Holds the command byte which was being waited on.
+    MIP_FLIGHT_BAD_RESPONSE   = 6, // Response or notification was cut short or had a bad length. Holds the command byte.
+    MIP_FLIGHT_DISCARD        = 7, // Unexpected data was thrown away. Holds the first MIP_FLIGHT_RECORD_BYTES of it.
+    MIP_FLIGHT_RECONNECT      = 8  // Link health monitor tried to reconnect. Holds 1 if it succeeded and 0 otherwise.
+};
+
+// The queues of MiP events which are waiting to be read (see MiP::readQueueStats()).
+enum MiPEventQueue
+{
+    MIP_QUEUE_CLAP = 0,         // See readClapEvent().
+    MIP_QUEUE_GESTURE,          // See readGestureEvent().
+    MIP_QUEUE_IR_CODE,          // See readIRDongleCode().
+    MIP_QUEUE_DETECTED_MIP,     // See readDetectedMiP().
+    MIP_QUEUE_COUNT
+};
+
 enum MiPClapEnabled
 {
     MIP_CLAP_DISABLED = 0x00,
@@ -311,11 +401,17 @@ public:
 
     void clear()
     {
-        battery = 0.0f;
+        batteryMillivolts = 0;
         position = MIP_POSITION_ON_BACK_WITH_KICKSTAND;
     }
 
-    float       battery;
+    // Only converts to floating point when asked.
+    float batteryVoltage() const
+    {
+        return batteryMillivolts / 1000.0f;
+    }
+
+    uint16_t    batteryMillivolts;
     MiPPosition position;
 };
 
@@ -423,6 +519,444 @@ public:
     uint16_t       delay;
 };
 
+// Bits that can be set in MiPSnapshot::valid to indicate which fields were successfully read.
+#define MIP_SNAPSHOT_STATUS             (1 << 0)
+#define MIP_SNAPSHOT_WEIGHT             (1 << 1)
+#define MIP_SNAPSHOT_DISTANCE           (1 << 2)
+#define MIP_SNAPSHOT_VOLUME             (1 << 3)
+#define MIP_SNAPSHOT_CHEST_LED          (1 << 4)
+#define MIP_SNAPSHOT_HEAD_LEDS          (1 << 5)
+#define MIP_SNAPSHOT_CLAP_SETTINGS      (1 << 6)
+#define MIP_SNAPSHOT_GAME_MODE          (1 << 7)
+#define MIP_SNAPSHOT_GESTURE_RADAR_MODE (1 << 8)
+#define MIP_SNAPSHOT_IR_REMOTE_CONTROL  (1 << 9)
+
+class MiPSnapshot
+{
+public:
+    MiPSnapshot()
+    {
+        clear();
+    }
+
+    void clear()
+    {
+        status.clear();
+        weight = 0;
+        distanceMillimetres = 0;
+        volume = 0;
+        chestLED.clear();
+        headLEDs.clear();
+        clapSettings.clear();
+        gameMode = MIP_DEFAULT_MODE;
+        gestureRadarMode = MIP_GESTURE_RADAR_DISABLED;
+        irRemoteControlEnabled = false;
+        valid = 0;
+        readTime = 0;
+    }
+
+    // Only converts to floating point centimetres when asked.
+    float distance() const
+    {
+        return distanceMillimetres / 10.0f;
+    }
+
+    MiPStatus           status;
+    int8_t              weight;
+    uint32_t            distanceMillimetres;
+    uint8_t             volume;
+    MiPChestLED         chestLED;
+    MiPHeadLEDs         headLEDs;
+    MiPClapSettings     clapSettings;
+    MiPGameMode         gameMode;
+    MiPGestureRadarMode gestureRadarMode;
+    bool                irRemoteControlEnabled;
+    uint16_t            valid;      // Bitmask of MIP_SNAPSHOT_* bits for the fields which were read successfully.
+    uint32_t            readTime;   // Number of milliseconds it took to read the whole snapshot.
+};
+
+// Read-only view of a response which still lives in the MiP object's own response buffer. It is only valid until the
+// next request is sent to MiP.
+class MiPResponseView
+{
+public:
+    MiPResponseView()
+    {
+        clear();
+    }
+
+    void clear()
+    {
+        pBuffer = NULL;
+        length = 0;
+    }
+
+    uint8_t operator[](size_t index) const
+    {
+        return pBuffer[index];
+    }
+
+    const uint8_t* pBuffer;
+    size_t         length;
+};
+
+// A complete request for the MiP, usually built at compile time by one of the builders in mip_frames.h.
+template<size_t LENGTH>
+struct MiPFrame
+{
+    uint8_t bytes[LENGTH];
+};
+
+// Entry in the background prefetch table. Holds the polling configuration for a property along with its last value.
+class MiPPrefetchEntry
+{
+public:
+    MiPPrefetchEntry()
+    {
+        clear();
+    }
+
+    void clear()
+    {
+        interval = 0;
+        maxStaleness = 0;
+        lastRequestTime = 0;
+        timestamp = 0;
+        value = 0;
+        policy = MIP_STALE_ALLOW;
+        enabled = false;
+        valid = false;
+    }
+
+    uint32_t       interval;
+    uint32_t       maxStaleness;
+    uint32_t       lastRequestTime;
+    uint32_t       timestamp;
+    uint32_t       value;
+    MiPStalePolicy policy;
+    bool           enabled;
+    bool           valid;
+};
+
+// Statistics about the UART link to MiP, as returned by MiP::readLinkStats(). Byte counts are of the characters
+// actually on the wire so responses, which MiP sends as hex text, count twice.
+class MiPLinkStats
+{
+public:
+    MiPLinkStats()
+    {
+        clear();
+    }
+
+    void clear()
+    {
+        baudRate = 0;
+        bytesSent = 0;
+        bytesReceived = 0;
+        throttledRequests = 0;
+        timeouts = 0;
+        badResponses = 0;
+        reconnects = 0;
+        discardedBytes = 0;
+        recentFailures = 0;
+        txUtilization = 0;
+        rxUtilization = 0;
+    }
+
+    uint32_t baudRate;
+    uint32_t bytesSent;
+    uint32_t bytesReceived;
+    uint32_t throttledRequests; // Number of low priority requests dropped or deferred due to the link being busy.
+    uint32_t timeouts;          // Number of responses which never arrived.
+    uint32_t badResponses;      // Number of responses and notifications which were cut short or unrecognized.
+    uint32_t reconnects;        // Number of times the link health monitor has successfully reconnected to MiP.
+    uint32_t discardedBytes;    // Number of unexpected bytes thrown away while looking for the start of a response.
+    uint8_t  recentFailures;    // Number of the last 32 exchanges with MiP which failed.
+    uint8_t  txUtilization;     // Percentage of the last MIP_LINK_WINDOW spent sending to MiP.
+    uint8_t  rxUtilization;     // Percentage of the last MIP_LINK_WINDOW spent receiving from MiP.
+};
+
+// Occupancy of one of the MiP event queues, as returned by MiP::readQueueStats().
+class MiPQueueStats
+{
+public:
+    MiPQueueStats()
+    {
+        clear();
+    }
+
+    void clear()
+    {
+        count = 0;
+        capacity = 0;
+        highWater = 0;
+        overflows = 0;
+    }
+
+    uint8_t  count;             // Number of events waiting to be read.
+    uint8_t  capacity;          // Number of events the queue can hold.
+    uint8_t  highWater;         // Most events which have been waiting at once.
+    uint32_t overflows;         // Number of events which were overwritten by newer ones before being read.
+};
+
+// Round trip times for one command, as returned by MiP::readCommandLatencies(). Times are in microseconds, from the
+// request being written to Serial to its response being found.
+class MiPCommandLatency
+{
+public:
+    MiPCommandLatency()
+    {
+        clear();
+    }
+
+    void clear()
+    {
+        command = 0;
+        count = 0;
+        timeouts = 0;
+        p50 = 0;
+        p95 = 0;
+        p99 = 0;
+        max = 0;
+    }
+
+    uint8_t  command;
+    uint32_t count;             // Number of responses received.
+    uint32_t timeouts;          // Number of responses which never arrived.
+    uint32_t p50;
+    uint32_t p95;
+    uint32_t p99;
+    uint32_t max;
+};
+
+// Entry in the transport's table of round trip times.
+class MiPLatencyEntry
+{
+public:
+    MiPLatencyEntry()
+    {
+        clear();
+    }
+
+    void clear()
+    {
+        command = 0;
+        timeouts = 0;
+        roundTrips.clear();
+    }
+
+    uint8_t      command;
+    uint32_t     timeouts;
+    MiPHistogram roundTrips;
+};
+
+// Wire time accounting for one direction of the UART link. The busy time is kept for the current and previous
+// MIP_LINK_WINDOW so that a rolling utilization can be interpolated from the two.
+class MiPLinkUsage
+{
+public:
+    MiPLinkUsage()
+    {
+        clear();
+    }
+
+    void clear()
+    {
+        totalBytes = 0;
+        currentMicros = 0;
+        previousMicros = 0;
+    }
+
+    uint32_t totalBytes;
+    uint32_t currentMicros;
+    uint32_t previousMicros;
+};
+
+// The settings last written to MiP, which are restored after the link health monitor reconnects.
+class MiPRestoreState
+{
+public:
+    MiPRestoreState()
+    {
+        clear();
+    }
+
+    void clear()
+    {
+        valid = 0;
+        chestLED.clear();
+        headLEDs.clear();
+        volume = 0;
+        gameMode = MIP_DEFAULT_MODE;
+        gestureRadarMode = MIP_GESTURE_RADAR_DISABLED;
+        clapEnabled = MIP_CLAP_DISABLED;
+        clapDelay = 0;
+        irRemoteControl = 0;
+        detectionId = 0;
+        detectionTxPower = 0;
+    }
+
+    // Bits that can be set in valid to indicate which settings have been written.
+    enum ValidBits
+    {
+        MIP_RESTORE_CHEST_LED          = (1 << 0),
+        MIP_RESTORE_CHEST_LED_FLASH    = (1 << 1),
+        MIP_RESTORE_HEAD_LEDS          = (1 << 2),
+        MIP_RESTORE_VOLUME             = (1 << 3),
+        MIP_RESTORE_GAME_MODE          = (1 << 4),
+        MIP_RESTORE_GESTURE_RADAR_MODE = (1 << 5),
+        MIP_RESTORE_CLAP_ENABLED       = (1 << 6),
+        MIP_RESTORE_CLAP_DELAY         = (1 << 7),
+        MIP_RESTORE_IR_REMOTE_CONTROL  = (1 << 8),
+        MIP_RESTORE_DETECTION_MODE     = (1 << 9)
+    };
+
+    uint16_t            valid;
+    MiPChestLED         chestLED;
+    MiPHeadLEDs         headLEDs;
+    uint8_t             volume;
+    MiPGameMode         gameMode;
+    MiPGestureRadarMode gestureRadarMode;
+    MiPClapEnabled      clapEnabled;
+    uint16_t            clapDelay;
+    uint8_t             irRemoteControl;
+    uint8_t             detectionId;
+    uint8_t             detectionTxPower;
+};
+
+// Record of a single transport event kept by the flight recorder. length is the full length of the event, which can be
+// more than the MIP_FLIGHT_RECORD_BYTES actually kept in bytes[].
+class MiPFlightRecord
+{
+public:
+    MiPFlightRecord()
+    {
+        clear();
+    }
+
+    void clear()
+    {
+        time = 0;
+        event = 0;
+        length = 0;
+        memset(bytes, 0, sizeof(bytes));
+    }
+
+    uint32_t time;      // millis() when the event was recorded.
+    uint8_t  event;     // One of the MiPFlightEvent values.
+    uint8_t  length;
+    uint8_t  bytes[MIP_FLIGHT_RECORD_BYTES];
+};
+
+// Function run by the library while it is waiting on MiP. See MiP::addIdleTask().
+typedef void (*MiPIdleTask)(void* pContext);
+
+class MiPIdleTaskEntry
+{
+public:
+    MiPIdleTaskEntry()
+    {
+        clear();
+    }
+
+    void clear()
+    {
+        task = NULL;
+        pContext = NULL;
+    }
+
+    MiPIdleTask task;
+    void*       pContext;
+};
+
+class MiP;
+
+// Entry in the transport's table of outstanding asynchronous requests. Each entry tracks a request which has been
+// sent to the MiP and holds the decoded response once it arrives.
+class MiPPendingRequest
+{
+public:
+    MiPPendingRequest()
+    {
+        clear();
+    }
+
+    void clear()
+    {
+        pDispatch = NULL;
+        pContinuation = NULL;
+        pParser = NULL;
+        pContext = NULL;
+        startTime = 0;
+        sentMicros = 0;
+        sequence = 0;
+        state = MIP_PENDING_FREE;
+        result = MIP_ERROR_NONE;
+        command = 0;
+        responseLength = 0;
+        memset(response, 0, sizeof(response));
+    }
+
+    enum State
+    {
+        MIP_PENDING_FREE     = 0,
+        MIP_PENDING_WAITING  = 1,
+        MIP_PENDING_COMPLETE = 2
+    };
+
+    void     (*pDispatch)(MiPPendingRequest& request);
+    void     (*pContinuation)();
+    void     (*pParser)();
+    void*    pContext;
+    uint32_t startTime;
+    uint32_t sentMicros;
+    uint16_t sequence;
+    uint8_t  state;
+    int8_t   result;
+    uint8_t  command;
+    uint8_t  responseLength;
+    uint8_t  response[MIP_RESPONSE_MAX_LEN];
+};
+
+// Lightweight handle to the result of an asynchronous request, returned by the read*Async() methods. It doesn't
+// allocate any memory itself since the response is held in the MiP object's pending request table until get() is
+// called or the then() continuation has been run.
+template<class T>
+class MiPFuture
+{
+public:
+    typedef int8_t (*Parser)(T& value, const uint8_t response[], size_t responseLength);
+    typedef void   (*Continuation)(int8_t result, const T& value, void* pContext);
+
+    MiPFuture(MiP* pMiP, Parser parser, uint8_t slot, uint16_t sequence, int8_t result)
+    {
+        m_pMiP = pMiP;
+        m_parser = parser;
+        m_sequence = sequence;
+        m_slot = slot;
+        m_result = result;
+    }
+
+    // Returns true once the response has arrived or the request has failed. Doesn't block.
+    bool   ready();
+    // Returns one of the MIP_ERROR_* codes. Only meaningful once ready() has returned true. MIP_ERROR_BUSY means that
+    // the response was lost because its table entry was recycled for a newer request before it was read.
+    int8_t result();
+    // Waits for the response if it hasn't arrived yet and returns the value. Also updates MiP::lastCallResult().
+    T      get();
+    // Registers a function to be called from MiP::handle() once the response arrives or the request fails.
+    void   then(Continuation continuation, void* pContext = NULL);
+
+protected:
+    static void dispatch(MiPPendingRequest& request);
+
+    MiP*     m_pMiP;
+    Parser   m_parser;
+    uint16_t m_sequence;
+    uint8_t  m_slot;
+    int8_t   m_result;
+};
+
 class MiP
 {
 public:
@@ -503,8 +1037,12 @@ public:
 
     float readDistanceTravelled();
     void  resetDistanceTravelled();
+    // Integer versions of readDistanceTravelled() which avoid floating point math.
+    uint32_t readDistanceTravelledTicks();
+    uint32_t readDistanceTravelledMillimetres();
 
     float readBatteryVoltage();
+    uint16_t readBatteryMillivolts();
     MiPPosition readPosition();
     bool  isOnBack();
     bool  isFaceDown();
@@ -557,11 +1095,125 @@ public:
     uint32_t readIRDongleCode();
     uint8_t  availableIRCodeEvents();
 
+    // Reads all of the above state in one call by pipelining the underlying requests. Only reads are sent, so unlike
+    // readGameMode() it doesn't stop MiP first. While a game mode is running MiP may not answer the game mode request,
+    // in which case MIP_SNAPSHOT_GAME_MODE is left clear in valid.
+    void     readSnapshot(MiPSnapshot& snapshot);
+
+    // Asynchronous versions of the read methods above. They send the request and return immediately. The response
+    // is collected by later calls to handle() or by the methods of the returned MiPFuture.
+    MiPFuture<float>              readDistanceTravelledAsync();
+    MiPFuture<int8_t>             readWeightAsync();
+    MiPFuture<uint8_t>            readVolumeAsync();
+    MiPFuture<MiPSoftwareVersion> readSoftwareVersionAsync();
+    MiPFuture<MiPHardwareInfo>    readHardwareInfoAsync();
+    MiPFuture<MiPChestLED>        readChestLEDAsync();
+    MiPFuture<MiPHeadLEDs>        readHeadLEDsAsync();
+    MiPFuture<MiPClapSettings>    readClapSettingsAsync();
+    // Number of asynchronous requests still waiting on MiP, out of MIP_MAX_PENDING_REQUESTS.
+    uint8_t                       pendingRequestCount();
+
+    // Should be called each time through loop() when using the asynchronous API or prefetching. It processes any
+    // received data, times out stale requests, runs the continuations registered with MiPFuture::then() and issues
+    // any background prefetch requests which are due.
+    void handle();
+
+    // Poll a property in the background every interval milliseconds, one request at a time and only while no other
+    // asynchronous requests are waiting on MiP. A maxStaleness of 0 means that the value never goes stale.
+    void     enablePrefetch(MiPPrefetchProperty property, uint32_t interval, uint32_t maxStaleness = 0,
+                            MiPStalePolicy policy = MIP_STALE_ALLOW);
+    void     disablePrefetch(MiPPrefetchProperty property);
+    // Milliseconds since the cached value was received from MiP. 0xFFFFFFFF if it has never been received.
+    uint32_t prefetchAge(MiPPrefetchProperty property);
+    // Return the cached values right away, subject to the staleness policy set in enablePrefetch().
+    uint32_t readPrefetchedDistanceTicks();
+    int8_t   readPrefetchedWeight();
+    uint8_t  readPrefetchedVolume();
+
+    // Bandwidth accounting for the UART link to MiP. Utilization is the percentage of the last MIP_LINK_WINDOW
+    // milliseconds that the busier direction of the link was in use. While it is above the throttle threshold, low
+    // priority traffic is shed: continuousDrive() fails with MIP_ERROR_THROTTLED and background prefetches are put
+    // off. A threshold of 100 disables throttling.
+    uint8_t  readLinkUtilization();
+    void     readLinkStats(MiPLinkStats& stats);
+    bool     isLinkOverBudget();
+    void     setLinkThrottleThreshold(uint8_t percent);
+    // Microseconds that a command's request and response occupy the link. A baudRate of 0 uses the current rate.
+    uint32_t estimateCommandWireTime(uint8_t command, uint32_t baudRate = 0);
+
+    // Transport instrumentation: the occupancy of each event queue and the round trip time percentiles of each
+    // command sent to MiP. readCommandLatencies() returns the number of commands copied into latencies.
+    // clearTransportStats() restarts these, along with the discarded byte count, without touching the rest of the
+    // link statistics.
+    void     readQueueStats(MiPEventQueue queue, MiPQueueStats& stats);
+    uint8_t  readCommandLatencies(MiPCommandLatency latencies[], uint8_t maxEntries);
+    void     clearTransportStats();
+
+    // Whenever the library has to wait on MiP it calls yield() so that the ESP8266 SDK can service WiFi and feed the
+    // watchdog. It also runs any tasks registered here so that the sketch can keep servers such as telnet, OTA and UDP
+    // going. Idle tasks must not call back into this MiP object since a request to MiP is still in progress.
+    bool addIdleTask(MiPIdleTask task, void* pContext = NULL);
+    void removeIdleTask(MiPIdleTask task, void* pContext = NULL);
+    // True while the idle tasks are being run, when calls back into this MiP object aren't allowed.
+    bool isRunningIdleTasks()
+    {
+        return m_isIdling;
+    }
+
+    // Link health monitoring. When at least failureThreshold of the last 32 exchanges with MiP have timed out or been
+    // garbled, or when begin() failed, the connection handshake is redone in place and the LEDs, volume and modes which
+    // were last written are restored. Calls made while the link is down, including ones which would otherwise be sent
+    // blindly such as drive and LED commands, fail with MIP_ERROR_LINK_DOWN without waiting on MiP. The reconnect is
+    // retried after a few seconds, backing off to once a minute while MiP stays unreachable since each attempt blocks
+    // for over a second. A threshold of 0 turns off the automatic reconnects. reconnect() returns false, with
+    // MIP_ERROR_NOT_STARTED, if begin() hasn't been called yet.
+    void setLinkHealthThreshold(uint8_t failureThreshold);
+    bool isLinkDown();
+    bool reconnect();
+
+    // Flight recorder of the most recent transport events: requests, responses, notifications, timeouts and discarded
+    // data. readFlightRecords() returns them oldest first and dumpFlightRecorder() prints them to any Print object,
+    // such as Serial1 or a MiPDebug telnet session. keepFlightRecorderInRtc() also mirrors each record into RTC memory,
+    // which survives a reset, so that a sketch can call restoreFlightRecorderFromRtc() after begin() to get back the
+    // events which led up to a crash.
+    uint8_t readFlightRecords(MiPFlightRecord records[], uint8_t maxRecords);
+    void    dumpFlightRecorder(Print& output);
+    void    clearFlightRecorder();
+    void    keepFlightRecorderInRtc(bool keep);
+    bool    restoreFlightRecorderFromRtc();
+
+    // Send a request frame built by one of the builders in mip_frames.h. Use sendFrame_P() for frames which have
+    // been placed in flash with PROGMEM.
+    template<size_t LENGTH>
+    void sendFrame(const MiPFrame<LENGTH>& frame);
+    template<size_t LENGTH>
+    void sendFrame_P(const MiPFrame<LENGTH>& frame);
+
     void   rawSend(const uint8_t request[], size_t requestLength);
     int8_t rawReceive(const uint8_t request[], size_t requestLength,
                       uint8_t responseBuffer[], size_t responseBufferSize, size_t& responseLength);
+    // Same as above but rather than copying the response, returns a view of it which is valid until the next request.
+    int8_t rawReceive(const uint8_t request[], size_t requestLength, size_t responseSize, MiPResponseView& response);
+
+    // Decoders for raw MiP responses. They only look at the response passed in so they can also be used on responses
+    // captured elsewhere, such as by host side tools.
+    static int8_t parseGestureRadarMode(MiPGestureRadarMode& mode, const uint8_t response[], size_t responseLength);
+    static int8_t parseChestLED(MiPChestLED& chestLED, const uint8_t response[], size_t responseLength);
+    static int8_t parseHeadLEDs(MiPHeadLEDs& headLEDs, const uint8_t response[], size_t responseLength);
+    static int8_t parseVolume(uint8_t& volume, const uint8_t response[], size_t responseLength);
+    static int8_t parseOdometer(float& distanceInCm, const uint8_t response[], size_t responseLength);
+    static int8_t parseOdometerTicks(uint32_t& ticks, const uint8_t response[], size_t responseLength);
+    static int8_t parseStatus(MiPStatus& status, const uint8_t response[], size_t responseLength);
+    static int8_t parseWeight(int8_t& weight, const uint8_t response[], size_t responseLength);
+    static int8_t parseClapSettings(MiPClapSettings& settings, const uint8_t response[], size_t responseLength);
+    static int8_t parseSoftwareVersion(MiPSoftwareVersion& software, const uint8_t response[], size_t responseLength);
+    static int8_t parseHardwareInfo(MiPHardwareInfo& hardware, const uint8_t response[], size_t responseLength);
+    static int8_t parseGameMode(MiPGameMode& mode, const uint8_t response[], size_t responseLength);
+    static int8_t parseIRRemoteControl(uint8_t& remoteControl, const uint8_t response[], size_t responseLength);
 
 protected:
+    template<class T> friend class MiPFuture;
+
     void    clear();
     int8_t  attemptMiPConnection(uint32_t baudRate);
 
@@ -576,22 +1228,22 @@ protected:
     void    rawFlashChestLED(uint8_t red, uint8_t green, uint8_t blue, uint16_t onTime, uint16_t offTime);
     int8_t  rawGetChestLED(MiPChestLED& chestLED);
 
+
     void    rawSetHeadLEDs(MiPHeadLED led1, MiPHeadLED led2, MiPHeadLED led3, MiPHeadLED led4);
     int8_t  rawGetHeadLEDs(MiPHeadLEDs& headLEDs);
-    bool    isValidHeadLED(uint8_t led);
+    static bool   isValidHeadLED(uint8_t led);
 
     void    fallDown(MiPFallDirection direction);
 
     void    rawSetVolume(uint8_t volume);
     int8_t  rawGetVolume(uint8_t& volume);
 
-    int8_t  rawReadOdometer(float& distanceInCm);
+    int8_t  readOdometerTicks(uint32_t& ticks);
+    int8_t  rawReadOdometer(uint32_t& ticks);
 
     int8_t  rawGetStatus(MiPStatus& status);
-    int8_t  parseStatus(MiPStatus& status, const uint8_t response[], size_t responseLength);
 
     int8_t  rawGetWeight(int8_t& weight);
-    int8_t  parseWeight(int8_t& weight, const uint8_t response[], size_t responseLength);
 
     void    checkedEnableClapEvents(MiPClapEnabled enabled);
     int8_t  readClapSettings(MiPClapSettings& settings);
@@ -615,9 +1267,47 @@ protected:
     void    rawSetIRRemoteControl(uint8_t remoteControl);
     int8_t  rawGetIRRemoteControl(uint8_t& remoteControl);
 
-    void    transportSendRequest(const uint8_t* pRequest, size_t requestLength, int expectResponse);
+    int8_t  parseSnapshotResponse(MiPSnapshot& snapshot, const uint8_t response[], size_t responseLength);
+
+    template<class T>
+    MiPFuture<T> beginAsyncRequest(uint8_t command, typename MiPFuture<T>::Parser parser);
+    int8_t  allocatePendingRequest(uint8_t command, uint8_t& slot, uint16_t& sequence);
+    uint8_t freePendingRequests();
+    MiPPendingRequest* findPendingRequest(uint8_t slot, uint16_t sequence);
+    MiPPendingRequest* findWaitingRequest(uint8_t commandByte);
+    void    pollPendingRequests();
+
+    void    servicePrefetch();
+    bool    readPrefetched(MiPPrefetchProperty property, uint32_t& value);
+    int8_t  fetchPrefetchProperty(MiPPrefetchProperty property, uint32_t& value);
+    void    updatePrefetch(MiPPrefetchProperty property, uint32_t value);
+    static void onPrefetchedDistance(int8_t result, const uint32_t& ticks, void* pContext);
+    static void onPrefetchedWeight(int8_t result, const int8_t& weight, void* pContext);
+    static void onPrefetchedVolume(int8_t result, const uint8_t& volume, void* pContext);
+
+    void    accountLinkTraffic(MiPLinkUsage& usage, size_t byteCount);
+    void    updateLinkWindow();
+    uint8_t linkUtilization(const MiPLinkUsage& usage);
+
+    void    idle();
+
+    void    recordLinkResult(int8_t result);
+    void    checkLinkHealth();
+    void    scheduleReconnect();
+    void    failWaitingRequests();
+    void    restoreState();
+
+    void    recordRoundTrip(uint8_t command, uint32_t sentMicros);
+    void    recordCommandTimeout(uint8_t command);
+    MiPLatencyEntry* findLatencyEntry(uint8_t command);
+    void    recordFlightEvent(MiPFlightEvent event, const uint8_t* pBytes, size_t length);
+    void    saveFlightRecordToRtc(uint8_t index);
+
+    int8_t  transportSendRequest(const uint8_t* pRequest, size_t requestLength, int expectResponse);
     int8_t  transportGetResponse(uint8_t* pResponseBuffer, size_t responseBufferSize, size_t* pResponseLength);
+    int8_t  transportGetResponse(size_t responseSize, MiPResponseView& response);
     bool    processAllResponseData();
+    bool    readResponseData(uint8_t* pResponse, uint8_t commandByte, size_t responseSize);
     void    copyHexTextToBinary(uint8_t* pDest, uint8_t* pSrc, uint8_t length);
     uint8_t parseHexDigit(uint8_t digit);
     void    processOobResponseData(uint8_t commandByte);
@@ -629,7 +1319,8 @@ protected:
         MIP_FLAG_RADAR_VALID     = (1 << 0),
         MIP_FLAG_SHAKE_DETECTED  = (1 << 1),
         MIP_FLAG_WEIGHT_VALID    = (1 << 2),
-        MRI_FLAG_INITIALIZED     = (1 << 3)
+        MRI_FLAG_INITIALIZED     = (1 << 3),
+        MIP_FLAG_LINK_DOWN       = (1 << 4)
     };
 
     uint32_t                     m_lastRequestTime;
@@ -649,10 +1340,184 @@ protected:
     CircularQueue<MiPGesture, 8> m_gestureEvents;
     CircularQueue<uint32_t, 8>   m_irCodeEvents;
     CircularQueue<uint8_t, 8>    m_detectedMiPEvents;
+    MiPPendingRequest            m_pendingRequests[MIP_MAX_PENDING_REQUESTS];
+    uint16_t                     m_nextSequence;
+    MiPPrefetchEntry             m_prefetch[MIP_PREFETCH_COUNT];
+    bool                         m_prefetchInFlight;
+    uint32_t                     m_baudRate;
+    uint32_t                     m_linkByteTime;
+    uint32_t                     m_linkWindowStart;
+    MiPLinkUsage                 m_linkTx;
+    MiPLinkUsage                 m_linkRx;
+    uint32_t                     m_throttledRequests;
+    uint8_t                      m_linkThrottleThreshold;
+    MiPIdleTaskEntry             m_idleTasks[MIP_MAX_IDLE_TASKS];
+    bool                         m_isIdling;
+    uint32_t                     m_linkHistory;
+    uint32_t                     m_linkTimeouts;
+    uint32_t                     m_linkBadResponses;
+    uint32_t                     m_reconnects;
+    uint32_t                     m_discardedBytes;
+    uint32_t                     m_requestSentMicros;
+    MiPLatencyEntry              m_latencies[MIP_LATENCY_COMMANDS];
+    uint8_t                      m_latencyCount;
+    uint32_t                     m_nextReconnectTime;
+    uint8_t                      m_reconnectFailures;
+    uint8_t                      m_linkHealthThreshold;
+    bool                         m_isReconnecting;
+    MiPRestoreState              m_restoreState;
+    MiPFlightRecord              m_flightRecords[MIP_FLIGHT_RECORDER_LENGTH];
+    uint32_t                     m_flightRecordCount;
+    uint8_t                      m_nextFlightRecord;
+    bool                         m_keepFlightRecorderInRtc;
     uint8_t                      m_irId;
     char                         m_ssid[32];
     char                         m_password[64];
     char                         m_hostname[63];
 };
 
+
+
+template<size_t LENGTH>
+void MiP::sendFrame(const MiPFrame<LENGTH>& frame)
+{
+    // Send this command blindly with no error checking since there is no way to determine if it has failed.
+    rawSend(frame.bytes, LENGTH);
+}
+
+template<size_t LENGTH>
+void MiP::sendFrame_P(const MiPFrame<LENGTH>& frame)
+{
+    uint8_t bytes[LENGTH];
+
+    memcpy_P(bytes, frame.bytes, LENGTH);
+    rawSend(bytes, LENGTH);
+}
+
+template<class T>
+MiPFuture<T> MiP::beginAsyncRequest(uint8_t command, typename MiPFuture<T>::Parser parser)
+{
+    uint8_t  slot = 0;
+    uint16_t sequence = 0;
+    int8_t   result = allocatePendingRequest(command, slot, sequence);
+
+    return MiPFuture<T>(this, parser, slot, sequence, result);
+}
+
+template<class T>
+bool MiPFuture<T>::ready()
+{
+    if (m_sequence == 0)
+    {
+        // The request was never issued or its result has already been consumed.
+        return true;
+    }
+
+    m_pMiP->pollPendingRequests();
+
+    MiPPendingRequest* pRequest = m_pMiP->findPendingRequest(m_slot, m_sequence);
+    if (pRequest == NULL)
+    {
+        // Continuation already consumed the result.
+        return true;
+    }
+    return pRequest->state == MiPPendingRequest::MIP_PENDING_COMPLETE;
+}
+
+template<class T>
+int8_t MiPFuture<T>::result()
+{
+    if (m_sequence == 0)
+    {
+        return m_result;
+    }
+
+    MiPPendingRequest* pRequest = m_pMiP->findPendingRequest(m_slot, m_sequence);
+    if (pRequest == NULL)
+    {
+        // The entry was recycled, or another copy of this future consumed it, so the response is lost.
+        return MIP_ERROR_BUSY;
+    }
+    if (pRequest->state != MiPPendingRequest::MIP_PENDING_COMPLETE)
+    {
+        return m_result;
+    }
+    return pRequest->result;
+}
+
+template<class T>
+T MiPFuture<T>::get()
+{
+    T value = T();
+
+    while (!ready())
+    {
+        m_pMiP->idle();
+    }
+
+    if (m_sequence != 0)
+    {
+        MiPPendingRequest* pRequest = m_pMiP->findPendingRequest(m_slot, m_sequence);
+        if (pRequest == NULL)
+        {
+            // The entry was recycled, or another copy of this future consumed it, so the response is lost.
+            m_result = MIP_ERROR_BUSY;
+        }
+        else
+        {
+            m_result = pRequest->result;
+            if (m_result == MIP_ERROR_NONE)
+            {
+                m_result = m_parser(value, pRequest->response, pRequest->responseLength);
+            }
+            // The response has now been consumed so free up the slot for another request.
+            pRequest->clear();
+        }
+        m_sequence = 0;
+    }
+
+    m_pMiP->m_lastError = m_result;
+    return value;
+}
+
+template<class T>
+void MiPFuture<T>::then(Continuation continuation, void* pContext /* = NULL */)
+{
+    if (m_sequence == 0)
+    {
+        // The request failed before it could be sent so run the continuation right away.
+        continuation(m_result, T(), pContext);
+        return;
+    }
+
+    MiPPendingRequest* pRequest = m_pMiP->findPendingRequest(m_slot, m_sequence);
+    if (pRequest == NULL)
+    {
+        // The response is already lost so report it right away.
+        continuation(MIP_ERROR_BUSY, T(), pContext);
+        return;
+    }
+    pRequest->pDispatch = dispatch;
+    pRequest->pContinuation = reinterpret_cast<void (*)()>(continuation);
+    pRequest->pParser = reinterpret_cast<void (*)()>(m_parser);
+    pRequest->pContext = pContext;
+}
+
+// This internal protected method is called from MiP::handle() with a copy of a completed request so that the
+// continuation can be called with the parsed response in its original type.
+template<class T>
+void MiPFuture<T>::dispatch(MiPPendingRequest& request)
+{
+    Continuation continuation = reinterpret_cast<Continuation>(request.pContinuation);
+    Parser       parser = reinterpret_cast<Parser>(request.pParser);
+    T            value = T();
+    int8_t       result = request.result;
+
+    if (result == MIP_ERROR_NONE)
+    {
+        result = parser(value, request.response, request.responseLength);
+    }
+    continuation(result, value, request.pContext);
+}
+
 #endif // MIP_ESP8266_H
@@ -0,0 +1,432 @@
+/* Copyright (C) 2018  Samuel Trassare (https://github.com/tiogaplanet)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* Flash log used by MiPDebug::setFlashLog().
+*/
+#include "mip_flash_log.h"
+
+
+// "MLOG" in the first bytes of each segment file.
+#define MIP_FLASH_LOG_MAGIC 0x474F4C4DUL
+
+static_assert(MIP_FLASH_LOG_BUFFER <= 0xFFFF, "MIP_FLASH_LOG_BUFFER must fit in the 16-bit ring indices");
+static_assert(MIP_FLASH_LOG_BUFFER >= MIP_FLASH_LOG_PAGE, "MIP_FLASH_LOG_BUFFER must hold at least a page");
+
+
+
+MiPFlashLog::MiPFlashLog()
+{
+    m_pFileSystem = NULL;
+    m_segmentCount = 0;
+    m_segmentSize = 0;
+    m_segment = 0;
+    m_sequence = 0;
+    m_firstSequence = 0;
+    m_segmentLength = 0;
+    m_bufferHead = 0;
+    m_bufferCount = 0;
+    m_bufferTime = 0;
+    m_isDroppingLine = false;
+}
+
+bool MiPFlashLog::begin(fs::FS& fileSystem, uint8_t segmentCount /* = MIP_FLASH_LOG_SEGMENTS */,
+                        uint32_t segmentSize /* = MIP_FLASH_LOG_SEGMENT_SIZE */)
+{
+    // Segments end on a page boundary so that the last write into each of them is a full page.
+    segmentSize -= segmentSize % MIP_FLASH_LOG_PAGE;
+    if (segmentCount < 2 || segmentCount > MIP_FLASH_LOG_MAX_SEGMENTS || segmentSize < 2 * MIP_FLASH_LOG_PAGE)
+    {
+        return false;
+    }
+
+    end();
+    m_pFileSystem = &fileSystem;
+    m_segmentCount = segmentCount;
+    m_segmentSize = segmentSize;
+    m_bufferHead = 0;
+    m_bufferCount = 0;
+    m_isDroppingLine = false;
+    m_stats.clear();
+
+    // Carry on from the newest segment left from before the reset, if any.
+    bool isFound = false;
+    for (uint8_t segment = 0 ; segment < m_segmentCount ; segment++)
+    {
+        SegmentHeader header;
+        uint32_t      size;
+
+        if (readSegmentHeader(segment, header, size) && (!isFound || (int32_t)(header.sequence - m_sequence) > 0))
+        {
+            isFound = true;
+            m_segment = segment;
+            m_sequence = header.sequence;
+            m_firstSequence = header.firstSequence;
+            m_segmentLength = size;
+        }
+    }
+
+    bool isOpen;
+    if (isFound)
+    {
+        char name[16];
+
+        segmentName(m_segment, name, sizeof(name));
+        m_file = m_pFileSystem->open(name, "a");
+        isOpen = m_file;
+    }
+    else
+    {
+        m_firstSequence = 1;
+        isOpen = startSegment(0, 1);
+    }
+    if (!isOpen)
+    {
+        m_pFileSystem = NULL;
+        return false;
+    }
+
+    // Mark where this run starts in the log.
+    char line[80];
+    int  length = snprintf_P(line, sizeof(line), PSTR("*** Log started, reset reason: %s\r\n"),
+                             ESP.getResetReason().c_str());
+    write(line, length < (int)sizeof(line) ? length : sizeof(line) - 1);
+
+    return true;
+}
+
+void MiPFlashLog::end()
+{
+    if (!isStarted())
+    {
+        return;
+    }
+
+    flush();
+    m_file.close();
+    m_pFileSystem = NULL;
+}
+
+bool MiPFlashLog::write(const char* pData, size_t length)
+{
+    if (!isStarted() || length == 0)
+    {
+        return false;
+    }
+
+    bool isLineEnd = pData[length - 1] == '\n';
+    if (m_isDroppingLine)
+    {
+        // The start of this line was dropped so drop the rest of it too.
+        m_isDroppingLine = !isLineEnd;
+        return false;
+    }
+    if (length > (size_t)(MIP_FLASH_LOG_BUFFER - m_bufferCount))
+    {
+        m_stats.droppedLines++;
+        m_isDroppingLine = !isLineEnd;
+        return false;
+    }
+
+    if (m_bufferCount == 0)
+    {
+        m_bufferTime = millis();
+    }
+    m_stats.bytesLogged += length;
+    while (length > 0)
+    {
+        size_t count = MIP_FLASH_LOG_BUFFER - m_bufferHead;
+        if (count > length)
+        {
+            count = length;
+        }
+        memcpy(&m_buffer[m_bufferHead], pData, count);
+        m_bufferHead = (m_bufferHead + count) % MIP_FLASH_LOG_BUFFER;
+        m_bufferCount += count;
+        pData += count;
+        length -= count;
+    }
+
+    return true;
+}
+
+void MiPFlashLog::handle()
+{
+    if (!isStarted() || m_bufferCount == 0)
+    {
+        return;
+    }
+    if (!rotateIfFull())
+    {
+        return;
+    }
+
+    // Only write once the next page can be completed, unless the oldest line has waited long enough.
+    size_t toPageEnd = MIP_FLASH_LOG_PAGE - m_segmentLength % MIP_FLASH_LOG_PAGE;
+    if (m_bufferCount >= toPageEnd)
+    {
+        writeBuffer(toPageEnd);
+    }
+    else if (millis() - m_bufferTime >= MIP_FLASH_LOG_FLUSH_INTERVAL)
+    {
+        writeBuffer(m_bufferCount);
+    }
+}
+
+void MiPFlashLog::flush()
+{
+    while (isStarted() && m_bufferCount > 0)
+    {
+        if (!rotateIfFull())
+        {
+            return;
+        }
+
+        uint32_t length = m_segmentSize - m_segmentLength;
+        writeBuffer(length < m_bufferCount ? length : m_bufferCount);
+    }
+}
+
+void MiPFlashLog::dump(Print& output, uint32_t maxBytes)
+{
+    if (!isStarted())
+    {
+        output.print(F("* Flash log isn't started\r\n"));
+        return;
+    }
+    flush();
+
+    uint32_t stored = storedBytes();
+    uint32_t skip = stored > maxBytes ? stored - maxBytes : 0;
+    bool     isFirst = true;
+    bool     isLineStart = true;
+
+    // Walk the segments from the oldest to the newest one.
+    for (uint8_t i = 1 ; i <= m_segmentCount ; i++)
+    {
+        uint8_t       segment = (m_segment + i) % m_segmentCount;
+        SegmentHeader header;
+        uint32_t      size;
+
+        if (!readSegmentHeader(segment, header, size) || header.sequence != m_sequence - (m_segmentCount - i))
+        {
+            continue;
+        }
+        uint32_t dataSize = size - sizeof(header);
+        if (skip >= dataSize)
+        {
+            skip -= dataSize;
+            continue;
+        }
+
+        char name[16];
+        segmentName(segment, name, sizeof(name));
+        File file = m_pFileSystem->open(name, "r");
+        if (!file)
+        {
+            continue;
+        }
+        file.seek(sizeof(header) + skip);
+
+        // Only the first segment of the log is known to start with a full line.
+        if (isFirst)
+        {
+            isLineStart = skip == 0 && header.sequence == header.firstSequence;
+            isFirst = false;
+        }
+        skip = 0;
+
+        char   chunk[64];
+        size_t count;
+        while ((count = file.read((uint8_t*)chunk, sizeof(chunk))) > 0)
+        {
+            const char* pChunk = chunk;
+
+            // Skip the rest of the line which was cut off by maxBytes.
+            if (!isLineStart)
+            {
+                const char* pNewLine = (const char*)memchr(chunk, '\n', count);
+                if (pNewLine == NULL)
+                {
+                    continue;
+                }
+                count -= pNewLine + 1 - chunk;
+                pChunk = pNewLine + 1;
+                isLineStart = true;
+            }
+            output.write((const uint8_t*)pChunk, count);
+        }
+        file.close();
+    }
+}
+
+bool MiPFlashLog::clear()
+{
+    if (!isStarted())
+    {
+        return false;
+    }
+
+    m_file.close();
+    for (uint8_t segment = 0 ; segment < MIP_FLASH_LOG_MAX_SEGMENTS ; segment++)
+    {
+        char name[16];
+
+        segmentName(segment, name, sizeof(name));
+        if (m_pFileSystem->exists(name))
+        {
+            m_pFileSystem->remove(name);
+        }
+    }
+    m_bufferCount = 0;
+    m_isDroppingLine = false;
+
+    m_firstSequence = m_sequence + 1;
+    if (!startSegment(0, m_firstSequence))
+    {
+        m_pFileSystem = NULL;
+        return false;
+    }
+    return true;
+}
+
+void MiPFlashLog::readStats(MiPFlashLogStats& stats)
+{
+    stats = m_stats;
+    stats.sequence = m_sequence;
+    stats.storedBytes = isStarted() ? storedBytes() : 0;
+}
+
+
+
+// This is an internal protected method which builds the file name of a segment.
+void MiPFlashLog::segmentName(uint8_t segment, char* pName, size_t nameSize)
+{
+    snprintf_P(pName, nameSize, PSTR("/mlog%u"), segment);
+}
+
+// This is an internal protected method which reads the header and size of a segment file. Returns false if the file
+// doesn't exist or isn't a log segment.
+bool MiPFlashLog::readSegmentHeader(uint8_t segment, SegmentHeader& header, uint32_t& size)
+{
+    char name[16];
+
+    segmentName(segment, name, sizeof(name));
+    if (!m_pFileSystem->exists(name))
+    {
+        return false;
+    }
+
+    File file = m_pFileSystem->open(name, "r");
+    if (!file)
+    {
+        return false;
+    }
+    size = file.size();
+    bool isValid = file.read((uint8_t*)&header, sizeof(header)) == sizeof(header) && header.magic == MIP_FLASH_LOG_MAGIC;
+    file.close();
+
+    return isValid;
+}
+
+// This is an internal protected method which truncates a segment file and makes it the newest segment. On failure the
+// log is stopped since there is nowhere left to write.
+bool MiPFlashLog::startSegment(uint8_t segment, uint32_t sequence)
+{
+    char name[16];
+
+    segmentName(segment, name, sizeof(name));
+    m_file.close();
+    m_file = m_pFileSystem->open(name, "w");
+
+    SegmentHeader header;
+    header.magic = MIP_FLASH_LOG_MAGIC;
+    header.sequence = sequence;
+    header.firstSequence = m_firstSequence;
+    if (!m_file || m_file.write((const uint8_t*)&header, sizeof(header)) != sizeof(header))
+    {
+        m_file.close();
+        m_pFileSystem = NULL;
+        return false;
+    }
+
+    m_segment = segment;
+    m_sequence = sequence;
+    m_segmentLength = sizeof(header);
+    m_stats.bytesWritten += sizeof(header);
+
+    return true;
+}
+
+// This is an internal protected method which moves on to the oldest segment once the newest one is full. Returns false
+// if the log had to be stopped.
+bool MiPFlashLog::rotateIfFull()
+{
+    if (m_segmentLength < m_segmentSize)
+    {
+        return true;
+    }
+    if (!startSegment((m_segment + 1) % m_segmentCount, m_sequence + 1))
+    {
+        return false;
+    }
+    m_stats.rotations++;
+
+    return true;
+}
+
+// This is an internal protected method which writes the oldest bytes in the RAM buffer to the newest segment in a
+// single batch. The caller has already checked that they fit in the segment.
+void MiPFlashLog::writeBuffer(size_t length)
+{
+    size_t tail = (m_bufferHead + MIP_FLASH_LOG_BUFFER - m_bufferCount) % MIP_FLASH_LOG_BUFFER;
+    size_t first = MIP_FLASH_LOG_BUFFER - tail;
+
+    if (first > length)
+    {
+        first = length;
+    }
+    m_file.write((const uint8_t*)&m_buffer[tail], first);
+    if (length > first)
+    {
+        m_file.write((const uint8_t*)m_buffer, length - first);
+    }
+    m_file.flush();
+
+    // Bytes which don't make it to flash, because the file system is full, are dropped rather than retried forever.
+    m_bufferCount -= length;
+    m_bufferTime = millis();
+    m_segmentLength += length;
+    m_stats.bytesWritten += length;
+    m_stats.writes++;
+}
+
+// This is an internal protected method which adds up the log data kept in the current segments.
+uint32_t MiPFlashLog::storedBytes()
+{
+    uint32_t total = 0;
+
+    for (uint8_t i = 1 ; i <= m_segmentCount ; i++)
+    {
+        uint8_t       segment = (m_segment + i) % m_segmentCount;
+        SegmentHeader header;
+        uint32_t      size;
+
+        if (readSegmentHeader(segment, header, size) && header.sequence == m_sequence - (m_segmentCount - i))
+        {
+            total += size - sizeof(header);
+        }
+    }
+
+    return total;
+}
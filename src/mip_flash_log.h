@@ -0,0 +1,166 @@
+/* Copyright (C) 2018  Samuel Trassare (https://github.com/tiogaplanet)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* This header file describes the flash log, an optional sink for MiPDebug output which keeps the most recent lines in
+   SPIFFS or LittleFS so that they survive a reset and can be read back later with the "flog" telnet command.
+
+   The log is an append-only ring of segment files, /mlog0 to /mlogN, each starting with a small header which holds
+   its sequence number. New lines are appended to the newest segment until it reaches the segment size and then the
+   oldest segment is truncated and reused. Segments are reused strictly in turn so every one of them is rewritten
+   equally often, and the file system spreads those rewrites over its flash blocks.
+
+   Logging a line only copies it into a RAM buffer so its cost doesn't depend on the flash. The buffer is written out
+   from MiPDebug::handle(), at most one page per call, and only once a whole page is waiting unless the oldest line has
+   waited MIP_FLASH_LOG_FLUSH_INTERVAL milliseconds. Each page of log data is therefore written once, apart from the
+   partial page left by such a timed flush, which bounds the extra flash wear to one page per flush interval.
+*/
+#ifndef MIP_FLASH_LOG_H
+#define MIP_FLASH_LOG_H
+
+#include <Arduino.h>
+#include <FS.h>
+#include <stdint.h>
+
+
+// Default number of segment files and their size in bytes, including the header. The log keeps between
+// (segments - 1) * size and segments * size bytes of the most recent output.
+#ifndef MIP_FLASH_LOG_SEGMENTS
+  #define MIP_FLASH_LOG_SEGMENTS 4
+#endif
+#ifndef MIP_FLASH_LOG_SEGMENT_SIZE
+  #define MIP_FLASH_LOG_SEGMENT_SIZE 16384
+#endif
+
+// Size of the flash page which writes are batched into. Writes end on a page boundary within the segment file.
+#define MIP_FLASH_LOG_PAGE 256
+
+// Size of the RAM buffer holding lines which haven't been written to flash yet. Lines which don't fit because
+// MiPDebug::handle() isn't being called often enough are dropped and counted.
+#ifndef MIP_FLASH_LOG_BUFFER
+  #define MIP_FLASH_LOG_BUFFER 1024
+#endif
+
+// Longest time, in milliseconds, that a line waits in the RAM buffer before a partial page is written out.
+#ifndef MIP_FLASH_LOG_FLUSH_INTERVAL
+  #define MIP_FLASH_LOG_FLUSH_INTERVAL 10000
+#endif
+
+// Maximum number of segment files.
+#define MIP_FLASH_LOG_MAX_SEGMENTS 16
+
+
+class MiPFlashLogStats
+{
+public:
+    MiPFlashLogStats()
+    {
+        clear();
+    }
+
+    void clear()
+    {
+        bytesLogged = 0;
+        bytesWritten = 0;
+        writes = 0;
+        droppedLines = 0;
+        rotations = 0;
+        sequence = 0;
+        storedBytes = 0;
+    }
+
+    // Bytes of output passed to write() and bytes written to flash, including segment headers, since begin().
+    uint32_t bytesLogged;
+    uint32_t bytesWritten;
+    // Number of writes made to flash since begin().
+    uint32_t writes;
+    // Lines dropped since begin() because the RAM buffer was full.
+    uint32_t droppedLines;
+    // Number of times the oldest segment has been reused since begin().
+    uint32_t rotations;
+    // Sequence number of the newest segment. It keeps counting across resets.
+    uint32_t sequence;
+    // Bytes of log data currently kept in flash, not counting the RAM buffer.
+    uint32_t storedBytes;
+};
+
+
+class MiPFlashLog
+{
+public:
+    MiPFlashLog();
+
+    // Start logging to a file system which has already been mounted, for example with SPIFFS.begin(). Logging carries
+    // on after the newest line kept from before the last reset. Returns false if the segments can't be created.
+    bool begin(fs::FS& fileSystem, uint8_t segmentCount = MIP_FLASH_LOG_SEGMENTS,
+               uint32_t segmentSize = MIP_FLASH_LOG_SEGMENT_SIZE);
+    void end();
+
+    bool isStarted() const
+    {
+        return m_pFileSystem != NULL;
+    }
+
+    // Queue a line of output, or a piece of one, to be written to flash. Never touches the flash itself. Returns false
+    // if it was dropped because the RAM buffer is full.
+    bool write(const char* pData, size_t length);
+
+    // Write out the RAM buffer if a full page is waiting or the flush interval has passed. Called from
+    // MiPDebug::handle().
+    void handle();
+
+    // Write out everything in the RAM buffer now. Call it before a reset or deep sleep.
+    void flush();
+
+    // Print the last maxBytes of the log, starting at the first full line, oldest first.
+    void dump(Print& output, uint32_t maxBytes);
+
+    // Remove every segment and start a new, empty log.
+    bool clear();
+
+    void readStats(MiPFlashLogStats& stats);
+
+protected:
+    // The header at the start of each segment file.
+    class SegmentHeader
+    {
+    public:
+        uint32_t magic;
+        uint32_t sequence;
+        uint32_t firstSequence;                 // Sequence number of the first segment since the log was cleared.
+    };
+
+    void     segmentName(uint8_t segment, char* pName, size_t nameSize);
+    bool     readSegmentHeader(uint8_t segment, SegmentHeader& header, uint32_t& size);
+    bool     startSegment(uint8_t segment, uint32_t sequence);
+    bool     rotateIfFull();
+    void     writeBuffer(size_t length);
+    uint32_t storedBytes();
+
+    fs::FS*  m_pFileSystem;
+    File     m_file;                            // The newest segment, open for appending.
+    uint8_t  m_segmentCount;
+    uint32_t m_segmentSize;
+    uint8_t  m_segment;                         // Index of the newest segment.
+    uint32_t m_sequence;                        // Sequence number of the newest segment.
+    uint32_t m_firstSequence;                   // Sequence number of the first segment since the log was cleared.
+    uint32_t m_segmentLength;                   // Bytes in the newest segment, including its header.
+    char     m_buffer[MIP_FLASH_LOG_BUFFER];    // Ring of output waiting to be written to flash.
+    uint16_t m_bufferHead;                      // Where the next byte is queued in the ring.
+    uint16_t m_bufferCount;                     // Number of bytes queued in the ring.
+    uint32_t m_bufferTime;                      // Time at which the oldest byte in the ring was queued.
+    bool     m_isDroppingLine;                  // Is the rest of the current line being dropped too?
+    MiPFlashLogStats m_stats;
+};
+
+#endif // MIP_FLASH_LOG_H
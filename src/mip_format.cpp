@@ -0,0 +1,190 @@
+/* Copyright (C) 2018  Samuel Trassare (https://github.com/tiogaplanet)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* Integer number formatting used by MiPDebug and the telemetry output.
+*/
+#include "mip_format.h"
+#include <string.h>
+
+#ifdef ARDUINO
+  #include <pgmspace.h>
+#else
+  // Built on the PC by extras/mip_format_bench.
+  #define PROGMEM
+  #define pgm_read_byte(pAddress) (*(const uint8_t*)(pAddress))
+#endif
+
+
+// "00" to "99" so that each division by 100 gives two digits at once.
+static const char g_digitPairs[200] PROGMEM =
+{
+    '0','0','0','1','0','2','0','3','0','4','0','5','0','6','0','7','0','8','0','9',
+    '1','0','1','1','1','2','1','3','1','4','1','5','1','6','1','7','1','8','1','9',
+    '2','0','2','1','2','2','2','3','2','4','2','5','2','6','2','7','2','8','2','9',
+    '3','0','3','1','3','2','3','3','3','4','3','5','3','6','3','7','3','8','3','9',
+    '4','0','4','1','4','2','4','3','4','4','4','5','4','6','4','7','4','8','4','9',
+    '5','0','5','1','5','2','5','3','5','4','5','5','5','6','5','7','5','8','5','9',
+    '6','0','6','1','6','2','6','3','6','4','6','5','6','6','6','7','6','8','6','9',
+    '7','0','7','1','7','2','7','3','7','4','7','5','7','6','7','7','7','8','7','9',
+    '8','0','8','1','8','2','8','3','8','4','8','5','8','6','8','7','8','8','8','9',
+    '9','0','9','1','9','2','9','3','9','4','9','5','9','6','9','7','9','8','9','9'
+};
+
+static const uint32_t g_powersOfTen[MIP_FORMAT_MAX_DECIMALS + 1] =
+{
+    1UL, 10UL, 100UL, 1000UL, 10000UL, 100000UL, 1000000UL, 10000000UL, 100000000UL, 1000000000UL
+};
+
+
+
+// Writes the decimal digits of value backwards, ending just before pEnd, with at least minDigits digits. Returns
+// where the digits start.
+static char* formatDecimal(char* pEnd, uint32_t value, uint8_t minDigits)
+{
+    char* pStart = pEnd;
+
+    while (value >= 100)
+    {
+        uint32_t quotient = value / 100;
+        uint32_t pair = (value - quotient * 100) * 2;
+
+        *--pStart = pgm_read_byte(&g_digitPairs[pair + 1]);
+        *--pStart = pgm_read_byte(&g_digitPairs[pair]);
+        value = quotient;
+    }
+    if (value >= 10)
+    {
+        *--pStart = pgm_read_byte(&g_digitPairs[value * 2 + 1]);
+        *--pStart = pgm_read_byte(&g_digitPairs[value * 2]);
+    }
+    else
+    {
+        *--pStart = '0' + value;
+    }
+
+    while (pEnd - pStart < minDigits)
+    {
+        *--pStart = '0';
+    }
+    return pStart;
+}
+
+// Copies the sign and the formatted digits into the caller's buffer with the padding in front of them.
+static size_t output(char* pBuffer, size_t bufferSize, const char* pDigits, size_t digitCount, bool isNegative,
+                     uint8_t width, char pad)
+{
+    size_t length = digitCount + (isNegative ? 1 : 0);
+    size_t padding = width > length ? width - length : 0;
+
+    if (bufferSize == 0)
+    {
+        return 0;
+    }
+    if (length + padding >= bufferSize)
+    {
+        pBuffer[0] = '\0';
+        return 0;
+    }
+
+    char* pNext = pBuffer;
+    if (isNegative && pad == '0')
+    {
+        *pNext++ = '-';
+    }
+    memset(pNext, pad, padding);
+    pNext += padding;
+    if (isNegative && pad != '0')
+    {
+        *pNext++ = '-';
+    }
+    memcpy(pNext, pDigits, digitCount);
+    pNext += digitCount;
+    *pNext = '\0';
+
+    return pNext - pBuffer;
+}
+
+
+
+size_t mipFormatUnsigned(char* pBuffer, size_t bufferSize, uint32_t value, uint8_t width /* = 0 */,
+                         char pad /* = ' ' */)
+{
+    char  digits[MIP_FORMAT_NUMBER_SIZE];
+    char* pEnd = &digits[sizeof(digits)];
+    char* pStart = formatDecimal(pEnd, value, 1);
+
+    return output(pBuffer, bufferSize, pStart, pEnd - pStart, false, width, pad);
+}
+
+size_t mipFormatSigned(char* pBuffer, size_t bufferSize, int32_t value, uint8_t width /* = 0 */,
+                       char pad /* = ' ' */)
+{
+    return mipFormatFixed(pBuffer, bufferSize, value, 0, width, pad);
+}
+
+size_t mipFormatHex(char* pBuffer, size_t bufferSize, uint32_t value, uint8_t digits /* = 0 */,
+                    bool isUpperCase /* = true */)
+{
+    char        hexDigits[8];
+    char*       pEnd = &hexDigits[sizeof(hexDigits)];
+    char*       pStart = pEnd;
+    const char  letterBase = isUpperCase ? 'A' - 10 : 'a' - 10;
+
+    do
+    {
+        uint8_t nibble = value & 0xF;
+
+        *--pStart = nibble < 10 ? '0' + nibble : letterBase + nibble;
+        value >>= 4;
+    } while (value != 0);
+
+    // Zeroes past the 8 digits of a 32-bit value are added as padding.
+    return output(pBuffer, bufferSize, pStart, pEnd - pStart, false, digits, '0');
+}
+
+size_t mipFormatFixed(char* pBuffer, size_t bufferSize, int32_t value, uint8_t decimals, uint8_t width /* = 0 */,
+                      char pad /* = ' ' */)
+{
+    if (decimals > MIP_FORMAT_MAX_DECIMALS)
+    {
+        if (bufferSize > 0)
+        {
+            pBuffer[0] = '\0';
+        }
+        return 0;
+    }
+
+    // Negating as unsigned also handles INT32_MIN.
+    bool     isNegative = value < 0;
+    uint32_t magnitude = isNegative ? 0UL - (uint32_t)value : (uint32_t)value;
+    char     digits[MIP_FORMAT_NUMBER_SIZE];
+    char*    pEnd = &digits[sizeof(digits)];
+    char*    pStart;
+
+    if (decimals == 0)
+    {
+        pStart = formatDecimal(pEnd, magnitude, 1);
+    }
+    else
+    {
+        uint32_t scale = g_powersOfTen[decimals];
+        uint32_t integer = magnitude / scale;
+
+        pStart = formatDecimal(pEnd, magnitude - integer * scale, decimals);
+        *--pStart = '.';
+        pStart = formatDecimal(pStart, integer, 1);
+    }
+
+    return output(pBuffer, bufferSize, pStart, pEnd - pStart, isNegative, width, pad);
+}
@@ -0,0 +1,55 @@
+/* Copyright (C) 2018  Samuel Trassare (https://github.com/tiogaplanet)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* This header file describes the integer number formatting used by MiPDebug and the library's telemetry output. The
+   ESP8266 has no floating point unit and its printf() family pulls in a full format parser, so these functions write
+   the digits of a 32-bit integer straight into a buffer supplied by the caller, two digits per division, without
+   touching the heap or any float math. Fixed point values such as millivolts or millimetres are shown with a decimal
+   point by passing the number of digits which follow it, so 7123 mV with 3 decimals prints as "7.123" volts.
+
+   Every function NUL terminates the buffer and returns the number of characters written before the NUL. A number
+   is never truncated: if it doesn't fit then the buffer is left empty and 0 is returned.
+
+   Nothing here depends on Arduino so it can also be built on the PC, as extras/mip_format_bench does.
+*/
+#ifndef MIP_FORMAT_H
+#define MIP_FORMAT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+// Size of a buffer which holds any unpadded number from these functions along with its NUL: a sign, 10 digits and
+// a decimal point.
+#define MIP_FORMAT_NUMBER_SIZE 13
+
+// Largest number of decimals which can be passed to mipFormatFixed().
+#define MIP_FORMAT_MAX_DECIMALS 9
+
+
+// Decimal formatting, padded on the left with pad characters to at least width characters. When pad is '0' the
+// sign of a negative number comes before the zeroes, as with printf("%05d").
+size_t mipFormatUnsigned(char* pBuffer, size_t bufferSize, uint32_t value, uint8_t width = 0, char pad = ' ');
+size_t mipFormatSigned(char* pBuffer, size_t bufferSize, int32_t value, uint8_t width = 0, char pad = ' ');
+
+// Hexadecimal formatting with at least digits digits, padded with zeroes, as with printf("%02X").
+size_t mipFormatHex(char* pBuffer, size_t bufferSize, uint32_t value, uint8_t digits = 0, bool isUpperCase = true);
+
+// Fixed point formatting of value / 10^decimals. For example millimetres shown as centimetres with 1 decimal:
+//     mipFormatFixed(buffer, sizeof(buffer), 1234, 1) writes "123.4"
+// Returns 0, leaving the buffer empty, if decimals is over MIP_FORMAT_MAX_DECIMALS.
+size_t mipFormatFixed(char* pBuffer, size_t bufferSize, int32_t value, uint8_t decimals, uint8_t width = 0,
+                      char pad = ' ');
+
+#endif // MIP_FORMAT_H
@@ -0,0 +1,169 @@
+/* Copyright (C) 2018  Samuel Trassare (https://github.com/tiogaplanet)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* This header file describes compile time builders for MiP request frames. The parameters are template arguments so
+   they are range checked with static_assert and the frame is encoded by the compiler. Frames for fixed choreography
+   can then be stored in flash and sent with MiP::sendFrame_P() without any encoding or checking at run time:
+
+       static const auto PROGMEM spin = mipTurnLeftFrame<360, 24>();
+       ...
+       mip.sendFrame_P(spin);
+
+   Each builder produces exactly the same bytes as the corresponding MiP method would for the same parameters.
+*/
+#ifndef MIP_FRAMES_H
+#define MIP_FRAMES_H
+
+#include "mip_esp8266.h"
+#include "mip_protocol.h"
+
+
+// Frame for MiP::continuousDrive(). Unlike continuousDrive(), sending it isn't rate limited by the library.
+template<int VELOCITY, int TURN_RATE>
+constexpr MiPFrame<MIP_REQUEST_LEN(MIP_CMD_CONTINUOUS_DRIVE)> mipContinuousDriveFrame()
+{
+    static_assert(VELOCITY >= -32 && VELOCITY <= 32, "velocity must be between -32 and 32");
+    static_assert(TURN_RATE >= -32 && TURN_RATE <= 32, "turnRate must be between -32 and 32");
+
+    return {{ MIP_CMD_CONTINUOUS_DRIVE, mipEncodeVelocity(VELOCITY), mipEncodeTurnRate(TURN_RATE) }};
+}
+
+// Frame for MiP::distanceDrive().
+template<MiPDriveDirection DRIVE_DIRECTION, int CM, MiPTurnDirection TURN_DIRECTION, int DEGREES>
+constexpr MiPFrame<MIP_REQUEST_LEN(MIP_CMD_DISTANCE_DRIVE)> mipDistanceDriveFrame()
+{
+    static_assert(CM >= 0 && CM <= 255, "cm must be between 0 and 255");
+    static_assert(DEGREES >= 0 && DEGREES <= 360, "degrees must be between 0 and 360");
+
+    return {{ MIP_CMD_DISTANCE_DRIVE, DRIVE_DIRECTION, CM, TURN_DIRECTION, DEGREES >> 8, DEGREES & 0xFF }};
+}
+
+// Frame for MiP::turnLeft().
+template<int DEGREES, int SPEED>
+constexpr MiPFrame<MIP_REQUEST_LEN(MIP_CMD_TURN_LEFT)> mipTurnLeftFrame()
+{
+    static_assert(DEGREES >= 0 && DEGREES <= 255 * 5, "degrees must be between 0 and 1275");
+    static_assert(SPEED >= 0 && SPEED <= 24, "speed must be between 0 and 24");
+
+    return {{ MIP_CMD_TURN_LEFT, mipEncodeTurnAngle(DEGREES), SPEED }};
+}
+
+// Frame for MiP::turnRight().
+template<int DEGREES, int SPEED>
+constexpr MiPFrame<MIP_REQUEST_LEN(MIP_CMD_TURN_RIGHT)> mipTurnRightFrame()
+{
+    static_assert(DEGREES >= 0 && DEGREES <= 255 * 5, "degrees must be between 0 and 1275");
+    static_assert(SPEED >= 0 && SPEED <= 24, "speed must be between 0 and 24");
+
+    return {{ MIP_CMD_TURN_RIGHT, mipEncodeTurnAngle(DEGREES), SPEED }};
+}
+
+// Frame for MiP::driveForward().
+template<int SPEED, int TIME>
+constexpr MiPFrame<MIP_REQUEST_LEN(MIP_CMD_DRIVE_FORWARD)> mipDriveForwardFrame()
+{
+    static_assert(SPEED >= 0 && SPEED <= 30, "speed must be between 0 and 30");
+    static_assert(TIME >= 0 && TIME <= 255 * 7, "time must be between 0 and 1785 milliseconds");
+
+    return {{ MIP_CMD_DRIVE_FORWARD, SPEED, mipEncodeDriveTime(TIME) }};
+}
+
+// Frame for MiP::driveBackward().
+template<int SPEED, int TIME>
+constexpr MiPFrame<MIP_REQUEST_LEN(MIP_CMD_DRIVE_BACKWARD)> mipDriveBackwardFrame()
+{
+    static_assert(SPEED >= 0 && SPEED <= 30, "speed must be between 0 and 30");
+    static_assert(TIME >= 0 && TIME <= 255 * 7, "time must be between 0 and 1785 milliseconds");
+
+    return {{ MIP_CMD_DRIVE_BACKWARD, SPEED, mipEncodeDriveTime(TIME) }};
+}
+
+// Frame for MiP::stop().
+constexpr MiPFrame<MIP_REQUEST_LEN(MIP_CMD_STOP)> mipStopFrame()
+{
+    return {{ MIP_CMD_STOP }};
+}
+
+// Frame for MiP::fallForward() and MiP::fallBackward().
+template<MiPFallDirection DIRECTION>
+constexpr MiPFrame<MIP_REQUEST_LEN(MIP_CMD_SET_POSITION)> mipFallDownFrame()
+{
+    return {{ MIP_CMD_SET_POSITION, DIRECTION }};
+}
+
+// Frame for MiP::getUp().
+template<MiPGetUp GETUP = MIP_GETUP_FROM_EITHER>
+constexpr MiPFrame<MIP_REQUEST_LEN(MIP_CMD_GET_UP)> mipGetUpFrame()
+{
+    return {{ MIP_CMD_GET_UP, GETUP }};
+}
+
+// Frame for MiP::unverifiedWriteChestLED(red, green, blue).
+template<int RED, int GREEN, int BLUE>
+constexpr MiPFrame<MIP_REQUEST_LEN(MIP_CMD_SET_CHEST_LED)> mipChestLEDFrame()
+{
+    static_assert(RED >= 0 && RED <= 255 && GREEN >= 0 && GREEN <= 255 && BLUE >= 0 && BLUE <= 255,
+                  "colour components must be between 0 and 255");
+
+    return {{ MIP_CMD_SET_CHEST_LED, RED, GREEN, BLUE }};
+}
+
+// Frame for MiP::unverifiedWriteChestLED(red, green, blue, onTime, offTime).
+template<int RED, int GREEN, int BLUE, int ON_TIME, int OFF_TIME>
+constexpr MiPFrame<MIP_REQUEST_LEN(MIP_CMD_FLASH_CHEST_LED)> mipFlashChestLEDFrame()
+{
+    static_assert(RED >= 0 && RED <= 255 && GREEN >= 0 && GREEN <= 255 && BLUE >= 0 && BLUE <= 255,
+                  "colour components must be between 0 and 255");
+    static_assert(ON_TIME >= 0 && mipEncodeFlashTime(ON_TIME) <= 255, "onTime must be between 0 and 5109 milliseconds");
+    static_assert(OFF_TIME >= 0 && mipEncodeFlashTime(OFF_TIME) <= 255, "offTime must be between 0 and 5109 milliseconds");
+
+    return {{ MIP_CMD_FLASH_CHEST_LED, RED, GREEN, BLUE, mipEncodeFlashTime(ON_TIME), mipEncodeFlashTime(OFF_TIME) }};
+}
+
+// Frame for MiP::unverifiedWriteHeadLEDs().
+template<MiPHeadLED LED1, MiPHeadLED LED2, MiPHeadLED LED3, MiPHeadLED LED4>
+constexpr MiPFrame<MIP_REQUEST_LEN(MIP_CMD_SET_HEAD_LEDS)> mipHeadLEDsFrame()
+{
+    return {{ MIP_CMD_SET_HEAD_LEDS, LED1, LED2, LED3, LED4 }};
+}
+
+// Frame for MiP::playSound().
+template<MiPSoundIndex SOUND, MiPVolume VOLUME = MIP_VOLUME_DEFAULT>
+constexpr MiPFrame<MIP_REQUEST_LEN(MIP_CMD_PLAY_SOUND)> mipPlaySoundFrame()
+{
+    static_assert(VOLUME <= MIP_VOLUME_7 || VOLUME == MIP_VOLUME_DEFAULT,
+                  "volume must be between MIP_VOLUME_OFF and MIP_VOLUME_7 or MIP_VOLUME_DEFAULT");
+
+    MiPFrame<MIP_REQUEST_LEN(MIP_CMD_PLAY_SOUND)> frame = {};
+    size_t                                        index = 0;
+
+    frame.bytes[index++] = MIP_CMD_PLAY_SOUND;
+    if (VOLUME != MIP_VOLUME_DEFAULT)
+    {
+        frame.bytes[index++] = MIP_SOUND_VOLUME_OFF + VOLUME;
+        frame.bytes[index++] = 0;
+    }
+    frame.bytes[index++] = SOUND;
+    frame.bytes[index++] = 0;
+
+    // Fill out the rest of the sound list with mute sounds. The last byte is the repeat count which is left as 0.
+    while (index < sizeof(frame.bytes) - 1)
+    {
+        frame.bytes[index++] = MIP_SOUND_SHORT_MUTE_FOR_STOP;
+        frame.bytes[index++] = 0;
+    }
+    return frame;
+}
+
+#endif // MIP_FRAMES_H
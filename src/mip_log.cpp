@@ -0,0 +1,240 @@
+/* Copyright (C) 2018  Samuel Trassare (https://github.com/tiogaplanet)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* Deferred logger used by the MIP_DEBUG_* macros.
+
+   The ring is lock free with a single producer, the code logging messages, and a single consumer, mipLogService().
+   Only the producer writes g_logHead and only the consumer writes g_logTail. Both are free running 8-bit counters
+   so their difference is the number of queued records. Messages must not be logged from interrupt handlers since
+   that would add a second producer.
+*/
+#include "mip_log.h"
+#include "mip_esp8266.h"
+
+
+// Number of milliseconds that mipLogFlush() waits for Serial1 to accept more data before giving up.
+#define MIP_LOG_FLUSH_TIMEOUT 100
+
+static_assert((MIP_LOG_DEPTH & (MIP_LOG_DEPTH - 1)) == 0, "MIP_LOG_DEPTH must be a power of 2");
+static_assert(MIP_LOG_DEPTH <= 128, "MIP_LOG_DEPTH must fit in the 8-bit ring indices");
+
+static MiPLogRecord         g_logRecords[MIP_LOG_DEPTH];
+static volatile uint8_t     g_logHead;
+static volatile uint8_t     g_logTail;
+// Messages dropped since the last record which made it into the ring. Only touched by the producer.
+static uint32_t             g_logPendingDrops;
+static uint32_t             g_logTotalDrops;
+
+// The line currently being written out to Serial1 and how much of it has been sent so far.
+static char                 g_logLine[MIP_LOG_LINE_MAX];
+static uint8_t              g_logLineLength;
+static uint8_t              g_logLineSent;
+static bool                 g_isLogServicing;
+
+
+
+static PGM_P levelPrefix(uint8_t level)
+{
+    switch (level)
+    {
+    case MIP_DEBUG_ERROR:
+        return PSTR("[ERROR] ");
+    case MIP_DEBUG_WARN:
+        return PSTR("[WARN] ");
+    default:
+        return PSTR("[INFO] ");
+    }
+}
+
+bool mipLogPush(uint8_t level, uint8_t flags, PGM_P pFormat, const uintptr_t* pArgs, uint8_t argCount)
+{
+    uint8_t head = g_logHead;
+
+    if ((uint8_t)(head - g_logTail) >= MIP_LOG_DEPTH)
+    {
+        g_logPendingDrops++;
+        g_logTotalDrops++;
+        return false;
+    }
+
+    MiPLogRecord& record = g_logRecords[head & (MIP_LOG_DEPTH - 1)];
+    record.pFormat = pFormat;
+    for (uint8_t i = 0 ; i < MIP_LOG_MAX_ARGS ; i++)
+    {
+        record.args[i] = i < argCount ? pArgs[i] : 0;
+    }
+    record.dropped = g_logPendingDrops > 0xFFFF ? 0xFFFF : g_logPendingDrops;
+    record.level = level;
+    record.flags = flags;
+    g_logPendingDrops = 0;
+
+    // The record must be complete before the consumer can see it.
+    __sync_synchronize();
+    g_logHead = head + 1;
+
+    return true;
+}
+
+void mipLogPrint(uint8_t level, uint8_t flags, const __FlashStringHelper* pText)
+{
+    mipLogPush(level, flags | MIP_LOG_FLAG_TEXT, (PGM_P)pText, NULL, 0);
+}
+
+void mipLogPrint(uint8_t level, uint8_t flags, const char* pText)
+{
+    uintptr_t arg = (uintptr_t)pText;
+    mipLogPush(level, flags, PSTR("%s"), &arg, 1);
+}
+
+void mipLogPrint(uint8_t level, uint8_t flags, int value)
+{
+    mipLogPrint(level, flags, (long)value);
+}
+
+void mipLogPrint(uint8_t level, uint8_t flags, unsigned int value)
+{
+    mipLogPrint(level, flags, (unsigned long)value);
+}
+
+void mipLogPrint(uint8_t level, uint8_t flags, long value)
+{
+    uintptr_t arg = (uintptr_t)value;
+    mipLogPush(level, flags, PSTR("%ld"), &arg, 1);
+}
+
+void mipLogPrint(uint8_t level, uint8_t flags, unsigned long value)
+{
+    uintptr_t arg = (uintptr_t)value;
+    mipLogPush(level, flags, PSTR("%lu"), &arg, 1);
+}
+
+void mipLogPrint(uint8_t level, uint8_t flags, const String& text)
+{
+    // Keep the message in order with those queued before it.
+    mipLogFlush();
+
+    Serial1.print(FPSTR(levelPrefix(level)));
+    Serial1.print(text);
+    if (flags & MIP_LOG_FLAG_NEWLINE)
+    {
+        Serial1.println();
+    }
+}
+
+// Formats the next line to be written out into g_logLine. Returns false if there is nothing left to write.
+static bool formatNextLine()
+{
+    if (g_logTail == g_logHead)
+    {
+        return false;
+    }
+
+    // The consumer owns the record at the tail until g_logTail is advanced past it.
+    MiPLogRecord& record = g_logRecords[g_logTail & (MIP_LOG_DEPTH - 1)];
+    int length;
+
+    if (record.dropped)
+    {
+        // Report the messages which were dropped just before this record, in the order they would have appeared.
+        length = snprintf_P(g_logLine, sizeof(g_logLine), PSTR("[WARN] MiP: %u log messages dropped\r\n"),
+                            record.dropped);
+        record.dropped = 0;
+    }
+    else
+    {
+        // Leave room for the "\r\n" so that it isn't lost when the message is truncated.
+        const size_t maxLength = sizeof(g_logLine) - 2;
+
+        length = strlcpy_P(g_logLine, levelPrefix(record.level), maxLength);
+        if (record.flags & MIP_LOG_FLAG_TEXT)
+        {
+            strlcpy_P(g_logLine + length, record.pFormat, maxLength - length);
+        }
+        else
+        {
+            snprintf_P(g_logLine + length, maxLength - length, record.pFormat,
+                       record.args[0], record.args[1], record.args[2], record.args[3]);
+        }
+        length = strlen(g_logLine);
+        if (record.flags & MIP_LOG_FLAG_NEWLINE)
+        {
+            g_logLine[length++] = '\r';
+            g_logLine[length++] = '\n';
+        }
+
+        __sync_synchronize();
+        g_logTail = g_logTail + 1;
+    }
+
+    g_logLineLength = length >= (int)sizeof(g_logLine) ? sizeof(g_logLine) - 1 : length;
+    g_logLineSent = 0;
+
+    return true;
+}
+
+void mipLogService()
+{
+    if (g_isLogServicing)
+    {
+        return;
+    }
+    g_isLogServicing = true;
+
+    while (g_logLineSent < g_logLineLength || formatNextLine())
+    {
+        int space = Serial1.availableForWrite();
+        if (space <= 0)
+        {
+            break;
+        }
+
+        size_t count = g_logLineLength - g_logLineSent;
+        if (count > (size_t)space)
+        {
+            count = space;
+        }
+        Serial1.write((const uint8_t*)&g_logLine[g_logLineSent], count);
+        g_logLineSent += count;
+    }
+
+    g_isLogServicing = false;
+}
+
+void mipLogFlush()
+{
+    MIP_ACTIVITY("mipLogFlush", MIP_ACTIVITY_NO_COMMAND);
+    uint32_t lastProgressTime = millis();
+
+    while (!g_isLogServicing && (g_logLineSent < g_logLineLength || g_logTail != g_logHead))
+    {
+        uint8_t tail = g_logTail;
+        uint8_t sent = g_logLineSent;
+
+        mipLogService();
+        if (tail != g_logTail || sent != g_logLineSent)
+        {
+            lastProgressTime = millis();
+        }
+        else if (millis() - lastProgressTime > MIP_LOG_FLUSH_TIMEOUT)
+        {
+            // Serial1 isn't accepting any more data, most likely because it hasn't been started yet.
+            return;
+        }
+    }
+}
+
+uint32_t mipLogDropped()
+{
+    return g_logTotalDrops;
+}
@@ -0,0 +1,98 @@
+/* Copyright (C) 2018  Samuel Trassare (https://github.com/tiogaplanet)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* This header file describes the deferred logger which sits behind the MIP_DEBUG_* macros in mip_esp8266.h. Writing
+   a message to Serial1 at 74880 baud can block for several milliseconds so, rather than formatting and sending the
+   message where it is logged, the macros only push a small record holding the format string pointer and its
+   arguments into a ring buffer. The records are formatted and written out later from MiP::handle() and while the
+   library idles waiting on MiP, and then only as fast as the Serial1 transmit FIFO can accept them without blocking.
+*/
+#ifndef MIP_LOG_H
+#define MIP_LOG_H
+
+#include <Arduino.h>
+#include <stdint.h>
+#include <type_traits>
+
+
+// Number of log records which can be waiting to be written out to Serial1. Must be a power of 2 no larger than 128.
+// Messages logged while the ring is full are dropped and counted.
+#ifndef MIP_LOG_DEPTH
+  #define MIP_LOG_DEPTH 16
+#endif
+
+// Maximum number of arguments which can follow the format string passed to a MIP_DEBUG_*_PRINTF() macro.
+#define MIP_LOG_MAX_ARGS 4
+
+// Longest line, in characters, that a log record is formatted into. Longer messages are truncated.
+#define MIP_LOG_LINE_MAX 96
+
+// Bits used in MiPLogRecord::flags.
+#define MIP_LOG_FLAG_NEWLINE    (1 << 0) // Follow the message with "\r\n".
+#define MIP_LOG_FLAG_TEXT       (1 << 1) // pFormat points to plain text in flash rather than a format string.
+
+
+class MiPLogRecord
+{
+public:
+    PGM_P     pFormat;
+    uintptr_t args[MIP_LOG_MAX_ARGS];
+    uint16_t  dropped;
+    uint8_t   level;
+    uint8_t   flags;
+};
+
+
+// Arguments are kept in the log record as raw machine words: integers by value and strings by pointer. Strings must
+// therefore still be valid when the record is written out later so only pass string literals, PSTR()s or buffers
+// which outlive the call.
+template<typename T>
+inline uintptr_t mipLogArg(T value)
+{
+    static_assert(std::is_integral<T>::value || std::is_enum<T>::value || std::is_pointer<T>::value,
+                  "MIP_DEBUG_*_PRINTF() only supports integer and pointer arguments");
+    return (uintptr_t)value;
+}
+
+bool mipLogPush(uint8_t level, uint8_t flags, PGM_P pFormat, const uintptr_t* pArgs, uint8_t argCount);
+
+template<typename... ARGS>
+inline void mipLogPrintf(uint8_t level, PGM_P pFormat, ARGS... args)
+{
+    static_assert(sizeof...(ARGS) <= MIP_LOG_MAX_ARGS, "Too many arguments passed to MIP_DEBUG_*_PRINTF()");
+
+    const uintptr_t argArray[MIP_LOG_MAX_ARGS + 1] = { mipLogArg(args)... };
+    mipLogPush(level, 0, pFormat, argArray, sizeof...(ARGS));
+}
+
+void mipLogPrint(uint8_t level, uint8_t flags, const __FlashStringHelper* pText);
+void mipLogPrint(uint8_t level, uint8_t flags, const char* pText);
+void mipLogPrint(uint8_t level, uint8_t flags, int value);
+void mipLogPrint(uint8_t level, uint8_t flags, unsigned int value);
+void mipLogPrint(uint8_t level, uint8_t flags, long value);
+void mipLogPrint(uint8_t level, uint8_t flags, unsigned long value);
+// A String can't be kept in a log record so it is written out immediately, after any records queued before it.
+void mipLogPrint(uint8_t level, uint8_t flags, const String& text);
+
+// Formats and writes out as many queued log records as Serial1 can accept without blocking. Called from MiP::handle()
+// and while the library waits on MiP but sketches which log without calling into MiP can call it from loop() too.
+void mipLogService();
+
+// Blocks until every queued log record has been written out to Serial1. Useful before a reset or deep sleep.
+void mipLogFlush();
+
+// Total number of log messages which have been dropped because the ring was full.
+uint32_t mipLogDropped();
+
+#endif // MIP_LOG_H
@@ -0,0 +1,334 @@
+/* Copyright (C) 2018  Samuel Trassare (https://github.com/tiogaplanet)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* Scope profiler used by MIP_PROFILE_SCOPE() and the loop monitor fed by mipLoopTick().
+*/
+#include "mip_profile.h"
+#include "mip_esp8266.h"
+
+
+// Longest scope name, in characters, which is compared when looking up a scope.
+#define MIP_PROFILE_MAX_NAME 32
+
+class MiPProfileEntry
+{
+public:
+    PGM_P        pName;
+    // Times are kept in CPU cycles.
+    MiPHistogram histogram;
+};
+
+#if MIP_PROFILE_MAX_SCOPES > 0
+static MiPProfileEntry g_profileEntries[MIP_PROFILE_MAX_SCOPES];
+#else
+static MiPProfileEntry g_profileEntries[1];
+#endif
+static uint8_t         g_profileEntryCount;
+
+// The loop monitor. Times are kept in microseconds since the intervals can outlast the 32-bit cycle counter.
+static MiPHistogram    g_loopIntervals;
+static MiPLoopStats    g_loopStats;
+static uint32_t        g_loopStallThreshold = MIP_LOOP_STALL_THRESHOLD * 1000UL;
+static uint32_t        g_lastLoopTick;
+static bool            g_isLoopStarted;
+
+// The innermost activity running right now and the one which has run the longest since the last loop tick.
+static MiPActivity*    g_pActivity;
+static PGM_P           g_pLongestActivity;
+static int16_t         g_longestActivityCommand;
+static uint32_t        g_longestActivityDuration;
+// RAM copy of the activity name logged with the last stall. The log keeps a pointer to it until it is written out.
+static char            g_stallActivityName[MIP_PROFILE_MAX_NAME + 1];
+
+
+
+void MiPHistogram::record(uint32_t value)
+{
+    uint8_t bucket = value ? 31 - __builtin_clz(value) : 0;
+
+    count++;
+    if (value > maxValue)
+    {
+        maxValue = value;
+    }
+
+    // Halve every bucket when one of them would overflow so that the shape is kept.
+    if (buckets[bucket] == 0xFFFF)
+    {
+        for (uint8_t i = 0 ; i < MIP_PROFILE_BUCKETS ; i++)
+        {
+            buckets[i] >>= 1;
+        }
+    }
+    buckets[bucket]++;
+}
+
+uint32_t MiPHistogram::percentile(uint8_t percent) const
+{
+    uint32_t total = 0;
+    for (uint8_t i = 0 ; i < MIP_PROFILE_BUCKETS ; i++)
+    {
+        total += buckets[i];
+    }
+
+    uint32_t rank = (total * percent + 99) / 100;
+    uint32_t seen = 0;
+    for (uint8_t i = 0 ; i < MIP_PROFILE_BUCKETS ; i++)
+    {
+        uint32_t bucketCount = buckets[i];
+
+        if (bucketCount == 0 || seen + bucketCount < rank)
+        {
+            seen += bucketCount;
+            continue;
+        }
+
+        uint32_t low = 1UL << i;
+        uint32_t value = low + (uint32_t)(((uint64_t)low * (rank - seen)) / bucketCount);
+
+        return value < maxValue ? value : maxValue;
+    }
+
+    return maxValue;
+}
+
+
+
+uint8_t mipProfileScope(PGM_P pName)
+{
+    char name[MIP_PROFILE_MAX_NAME + 1];
+
+    strncpy_P(name, pName, sizeof(name) - 1);
+    name[sizeof(name) - 1] = '\0';
+
+    for (uint8_t i = 0 ; i < g_profileEntryCount ; i++)
+    {
+        if (g_profileEntries[i].pName == pName || strncmp_P(name, g_profileEntries[i].pName, MIP_PROFILE_MAX_NAME) == 0)
+        {
+            return i;
+        }
+    }
+
+    if (g_profileEntryCount >= MIP_PROFILE_MAX_SCOPES)
+    {
+        return MIP_PROFILE_NO_SCOPE;
+    }
+
+    MiPProfileEntry& entry = g_profileEntries[g_profileEntryCount];
+    entry.pName = pName;
+    entry.histogram.clear();
+
+    return g_profileEntryCount++;
+}
+
+void mipProfileRecord(uint8_t scope, uint32_t cycles)
+{
+    if (scope >= g_profileEntryCount)
+    {
+        return;
+    }
+
+    g_profileEntries[scope].histogram.record(cycles);
+}
+
+uint8_t mipProfileScopeCount()
+{
+    return g_profileEntryCount;
+}
+
+bool mipProfileRead(uint8_t scope, MiPProfileSummary& summary)
+{
+    summary.clear();
+    if (scope >= g_profileEntryCount)
+    {
+        return false;
+    }
+
+    const MiPHistogram& histogram = g_profileEntries[scope].histogram;
+    uint32_t            cyclesPerMicrosecond = ESP.getCpuFreqMHz();
+
+    summary.pName = g_profileEntries[scope].pName;
+    summary.count = histogram.count;
+    summary.p50 = histogram.percentile(50) / cyclesPerMicrosecond;
+    summary.p95 = histogram.percentile(95) / cyclesPerMicrosecond;
+    summary.p99 = histogram.percentile(99) / cyclesPerMicrosecond;
+    summary.max = histogram.maxValue / cyclesPerMicrosecond;
+
+    return true;
+}
+
+void mipProfileDump(Print& output)
+{
+    output.printf_P(PSTR("%-24s %10s %10s %10s %10s %10s\r\n"), "scope", "count", "p50 us", "p95 us", "p99 us", "max us");
+    for (uint8_t i = 0 ; i < g_profileEntryCount ; i++)
+    {
+        MiPProfileSummary summary;
+        char              name[MIP_PROFILE_MAX_NAME + 1];
+
+        mipProfileRead(i, summary);
+        strncpy_P(name, summary.pName, sizeof(name) - 1);
+        name[sizeof(name) - 1] = '\0';
+        output.printf_P(PSTR("%-24s %10u %10u %10u %10u %10u\r\n"), name, summary.count, summary.p50, summary.p95,
+                        summary.p99, summary.max);
+    }
+}
+
+void mipProfileReset()
+{
+    for (uint8_t i = 0 ; i < g_profileEntryCount ; i++)
+    {
+        g_profileEntries[i].histogram.clear();
+    }
+}
+
+
+
+void mipLoopTick()
+{
+    uint32_t now = micros();
+    uint32_t interval = now - g_lastLoopTick;
+
+    g_lastLoopTick = now;
+    if (!g_isLoopStarted)
+    {
+        // There is no interval to measure until the second call.
+        g_isLoopStarted = true;
+        g_pLongestActivity = NULL;
+        g_longestActivityDuration = 0;
+        return;
+    }
+
+    g_loopIntervals.record(interval);
+    if (interval > g_loopStallThreshold)
+    {
+        g_loopStats.stalls++;
+        if (interval > g_loopStats.worstStall)
+        {
+            g_loopStats.worstStall = interval;
+            g_loopStats.worstStallTime = millis();
+            g_loopStats.pWorstActivity = g_pLongestActivity;
+            g_loopStats.worstCommand = g_longestActivityCommand;
+            g_loopStats.worstActivityDuration = g_longestActivityDuration;
+        }
+
+        // The activity name is in flash, which %s can't read, so it is copied to RAM as mipLoopDump() does.
+        if (g_pLongestActivity)
+        {
+            strncpy_P(g_stallActivityName, g_pLongestActivity, sizeof(g_stallActivityName) - 1);
+            g_stallActivityName[sizeof(g_stallActivityName) - 1] = '\0';
+        }
+        if (g_pLongestActivity && g_longestActivityCommand != MIP_ACTIVITY_NO_COMMAND)
+        {
+            MIP_DEBUG_WARN_PRINTF("MiP: %u ms loop stall, %u ms inside %s, cmd 0x%02X\r\n", interval / 1000,
+                                  g_longestActivityDuration / 1000, g_stallActivityName, g_longestActivityCommand);
+        }
+        else if (g_pLongestActivity)
+        {
+            MIP_DEBUG_WARN_PRINTF("MiP: %u ms loop stall, %u ms inside %s\r\n", interval / 1000,
+                                  g_longestActivityDuration / 1000, g_stallActivityName);
+        }
+        else
+        {
+            MIP_DEBUG_WARN_PRINTF("MiP: %u ms loop stall outside the library\r\n", interval / 1000);
+        }
+    }
+
+    g_pLongestActivity = NULL;
+    g_longestActivityCommand = MIP_ACTIVITY_NO_COMMAND;
+    g_longestActivityDuration = 0;
+}
+
+void mipLoopSetStallThreshold(uint32_t milliseconds)
+{
+    g_loopStallThreshold = milliseconds * 1000;
+}
+
+void mipLoopRead(MiPLoopStats& stats)
+{
+    stats = g_loopStats;
+    stats.count = g_loopIntervals.count;
+    stats.p50 = g_loopIntervals.percentile(50);
+    stats.p95 = g_loopIntervals.percentile(95);
+    stats.p99 = g_loopIntervals.percentile(99);
+    stats.max = g_loopIntervals.maxValue;
+}
+
+void mipLoopDump(Print& output)
+{
+    MiPLoopStats stats;
+
+    mipLoopRead(stats);
+    output.printf_P(PSTR("handle() intervals: %u (p50 %u us, p95 %u us, p99 %u us, max %u us)\r\n"),
+                    stats.count, stats.p50, stats.p95, stats.p99, stats.max);
+    output.printf_P(PSTR("stalls over %u ms: %u\r\n"), g_loopStallThreshold / 1000, stats.stalls);
+    if (stats.stalls == 0)
+    {
+        return;
+    }
+
+    output.printf_P(PSTR("worst stall: %u ms, %u ms ago, "), stats.worstStall / 1000,
+                    (uint32_t)(millis() - stats.worstStallTime));
+    if (stats.pWorstActivity == NULL)
+    {
+        output.print(F("outside the library\r\n"));
+        return;
+    }
+
+    char name[MIP_PROFILE_MAX_NAME + 1];
+    strncpy_P(name, stats.pWorstActivity, sizeof(name) - 1);
+    name[sizeof(name) - 1] = '\0';
+    output.printf_P(PSTR("inside %s"), name);
+    if (stats.worstCommand != MIP_ACTIVITY_NO_COMMAND)
+    {
+        output.printf_P(PSTR(", cmd 0x%02X"), stats.worstCommand);
+    }
+    output.printf_P(PSTR(" for %u ms\r\n"), stats.worstActivityDuration / 1000);
+}
+
+void mipLoopReset()
+{
+    g_loopIntervals.clear();
+    g_loopStats.clear();
+}
+
+
+
+MiPActivity::MiPActivity(PGM_P pName, int16_t command /* = MIP_ACTIVITY_NO_COMMAND */)
+{
+    m_pName = pName;
+    m_command = command;
+    m_nestedTime = 0;
+    m_pOuter = g_pActivity;
+    g_pActivity = this;
+    m_startTime = micros();
+}
+
+MiPActivity::~MiPActivity()
+{
+    uint32_t duration = micros() - m_startTime;
+    uint32_t ownTime = duration - m_nestedTime;
+
+    if (ownTime > g_longestActivityDuration)
+    {
+        g_pLongestActivity = m_pName;
+        g_longestActivityCommand = m_command;
+        g_longestActivityDuration = ownTime;
+    }
+
+    g_pActivity = m_pOuter;
+    if (m_pOuter)
+    {
+        m_pOuter->m_nestedTime += duration;
+    }
+}
@@ -0,0 +1,241 @@
+/* Copyright (C) 2018  Samuel Trassare (https://github.com/tiogaplanet)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* This header file describes the scope profiler. Placing MIP_PROFILE_SCOPE("name") at the top of a block times each
+   pass through that block with the CPU cycle counter and adds the time to a histogram kept for that name in a static
+   table. The histograms use power of 2 buckets so that a few bytes cover everything from a handful of cycles to
+   seconds, and the p50/p95/p99 percentiles are estimated from them. The library times its own transport, parsing,
+   LED and drive code this way and MiPDebug prints the table with its "prof" telnet command.
+
+   The same histograms back the loop monitor. MiP::handle() calls mipLoopTick() which records the time since the
+   previous call. Intervals longer than the stall threshold are counted as stalls and blamed on the MIP_ACTIVITY()
+   block which ran the longest during them, such as the wait in transportGetResponse for a given command. MiPDebug
+   prints the interval percentiles and the worst stall with its "loop" telnet command.
+*/
+#ifndef MIP_PROFILE_H
+#define MIP_PROFILE_H
+
+#include <Arduino.h>
+#include <stdint.h>
+
+
+// Number of named scopes which can be profiled. Set it to 0 to compile MIP_PROFILE_SCOPE() out altogether.
+#ifndef MIP_PROFILE_MAX_SCOPES
+  #define MIP_PROFILE_MAX_SCOPES 12
+#endif
+
+// Number of buckets in a MiPHistogram, enough for any 32-bit value.
+#define MIP_PROFILE_BUCKETS 32
+
+// Returned by mipProfileScope() when the table is full. Passes through such scopes aren't recorded.
+#define MIP_PROFILE_NO_SCOPE 0xFF
+
+// Default time, in milliseconds, between calls to mipLoopTick() which is counted as a stall.
+#ifndef MIP_LOOP_STALL_THRESHOLD
+  #define MIP_LOOP_STALL_THRESHOLD 50
+#endif
+
+// Passed to MIP_ACTIVITY() when there is no MiP command associated with the activity.
+#define MIP_ACTIVITY_NO_COMMAND -1
+
+
+// Histogram of 32-bit values with power of 2 buckets. Bucket n counts the values from 2^n to 2^(n+1)-1 so that a few
+// bytes cover everything from a handful of cycles or microseconds to seconds. Percentiles are estimated from it.
+class MiPHistogram
+{
+public:
+    MiPHistogram()
+    {
+        clear();
+    }
+
+    void clear()
+    {
+        count = 0;
+        maxValue = 0;
+        memset(buckets, 0, sizeof(buckets));
+    }
+
+    void     record(uint32_t value);
+    // Estimates a percentile from the histogram by interpolating within the bucket which holds it.
+    uint32_t percentile(uint8_t percent) const;
+
+    uint32_t count;
+    uint32_t maxValue;
+    uint16_t buckets[MIP_PROFILE_BUCKETS];
+};
+
+class MiPProfileSummary
+{
+public:
+    MiPProfileSummary()
+    {
+        clear();
+    }
+
+    void clear()
+    {
+        pName = NULL;
+        count = 0;
+        p50 = 0;
+        p95 = 0;
+        p99 = 0;
+        max = 0;
+    }
+
+    // Name of the scope, stored in flash.
+    PGM_P    pName;
+    // Number of passes through the scope since the last reset.
+    uint32_t count;
+    // Percentiles and maximum of the time spent in the scope, in microseconds.
+    uint32_t p50;
+    uint32_t p95;
+    uint32_t p99;
+    uint32_t max;
+};
+
+
+class MiPLoopStats
+{
+public:
+    MiPLoopStats()
+    {
+        clear();
+    }
+
+    void clear()
+    {
+        count = 0;
+        p50 = 0;
+        p95 = 0;
+        p99 = 0;
+        max = 0;
+        stalls = 0;
+        worstStall = 0;
+        worstStallTime = 0;
+        pWorstActivity = NULL;
+        worstCommand = MIP_ACTIVITY_NO_COMMAND;
+        worstActivityDuration = 0;
+    }
+
+    // Number of intervals between calls to mipLoopTick() since the last reset.
+    uint32_t count;
+    // Percentiles and maximum of those intervals, in microseconds.
+    uint32_t p50;
+    uint32_t p95;
+    uint32_t p99;
+    uint32_t max;
+    // Number of intervals longer than the stall threshold.
+    uint32_t stalls;
+    // Length of the longest stall, in microseconds, and the millis() time at which it ended.
+    uint32_t worstStall;
+    uint32_t worstStallTime;
+    // Name, stored in flash, and command of the activity which ran the longest during the worst stall, along with
+    // the time spent in it, in microseconds. pWorstActivity is NULL if no MIP_ACTIVITY() block ran during the stall.
+    PGM_P    pWorstActivity;
+    int16_t  worstCommand;
+    uint32_t worstActivityDuration;
+};
+
+
+// Finds the scope with this name, stored in flash, adding it to the table if it isn't there yet.
+uint8_t mipProfileScope(PGM_P pName);
+
+// Adds a pass through a scope to its histogram.
+void mipProfileRecord(uint8_t scope, uint32_t cycles);
+
+// Number of scopes in the table.
+uint8_t mipProfileScopeCount();
+
+// Summarizes one of the scopes in the table. Returns false if there is no such scope.
+bool mipProfileRead(uint8_t scope, MiPProfileSummary& summary);
+
+// Prints a table with the summary of every scope.
+void mipProfileDump(Print& output);
+
+// Clears the histograms of every scope. The scopes themselves stay in the table.
+void mipProfileReset();
+
+
+// Times the life of the object, normally the enclosing block, and records it against a scope.
+class MiPProfileTimer
+{
+public:
+    MiPProfileTimer(uint8_t scope)
+    {
+        m_scope = scope;
+        m_startCycles = ESP.getCycleCount();
+    }
+
+    ~MiPProfileTimer()
+    {
+        mipProfileRecord(m_scope, ESP.getCycleCount() - m_startCycles);
+    }
+
+protected:
+    uint8_t  m_scope;
+    uint32_t m_startCycles;
+};
+
+
+// Records the time since the previous call as a loop interval. Called from MiP::handle().
+void mipLoopTick();
+
+// Sets the interval, in milliseconds, above which mipLoopTick() counts a stall and logs a warning.
+void mipLoopSetStallThreshold(uint32_t milliseconds);
+
+// Summarizes the loop intervals and the worst stall.
+void mipLoopRead(MiPLoopStats& stats);
+
+// Prints the loop interval percentiles and the worst stall.
+void mipLoopDump(Print& output);
+
+// Clears the loop interval histogram and the stall statistics.
+void mipLoopReset();
+
+
+// Marks the life of the object as time spent in a named activity, optionally for a MiP command, so that a stall
+// can be blamed on it. Activities can nest. Each is only charged with the time not spent in the ones nested inside.
+class MiPActivity
+{
+public:
+    MiPActivity(PGM_P pName, int16_t command = MIP_ACTIVITY_NO_COMMAND);
+    ~MiPActivity();
+
+protected:
+    PGM_P        m_pName;
+    int16_t      m_command;
+    uint32_t     m_startTime;
+    uint32_t     m_nestedTime;
+    MiPActivity* m_pOuter;
+};
+
+#define MIP_PROFILE_CONCAT2(A, B) A##B
+#define MIP_PROFILE_CONCAT(A, B)  MIP_PROFILE_CONCAT2(A, B)
+
+// Profiles the rest of the enclosing block under the given name, which must be a string literal. The name is only
+// looked up on the first pass.
+#if MIP_PROFILE_MAX_SCOPES > 0
+  #define MIP_PROFILE_SCOPE(NAME) \
+    static const uint8_t MIP_PROFILE_CONCAT(s_profileScope, __LINE__) = mipProfileScope(PSTR(NAME)); \
+    MiPProfileTimer MIP_PROFILE_CONCAT(profileTimer, __LINE__)(MIP_PROFILE_CONCAT(s_profileScope, __LINE__))
+#else
+  #define MIP_PROFILE_SCOPE(NAME)
+#endif
+
+// Marks the rest of the enclosing block as an activity with the given name, which must be a string literal.
+#define MIP_ACTIVITY(NAME, COMMAND) \
+    MiPActivity MIP_PROFILE_CONCAT(activity, __LINE__)(PSTR(NAME), COMMAND)
+
+#endif // MIP_PROFILE_H
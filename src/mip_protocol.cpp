@@ -0,0 +1,62 @@
+/* Copyright (C) 2018  Samuel Trassare (https://github.com/tiogaplanet)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* This is the run time side of the MiP protocol table.
+*/
+#include "mip_protocol.h"
+#include "mip_esp8266.h"
+
+
+static_assert(mipMaxRequestLength() <= MIP_REQUEST_MAX_LEN, "MIP_REQUEST_MAX_LEN is too small for protocol table");
+static_assert(mipMaxResponseLength() <= MIP_RESPONSE_MAX_LEN, "MIP_RESPONSE_MAX_LEN is too small for protocol table");
+
+// Copy of the lookup table which is kept in flash rather than RAM.
+static const MiPCommandTable g_commandTable PROGMEM = mipBuildCommandTable();
+
+// Battery level to millivolt conversion for every possible raw battery level, built at compile time.
+struct MiPBatteryTable
+{
+    uint16_t millivolts[256];
+};
+
+static constexpr MiPBatteryTable buildBatteryTable()
+{
+    MiPBatteryTable table = {};
+
+    // Linear interpolation between 4000mV at 0x4D and 6400mV at 0x7C, rounded to the nearest millivolt. It is
+    // extrapolated in the same way outside of that range.
+    for (int level = 0 ; level < 256 ; level++)
+    {
+        int32_t scaled = (level - 0x4D) * (6400 - 4000);
+        int32_t rounding = scaled < 0 ? -(0x7C - 0x4D) / 2 : (0x7C - 0x4D) / 2;
+
+        table.millivolts[level] = 4000 + (scaled + rounding) / (0x7C - 0x4D);
+    }
+    return table;
+}
+
+static const MiPBatteryTable g_batteryTable PROGMEM = buildBatteryTable();
+
+
+
+bool mipLookupCommand(uint8_t command, MiPCommandInfo& info)
+{
+    memcpy_P(&info, &g_commandTable.entries[command], sizeof(info));
+    return info.requestLength != 0 || info.responseLength != 0;
+}
+
+uint16_t mipDecodeBatteryMillivolts(uint8_t batteryLevel)
+{
+    return pgm_read_word(&g_batteryTable.millivolts[batteryLevel]);
+}
@@ -0,0 +1,288 @@
+/* Copyright (C) 2018  Samuel Trassare (https://github.com/tiogaplanet)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* This header file describes the MiP protocol itself: the command codes and a table of the request and response
+   lengths for each of them. The lengths of requests built by the library, the sizes of the responses it expects and
+   the parsing of out of band notifications are all driven from this one table so adding a command only requires a
+   new entry in g_mipCommandDescriptors[].
+*/
+#ifndef MIP_PROTOCOL_H
+#define MIP_PROTOCOL_H
+
+#include <Arduino.h>
+#include <stdint.h>
+
+
+// MiP Protocol Commands.
+// These command codes are placed in the first byte of requests sent to the MiP and responses sent back from the MiP.
+// See https://github.com/WowWeeLabs/MiP-BLE-Protocol/blob/master/MiP-Protocol.md for more information.
+#define MIP_CMD_RECEIVE_IR_DONGLE_CODE  0x03
+#define MIP_CMD_GET_DETECTED_MIP        0x04
+#define MIP_CMD_PLAY_SOUND              0x06
+#define MIP_CMD_SET_POSITION            0x08
+#define MIP_CMD_GET_GESTURE_RESPONSE    0x0A
+#define MIP_CMD_SET_GESTURE_RADAR_MODE  0x0C
+#define MIP_CMD_GET_RADAR_RESPONSE      0x0C
+#define MIP_CMD_GET_GESTURE_RADAR_MODE  0x0D
+#define MIP_CMD_SET_DETECTION_MODE      0x0E
+#define MIP_CMD_SET_IR_REMOTE_CONTROL   0x10
+#define MIP_CMD_GET_IR_REMOTE_CONTROL   0x11
+#define MIP_CMD_SET_USER_DATA           0x12
+#define MIP_CMD_GET_USER_DATA           0x13
+#define MIP_CMD_GET_SOFTWARE_VERSION    0x14
+#define MIP_CMD_SET_VOLUME              0x15
+#define MIP_CMD_GET_VOLUME              0x16
+#define MIP_CMD_GET_HARDWARE_INFO       0x19
+#define MIP_CMD_SHAKE_RESPONSE          0x1A
+#define MIP_CMD_CLAP_RESPONSE           0x1D
+#define MIP_CMD_ENABLE_CLAP             0x1E
+#define MIP_CMD_GET_CLAP_SETTINGS       0x1F
+#define MIP_CMD_SET_CLAP_DELAY          0x20
+#define MIP_CMD_GET_UP                  0x23
+#define MIP_CMD_DISTANCE_DRIVE          0x70
+#define MIP_CMD_DRIVE_FORWARD           0x71
+#define MIP_CMD_DRIVE_BACKWARD          0x72
+#define MIP_CMD_TURN_LEFT               0x73
+#define MIP_CMD_TURN_RIGHT              0x74
+#define MIP_CMD_SET_GAME_MODE           0x76
+#define MIP_CMD_STOP                    0x77
+#define MIP_CMD_CONTINUOUS_DRIVE        0x78
+#define MIP_CMD_GET_STATUS              0x79
+#define MIP_CMD_GET_WEIGHT              0x81
+#define MIP_CMD_GET_GAME_MODE           0x82
+#define MIP_CMD_GET_CHEST_LED           0x83
+#define MIP_CMD_SET_CHEST_LED           0x84
+#define MIP_CMD_READ_ODOMETER           0x85
+#define MIP_CMD_RESET_ODOMETER          0x86
+#define MIP_CMD_FLASH_CHEST_LED         0x89
+#define MIP_CMD_SET_HEAD_LEDS           0x8A
+#define MIP_CMD_GET_HEAD_LEDS           0x8B
+#define MIP_CMD_SEND_IR_DONGLE_CODE     0x8C
+#define MIP_CMD_SLEEP                   0xFA
+#define MIP_CMD_DISCONNECT_APP          0xFE
+
+
+// Bits used in MiPCommandInfo::flags.
+#define MIP_CMD_FLAG_OOB                (1 << 0)    // MiP can send this response without being asked for it.
+#define MIP_CMD_FLAG_VARIABLE_LENGTH    (1 << 1)    // Byte after the command byte holds the number of bytes to follow.
+
+
+// Describes the framing of a single MiP command. All lengths are in bytes and include the command byte itself.
+struct MiPCommandInfo
+{
+    uint8_t command;
+    uint8_t requestLength;      // Length of the request sent to the MiP. 0 if the library never sends it.
+    uint8_t responseLength;     // Length of the response from the MiP (the maximum if variable length). 0 if none.
+    uint8_t minResponseLength;  // Shortest valid response for MIP_CMD_FLAG_VARIABLE_LENGTH commands.
+    uint8_t flags;
+};
+
+// The protocol table. Commands which share a command byte, like MIP_CMD_SET_GESTURE_RADAR_MODE and
+// MIP_CMD_GET_RADAR_RESPONSE, can each have their own entry and will be merged into a single lookup table entry.
+inline constexpr MiPCommandInfo g_mipCommandDescriptors[] =
+{
+    // command                          request response minimum    flags
+    { MIP_CMD_RECEIVE_IR_DONGLE_CODE,   0,      1+4,     1+2,       MIP_CMD_FLAG_OOB | MIP_CMD_FLAG_VARIABLE_LENGTH },
+    { MIP_CMD_GET_DETECTED_MIP,         0,      1+1,     0,         MIP_CMD_FLAG_OOB },
+    { MIP_CMD_PLAY_SOUND,               1+17,   0,       0,         0 },
+    { MIP_CMD_SET_POSITION,             1+1,    0,       0,         0 },
+    { MIP_CMD_GET_GESTURE_RESPONSE,     0,      1+1,     0,         MIP_CMD_FLAG_OOB },
+    { MIP_CMD_SET_GESTURE_RADAR_MODE,   1+1,    0,       0,         0 },
+    { MIP_CMD_GET_RADAR_RESPONSE,       0,      1+1,     0,         MIP_CMD_FLAG_OOB },
+    { MIP_CMD_GET_GESTURE_RADAR_MODE,   1,      1+1,     0,         0 },
+    { MIP_CMD_SET_DETECTION_MODE,       1+2,    0,       0,         0 },
+    { MIP_CMD_SET_IR_REMOTE_CONTROL,    1+1,    0,       0,         0 },
+    { MIP_CMD_GET_IR_REMOTE_CONTROL,    1,      1+1,     0,         0 },
+    { MIP_CMD_SET_USER_DATA,            1+2,    0,       0,         0 },
+    { MIP_CMD_GET_USER_DATA,            1+1,    1+2,     0,         0 },
+    { MIP_CMD_GET_SOFTWARE_VERSION,     1,      1+4,     0,         0 },
+    { MIP_CMD_SET_VOLUME,               1+1,    0,       0,         0 },
+    { MIP_CMD_GET_VOLUME,               1,      1+1,     0,         0 },
+    { MIP_CMD_GET_HARDWARE_INFO,        1,      1+2,     0,         0 },
+    { MIP_CMD_SHAKE_RESPONSE,           0,      1,       0,         MIP_CMD_FLAG_OOB },
+    { MIP_CMD_CLAP_RESPONSE,            0,      1+1,     0,         MIP_CMD_FLAG_OOB },
+    { MIP_CMD_ENABLE_CLAP,              1+1,    0,       0,         0 },
+    { MIP_CMD_GET_CLAP_SETTINGS,        1,      1+3,     0,         0 },
+    { MIP_CMD_SET_CLAP_DELAY,           1+2,    0,       0,         0 },
+    { MIP_CMD_GET_UP,                   1+1,    0,       0,         0 },
+    { MIP_CMD_DISTANCE_DRIVE,           1+5,    0,       0,         0 },
+    { MIP_CMD_DRIVE_FORWARD,            1+2,    0,       0,         0 },
+    { MIP_CMD_DRIVE_BACKWARD,           1+2,    0,       0,         0 },
+    { MIP_CMD_TURN_LEFT,                1+2,    0,       0,         0 },
+    { MIP_CMD_TURN_RIGHT,               1+2,    0,       0,         0 },
+    { MIP_CMD_SET_GAME_MODE,            1+1,    0,       0,         0 },
+    { MIP_CMD_STOP,                     1,      0,       0,         0 },
+    { MIP_CMD_CONTINUOUS_DRIVE,         1+2,    0,       0,         0 },
+    { MIP_CMD_GET_STATUS,               1,      1+2,     0,         MIP_CMD_FLAG_OOB },
+    { MIP_CMD_GET_WEIGHT,               1,      1+1,     0,         MIP_CMD_FLAG_OOB },
+    { MIP_CMD_GET_GAME_MODE,            1,      1+1,     0,         0 },
+    { MIP_CMD_GET_CHEST_LED,            1,      1+5,     0,         0 },
+    { MIP_CMD_SET_CHEST_LED,            1+3,    0,       0,         0 },
+    { MIP_CMD_READ_ODOMETER,            1,      1+4,     0,         0 },
+    { MIP_CMD_RESET_ODOMETER,           1,      0,       0,         0 },
+    { MIP_CMD_FLASH_CHEST_LED,          1+5,    0,       0,         0 },
+    { MIP_CMD_SET_HEAD_LEDS,            1+4,    0,       0,         0 },
+    { MIP_CMD_GET_HEAD_LEDS,            1,      1+4,     0,         0 },
+    { MIP_CMD_SEND_IR_DONGLE_CODE,      1+6,    0,       0,         0 },
+    { MIP_CMD_SLEEP,                    1,      0,       0,         0 },
+    { MIP_CMD_DISCONNECT_APP,           1,      0,       0,         0 }
+};
+
+// Lookup table indexed directly by command byte, built from g_mipCommandDescriptors[] at compile time. Unused
+// command bytes are left zeroed.
+struct MiPCommandTable
+{
+    MiPCommandInfo entries[256];
+};
+
+static constexpr MiPCommandTable mipBuildCommandTable()
+{
+    MiPCommandTable table = {};
+
+    for (const MiPCommandInfo& descriptor : g_mipCommandDescriptors)
+    {
+        MiPCommandInfo& entry = table.entries[descriptor.command];
+
+        entry.command = descriptor.command;
+        if (descriptor.requestLength)
+        {
+            entry.requestLength = descriptor.requestLength;
+        }
+        if (descriptor.responseLength)
+        {
+            entry.responseLength = descriptor.responseLength;
+            entry.minResponseLength = descriptor.minResponseLength ? descriptor.minResponseLength
+                                                                   : descriptor.responseLength;
+        }
+        entry.flags |= descriptor.flags;
+    }
+    return table;
+}
+
+static constexpr uint8_t mipMaxRequestLength()
+{
+    uint8_t length = 0;
+
+    for (const MiPCommandInfo& descriptor : g_mipCommandDescriptors)
+    {
+        length = descriptor.requestLength > length ? descriptor.requestLength : length;
+    }
+    return length;
+}
+
+static constexpr uint8_t mipMaxResponseLength()
+{
+    uint8_t length = 0;
+
+    for (const MiPCommandInfo& descriptor : g_mipCommandDescriptors)
+    {
+        length = descriptor.responseLength > length ? descriptor.responseLength : length;
+    }
+    return length;
+}
+
+// The tables are inline so that translation units which need them at run time all share one copy.
+inline constexpr MiPCommandTable g_mipCommandTable = mipBuildCommandTable();
+
+// Compile time access to the table, for sizing request buffers and checking response lengths. The command must be a
+// constant expression.
+template<uint8_t COMMAND>
+struct MiPCommand
+{
+    static_assert(g_mipCommandTable.entries[COMMAND].command == COMMAND, "Command missing from g_mipCommandDescriptors");
+
+    static constexpr uint8_t requestLength = g_mipCommandTable.entries[COMMAND].requestLength;
+    static constexpr uint8_t responseLength = g_mipCommandTable.entries[COMMAND].responseLength;
+};
+
+#define MIP_REQUEST_LEN(COMMAND)    (MiPCommand<COMMAND>::requestLength)
+#define MIP_RESPONSE_LEN(COMMAND)   (MiPCommand<COMMAND>::responseLength)
+
+// Run time lookup of the entry for any command byte. Returns false if the command byte isn't part of the protocol.
+bool mipLookupCommand(uint8_t command, MiPCommandInfo& info);
+
+// Requests are sent to MiP as binary bytes but MiP sends its responses back as hex text, two characters per byte.
+// Each character occupies the UART for 10 bit times: start bit, 8 data bits and stop bit.
+#define MIP_UART_BITS_PER_BYTE 10
+
+static constexpr uint32_t mipRequestWireBytes(const MiPCommandInfo& info)
+{
+    return info.requestLength;
+}
+
+static constexpr uint32_t mipResponseWireBytes(const MiPCommandInfo& info)
+{
+    return info.responseLength * 2;
+}
+
+// Microseconds for a single character on the UART at the specified baud rate, rounded to the nearest microsecond.
+static constexpr uint32_t mipByteWireTime(uint32_t baudRate)
+{
+    return (MIP_UART_BITS_PER_BYTE * 1000000 + baudRate / 2) / baudRate;
+}
+
+
+// Encoders for the individual fields of MiP requests. They are shared by the MiP methods and the compile time frame
+// builders in mip_frames.h so that both always produce the same bytes. None of them range check their inputs.
+static constexpr uint8_t mipEncodeVelocity(int8_t velocity)
+{
+    return velocity < 0 ? 0x20 + -velocity : velocity;
+}
+
+static constexpr uint8_t mipEncodeTurnRate(int8_t turnRate)
+{
+    return turnRate == 0 ? 0x00 : turnRate < 0 ? 0x60 + -turnRate : 0x40 + turnRate;
+}
+
+// Turn angles are sent in units of 5 degrees.
+static constexpr uint8_t mipEncodeTurnAngle(uint16_t degrees)
+{
+    return degrees / 5;
+}
+
+// Drive forward/backward times are sent in units of 7 milliseconds.
+static constexpr uint8_t mipEncodeDriveTime(uint16_t milliseconds)
+{
+    return milliseconds / 7;
+}
+
+// Delays between sounds are sent in units of 30 milliseconds.
+static constexpr uint8_t mipEncodeSoundDelay(uint16_t milliseconds)
+{
+    return milliseconds / 30;
+}
+
+// Chest LED flash on/off times are sent in units of 20 milliseconds, rounded to the nearest unit.
+static constexpr uint16_t mipEncodeFlashTime(uint16_t milliseconds)
+{
+    return (milliseconds + 10) / 20;
+}
+
+
+// Decoders for the fields of MiP responses which need unit conversion. They stick to integer math since the ESP8266
+// has no FPU.
+
+// The odometer counts 48.5 ticks per centimetre.
+#define MIP_ODOMETER_TICKS_PER_10CM 485
+
+// Converts the raw battery level from MIP_CMD_GET_STATUS into millivolts. 0x4D is 4.0V and 0x7C is 6.4V.
+uint16_t mipDecodeBatteryMillivolts(uint8_t batteryLevel);
+
+static constexpr uint32_t mipDecodeOdometerMillimetres(uint32_t ticks)
+{
+    // Split the scaling by 100/485 (20/97) so that the intermediate results can't overflow 32 bits.
+    return (ticks / 97) * 20 + (ticks % 97) * 20 / 97;
+}
+
+#endif // MIP_PROTOCOL_H
@@ -12,7 +12,9 @@
    See the License for the specific language governing permissions and
    limitations under the License.
 */
-/* Circular queue used internally by MiP library. Overwrites oldest items once it is full.
+/* Circular queue used internally by MiP library. Overwrites oldest items once it is full. The most items ever queued at
+   once and the number of items overwritten are kept so that a queue which isn't being drained fast enough can be
+   spotted.
 
    NOT THREAD SAFE!
    ****************
@@ -36,6 +38,13 @@ public:
         m_count = 0;
         m_readIndex = 0;
         m_writeIndex = 0;
+        clearStats();
+    }
+
+    void clearStats()
+    {
+        m_highWater = m_count;
+        m_overflows = 0;
     }
     
     bool isEmpty()
@@ -48,6 +57,23 @@ public:
         return m_count;
     }
 
+    uint8_t capacity()
+    {
+        return Size;
+    }
+
+    // Most items which have been in the queue at once since the stats were last cleared.
+    uint8_t highWater()
+    {
+        return m_highWater;
+    }
+
+    // Number of items which were overwritten before being popped since the stats were last cleared.
+    uint32_t overflows()
+    {
+        return m_overflows;
+    }
+
     void push(const ElementType& element)
     {
         m_elements[m_writeIndex] = element;
@@ -55,11 +81,16 @@ public:
         if (m_count < Size)
         {
             m_count++;
+            if (m_count > m_highWater)
+            {
+                m_highWater = m_count;
+            }
         }
         else
         {
             // Queue was full so oldest response was overwritten. Increment read index to discard oldest.
             advanceReadIndex();
+            m_overflows++;
         }
     }
 
@@ -108,6 +139,8 @@ protected:
     uint8_t     m_count;
     uint8_t     m_readIndex;
     uint8_t     m_writeIndex;
+    uint8_t     m_highWater;
+    uint32_t    m_overflows;
 };
 
 #endif // QUEUE_H_